@@ -0,0 +1,613 @@
+/*------------------------------------------------------------------------------
+ *    Copyright 2016 Chris Rink
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *----------------------------------------------------------------------------*/
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libds/alloc.h"
+#include "ast_bench.h"
+#include "../src/bytecode.h"
+#include "../src/mscript.h"
+#include "../src/parallel.h"
+#include "../src/parser.h"
+#include "../src/verifier.h"
+
+/*
+ * BENCHMARK DEFINITIONS
+ */
+
+static void ast_BenchParse(void);
+static void ast_BenchParseExpressions(void);
+static void ast_BenchParseCompound(void);
+static void ast_BenchParseNested(void);
+static void ast_BenchVerify(void);
+static void ast_BenchGenerate(void);
+static void ast_BenchScript(void);
+static void ast_BenchCompileLine(void);
+static void ast_BenchCompileParallel(void);
+
+const ms_Bench ast_benches[] = {
+    { "/Parse", ast_BenchParse },
+    { "/ParseExpressions", ast_BenchParseExpressions },
+    { "/ParseCompound", ast_BenchParseCompound },
+    { "/ParseNested", ast_BenchParseNested },
+    { "/Verify", ast_BenchVerify },
+    { "/Generate", ast_BenchGenerate },
+    { "/Script", ast_BenchScript },
+    { "/CompileLine", ast_BenchCompileLine },
+    { "/CompileParallel", ast_BenchCompileParallel },
+    { NULL, NULL },
+};
+
+static const size_t NUM_UNITS = 2000;
+static const size_t STATEMENTS_PER_UNIT = 4;
+static const size_t NUM_PARSES = 50;
+static const size_t EXPRESSION_UNITS = 10000;
+static const size_t EXPRESSIONS_PER_UNIT = 3;
+static const size_t OPERATORS_PER_UNIT = 41;
+static const size_t COMPOUND_STATEMENTS_PER_UNIT = 4;
+static const size_t NESTING_DEPTH = 24;
+static const size_t VERIFY_UNITS[] = { 1000, 10000, 100000 };
+static const size_t VERIFY_STATEMENTS_PER_UNIT = 7;
+static const size_t SCRIPT_RUNS = 20000;
+static const size_t SCRIPT_RUNS_PER_STATE = 1000;
+static const char *const SCRIPT_PARAMS = "var n := 7;\n"
+                                         "var s := \"label\";\n";
+static const size_t COMPILE_LINE_RUNS = 200000;
+static const char *const COMPILE_LINE = "var total := 3, rate := 0.25; total += total * rate - 1;";
+static const size_t PARALLEL_UNITS = 10000;
+static const size_t PARALLEL_THREADS[] = { 2, 4, 8 };
+static const char *const SCRIPT_BODY = "var a := n * 3 + 1;\n"
+                                       "var b := a - n * 2;\n"
+                                       "var c := s + \"!\";\n"
+                                       "var d := -a;\n"
+                                       "var e := b * b + d;\n";
+
+typedef struct {
+    size_t nallocs;                 /* allocations made (not counting resizes) */
+} AllocCounter;
+
+static const ms_AST *ParseModule(ms_Parser *prs, const char *src);
+static double TimeParses(const char *src, size_t nparses);
+static double TimeGenerate(const char *src, bool lazy);
+static double TimeExecute(const char *src, const ms_Script *script);
+static double TimeCompile(const char *src, size_t nthreads);
+static void CountParse(const char *src, size_t *nallocs, size_t *bytes);
+static char *GenerateSource(size_t nunits);
+static char *GenerateExpressionSource(size_t nunits);
+static char *GenerateCompoundSource(size_t nunits);
+static char *GenerateNestedSource(size_t nunits);
+static char *GenerateVerifiableSource(size_t nunits);
+static void *CountingAlloc(void *ctx, void *ptr, size_t size);
+
+/*
+ * BENCHMARK FUNCTIONS
+ */
+
+/* Parse a module made of the small statements, blocks, argument lists and
+ * collection literals typical of scripts, most of which hold one to four
+ * elements. */
+static void ast_BenchParse(void) {
+    char *src = GenerateSource(NUM_UNITS);
+    assert(src);
+    double elapsed = TimeParses(src, NUM_PARSES);
+
+    size_t nallocs, bytes;
+    CountParse(src, &nallocs, &bytes);
+
+    size_t nstmts = NUM_UNITS * STATEMENTS_PER_UNIT;
+    BenchReport("parse time", (elapsed / (NUM_PARSES * nstmts)) * 1e9, "ns/statement");
+    BenchReport("allocations", (double)nallocs / nstmts, "allocs/statement");
+    BenchReport("bytes held after parsing", (double)bytes / nstmts, "bytes/statement");
+    free(src);
+}
+
+/* Parse a large module of long expressions using every binary operator
+ * precedence level, mixed with unary operators and parentheses. */
+static void ast_BenchParseExpressions(void) {
+    char *src = GenerateExpressionSource(EXPRESSION_UNITS);
+    assert(src);
+    double elapsed = TimeParses(src, NUM_PARSES / 10);
+
+    double nparses = (double)(NUM_PARSES / 10);
+    size_t nstmts = EXPRESSION_UNITS * EXPRESSIONS_PER_UNIT;
+    size_t nops = EXPRESSION_UNITS * OPERATORS_PER_UNIT;
+    BenchReport("parse time", (elapsed / (nparses * nstmts)) * 1e9, "ns/statement");
+    BenchReport("parse time", (elapsed / (nparses * nops)) * 1e9, "ns/operator");
+    free(src);
+}
+
+/* Parse compound assignments to plain, qualified and subscripted names,
+ * each of which also reads its target. */
+static void ast_BenchParseCompound(void) {
+    char *src = GenerateCompoundSource(NUM_UNITS);
+    assert(src);
+    double elapsed = TimeParses(src, NUM_PARSES);
+
+    size_t nallocs, bytes;
+    CountParse(src, &nallocs, &bytes);
+
+    size_t nstmts = NUM_UNITS * COMPOUND_STATEMENTS_PER_UNIT;
+    BenchReport("parse time", (elapsed / (NUM_PARSES * nstmts)) * 1e9, "ns/statement");
+    BenchReport("allocations", (double)nallocs / nstmts, "allocs/statement");
+    BenchReport("bytes held after parsing", (double)bytes / nstmts, "bytes/statement");
+    free(src);
+}
+
+/* Parse statements holding parenthesized expressions and calls nested
+ * NESTING_DEPTH levels deep. */
+static void ast_BenchParseNested(void) {
+    char *src = GenerateNestedSource(NUM_UNITS);
+    assert(src);
+    double elapsed = TimeParses(src, NUM_PARSES);
+
+    size_t nallocs, bytes;
+    CountParse(src, &nallocs, &bytes);
+
+    BenchReport("parse time", (elapsed / (NUM_PARSES * NUM_UNITS)) * 1e9, "ns/statement");
+    BenchReport("allocations", (double)nallocs / NUM_UNITS, "allocs/statement");
+    BenchReport("bytes held after parsing", (double)bytes / NUM_UNITS, "bytes/statement");
+    free(src);
+}
+
+/* Verify modules of increasing size, each made of functions with nested
+ * blocks referring to names declared throughout the enclosing scopes. */
+static void ast_BenchVerify(void) {
+    for (size_t i = 0; i < sizeof(VERIFY_UNITS) / sizeof(VERIFY_UNITS[0]); i++) {
+        size_t nunits = VERIFY_UNITS[i];
+        char *src = GenerateVerifiableSource(nunits);
+        ms_Parser *prs = ms_ParserNew();
+        assert(src && prs);
+
+        const ms_AST *ast = ParseModule(prs, src);
+        ms_Error *err = NULL;
+
+        AllocCounter counter = { 0 };
+        DSAllocator alloc;
+        dsallocator_init(&alloc, CountingAlloc, &counter, 0);
+        DSAllocator *prev = dsallocator_swap(&alloc);
+
+        double start = BenchTimeNow();
+        ms_Result res = ms_ParserVerifyAST(ast, &err);
+        double elapsed = BenchTimeNow() - start;
+        dsallocator_swap(prev);
+
+        if (res == MS_RESULT_ERROR) {
+            fprintf(stderr, "failed to verify module: %s\n", (err) ? err->msg : "");
+            ms_ErrorDestroy(err);
+            exit(EXIT_FAILURE);
+        }
+
+        char metric[64];
+        size_t nstmts = nunits * VERIFY_STATEMENTS_PER_UNIT;
+        snprintf(metric, sizeof(metric), "verify time (%zu statements)", nstmts);
+        BenchReport(metric, (elapsed / nstmts) * 1e9, "ns/statement");
+        snprintf(metric, sizeof(metric), "allocations (%zu statements)", nstmts);
+        BenchReport(metric, (double)counter.nallocs / nstmts, "allocs/statement");
+        snprintf(metric, sizeof(metric), "peak bytes (%zu statements)", nstmts);
+        BenchReport(metric, (double)alloc.peak / nstmts, "bytes/statement");
+
+        ms_ParserDestroy(prs);
+        free(src);
+    }
+}
+
+/* Generate bytecode for the same modules as ast_BenchVerify, both compiling
+ * every function body and leaving function bodies to their first call. */
+static void ast_BenchGenerate(void) {
+    for (size_t i = 0; i < sizeof(VERIFY_UNITS) / sizeof(VERIFY_UNITS[0]); i++) {
+        size_t nunits = VERIFY_UNITS[i];
+        char *src = GenerateVerifiableSource(nunits);
+        assert(src);
+
+        size_t nstmts = nunits * VERIFY_STATEMENTS_PER_UNIT;
+        double eager = TimeGenerate(src, false);
+        double lazy = TimeGenerate(src, true);
+
+        char metric[64];
+        snprintf(metric, sizeof(metric), "generate time (%zu statements)", nstmts);
+        BenchReport(metric, (eager / nstmts) * 1e9, "ns/statement");
+        snprintf(metric, sizeof(metric), "lazy generate time (%zu statements)", nstmts);
+        BenchReport(metric, (lazy / nstmts) * 1e9, "ns/statement");
+        free(src);
+    }
+}
+
+/* Execute a small script repeatedly, both from source (so it is compiled
+ * on every run) and precompiled with its parameters bound on each call. */
+static void ast_BenchScript(void) {
+    size_t plen = strlen(SCRIPT_PARAMS);
+    size_t blen = strlen(SCRIPT_BODY);
+    char *src = malloc(plen + blen + 1);
+    assert(src);
+    memcpy(src, SCRIPT_PARAMS, plen);
+    memcpy(&src[plen], SCRIPT_BODY, blen + 1);
+
+    const char *const names[] = { "n", "s" };
+    ms_Error *err = NULL;
+    ms_Script *script = ms_ScriptCompileString(SCRIPT_BODY, names, 2, &err);
+    if (!script) {
+        fprintf(stderr, "failed to compile script: %s\n", (err) ? err->msg : "");
+        ms_ErrorDestroy(err);
+        exit(EXIT_FAILURE);
+    }
+
+    double source = TimeExecute(src, NULL);
+    double compiled = TimeExecute(NULL, script);
+    BenchReport("execute from source", (source / SCRIPT_RUNS) * 1e9, "ns/run");
+    BenchReport("execute compiled script", (compiled / SCRIPT_RUNS) * 1e9, "ns/run");
+
+    ms_ScriptDestroy(script);
+    free(src);
+}
+
+/* Compile a short REPL style line, both in a single pass and through the
+ * full parse, verify and generate pipeline. */
+static void ast_BenchCompileLine(void) {
+    ms_Parser *prs = ms_ParserNew();
+    assert(prs);
+
+    double single = 0;
+    double full = 0;
+    for (size_t i = 0; i < COMPILE_LINE_RUNS; i++) {
+        ms_VMByteCode *code;
+        double start = BenchTimeNow();
+        ms_ParserInitString(prs, COMPILE_LINE);
+        if (!ms_ParserCompile(prs, &code)) {
+            fprintf(stderr, "failed to compile line in a single pass\n");
+            exit(EXIT_FAILURE);
+        }
+        single += BenchTimeNow() - start;
+        ms_VMByteCodeDestroy(code);
+
+        ms_Error *err = NULL;
+        start = BenchTimeNow();
+        const ms_AST *ast = ParseModule(prs, COMPILE_LINE);
+        if ((ms_ParserVerifyAST(ast, &err) == MS_RESULT_ERROR) ||
+            (ms_VMByteCodeGenerateLazy(ms_ParserArena(prs), &code, &err) == MS_RESULT_ERROR)) {
+            fprintf(stderr, "failed to compile line: %s\n", (err) ? err->msg : "");
+            ms_ErrorDestroy(err);
+            exit(EXIT_FAILURE);
+        }
+        full += BenchTimeNow() - start;
+        ms_VMByteCodeDestroy(code);
+    }
+
+    BenchReport("single pass compile", (single / COMPILE_LINE_RUNS) * 1e9, "ns/line");
+    BenchReport("parse, verify and generate", (full / COMPILE_LINE_RUNS) * 1e9, "ns/line");
+    ms_ParserDestroy(prs);
+}
+
+/* Compile an ast_BenchVerify module (small enough that every constant
+ * index fits in an opcode) on one thread and split between several
+ * threads. */
+static void ast_BenchCompileParallel(void) {
+    char *src = GenerateVerifiableSource(PARALLEL_UNITS);
+    assert(src);
+
+    size_t nstmts = PARALLEL_UNITS * VERIFY_STATEMENTS_PER_UNIT;
+    BenchReport("compile time (1 thread)", (TimeCompile(src, 1) / nstmts) * 1e9, "ns/statement");
+    for (size_t i = 0; i < sizeof(PARALLEL_THREADS) / sizeof(PARALLEL_THREADS[0]); i++) {
+        char metric[64];
+        snprintf(metric, sizeof(metric), "compile time (%zu threads)", PARALLEL_THREADS[i]);
+        BenchReport(metric, (TimeCompile(src, PARALLEL_THREADS[i]) / nstmts) * 1e9, "ns/statement");
+    }
+    free(src);
+}
+
+/*
+ * UTILITY FUNCTIONS
+ */
+
+/* Parse `src` with `prs`, exiting if the module is invalid. */
+static const ms_AST *ParseModule(ms_Parser *prs, const char *src) {
+    const ms_AST *ast;
+    ms_Error *err = NULL;
+    ms_ParserInitString(prs, src);
+    if (ms_ParserParse(prs, &ast, &err) == MS_RESULT_ERROR) {
+        fprintf(stderr, "failed to parse module: %s\n", (err) ? err->msg : "");
+        ms_ErrorDestroy(err);
+        exit(EXIT_FAILURE);
+    }
+    return ast;
+}
+
+/* Parse `src` `nparses` times, returning the elapsed time in seconds. */
+static double TimeParses(const char *src, size_t nparses) {
+    ms_Parser *prs = ms_ParserNew();
+    assert(prs);
+
+    double start = BenchTimeNow();
+    for (size_t i = 0; i < nparses; i++) {
+        const ms_AST *ast;
+        ms_Error *err = NULL;
+        ms_ParserInitString(prs, src);
+        if (ms_ParserParse(prs, &ast, &err) == MS_RESULT_ERROR) {
+            fprintf(stderr, "failed to parse module: %s\n", (err) ? err->msg : "");
+            ms_ErrorDestroy(err);
+            exit(EXIT_FAILURE);
+        }
+    }
+    double elapsed = BenchTimeNow() - start;
+
+    ms_ParserDestroy(prs);
+    return elapsed;
+}
+
+/* Generate bytecode for `src` once, returning the elapsed time in seconds. */
+static double TimeGenerate(const char *src, bool lazy) {
+    ms_Parser *prs = ms_ParserNew();
+    assert(prs);
+
+    const ms_AST *ast = ParseModule(prs, src);
+    ms_Error *err = NULL;
+    ms_VMByteCode *code = NULL;
+
+    double start = BenchTimeNow();
+    ms_Result res = (lazy) ?
+                    ms_VMByteCodeGenerateLazy(ms_ParserArena(prs), &code, &err) :
+                    ms_VMByteCodeGenerateFromAST(ast, &code, &err);
+    double elapsed = BenchTimeNow() - start;
+
+    if (res == MS_RESULT_ERROR) {
+        fprintf(stderr, "failed to generate bytecode: %s\n", (err) ? err->msg : "");
+        ms_ErrorDestroy(err);
+        exit(EXIT_FAILURE);
+    }
+
+    ms_VMByteCodeDestroy(code);
+    ms_ParserDestroy(prs);
+    return elapsed;
+}
+
+/* Compile `src` once on `nthreads` threads (parsing, verifying and
+ * generating on the calling thread if it is 1), returning the elapsed time
+ * in seconds. */
+static double TimeCompile(const char *src, size_t nthreads) {
+    ms_VMByteCode *code = NULL;
+
+    if (nthreads != 1) {
+        double start = BenchTimeNow();
+        bool ok = ms_ParserCompileParallel(src, strlen(src), NULL, nthreads, NULL, &code);
+        double elapsed = BenchTimeNow() - start;
+
+        if (!ok) {
+            fprintf(stderr, "failed to compile module on %zu threads\n", nthreads);
+            exit(EXIT_FAILURE);
+        }
+        ms_VMByteCodeDestroy(code);
+        return elapsed;
+    }
+
+    ms_Parser *prs = ms_ParserNew();
+    assert(prs);
+
+    const ms_AST *ast;
+    ms_Error *err = NULL;
+    double start = BenchTimeNow();
+    ms_ParserInitString(prs, src);
+    ms_Result res = ms_ParserParse(prs, &ast, &err);
+    res = (res == MS_RESULT_ERROR) ? res : ms_ParserVerifyAST(ast, &err);
+    res = (res == MS_RESULT_ERROR) ? res : ms_VMByteCodeGenerateFromAST(ast, &code, &err);
+    double elapsed = BenchTimeNow() - start;
+
+    if (res == MS_RESULT_ERROR) {
+        fprintf(stderr, "failed to compile module: %s\n", (err) ? err->msg : "");
+        ms_ErrorDestroy(err);
+        exit(EXIT_FAILURE);
+    }
+
+    ms_VMByteCodeDestroy(code);
+    ms_ParserDestroy(prs);
+    return elapsed;
+}
+
+/* Execute `src` (or `script`, if it is given) SCRIPT_RUNS times, returning
+ * the elapsed time in seconds spent executing. Fresh states are used every
+ * SCRIPT_RUNS_PER_STATE runs, since states keep the frames of every string
+ * they have executed. */
+static double TimeExecute(const char *src, const ms_Script *script) {
+    ms_Param params[] = {
+        { .type = MS_PARAM_INT, .val.i = 7 },
+        { .type = MS_PARAM_STR, .val.s = "label", .len = 5 },
+    };
+
+    double elapsed = 0;
+    for (size_t i = 0; i < SCRIPT_RUNS; i += SCRIPT_RUNS_PER_STATE) {
+        ms_State *state = ms_StateNew();
+        assert(state);
+
+        double start = BenchTimeNow();
+        for (size_t j = 0; j < SCRIPT_RUNS_PER_STATE; j++) {
+            const ms_Error *err;
+            ms_Result res = (script) ?
+                            ms_StateExecuteScript(state, script, params, 2, &err) :
+                            ms_StateExecuteString(state, src, &err);
+            if (res == MS_RESULT_ERROR) {
+                fprintf(stderr, "failed to execute script: %s\n", (err) ? err->msg : "");
+                exit(EXIT_FAILURE);
+            }
+        }
+        elapsed += BenchTimeNow() - start;
+
+        ms_StateDestroy(state);
+    }
+    return elapsed;
+}
+
+/* Count the allocations made and bytes held by parsing `src` once. */
+static void CountParse(const char *src, size_t *nallocs, size_t *bytes) {
+    AllocCounter counter = { 0 };
+    DSAllocator alloc;
+    dsallocator_init(&alloc, CountingAlloc, &counter, 0);
+    DSAllocator *prev = dsallocator_swap(&alloc);
+
+    const ms_AST *ast;
+    ms_Error *err = NULL;
+    ms_Parser *prs = ms_ParserNew();
+    assert(prs);
+    ms_ParserInitString(prs, src);
+    ms_Result res = ms_ParserParse(prs, &ast, &err);
+    assert(res != MS_RESULT_ERROR);
+    (void)res;
+    *nallocs = counter.nallocs;
+    *bytes = alloc.used;
+    ms_ParserDestroy(prs);
+    dsallocator_swap(prev);
+}
+
+/* Generate `nunits` groups of STATEMENTS_PER_UNIT top level statements. */
+static char *GenerateSource(size_t nunits) {
+    static const char *const UNIT =
+        "func f%zu(a, b) { var t := a + b; return g(t, 1); }\n"
+        "var l%zu := [1, 2, 3];\n"
+        "var o%zu := {\"k\": %zu, \"j\": 2};\n"
+        "if x > %zu { y := h(x); } else { y := 0; }\n";
+
+    size_t cap = nunits * 256;
+    char *src = malloc(cap);
+    assert(src);
+
+    size_t len = 0;
+    for (size_t i = 0; i < nunits; i++) {
+        int n = snprintf(&src[len], cap - len, UNIT, i, i, i, i, i);
+        assert((n > 0) && ((size_t)n < cap - len));
+        len += (size_t)n;
+    }
+    return src;
+}
+
+/* Generate `nunits` groups of EXPRESSIONS_PER_UNIT statements, holding
+ * OPERATORS_PER_UNIT binary operators between them. */
+static char *GenerateExpressionSource(size_t nunits) {
+    static const char *const UNIT =
+        "var e%zu := a * 2 + b - c / 4 >= d << 1 && e | f ^ g & h == i ** 2 %% j || !k;\n"
+        "e%zu := (x + 1) * (y - 2) \\ -z ** w ** 2 < m >> n & 255 != (p | q) ^ ~r;\n"
+        "f(e%zu <= s + t * u || v && w > 1 == a - b - c - d + e + f %% 3 * g / h);\n";
+
+    size_t cap = nunits * 256;
+    char *src = malloc(cap);
+    assert(src);
+
+    size_t len = 0;
+    for (size_t i = 0; i < nunits; i++) {
+        int n = snprintf(&src[len], cap - len, UNIT, i, i, i);
+        assert((n > 0) && ((size_t)n < cap - len));
+        len += (size_t)n;
+    }
+    return src;
+}
+
+/* Generate `nunits` groups of COMPOUND_STATEMENTS_PER_UNIT compound
+ * assignment statements. */
+static char *GenerateCompoundSource(size_t nunits) {
+    static const char *const UNIT =
+        "x%zu += 1;\n"
+        "o.p%zu.q -= a * 2;\n"
+        "l[i%zu][j] *= b + c;\n"
+        "s.t.u.v <<= %zu;\n";
+
+    size_t cap = nunits * 128;
+    char *src = malloc(cap);
+    assert(src);
+
+    size_t len = 0;
+    for (size_t i = 0; i < nunits; i++) {
+        int n = snprintf(&src[len], cap - len, UNIT, i, i, i, i);
+        assert((n > 0) && ((size_t)n < cap - len));
+        len += (size_t)n;
+    }
+    return src;
+}
+
+/* Generate `nunits` statements, each of the form
+ *
+ *     var n0 := (((a + 1) * 2) + f(f(f(0))));
+ *
+ * with NESTING_DEPTH levels of parentheses and of calls. */
+static char *GenerateNestedSource(size_t nunits) {
+    size_t cap = nunits * (NESTING_DEPTH * 12 + 32);
+    char *src = malloc(cap);
+    assert(src);
+
+    size_t len = 0;
+    for (size_t i = 0; i < nunits; i++) {
+        int n = snprintf(&src[len], cap - len, "var n%zu := ", i);
+        assert(n > 0);
+        len += (size_t)n;
+        for (size_t j = 0; j < NESTING_DEPTH; j++) {
+            src[len++] = '(';
+        }
+        src[len++] = 'a';
+        for (size_t j = 0; j < NESTING_DEPTH; j++) {
+            n = snprintf(&src[len], cap - len, " %c %zu)", (j % 2 == 0) ? '+' : '*', j + 1);
+            assert(n > 0);
+            len += (size_t)n;
+        }
+        memcpy(&src[len], " + ", 3);
+        len += 3;
+        for (size_t j = 0; j < NESTING_DEPTH; j++) {
+            memcpy(&src[len], "f(", 2);
+            len += 2;
+        }
+        src[len++] = '0';
+        for (size_t j = 0; j < NESTING_DEPTH; j++) {
+            src[len++] = ')';
+        }
+        memcpy(&src[len], ";\n", 2);
+        len += 2;
+        assert(len < cap);
+    }
+    src[len] = '\0';
+    return src;
+}
+
+/* Generate `nunits` groups of VERIFY_STATEMENTS_PER_UNIT statements, which
+ * pass verification. */
+static char *GenerateVerifiableSource(size_t nunits) {
+    static const char *const UNIT =
+        "var v%zu := %zu;\n"
+        "func f%zu(a, b) {\n"
+        "    var t := a + b + v%zu;\n"
+        "    if t > 1 { var u := t * 2; return u; }\n"
+        "    return t;\n"
+        "}\n";
+
+    size_t cap = nunits * 160;
+    char *src = malloc(cap);
+    assert(src);
+
+    size_t len = 0;
+    for (size_t i = 0; i < nunits; i++) {
+        int n = snprintf(&src[len], cap - len, UNIT, i, i, i, i);
+        assert((n > 0) && ((size_t)n < cap - len));
+        len += (size_t)n;
+    }
+    return src;
+}
+
+static void *CountingAlloc(void *ctx, void *ptr, size_t size) {
+    AllocCounter *counter = ctx;
+    if (size == 0) {
+        free(ptr);
+        return NULL;
+    }
+    if (!ptr) {
+        counter->nallocs++;
+    }
+    return realloc(ptr, size);
+}
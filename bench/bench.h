@@ -0,0 +1,48 @@
+/*------------------------------------------------------------------------------
+ *    Copyright 2016 Chris Rink
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *----------------------------------------------------------------------------*/
+
+#ifndef MSCRIPT_BENCH_H
+#define MSCRIPT_BENCH_H
+
+#include <stddef.h>
+
+/*
+ * BENCHMARK DEFINITIONS
+ */
+
+typedef void (*ms_BenchFunc)(void);
+
+typedef struct {
+    const char *name;               /** name of the benchmark */
+    ms_BenchFunc func;              /** function running the benchmark */
+} ms_Bench;
+
+typedef struct {
+    const char *prefix;             /** prefix for every benchmark in the suite */
+    const ms_Bench *benches;        /** NULL terminated array of benchmarks */
+} ms_BenchSuite;
+
+/**
+* @brief Return a monotonic timestamp in seconds.
+*/
+double BenchTimeNow(void);
+
+/**
+* @brief Report a single measurement from the currently running benchmark.
+*/
+void BenchReport(const char *metric, double value, const char *unit);
+
+#endif //MSCRIPT_BENCH_H
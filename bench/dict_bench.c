@@ -0,0 +1,283 @@
+/*------------------------------------------------------------------------------
+ *    Copyright 2016 Chris Rink
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *----------------------------------------------------------------------------*/
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libds/alloc.h"
+#include "libds/dict.h"
+#include "libds/hash.h"
+#include "dict_bench.h"
+
+/*
+ * BENCHMARK DEFINITIONS
+ */
+
+static void dict_BenchSmallScopes(void);
+static void dict_BenchInsert(void);
+static void dict_BenchLookup(void);
+static void dict_BenchChurn(void);
+static void dict_BenchInsertLatency(void);
+
+const ms_Bench dict_benches[] = {
+    { "/SmallScopes", dict_BenchSmallScopes },
+    { "/Insert", dict_BenchInsert },
+    { "/Lookup", dict_BenchLookup },
+    { "/Churn", dict_BenchChurn },
+    { "/InsertLatency", dict_BenchInsertLatency },
+    { NULL, NULL },
+};
+
+static const size_t SCOPE_NAMES = 3;
+static const size_t SCOPE_LOOKUPS = 8;
+static const size_t NUM_SCOPES = 1000000;
+static const size_t TABLE_SIZES[] = { 100, 10000, 1000000 };
+static const size_t NUM_TABLE_SIZES = sizeof(TABLE_SIZES) / sizeof(TABLE_SIZES[0]);
+static const size_t NUM_LOOKUPS = 4000000;
+static const size_t CHURN_LIVE = 10000;
+static const size_t CHURN_OPS = 4000000;
+static const size_t LATENCY_KEYS = 2000000;
+static const double LATENCY_PERCENTILES[] = { 50.0, 99.0, 99.99 };
+static const size_t NUM_LATENCY_PERCENTILES = sizeof(LATENCY_PERCENTILES) / sizeof(LATENCY_PERCENTILES[0]);
+
+static char **NewKeys(size_t n, const char *prefix);
+static void DestroyKeys(char **keys, size_t n);
+static uint32_t IdentityHash(void *key);
+static int IdentityCompare(const void *left, const void *right);
+static int CompareDouble(const void *left, const void *right);
+
+/*
+ * BENCHMARK FUNCTIONS
+ */
+
+/* Create and tear down many block-sized scopes, as the VM does for each
+ * block, keyed by identity like interned identifiers. */
+static void dict_BenchSmallScopes(void) {
+    char **names = NewKeys(SCOPE_NAMES, "name");
+
+    double start = BenchTimeNow();
+    for (size_t i = 0; i < NUM_SCOPES; i++) {
+        DSDict *scope = dsdict_new(IdentityHash, IdentityCompare, NULL, NULL);
+        assert(scope);
+        for (size_t j = 0; j < SCOPE_NAMES; j++) {
+            dsdict_put(scope, names[j], names[j]);
+        }
+        for (size_t j = 0; j < SCOPE_LOOKUPS; j++) {
+            void *v = dsdict_get(scope, names[j % SCOPE_NAMES]);
+            assert(v);
+            (void)v;
+        }
+        dsdict_destroy(scope);
+    }
+    double elapsed = BenchTimeNow() - start;
+
+    /* measure the memory held by one such scope */
+    DSAllocator alloc;
+    dsallocator_init(&alloc, NULL, NULL, 0);
+    DSAllocator *prev = dsallocator_swap(&alloc);
+    DSDict *scope = dsdict_new(IdentityHash, IdentityCompare, NULL, NULL);
+    for (size_t j = 0; j < SCOPE_NAMES; j++) {
+        dsdict_put(scope, names[j], names[j]);
+    }
+    size_t bytes = alloc.used;
+    dsdict_destroy(scope);
+    dsallocator_swap(prev);
+
+    BenchReport("create, fill, query, destroy", (elapsed / NUM_SCOPES) * 1e9, "ns/scope");
+    BenchReport("memory per scope", (double)bytes, "bytes");
+    DestroyKeys(names, SCOPE_NAMES);
+}
+
+/* Insert distinct string keys into an empty table. */
+static void dict_BenchInsert(void) {
+    char metric[64];
+
+    for (size_t n = 0; n < NUM_TABLE_SIZES; n++) {
+        char **keys = NewKeys(TABLE_SIZES[n], "key");
+        size_t reps = (TABLE_SIZES[n] < NUM_LOOKUPS) ? NUM_LOOKUPS / TABLE_SIZES[n] : 1;
+
+        double start = BenchTimeNow();
+        for (size_t r = 0; r < reps; r++) {
+            DSDict *dict = dsdict_new((dsdict_hash_fn)hash_fnv1, (dsdict_compare_fn)strcmp, NULL, NULL);
+            assert(dict);
+            for (size_t i = 0; i < TABLE_SIZES[n]; i++) {
+                dsdict_put(dict, keys[i], keys[i]);
+            }
+            assert(dsdict_count(dict) == TABLE_SIZES[n]);
+            dsdict_destroy(dict);
+        }
+        double elapsed = BenchTimeNow() - start;
+
+        snprintf(metric, sizeof(metric), "%zu keys", TABLE_SIZES[n]);
+        BenchReport(metric, (elapsed / (reps * TABLE_SIZES[n])) * 1e9, "ns/insert");
+        DestroyKeys(keys, TABLE_SIZES[n]);
+    }
+}
+
+/* Look up present and absent string keys in tables of several sizes. */
+static void dict_BenchLookup(void) {
+    char metric[64];
+
+    for (size_t n = 0; n < NUM_TABLE_SIZES; n++) {
+        char **keys = NewKeys(TABLE_SIZES[n], "key");
+        char **misses = NewKeys(TABLE_SIZES[n], "absent");
+        DSDict *dict = dsdict_new((dsdict_hash_fn)hash_fnv1, (dsdict_compare_fn)strcmp, NULL, NULL);
+        assert(dict);
+        for (size_t i = 0; i < TABLE_SIZES[n]; i++) {
+            dsdict_put(dict, keys[i], keys[i]);
+        }
+
+        unsigned int seed = 12345;
+        double start = BenchTimeNow();
+        for (size_t i = 0; i < NUM_LOOKUPS; i++) {
+            seed = (seed * 1103515245u) + 12345u;
+            void *v = dsdict_get(dict, keys[(seed >> 4) % TABLE_SIZES[n]]);
+            assert(v);
+            (void)v;
+        }
+        double hits = BenchTimeNow() - start;
+
+        start = BenchTimeNow();
+        for (size_t i = 0; i < NUM_LOOKUPS; i++) {
+            seed = (seed * 1103515245u) + 12345u;
+            void *v = dsdict_get(dict, misses[(seed >> 4) % TABLE_SIZES[n]]);
+            assert(!v);
+            (void)v;
+        }
+        double absent = BenchTimeNow() - start;
+
+        snprintf(metric, sizeof(metric), "%zu keys hit", TABLE_SIZES[n]);
+        BenchReport(metric, (hits / NUM_LOOKUPS) * 1e9, "ns/lookup");
+        snprintf(metric, sizeof(metric), "%zu keys miss", TABLE_SIZES[n]);
+        BenchReport(metric, (absent / NUM_LOOKUPS) * 1e9, "ns/lookup");
+
+        dsdict_destroy(dict);
+        DestroyKeys(keys, TABLE_SIZES[n]);
+        DestroyKeys(misses, TABLE_SIZES[n]);
+    }
+}
+
+/* Repeatedly delete a random live key and insert a random dead one,
+ * keeping the table at a fixed size. */
+static void dict_BenchChurn(void) {
+    char **keys = NewKeys(2 * CHURN_LIVE, "key");
+    bool *live = calloc(2 * CHURN_LIVE, sizeof(bool));
+    DSDict *dict = dsdict_new((dsdict_hash_fn)hash_fnv1, (dsdict_compare_fn)strcmp, NULL, NULL);
+    assert(live && dict);
+    for (size_t i = 0; i < CHURN_LIVE; i++) {
+        dsdict_put(dict, keys[i], keys[i]);
+        live[i] = true;
+    }
+
+    unsigned int seed = 12345;
+    double start = BenchTimeNow();
+    for (size_t i = 0; i < CHURN_OPS; i++) {
+        seed = (seed * 1103515245u) + 12345u;
+        size_t k = (seed >> 4) % (2 * CHURN_LIVE);
+        if (live[k]) {
+            void *v = dsdict_del(dict, keys[k]);
+            assert(v);
+            (void)v;
+        } else {
+            dsdict_put(dict, keys[k], keys[k]);
+        }
+        live[k] = !live[k];
+    }
+    double elapsed = BenchTimeNow() - start;
+
+    BenchReport("put or del", (elapsed / CHURN_OPS) * 1e9, "ns/op");
+    BenchReport("final capacity", (double)dsdict_cap(dict), "slots");
+
+    dsdict_destroy(dict);
+    free(live);
+    DestroyKeys(keys, 2 * CHURN_LIVE);
+}
+
+/* Time every insert while a table grows from empty, reporting the tail
+ * latency which resizing the table adds to individual puts. */
+static void dict_BenchInsertLatency(void) {
+    char metric[64];
+    char **keys = NewKeys(LATENCY_KEYS, "key");
+    double *latency = malloc(LATENCY_KEYS * sizeof(double));
+    DSDict *dict = dsdict_new((dsdict_hash_fn)hash_fnv1, (dsdict_compare_fn)strcmp, NULL, NULL);
+    assert(latency && dict);
+
+    double total = BenchTimeNow();
+    for (size_t i = 0; i < LATENCY_KEYS; i++) {
+        double start = BenchTimeNow();
+        dsdict_put(dict, keys[i], keys[i]);
+        latency[i] = BenchTimeNow() - start;
+    }
+    total = BenchTimeNow() - total;
+    assert(dsdict_count(dict) == LATENCY_KEYS);
+
+    qsort(latency, LATENCY_KEYS, sizeof(double), CompareDouble);
+    for (size_t i = 0; i < NUM_LATENCY_PERCENTILES; i++) {
+        size_t rank = (size_t)((LATENCY_PERCENTILES[i] / 100.0) * (LATENCY_KEYS - 1));
+        snprintf(metric, sizeof(metric), "p%g", LATENCY_PERCENTILES[i]);
+        BenchReport(metric, latency[rank] * 1e9, "ns/insert");
+    }
+    BenchReport("max", latency[LATENCY_KEYS - 1] * 1e9, "ns/insert");
+    BenchReport("mean (timed)", (total / LATENCY_KEYS) * 1e9, "ns/insert");
+
+    dsdict_destroy(dict);
+    free(latency);
+    DestroyKeys(keys, LATENCY_KEYS);
+}
+
+/*
+ * UTILITY FUNCTIONS
+ */
+
+/* Create `n` distinct NUL terminated keys beginning with `prefix`. */
+static char **NewKeys(size_t n, const char *prefix) {
+    char **keys = malloc(n * sizeof(char *));
+    assert(keys);
+    for (size_t i = 0; i < n; i++) {
+        size_t len = (size_t)snprintf(NULL, 0, "%s_%zu", prefix, i);
+        keys[i] = malloc(len + 1);
+        assert(keys[i]);
+        snprintf(keys[i], len + 1, "%s_%zu", prefix, i);
+    }
+    return keys;
+}
+
+static void DestroyKeys(char **keys, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        free(keys[i]);
+    }
+    free(keys);
+}
+
+/* Hash a key by its address, as interned identifiers are. */
+static uint32_t IdentityHash(void *key) {
+    uintptr_t p = (uintptr_t)key;
+    p ^= (p >> 17);
+    return (uint32_t)((p >> 4) * 2654435761u);
+}
+
+static int IdentityCompare(const void *left, const void *right) {
+    return (left == right) ? 0 : 1;
+}
+
+static int CompareDouble(const void *left, const void *right) {
+    double l = *(const double *)left;
+    double r = *(const double *)right;
+    return (l > r) - (l < r);
+}
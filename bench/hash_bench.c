@@ -0,0 +1,88 @@
+/*------------------------------------------------------------------------------
+ *    Copyright 2016 Chris Rink
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *----------------------------------------------------------------------------*/
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libds/hash.h"
+#include "hash_bench.h"
+
+/*
+ * BENCHMARK DEFINITIONS
+ */
+
+static void hash_BenchThroughput(void);
+
+const ms_Bench hash_benches[] = {
+    { "/Throughput", hash_BenchThroughput },
+    { NULL, NULL },
+};
+
+static const size_t KEY_LENGTHS[] = { 3, 8, 16, 32, 64, 256, 4096 };
+static const size_t NUM_KEY_LENGTHS = sizeof(KEY_LENGTHS) / sizeof(KEY_LENGTHS[0]);
+static const size_t BYTES_PER_RUN = 256 * 1024 * 1024;
+static const size_t MIN_HASHES_PER_RUN = 1000000;
+
+static volatile uint32_t HASH_SINK;
+
+/*
+ * BENCHMARK FUNCTIONS
+ */
+
+/* Hash keys of several lengths with the byte-at-a-time FNV1 hash and the
+ * word-at-a-time hash, reporting the bytes hashed per second. Keys differ
+ * in their first byte so no call can reuse the previous result. */
+static void hash_BenchThroughput(void) {
+    char metric[64];
+
+    for (size_t n = 0; n < NUM_KEY_LENGTHS; n++) {
+        size_t len = KEY_LENGTHS[n];
+        size_t reps = BYTES_PER_RUN / len;
+        if (reps < MIN_HASHES_PER_RUN) { reps = MIN_HASHES_PER_RUN; }
+
+        char *key = malloc(len + 1);
+        assert(key);
+        for (size_t i = 0; i < len; i++) {
+            key[i] = (char)('a' + (i % 26));
+        }
+        key[len] = '\0';
+
+        uint32_t sink = 0;
+        double start = BenchTimeNow();
+        for (size_t r = 0; r < reps; r++) {
+            key[0] = (char)('a' + (r & 15));
+            sink ^= hash_fnv1(key);
+        }
+        double fnv1 = BenchTimeNow() - start;
+
+        start = BenchTimeNow();
+        for (size_t r = 0; r < reps; r++) {
+            key[0] = (char)('a' + (r & 15));
+            sink ^= hash_bytes(key, len);
+        }
+        double bytes = BenchTimeNow() - start;
+        HASH_SINK = sink;
+
+        double mb = ((double)reps * len) / (1024.0 * 1024.0);
+        snprintf(metric, sizeof(metric), "%zu bytes fnv1", len);
+        BenchReport(metric, mb / fnv1, "MB/s");
+        snprintf(metric, sizeof(metric), "%zu bytes hash_bytes", len);
+        BenchReport(metric, mb / bytes, "MB/s");
+        free(key);
+    }
+}
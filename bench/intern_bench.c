@@ -0,0 +1,235 @@
+/*------------------------------------------------------------------------------
+ *    Copyright 2016 Chris Rink
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *----------------------------------------------------------------------------*/
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libds/buffer.h"
+#include "libds/dict.h"
+#include "intern_bench.h"
+#include "../src/bytecode.h"
+#include "../src/intern.h"
+#include "../src/mscript.h"
+#include "../src/parser.h"
+#include "../src/verifier.h"
+
+/*
+ * BENCHMARK DEFINITIONS
+ */
+
+static void intern_BenchModuleMemory(void);
+static void intern_BenchDictLookup(void);
+static void intern_BenchExecuteModules(void);
+
+const ms_Bench intern_benches[] = {
+    { "/ModuleMemory", intern_BenchModuleMemory },
+    { "/DictLookup", intern_BenchDictLookup },
+    { "/ExecuteModules", intern_BenchExecuteModules },
+    { NULL, NULL },
+};
+
+static const size_t NUM_MODULES = 500;
+static const size_t MODULE_BUFFER_LEN = 1 << 16;
+static const size_t DICT_LOOKUPS = 4000000;
+
+static const char *const VOCABULARY[] = {
+    "customer", "order", "total", "subtotal", "discount", "quantity",
+    "price", "tax_rate", "shipping", "region", "currency", "account",
+    "balance", "invoice", "line_item", "due_date", "created_at", "status",
+    "warehouse", "sku", "category", "vendor", "margin", "revenue",
+};
+
+static const size_t VOCABULARY_LEN = sizeof(VOCABULARY) / sizeof(VOCABULARY[0]);
+
+static void GenerateModule(char *buf, size_t len, size_t module);
+static size_t ByteCodeStringBytes(const ms_VMByteCode *bc, size_t *nrefs);
+
+/*
+ * BENCHMARK FUNCTIONS
+ */
+
+static void intern_BenchModuleMemory(void) {
+    char *src = malloc(MODULE_BUFFER_LEN);
+    ms_VMByteCode **modules = calloc(NUM_MODULES, sizeof(ms_VMByteCode *));
+    ms_Parser *prs = ms_ParserNew();
+    assert(src && modules && prs);
+
+    double start = BenchTimeNow();
+    for (size_t i = 0; i < NUM_MODULES; i++) {
+        GenerateModule(src, MODULE_BUFFER_LEN, i);
+        ms_ParserInitString(prs, src);
+
+        const ms_AST *ast;
+        ms_Error *err = NULL;
+        if ((ms_ParserParse(prs, &ast, &err) == MS_RESULT_ERROR) ||
+            (ms_ParserVerifyAST(ast, &err) == MS_RESULT_ERROR) ||
+            (ms_VMByteCodeGenerateFromAST(ast, &modules[i], &err) == MS_RESULT_ERROR)) {
+            fprintf(stderr, "failed to compile module %zu: %s\n", i, (err) ? err->msg : "");
+            ms_ErrorDestroy(err);
+            exit(EXIT_FAILURE);
+        }
+    }
+    double elapsed = BenchTimeNow() - start;
+
+    size_t nrefs = 0;
+    size_t copied = 0;
+    for (size_t i = 0; i < NUM_MODULES; i++) {
+        copied += ByteCodeStringBytes(modules[i], &nrefs);
+    }
+
+    ms_InternStats stats;
+    ms_InternGetStats(&stats);
+
+    BenchReport("modules compiled", (double)NUM_MODULES, "modules");
+    BenchReport("compile time", elapsed * 1e3, "ms");
+    BenchReport("string references held by bytecode", (double)nrefs, "refs");
+    BenchReport("bytes if copied per reference", (double)copied, "bytes");
+    BenchReport("distinct interned strings", (double)stats.nstrs, "strings");
+    BenchReport("bytes held by intern table", (double)stats.nbytes, "bytes");
+
+    for (size_t i = 0; i < NUM_MODULES; i++) {
+        ms_VMByteCodeDestroy(modules[i]);
+    }
+    ms_ParserDestroy(prs);
+    free(modules);
+    free(src);
+}
+
+static void intern_BenchDictLookup(void) {
+    DSDict *bycontent = dsdict_new((dsdict_hash_fn)dsbuf_hash,
+                                   (dsdict_compare_fn)dsbuf_compare,
+                                   (dsdict_free_fn)dsbuf_destroy, NULL);
+    DSDict *byidentity = dsdict_new((dsdict_hash_fn)ms_InternHash,
+                                    (dsdict_compare_fn)ms_InternCompare,
+                                    (dsdict_free_fn)ms_InternRelease, NULL);
+    DSBuffer **probes = calloc(VOCABULARY_LEN, sizeof(DSBuffer *));
+    DSBuffer **interned = calloc(VOCABULARY_LEN, sizeof(DSBuffer *));
+    assert(bycontent && byidentity && probes && interned);
+
+    for (size_t i = 0; i < VOCABULARY_LEN; i++) {
+        /* probes are separate copies, as each piece of bytecode had before */
+        probes[i] = dsbuf_new(VOCABULARY[i]);
+        interned[i] = ms_InternStr(probes[i]);
+        dsdict_put(bycontent, dsbuf_new(VOCABULARY[i]), (void *)VOCABULARY[i]);
+        dsdict_put(byidentity, ms_InternRetain(interned[i]), (void *)VOCABULARY[i]);
+    }
+
+    size_t found = 0;
+    double start = BenchTimeNow();
+    for (size_t i = 0; i < DICT_LOOKUPS; i++) {
+        found += (dsdict_get(bycontent, probes[i % VOCABULARY_LEN]) != NULL);
+    }
+    double content = BenchTimeNow() - start;
+
+    start = BenchTimeNow();
+    for (size_t i = 0; i < DICT_LOOKUPS; i++) {
+        found += (dsdict_get(byidentity, interned[i % VOCABULARY_LEN]) != NULL);
+    }
+    double identity = BenchTimeNow() - start;
+    assert(found == 2 * DICT_LOOKUPS);
+
+    BenchReport("content keyed lookup", (content / DICT_LOOKUPS) * 1e9, "ns/op");
+    BenchReport("interned keyed lookup", (identity / DICT_LOOKUPS) * 1e9, "ns/op");
+
+    for (size_t i = 0; i < VOCABULARY_LEN; i++) {
+        dsbuf_destroy(probes[i]);
+        ms_InternRelease(interned[i]);
+    }
+    dsdict_destroy(bycontent);
+    dsdict_destroy(byidentity);
+    free(probes);
+    free(interned);
+}
+
+static void intern_BenchExecuteModules(void) {
+    char *src = malloc(MODULE_BUFFER_LEN);
+    ms_State *state = ms_StateNew();
+    assert(src && state);
+
+    double elapsed = 0.0;
+    for (size_t i = 0; i < NUM_MODULES; i++) {
+        GenerateModule(src, MODULE_BUFFER_LEN, i);
+
+        const ms_Error *err;
+        double start = BenchTimeNow();
+        if (ms_StateExecuteString(state, src, &err) == MS_RESULT_ERROR) {
+            fprintf(stderr, "failed to execute module %zu: %s\n", i, (err) ? err->msg : "");
+            exit(EXIT_FAILURE);
+        }
+        elapsed += BenchTimeNow() - start;
+    }
+
+    BenchReport("modules executed", (double)NUM_MODULES, "modules");
+    BenchReport("mean time per module", (elapsed / NUM_MODULES) * 1e6, "us");
+
+    ms_StateDestroy(state);
+    free(src);
+}
+
+/*
+ * UTILITY FUNCTIONS
+ */
+
+/* Generate one module of a script set; every module shares the same small
+ * vocabulary of identifiers and string constants, as real libraries do. */
+static void GenerateModule(char *buf, size_t len, size_t module) {
+    size_t pos = 0;
+    pos += (size_t)snprintf(&buf[pos], len - pos, "var %s := %zu;\n", VOCABULARY[0], module);
+
+    for (size_t i = 1; i < VOCABULARY_LEN; i++) {
+        pos += (size_t)snprintf(&buf[pos], len - pos, "var %s := %s + %zu;\n",
+                                VOCABULARY[i], VOCABULARY[i - 1], i);
+    }
+
+    for (size_t i = 0; i < VOCABULARY_LEN; i++) {
+        pos += (size_t)snprintf(&buf[pos], len - pos, "%s := %s * %s - %zu;\n",
+                                VOCABULARY[i], VOCABULARY[(i + 3) % VOCABULARY_LEN],
+                                VOCABULARY[(i + 7) % VOCABULARY_LEN], i);
+    }
+
+    for (size_t i = 0; i < VOCABULARY_LEN; i++) {
+        pos += (size_t)snprintf(&buf[pos], len - pos, "var label_%zu := \"%s\";\n",
+                                i, VOCABULARY[i]);
+    }
+
+    pos += (size_t)snprintf(&buf[pos], len - pos,
+                            "func compute_%zu(%s, %s) { var %s := %s + %s; }\n",
+                            module, VOCABULARY[0], VOCABULARY[1], VOCABULARY[2],
+                            VOCABULARY[0], VOCABULARY[1]);
+    assert(pos < len);
+}
+
+/* Sum the bytes of every identifier and string constant in the bytecode. */
+static size_t ByteCodeStringBytes(const ms_VMByteCode *bc, size_t *nrefs) {
+    size_t bytes = 0;
+    for (size_t i = 0; i < bc->nidents; i++) {
+        bytes += dsbuf_len(bc->idents[i]);
+        *nrefs += 1;
+    }
+
+    for (size_t i = 0; i < bc->nvals; i++) {
+        const ms_VMValue *v = &bc->values[i];
+        if (v->type == VMVAL_STR) {
+            bytes += dsbuf_len(v->val.s);
+            *nrefs += 1;
+        } else if (v->type == VMVAL_FUNC) {
+            bytes += ByteCodeStringBytes(v->val.fn->code, nrefs);
+        }
+    }
+
+    return bytes;
+}
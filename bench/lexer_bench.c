@@ -0,0 +1,158 @@
+/*------------------------------------------------------------------------------
+ *    Copyright 2016 Chris Rink
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *----------------------------------------------------------------------------*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lexer_bench.h"
+#include "../src/lexer.h"
+
+/*
+ * BENCHMARK DEFINITIONS
+ */
+
+static void lexer_BenchString(void);
+static void lexer_BenchFile(void);
+
+const ms_Bench lexer_benches[] = {
+    { "/String", lexer_BenchString },
+    { "/File", lexer_BenchFile },
+    { NULL, NULL },
+};
+
+static const size_t NUM_UNITS = 50000;
+static const size_t NUM_LEXES = 5;
+
+static char *GenerateSource(size_t nunits, size_t *len);
+static char *WriteTempFile(const char *src, size_t len);
+static size_t LexAll(ms_Lexer *lex);
+static void ReportThroughput(double elapsed, size_t len, size_t ntoks);
+
+/*
+ * BENCHMARK FUNCTIONS
+ */
+
+/* Lex a large module held in memory. */
+static void lexer_BenchString(void) {
+    size_t len;
+    char *src = GenerateSource(NUM_UNITS, &len);
+    ms_Lexer *lex = ms_LexerNew();
+    assert(lex);
+
+    size_t ntoks = 0;
+    double start = BenchTimeNow();
+    for (size_t i = 0; i < NUM_LEXES; i++) {
+        bool ok = ms_LexerInitStringL(lex, src, len);
+        assert(ok);
+        (void)ok;
+        ntoks = LexAll(lex);
+    }
+    double elapsed = BenchTimeNow() - start;
+    ReportThroughput(elapsed, len, ntoks);
+
+    ms_LexerDestroy(lex);
+    free(src);
+}
+
+/* Lex the same module from a file, including opening (and mapping or
+ * reading) the file each time. */
+static void lexer_BenchFile(void) {
+    size_t len;
+    char *src = GenerateSource(NUM_UNITS, &len);
+    char *fname = WriteTempFile(src, len);
+    ms_Lexer *lex = ms_LexerNew();
+    assert(lex);
+
+    size_t ntoks = 0;
+    double start = BenchTimeNow();
+    for (size_t i = 0; i < NUM_LEXES; i++) {
+        bool ok = ms_LexerInitFile(lex, fname);
+        assert(ok);
+        (void)ok;
+        ntoks = LexAll(lex);
+    }
+    double elapsed = BenchTimeNow() - start;
+    ReportThroughput(elapsed, len, ntoks);
+
+    ms_LexerDestroy(lex);
+    remove(fname);
+    free(fname);
+    free(src);
+}
+
+/*
+ * UTILITY FUNCTIONS
+ */
+
+/* Generate `nunits` groups of typical top level statements. */
+static char *GenerateSource(size_t nunits, size_t *len) {
+    static const char *const UNIT =
+        "// compute the total for item %zu\n"
+        "func total_%zu(amount, rate) {\n"
+        "    var tax := amount * (rate / 100.0);\n"
+        "    return amount + tax - 0x%zx;\n"
+        "}\n"
+        "var label_%zu := \"item number %zu\";\n";
+
+    size_t cap = nunits * 192;
+    char *src = malloc(cap);
+    assert(src);
+
+    *len = 0;
+    for (size_t i = 0; i < nunits; i++) {
+        int n = snprintf(&src[*len], cap - *len, UNIT, i, i, i, i, i);
+        assert((n > 0) && ((size_t)n < cap - *len));
+        *len += (size_t)n;
+    }
+    return src;
+}
+
+static char *WriteTempFile(const char *src, size_t len) {
+    char *fname = malloc(24);
+    assert(fname);
+    memcpy(fname, "/tmp/lexerbenchXXXXXX", 22);
+    int fd = mkstemp(fname);
+    assert(fd >= 0);
+    (void)fd;
+
+    FILE *f = fopen(fname, "wb");
+    assert(f);
+    size_t nwritten = fwrite(src, 1, len, f);
+    assert(nwritten == len);
+    (void)nwritten;
+    fclose(f);
+    return fname;
+}
+
+/* Lex every token in the input (as the parser does, without allocating
+ * tokens), returning the number of tokens. */
+static size_t LexAll(ms_Lexer *lex) {
+    size_t ntoks = 0;
+    const ms_TokenView *tok;
+    while ((tok = ms_LexerNextTokenView(lex)) != NULL) {
+        assert(tok->type != ERROR);
+        ntoks++;
+    }
+    return ntoks;
+}
+
+static void ReportThroughput(double elapsed, size_t len, size_t ntoks) {
+    BenchReport("throughput", ((double)len * NUM_LEXES) / (elapsed * 1e6), "MB/s");
+    BenchReport("lex time", (elapsed / (NUM_LEXES * (double)ntoks)) * 1e9, "ns/token");
+}
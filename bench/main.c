@@ -0,0 +1,61 @@
+/*------------------------------------------------------------------------------
+ *    Copyright 2016 Chris Rink
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *----------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <string.h>
+#include "bench.h"
+#include "ast_bench.h"
+#include "dict_bench.h"
+#include "hash_bench.h"
+#include "intern_bench.h"
+#include "lexer_bench.h"
+#include "pool_bench.h"
+#include "str_bench.h"
+
+static const ms_BenchSuite suites[] = {
+    { "/ast", ast_benches },
+    { "/dict", dict_benches },
+    { "/hash", hash_benches },
+    { "/intern", intern_benches },
+    { "/lexer", lexer_benches },
+    { "/pool", pool_benches },
+    { "/str", str_benches },
+    { NULL, NULL },
+};
+
+/*
+ * Run every benchmark whose full name begins with the (optional) prefix
+ * given as the first command line argument, e.g. `mscript_bench /intern`.
+ */
+int main(int argc, char *argv[]) {
+    const char *filter = (argc > 1) ? argv[1] : "";
+    char name[256];
+
+    for (const ms_BenchSuite *s = &suites[0]; s->prefix; s++) {
+        for (const ms_Bench *b = &s->benches[0]; b->name; b++) {
+            snprintf(name, sizeof(name), "%s%s", s->prefix, b->name);
+            if (strncmp(name, filter, strlen(filter)) != 0) {
+                continue;
+            }
+
+            printf("%s\n", name);
+            fflush(stdout);
+            b->func();
+        }
+    }
+
+    return 0;
+}
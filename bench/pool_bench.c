@@ -0,0 +1,173 @@
+/*------------------------------------------------------------------------------
+ *    Copyright 2016 Chris Rink
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *----------------------------------------------------------------------------*/
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "libds/buffer.h"
+#include "libds/pool.h"
+#include "pool_bench.h"
+#include "../src/bytecode.h"
+#include "../src/parser.h"
+#include "../src/vm.h"
+
+/*
+ * BENCHMARK DEFINITIONS
+ */
+
+static void pool_BenchChurn(void);
+static void pool_BenchVMOccupancy(void);
+
+const ms_Bench pool_benches[] = {
+    { "/Churn", pool_BenchChurn },
+    { "/VMOccupancy", pool_BenchVMOccupancy },
+    { NULL, NULL },
+};
+
+/* object sizes in roughly the mix the VM allocates: values, blocks,
+ * dict buckets, iterators, ropes, and slices */
+static const size_t CHURN_SIZES[] = { 16, 16, 16, 24, 40, 40, 48, 56 };
+static const size_t NUM_CHURN_SIZES = sizeof(CHURN_SIZES) / sizeof(CHURN_SIZES[0]);
+static const size_t CHURN_LIVE = 100000;
+static const size_t CHURN_OPS = 5000000;
+static const size_t VM_NAMES[] = { 1000, 5000, 10000 };
+static const size_t NUM_VM_SIZES = sizeof(VM_NAMES) / sizeof(VM_NAMES[0]);
+
+static double ChurnPool(DSPool *pool);
+static void ReportStats(const DSPoolStats *stats);
+
+/*
+ * BENCHMARK FUNCTIONS
+ */
+
+/* Keep a fixed number of small objects live while repeatedly freeing one
+ * at random and allocating a replacement, once from a pool and once from
+ * the system allocator. */
+static void pool_BenchChurn(void) {
+    DSPool *pool = dspool_new();
+    assert(pool);
+
+    double pooled = ChurnPool(pool);
+    DSPoolStats stats;
+    dspool_stats(pool, &stats);
+    dspool_destroy(pool);
+
+    double system = ChurnPool(NULL);
+
+    BenchReport("pool alloc+free", (pooled / CHURN_OPS) * 1e9, "ns/op");
+    BenchReport("malloc alloc+free", (system / CHURN_OPS) * 1e9, "ns/op");
+    BenchReport("pool bytes reserved at end", (double)stats.reserved, "bytes");
+}
+
+/* Declare many names in a single script and report how the pool which
+ * backs the VM symbol tables is used. */
+static void pool_BenchVMOccupancy(void) {
+    char metric[64];
+
+    for (size_t n = 0; n < NUM_VM_SIZES; n++) {
+        DSBuffer *code = dsbuf_new_buffer(VM_NAMES[n] * 24);
+        assert(code);
+        for (size_t i = 0; i < VM_NAMES[n]; i++) {
+            snprintf(metric, sizeof(metric), "var v%zu := %zu;\n", i, i);
+            dsbuf_append_str(code, metric);
+        }
+
+        ms_Parser *prs = ms_ParserNew();
+        ms_VM *vm = ms_VMNew();
+        assert(prs && vm);
+
+        const ms_AST *ast;
+        ms_VMByteCode *bc;      /* freed by the VM */
+        ms_Error *err = NULL;
+        if ((!ms_ParserInitString(prs, dsbuf_char_ptr(code))) ||
+            (ms_ParserParse(prs, &ast, &err) == MS_RESULT_ERROR) ||
+            (ms_VMByteCodeGenerateFromAST(ast, &bc, &err) == MS_RESULT_ERROR)) {
+            fprintf(stderr, "failed to compile script: %s\n", (err) ? err->msg : "");
+            exit(EXIT_FAILURE);
+        }
+
+        double start = BenchTimeNow();
+        if (ms_VMExecute(vm, bc, &err) == MS_RESULT_ERROR) {
+            fprintf(stderr, "failed to execute script: %s\n", (err) ? err->msg : "");
+            exit(EXIT_FAILURE);
+        }
+        double elapsed = BenchTimeNow() - start;
+
+        DSPoolStats stats;
+        ms_VMPoolStats(vm, &stats);
+        snprintf(metric, sizeof(metric), "%zu names executed", VM_NAMES[n]);
+        BenchReport(metric, elapsed * 1e3, "ms");
+        ReportStats(&stats);
+
+        ms_VMDestroy(vm);
+        ms_ParserDestroy(prs);
+        dsbuf_destroy(code);
+    }
+}
+
+/*
+ * UTILITY FUNCTIONS
+ */
+
+/* Run the churn workload against the given pool (or malloc if NULL),
+ * returning the elapsed time in seconds. */
+static double ChurnPool(DSPool *pool) {
+    void **objs = malloc(sizeof(void *) * CHURN_LIVE);
+    size_t *sizes = malloc(sizeof(size_t) * CHURN_LIVE);
+    assert(objs && sizes);
+
+    unsigned int seed = 12345;
+    for (size_t i = 0; i < CHURN_LIVE; i++) {
+        sizes[i] = CHURN_SIZES[i % NUM_CHURN_SIZES];
+        objs[i] = dspool_alloc(pool, sizes[i]);
+        assert(objs[i]);
+    }
+
+    double start = BenchTimeNow();
+    for (size_t i = 0; i < CHURN_OPS; i++) {
+        seed = (seed * 1103515245u) + 12345u;
+        size_t victim = (seed >> 8) % CHURN_LIVE;
+        dspool_free(pool, objs[victim], sizes[victim]);
+        sizes[victim] = CHURN_SIZES[(seed >> 4) % NUM_CHURN_SIZES];
+        objs[victim] = dspool_alloc(pool, sizes[victim]);
+        assert(objs[victim]);
+    }
+    double elapsed = BenchTimeNow() - start;
+
+    for (size_t i = 0; i < CHURN_LIVE; i++) {
+        dspool_free(pool, objs[i], sizes[i]);
+    }
+    free(objs);
+    free(sizes);
+    return elapsed;
+}
+
+/* Report the occupancy of each size class in use and the overall
+ * fragmentation of the pool. */
+static void ReportStats(const DSPoolStats *stats) {
+    char metric[64];
+
+    for (int i = 0; i < DSPOOL_NUM_CLASSES; i++) {
+        const DSPoolClassStats *cls = &stats->classes[i];
+        if (cls->nslots == 0) { continue; }
+        snprintf(metric, sizeof(metric), "  %zu byte class occupancy (%zu live)", cls->size, cls->nlive);
+        BenchReport(metric, ((double)cls->nlive / cls->nslots) * 100.0, "%");
+    }
+
+    BenchReport("  requested", (double)stats->requested, "bytes");
+    BenchReport("  reserved", (double)stats->reserved, "bytes");
+    BenchReport("  fragmentation", (double)(stats->reserved - stats->requested), "bytes");
+}
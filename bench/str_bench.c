@@ -0,0 +1,207 @@
+/*------------------------------------------------------------------------------
+ *    Copyright 2016 Chris Rink
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *----------------------------------------------------------------------------*/
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libds/buffer.h"
+#include "str_bench.h"
+#include "../src/bytecode.h"
+#include "../src/parser.h"
+#include "../src/vm.h"
+
+/*
+ * BENCHMARK DEFINITIONS
+ */
+
+static void str_BenchConcatRope(void);
+static void str_BenchConcatCopy(void);
+static void str_BenchSliceFields(void);
+
+const ms_Bench str_benches[] = {
+    { "/ConcatRope", str_BenchConcatRope },
+    { "/ConcatCopy", str_BenchConcatCopy },
+    { "/SliceFields", str_BenchSliceFields },
+    { NULL, NULL },
+};
+
+static const char *const PIECE = "0123456789";
+static const size_t ROPE_PIECES[] = { 250000, 500000, 1000000 };
+static const size_t COPY_PIECES[] = { 12500, 25000, 50000 };
+static const size_t NUM_SIZES = sizeof(ROPE_PIECES) / sizeof(ROPE_PIECES[0]);
+static const size_t RECORD_FIELDS = 200000;
+static const size_t RECORD_FIELD_LEN = 24;
+static const size_t RECORD_PASSES = 10;
+
+static ms_VM *VMWithFrame(void);
+
+/*
+ * BENCHMARK FUNCTIONS
+ */
+
+/* Build a string from many small pieces with the VM `+` operator, which is
+ * what `s += piece` in a loop executes, then read it back once. */
+static void str_BenchConcatRope(void) {
+    char metric[64];
+    DSBuffer *piece = dsbuf_new(PIECE);
+    assert(piece);
+
+    for (size_t n = 0; n < NUM_SIZES; n++) {
+        ms_VM *vm = VMWithFrame();
+        ms_Function add = ms_VMPrototypeFuncGet(vm, VMVAL_STR, "__add__");
+        assert(add);
+
+        double start = BenchTimeNow();
+        ms_VMPushStr(vm, piece);
+        for (size_t i = 1; i < ROPE_PIECES[n]; i++) {
+            ms_VMPushStr(vm, piece);
+            int res = add(vm);
+            assert(res == 1);
+            (void)res;
+        }
+        double append = BenchTimeNow() - start;
+
+        start = BenchTimeNow();
+        const ms_VMStr *flat = ms_VMStrFlatten(vm, ms_VMTop(vm));
+        double flatten = BenchTimeNow() - start;
+        assert(flat);
+        assert(dsbuf_len(flat) == ROPE_PIECES[n] * strlen(PIECE));
+
+        snprintf(metric, sizeof(metric), "%zu pieces (%zu bytes) total", ROPE_PIECES[n], dsbuf_len(flat));
+        BenchReport(metric, (append + flatten) * 1e3, "ms");
+        BenchReport("  append", ((append / ROPE_PIECES[n]) * 1e9), "ns/piece");
+        BenchReport("  flatten", (dsbuf_len(flat) / flatten) / 1e6, "MB/s");
+        ms_VMDestroy(vm);
+    }
+
+    dsbuf_destroy(piece);
+}
+
+/* Reference measurement for building the same strings by copying both
+ * operands into a new buffer on every append. */
+static void str_BenchConcatCopy(void) {
+    char metric[64];
+    const size_t plen = strlen(PIECE);
+
+    for (size_t n = 0; n < NUM_SIZES; n++) {
+        size_t len = 0;
+        char *cur = NULL;
+
+        double start = BenchTimeNow();
+        for (size_t i = 0; i < COPY_PIECES[n]; i++) {
+            char *next = malloc(len + plen + 1);
+            assert(next);
+            if (cur) {
+                memcpy(next, cur, len);
+            }
+            memcpy(&next[len], PIECE, plen + 1);
+            free(cur);
+            cur = next;
+            len += plen;
+        }
+        double elapsed = BenchTimeNow() - start;
+
+        snprintf(metric, sizeof(metric), "%zu pieces (%zu bytes) total", COPY_PIECES[n], len);
+        BenchReport(metric, elapsed * 1e3, "ms");
+        BenchReport("  append", ((elapsed / COPY_PIECES[n]) * 1e9), "ns/piece");
+        free(cur);
+    }
+}
+
+/* Split one large delimited text record into its fields, once as slices
+ * of the record and once by copying each field into its own buffer. */
+static void str_BenchSliceFields(void) {
+    const size_t reclen = RECORD_FIELDS * (RECORD_FIELD_LEN + 1);
+    char *text = malloc(reclen + 1);
+    assert(text);
+    for (size_t i = 0; i < RECORD_FIELDS; i++) {
+        memset(&text[i * (RECORD_FIELD_LEN + 1)], 'a' + (int)(i % 26), RECORD_FIELD_LEN);
+        text[(i * (RECORD_FIELD_LEN + 1)) + RECORD_FIELD_LEN] = ',';
+    }
+    text[reclen] = '\0';
+
+    DSBuffer *record = dsbuf_new_l(text, reclen);
+    assert(record);
+    ms_VMValue rv = { .type = VMVAL_STR, .val = { .s = record } };
+
+    double slice = 0.0;
+    double copy = 0.0;
+    size_t copied = 0;
+    for (size_t pass = 0; pass < RECORD_PASSES; pass++) {
+        ms_VM *vm = VMWithFrame();
+
+        double start = BenchTimeNow();
+        size_t begin = 0;
+        for (size_t i = 0; i < reclen; i++) {
+            if (text[i] != ',') { continue; }
+            bool res = ms_VMPushStrSlice(vm, &rv, begin, i - begin);
+            assert(res);
+            (void)res;
+            (void)ms_VMPop(vm);
+            begin = i + 1;
+        }
+        slice += BenchTimeNow() - start;
+        ms_VMDestroy(vm);
+
+        start = BenchTimeNow();
+        begin = 0;
+        for (size_t i = 0; i < reclen; i++) {
+            if (text[i] != ',') { continue; }
+            DSBuffer *field = dsbuf_substr(record, begin, i - begin);
+            assert(field);
+            copied += dsbuf_cap(field);
+            dsbuf_destroy(field);
+            begin = i + 1;
+        }
+        copy += BenchTimeNow() - start;
+    }
+
+    const double nfields = (double)(RECORD_FIELDS * RECORD_PASSES);
+    BenchReport("record size", (double)reclen, "bytes");
+    BenchReport("slice per field", (slice / nfields) * 1e9, "ns/field");
+    BenchReport("copy per field", (copy / nfields) * 1e9, "ns/field");
+    BenchReport("bytes copied per record by copying", (double)copied / RECORD_PASSES, "bytes");
+
+    dsbuf_destroy(record);
+    free(text);
+}
+
+/*
+ * UTILITY FUNCTIONS
+ */
+
+/* Create a new VM with a current frame to push values onto. */
+static ms_VM *VMWithFrame(void) {
+    ms_Parser *prs = ms_ParserNew();
+    ms_VM *vm = ms_VMNew();
+    assert(prs && vm);
+
+    const ms_AST *ast;
+    ms_VMByteCode *bc;      /* freed by the VM */
+    ms_Error *err = NULL;
+    if ((!ms_ParserInitString(prs, "var s := \"s\";")) ||
+        (ms_ParserParse(prs, &ast, &err) == MS_RESULT_ERROR) ||
+        (ms_VMByteCodeGenerateFromAST(ast, &bc, &err) == MS_RESULT_ERROR) ||
+        (ms_VMExecute(vm, bc, &err) == MS_RESULT_ERROR)) {
+        fprintf(stderr, "failed to set up VM: %s\n", (err) ? err->msg : "");
+        exit(EXIT_FAILURE);
+    }
+
+    ms_ParserDestroy(prs);
+    return vm;
+}
@@ -0,0 +1,299 @@
+/*****************************************************************************
+ * libds :: alloc.c
+ *
+ * Replaceable, accounted memory allocation for libds and its users.
+ *
+ * Author:  Chris Rink <chrisrink10@gmail.com>
+ *
+ * License: MIT (see LICENSE document at source tree root)
+ *****************************************************************************/
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libds/alloc.h"
+
+/*
+ * Every block is preceded by a tag naming its allocator and size, so frees
+ * and resizes can be routed without help from callers. Blocks from any
+ * allocator but the default are also preceded by a link in their
+ * allocator's list of live blocks, ahead of the tag, and are accounted;
+ * the default allocator keeps no list and no counts, so it costs no more
+ * than the C library and may be used by any number of threads at once.
+ * Both are padded to keep the block aligned for any object.
+ */
+union tag {
+    struct {
+        DSAllocator *owner;
+        size_t size;
+    } t;
+    long double ld;
+    long long ll;
+    void *p;
+};
+
+union link {
+    struct {
+        union tag *prev;
+        union tag *next;
+    } l;
+    long double ld;
+    long long ll;
+    void *p;
+};
+
+static DSAllocator DSALLOC_DEFAULT = { NULL, NULL, 0, NULL, 0, 0, false, NULL };
+static DS_THREAD_LOCAL DSAllocator *DSALLOC_CURRENT = &DSALLOC_DEFAULT;
+
+static inline size_t dsalloc_overhead(const DSAllocator *alloc);
+static inline void *dsalloc_base(const DSAllocator *alloc, union tag *tag);
+static inline bool dsalloc_reserve(DSAllocator *alloc, size_t old, size_t size);
+static inline void *dsalloc_call(DSAllocator *alloc, void *ptr, size_t size);
+static inline void dsalloc_link(DSAllocator *alloc, union tag *tag);
+static inline void dsalloc_unlink(DSAllocator *alloc, union tag *tag);
+
+/*
+ * ALLOCATOR PUBLIC FUNCTIONS
+ */
+
+void dsallocator_init(DSAllocator *alloc, dsalloc_fn fn, void *ctx, size_t limit) {
+    assert(alloc);
+    alloc->fn = fn;
+    alloc->ctx = ctx;
+    alloc->limit = limit;
+    alloc->on_limit = NULL;
+    alloc->used = 0;
+    alloc->peak = 0;
+    alloc->exceeded = false;
+    alloc->blocks = NULL;
+}
+
+void dsallocator_release(DSAllocator *alloc) {
+    assert(alloc);
+
+    union tag *tag = alloc->blocks;
+    while (tag) {
+        union tag *next = ((union link *)tag - 1)->l.next;
+        (void)dsalloc_call(alloc, dsalloc_base(alloc, tag), 0);
+        tag = next;
+    }
+
+    alloc->blocks = NULL;
+    alloc->used = 0;
+}
+
+void dsallocator_merge(DSAllocator *into, DSAllocator *from) {
+    assert(into);
+    assert(from);
+    assert(into != from);
+    assert((into != &DSALLOC_DEFAULT) && (from != &DSALLOC_DEFAULT));
+    assert((into->fn == from->fn) && (into->ctx == from->ctx));
+
+    union tag *tag = from->blocks;
+    while (tag) {
+        union tag *next = ((union link *)tag - 1)->l.next;
+        tag->t.owner = into;
+        dsalloc_link(into, tag);
+        tag = next;
+    }
+
+    into->used += from->used;
+    if (into->used > into->peak) {
+        into->peak = into->used;
+    }
+    from->blocks = NULL;
+    from->used = 0;
+}
+
+bool dsallocator_charge(DSAllocator *alloc, size_t size) {
+    return (!alloc) || (dsalloc_reserve(alloc, 0, size));
+}
+
+void dsallocator_discharge(DSAllocator *alloc, size_t size) {
+    if ((!alloc) || (alloc == &DSALLOC_DEFAULT)) { return; }
+    assert(alloc->used >= size);
+    alloc->used -= size;
+}
+
+DSAllocator *dsallocator_owner(const void *ptr) {
+    assert(ptr);
+    const union tag *tag = (const union tag *)ptr - 1;
+    return (tag->t.owner != &DSALLOC_DEFAULT) ? tag->t.owner : NULL;
+}
+
+DSAllocator *dsallocator_swap(DSAllocator *alloc) {
+    DSAllocator *prev = DSALLOC_CURRENT;
+    DSALLOC_CURRENT = (alloc) ? alloc : &DSALLOC_DEFAULT;
+    return prev;
+}
+
+void *dsalloc(size_t size) {
+    DSAllocator *alloc = DSALLOC_CURRENT;
+    size_t overhead = dsalloc_overhead(alloc);
+    if ((size > SIZE_MAX - overhead) ||
+        (!dsalloc_reserve(alloc, 0, size + overhead))) {
+        return NULL;
+    }
+
+    char *base = dsalloc_call(alloc, NULL, size + overhead);
+    if (!base) {
+        if (alloc != &DSALLOC_DEFAULT) {
+            alloc->used -= size + overhead;
+        }
+        return NULL;
+    }
+
+    union tag *tag = (union tag *)(base + overhead) - 1;
+    tag->t.owner = alloc;
+    tag->t.size = size;
+    dsalloc_link(alloc, tag);
+    return tag + 1;
+}
+
+void *dscalloc(size_t n, size_t size) {
+    if ((size > 0) && (n > SIZE_MAX / size)) {
+        return NULL;
+    }
+
+    void *ptr = dsalloc(n * size);
+    if (ptr) {
+        memset(ptr, 0, n * size);
+    }
+    return ptr;
+}
+
+void *dsrealloc(void *ptr, size_t size) {
+    if (!ptr) {
+        return dsalloc(size);
+    }
+
+    union tag *tag = (union tag *)ptr - 1;
+    DSAllocator *alloc = tag->t.owner;
+    size_t overhead = dsalloc_overhead(alloc);
+    size_t old = tag->t.size + overhead;
+    if ((size > SIZE_MAX - overhead) ||
+        (!dsalloc_reserve(alloc, old, size + overhead))) {
+        return NULL;
+    }
+
+    /* the block may move, so it is relinked afterwards */
+    dsalloc_unlink(alloc, tag);
+    char *base = dsalloc_call(alloc, dsalloc_base(alloc, tag), size + overhead);
+    if (!base) {
+        if (alloc != &DSALLOC_DEFAULT) {
+            alloc->used = alloc->used - (size + overhead) + old;
+        }
+        dsalloc_link(alloc, tag);
+        return NULL;
+    }
+
+    union tag *resized = (union tag *)(base + overhead) - 1;
+    resized->t.size = size;
+    dsalloc_link(alloc, resized);
+    return resized + 1;
+}
+
+void dsfree(void *ptr) {
+    if (!ptr) { return; }
+
+    union tag *tag = (union tag *)ptr - 1;
+    DSAllocator *alloc = tag->t.owner;
+    assert(alloc);
+    if (alloc != &DSALLOC_DEFAULT) {
+        assert(alloc->used >= tag->t.size + dsalloc_overhead(alloc));
+        alloc->used -= tag->t.size + dsalloc_overhead(alloc);
+        dsalloc_unlink(alloc, tag);
+    }
+    (void)dsalloc_call(alloc, dsalloc_base(alloc, tag), 0);
+}
+
+/*
+ * PRIVATE FUNCTIONS
+ */
+
+// Return the number of bytes which precede each block from an allocator.
+static inline size_t dsalloc_overhead(const DSAllocator *alloc) {
+    return (alloc == &DSALLOC_DEFAULT)
+           ? sizeof(union tag)
+           : sizeof(union link) + sizeof(union tag);
+}
+
+// Return the address actually allocated for the block with the given tag.
+static inline void *dsalloc_base(const DSAllocator *alloc, union tag *tag) {
+    return (char *)(tag + 1) - dsalloc_overhead(alloc);
+}
+
+// Account for resizing a block of `old` bytes (0 for a new block) to `size`
+// bytes, refusing the request if it would take the allocator over its limit.
+// The default allocator has no limit and keeps no counts.
+static inline bool dsalloc_reserve(DSAllocator *alloc, size_t old, size_t size) {
+    assert(alloc);
+    if (alloc == &DSALLOC_DEFAULT) {
+        return true;
+    }
+    assert(alloc->used >= old);
+
+    size_t used = alloc->used - old;
+    if ((alloc->limit > 0) && ((used > alloc->limit) || (size > alloc->limit - used))) {
+        alloc->exceeded = true;
+        if (alloc->on_limit) {
+            alloc->on_limit(alloc);
+        }
+        return false;
+    }
+
+    alloc->used = used + size;
+    if (alloc->used > alloc->peak) {
+        alloc->peak = alloc->used;
+    }
+    return true;
+}
+
+// Call the allocation function of an allocator.
+static inline void *dsalloc_call(DSAllocator *alloc, void *ptr, size_t size) {
+    if (alloc->fn) {
+        return alloc->fn(alloc->ctx, ptr, size);
+    }
+
+    if (size == 0) {
+        free(ptr);
+        return NULL;
+    }
+    return realloc(ptr, size);
+}
+
+// Add a block to the front of its allocator's list of live blocks. Blocks
+// from the default allocator are not listed.
+static inline void dsalloc_link(DSAllocator *alloc, union tag *tag) {
+    if (alloc == &DSALLOC_DEFAULT) {
+        return;
+    }
+
+    union link *link = (union link *)tag - 1;
+    link->l.prev = NULL;
+    link->l.next = alloc->blocks;
+    if (link->l.next) {
+        ((union link *)link->l.next - 1)->l.prev = tag;
+    }
+    alloc->blocks = tag;
+}
+
+// Remove a block from its allocator's list of live blocks.
+static inline void dsalloc_unlink(DSAllocator *alloc, union tag *tag) {
+    if (alloc == &DSALLOC_DEFAULT) {
+        return;
+    }
+
+    union link *link = (union link *)tag - 1;
+    if (link->l.prev) {
+        ((union link *)link->l.prev - 1)->l.next = link->l.next;
+    } else {
+        assert(alloc->blocks == tag);
+        alloc->blocks = link->l.next;
+    }
+    if (link->l.next) {
+        ((union link *)link->l.next - 1)->l.prev = link->l.prev;
+    }
+}
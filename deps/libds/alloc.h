@@ -0,0 +1,180 @@
+/**
+ * @file alloc.h
+ *
+ * @brief Replaceable, accounted memory allocation for libds and its users.
+ *
+ * @author Chris Rink <chrisrink10@gmail.com>
+ *
+ * @copyright 2015 Chris Rink. MIT Licensed.
+ */
+
+#ifndef LIBDS_ALLOC_H
+#define LIBDS_ALLOC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+* @brief Allocation function for a @c DSAllocator .
+*
+* If @c ptr is @c NULL , the function should allocate @c size bytes. If
+* @c size is 0, the function should free @c ptr and return @c NULL .
+* Otherwise, it should resize @c ptr to @c size bytes, as @c realloc .
+*/
+typedef void *(*dsalloc_fn)(void *ctx, void *ptr, size_t size);
+
+typedef struct DSAllocator DSAllocator;
+
+/**
+* @brief Storage class of per-thread state, where the compiler supports it.
+*/
+#if defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 201112L) && !defined(__STDC_NO_THREADS__)
+#define DS_THREAD_LOCAL _Thread_local
+#elif defined(__GNUC__)
+#define DS_THREAD_LOCAL __thread
+#else
+#define DS_THREAD_LOCAL
+#endif
+
+/**
+* @brief Function called when a request is refused because it would take
+* a @c DSAllocator over its limit.
+*
+* The function may transfer control elsewhere (e.g. with @c longjmp ) to
+* abandon the operation which made the request; if it returns, the request
+* fails and returns @c NULL .
+*/
+typedef void (*dsalloc_limit_fn)(DSAllocator *alloc);
+
+/**
+* @brief Source of memory for every libds allocation.
+*
+* Each block allocated with @c dsalloc and friends records the allocator
+* which was current when it was allocated, so it is always returned to
+* (and accounted against) that allocator, whichever allocator is current
+* when it is freed. An allocator must therefore outlive every block which
+* was allocated from it.
+*
+* Every allocator keeps a list of its live blocks, so all of them may be
+* released at once by @c dsallocator_release , and counts the bytes they
+* occupy. The default allocator (used where no other is current) does
+* neither: it has no limit, and its blocks carry only the owner and size.
+*
+* Each thread has its own current allocator, so threads may allocate from
+* separate allocators at once. The default allocator is as thread-safe as
+* the C library; any other allocator may only be allocated from (or have
+* blocks freed to it) by one thread at a time.
+*/
+struct DSAllocator {
+    dsalloc_fn fn;                  /** allocation function, or NULL for the C library */
+    void *ctx;                      /** context passed to the allocation function */
+    size_t limit;                   /** maximum bytes live at once, or 0 for no limit */
+    dsalloc_limit_fn on_limit;      /** called when a request exceeds the limit, or NULL */
+    size_t used;                    /** bytes currently live */
+    size_t peak;                    /** most bytes ever live at once */
+    bool exceeded;                  /** true if a request was refused due to the limit */
+    void *blocks;                   /** live blocks allocated from this allocator */
+};
+
+/**
+* @brief Initialize an allocator.
+*
+* @param alloc the @c DSAllocator to initialize
+* @param fn the allocation function, or @c NULL to use the C library
+* @param ctx context passed to @c fn
+* @param limit the maximum number of bytes which may be allocated from
+*        this allocator at once, or 0 for no limit
+*/
+void dsallocator_init(DSAllocator *alloc, dsalloc_fn fn, void *ctx, size_t limit);
+
+/**
+* @brief Free every block still allocated from an allocator.
+*
+* This is intended for abandoning everything allocated by an operation
+* which cannot be unwound normally; any pointer into those blocks is
+* invalid afterwards.
+*
+* @param alloc a @c DSAllocator
+*/
+void dsallocator_release(DSAllocator *alloc);
+
+/**
+* @brief Move every block still allocated from @c from to @c into , so that
+* the blocks outlive @c from .
+*
+* The blocks are charged to @c into , even if that takes it over its limit,
+* and are no longer charged to @c from . Both allocators must use the same
+* allocation function and context.
+*
+* @param into a @c DSAllocator other than the default allocator
+* @param from a @c DSAllocator , which is left holding no blocks
+*/
+void dsallocator_merge(DSAllocator *into, DSAllocator *from);
+
+/**
+* @brief Charge @c size bytes to an allocator without allocating them, as
+* though a block of that size had been allocated from it.
+*
+* This accounts for memory which is held on behalf of the allocator's user
+* but lives elsewhere (such as a string shared with other users). The
+* charge is refused like any request which would exceed the limit, and is
+* cleared by @c dsallocator_release along with every block.
+*
+* @param alloc a @c DSAllocator , or @c NULL for the default allocator
+*        (which keeps no counts, so the charge always succeeds)
+* @param size the number of bytes to charge
+* @returns true if the bytes were charged; false if the limit would be
+*          exceeded (after calling the limit handler, if it returns)
+*/
+bool dsallocator_charge(DSAllocator *alloc, size_t size);
+
+/**
+* @brief Return @c size bytes charged by @c dsallocator_charge .
+*/
+void dsallocator_discharge(DSAllocator *alloc, size_t size);
+
+/**
+* @brief Return the allocator which a block was allocated from.
+*
+* @param ptr a block allocated by @c dsalloc
+* @returns the block's @c DSAllocator , or @c NULL for the default allocator
+*/
+DSAllocator *dsallocator_owner(const void *ptr);
+
+/**
+* @brief Make @c alloc the current allocator of the calling thread.
+*
+* @param alloc a @c DSAllocator or @c NULL for the default allocator
+* @returns the previously current allocator, which should be passed back
+*          to this function to restore it
+*/
+DSAllocator *dsallocator_swap(DSAllocator *alloc);
+
+/**
+* @brief Allocate @c size bytes from the current allocator, as @c malloc .
+*
+* @returns a pointer to the new block or @c NULL if the memory could not
+*          be allocated or the allocator's limit would be exceeded
+*/
+void *dsalloc(size_t size);
+
+/**
+* @brief Allocate @c n zeroed objects of @c size bytes from the current
+* allocator, as @c calloc .
+*/
+void *dscalloc(size_t n, size_t size);
+
+/**
+* @brief Resize a block allocated by @c dsalloc , as @c realloc .
+*
+* The block stays with the allocator it was first allocated from. If @c ptr
+* is @c NULL , this is equivalent to @c dsalloc .
+*/
+void *dsrealloc(void *ptr, size_t size);
+
+/**
+* @brief Free a block allocated by @c dsalloc , as @c free .
+*/
+void dsfree(void *ptr);
+
+#endif //LIBDS_ALLOC_H
@@ -11,15 +11,18 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
+#include "libds/alloc.h"
 #include "libds/array.h"
 #include "iterpriv.h"
 
 struct DSArray {
-    void **data;
+    void **data;                    /* elements; points to local until the array grows */
     size_t len;
     size_t cap;
     dsarray_compare_fn cmp;
     dsarray_free_fn free;
+    void *local[];                  /* inline elements, if created with a small capacity */
 };
 
 static bool dsarray_resize(DSArray *array, size_t cap);
@@ -35,15 +38,23 @@ DSArray* dsarray_new(dsarray_compare_fn cmpfn, dsarray_free_fn freefn) {
 
 DSArray* dsarray_new_cap(size_t cap, dsarray_compare_fn cmpfn, dsarray_free_fn freefn) {
     assert(cap > 0);
-    DSArray *array = malloc(sizeof(DSArray));
+
+    // Small arrays keep their elements in the same allocation as the header
+    size_t nlocal = (cap <= DSARRAY_INLINE_MAX_CAPACITY) ? cap : 0;
+    DSArray *array = dsalloc(sizeof(DSArray) + (nlocal * sizeof(void *)));
     if (!array) {
         return NULL;
     }
 
-    array->data = calloc(cap, sizeof(void *));
-    if (!array->data) {
-        free(array);
-        return NULL;
+    if (nlocal > 0) {
+        array->data = array->local;
+        memset(array->local, 0, nlocal * sizeof(void *));
+    } else {
+        array->data = dscalloc(cap, sizeof(void *));
+        if (!array->data) {
+            dsfree(array);
+            return NULL;
+        }
     }
 
     array->len = 0;
@@ -61,7 +72,7 @@ DSArray *dsarray_new_lit(void **list, size_t len, size_t cap, dsarray_compare_fn
         return NULL;
     }
 
-    for (size_t i = 0; i < cap; i++) {
+    for (size_t i = 0; i < len; i++) {
         array->data[i] = list[i];
         array->len++;
     }
@@ -72,8 +83,10 @@ DSArray *dsarray_new_lit(void **list, size_t len, size_t cap, dsarray_compare_fn
 void dsarray_destroy(DSArray *array) {
     if (!array) { return; }
     dsarray_free(array);
-    free(array->data);
-    free(array);
+    if (array->data != array->local) {
+        dsfree(array->data);
+    }
+    dsfree(array);
 }
 
 size_t dsarray_len(const DSArray *array) {
@@ -88,7 +101,7 @@ size_t dsarray_cap(const DSArray *array) {
 
 void* dsarray_get(const DSArray *array, size_t index) {
     if (!array) { return NULL; }
-    if (index > array->len) { return NULL; }
+    if (index >= array->len) { return NULL; }
     return array->data[index];
 }
 
@@ -167,12 +180,12 @@ void* dsarray_remove_index(DSArray *array, size_t index) {
 
     void* cache = array->data[index];
 
-    for (size_t i = index; i < array->len; i++) {
+    for (size_t i = index; i < array->len - 1; i++) {
         array->data[i] = array->data[i+1];
     }
 
-    array->data[array->len] = NULL;
     array->len--;
+    array->data[array->len] = NULL;
     return cache;
 }
 
@@ -232,7 +245,7 @@ void dsarray_reverse(DSArray *array) {
 DSIter* dsarray_iter(DSArray *array) {
     if (!array) { return NULL; }
 
-    DSIter *iter = dsiter_priv_new(ITER_ARRAY, array);
+    DSIter *iter = dsiter_priv_new(DSITER_ARRAY, array, NULL);
     if (!iter) {
         return NULL;
     }
@@ -253,7 +266,7 @@ static bool dsarray_resize(DSArray *array, size_t cap) {
     }
 
     void **cache = array->data;
-    array->data = calloc(cap, sizeof(void *));
+    array->data = dscalloc(cap, sizeof(void *));
     if (!array->data) {
         array->data = cache;
         return false;
@@ -263,7 +276,10 @@ static bool dsarray_resize(DSArray *array, size_t cap) {
         array->data[i] = cache[i];
     }
 
-    free(cache);
+    // Inline elements are freed with the header
+    if (cache != array->local) {
+        dsfree(cache);
+    }
     array->cap = cap;
     return true;
 }
@@ -284,7 +300,7 @@ static void dsarray_free(DSArray *array) {
 // Iterate on the next array entry.
 bool dsiter_dsarray_next(DSIter *iter, bool advance) {
     assert(iter);
-    assert(iter->type == ITER_ARRAY);
+    assert(iter->type == DSITER_ARRAY);
 
     if (DSITER_IS_FINISHED(iter)) {
         return false;
@@ -20,6 +20,10 @@
 *
 * DSArray objects are typically resized by @c DSARRAY_CAPACITY_FACTOR
 * whenever a resize is necessary using the API.
+*
+* Arrays created with a capacity of at most @c DSARRAY_INLINE_MAX_CAPACITY
+* store their elements in the same allocation as the array itself, and
+* only allocate separate storage for their elements if they outgrow it.
 */
 typedef struct DSArray DSArray;
 
@@ -33,6 +37,12 @@ static const size_t DSARRAY_DEFAULT_CAPACITY = 10;
 */
 static const size_t DSARRAY_CAPACITY_FACTOR = 2;
 
+/**
+* @brief The largest starting capacity for which a @c DSArray stores its
+* elements inline, rather than in a separate allocation.
+*/
+static const size_t DSARRAY_INLINE_MAX_CAPACITY = 16;
+
 /**
 * @brief Comparator function used in a @c DSArray to sort and search.
 */
@@ -291,4 +301,22 @@ void dsarray_reverse(DSArray *array);
 */
 DSIter* dsarray_iter(DSArray *array);
 
+/**
+* @brief Initializer for a @c DSIter over a @c DSArray which does not
+* allocate and need not be destroyed.
+*
+* @code
+* DSIter iter = DSARRAY_ITER_INIT(array);
+* while (dsiter_next(&iter)) { ... }
+* @endcode
+*/
+#define DSARRAY_ITER_INIT(a) DSITER_INIT(DSITER_ARRAY, array, (a))
+
+/**
+* @brief Iterate over every element of a @c DSArray with a stack iterator
+* named @c iter, which is only in scope within the loop body.
+*/
+#define DSARRAY_FOREACH(a, iter) \
+    for (DSIter iter = DSARRAY_ITER_INIT(a); dsiter_next(&iter); )
+
 #endif //LIBDS_ARRAY_H
@@ -14,6 +14,7 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
+#include "libds/alloc.h"
 #include "libds/buffer.h"
 #include "libds/hash.h"
 
@@ -40,14 +41,14 @@ DSBuffer *dsbuf_new_l(const char *value, size_t len) {
         return NULL;
     }
 
-    DSBuffer *s = malloc(sizeof(DSBuffer));
+    DSBuffer *s = dsalloc(sizeof(DSBuffer));
     if (!s) {
         return NULL;
     }
 
     s->len = len;
     s->cap = len * DSBUFFER_CAPACITY_FACTOR;
-    s->str = malloc(s->cap);
+    s->str = dsalloc(s->cap);
     if (!s->str) {
         goto cleanup_dsbuf;
     }
@@ -57,49 +58,49 @@ DSBuffer *dsbuf_new_l(const char *value, size_t len) {
     return s;
 
 cleanup_dsbuf:
-    free(s);
+    dsfree(s);
     return NULL;
 }
 
 DSBuffer *dsbuf_new_buffer(size_t cap) {
     cap = (cap < DSBUFFER_MINIMUM_CAPACITY) ? DSBUFFER_MINIMUM_CAPACITY : cap;
 
-    DSBuffer *s = malloc(sizeof(DSBuffer));
+    DSBuffer *s = dsalloc(sizeof(DSBuffer));
     if (!s) {
         return NULL;
     }
 
     s->len = 0;
     s->cap = cap;
-    s->str = calloc(s->cap, 1);
+    s->str = dscalloc(s->cap, 1);
     if (!s->str) {
         goto cleanup_dsbuf_buffer;
     }
     return s;
 
 cleanup_dsbuf_buffer:
-    free(s);
+    dsfree(s);
     return NULL;
 }
 
 void dsbuf_destroy(DSBuffer *str) {
     if (!str) { return; }
-    free(str->str);
+    dsfree(str->str);
     str->str = NULL;
-    free(str);
+    dsfree(str);
 }
 
 DSBuffer *dsbuf_dup(const DSBuffer *str) {
     if (!str) { return NULL; }
 
-    DSBuffer *s = malloc(sizeof(DSBuffer));
+    DSBuffer *s = dsalloc(sizeof(DSBuffer));
     if (!s) {
         return NULL;
     }
 
     s->len = str->len;
     s->cap = str->cap;
-    s->str = calloc(s->cap, 1);
+    s->str = dscalloc(s->cap, 1);
     if (!s->str) {
         goto cleanup_dsbuf_dup;
     }
@@ -108,7 +109,7 @@ DSBuffer *dsbuf_dup(const DSBuffer *str) {
     return s;
 
 cleanup_dsbuf_dup:
-    free(s);
+    dsfree(s);
     return NULL;
 }
 
@@ -235,19 +236,19 @@ char *dsbuf_to_char_array(const DSBuffer *str) {
     }
 
     size_t m = (str->len) + 1;
-    char* cpy = malloc(m);
+    char* cpy = dsalloc(m);
     if (!cpy) {
         return NULL;
     }
 
     memcpy(cpy, str->str, str->len);
-    str->str[str->len] = '\0';
+    cpy[str->len] = '\0';
     return cpy;
 }
 
 unsigned int dsbuf_hash(const DSBuffer *str) {
     if (!str) { return 0; }
-    return (unsigned int) hash_fnv1(str->str);
+    return (unsigned int) hash_bytes(str->str, str->len);
 }
 
 int dsbuf_compare(const DSBuffer *left, const DSBuffer *right) {
@@ -306,7 +307,7 @@ static bool dsbuf_resize(DSBuffer *str, size_t size) {
     }
 
     char* cache = str->str; // Cache a pointer to the old string
-    str->str = malloc(size);
+    str->str = dsalloc(size);
     if (!str->str) {
         str->str = cache;   // Point the old pointer back to the cached value
         return false;
@@ -314,7 +315,7 @@ static bool dsbuf_resize(DSBuffer *str, size_t size) {
 
     str->cap = size;
     memcpy(str->str, cache, str->len);
-    free(cache);
+    dsfree(cache);
     return true;
 }
 
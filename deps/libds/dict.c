@@ -9,82 +9,124 @@
  *****************************************************************************/
 
 #include <assert.h>
-#include <math.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
+#include "libds/alloc.h"
+#include "libds/pool.h"
 #include "dictpriv.h"
 #include "iterpriv.h"
 
-static const double DSDICT_DEFAULT_LOAD = 0.66;
-static const size_t DSDICT_DEFAULT_CAP = 64;
-static const size_t DSDICT_DEFAULT_CAPACITY_FACTOR = 2;
+#if defined(__SSE2__) && !defined(DSDICT_NO_SIMD)
+#include <emmintrin.h>
+#define DSDICT_USE_SSE2
+#endif
 
 /*
- * Prime moduli for hash table capacity
- * - Array index is power of 2 (i.e. index 1 is 2^1 = 2)
- * - Value at index is modulus to use for capacity at indexed power of 2
- * - Powers of 2 given at: https://primes.utm.edu/lists/2small/0bit.html
+ * Open addressing with one control byte per slot
+ * - Slots are probed a group of DSDICT_GROUP_WIDTH at a time, comparing
+ *   every control byte in the group at once (with SSE2 if available)
+ * - Full slots hold the top 7 bits of their key's hash (0 through 127)
+ * - Groups are visited in triangular order, which reaches every group
+ *   of a power of two sized table exactly once
+ * - Tables smaller than one group are padded with sentinel bytes, which
+ *   are neither full nor free
+ *
+ * Large tables are resized incrementally
+ * - The old table is kept alongside the new one and each put or delete
+ *   migrates the next DSDICT_MIGRATE_STEP old slots into the new table
+ * - Lookups check the new table and then the old one until the last old
+ *   slot has been migrated
+ * - Migrated old slots are marked deleted, so probes into the old table
+ *   and scans over it see only entries which have not yet moved
  */
-#define POW2(n, k) ((1 << n) - k)
-static const size_t DSDICT_MOD_TABLE[] = {
-        1, 2, 3, 7, 13, 31, 61, 127, 251,                           /* Powers 0 through 8 */
-        POW2(9, 3), POW2(10, 3), POW2(11, 9), POW2(12, 3),          /* Powers 9 through 12 */
-        POW2(13, 1), POW2(14, 3), POW2(15, 19), POW2(16, 15),       /* Powers 13 through 16 */
-        POW2(17, 1), POW2(18, 5), POW2(19, 1), POW2(20, 3),         /* Powers 17 through 20 */
-        POW2(21, 9), POW2(22, 3), POW2(23, 15), POW2(24, 3),        /* Powers 21 through 24 */
-        POW2(25, 39), POW2(26, 5), POW2(27, 39), POW2(28, 57),      /* Powers 25 through 28 */
-        POW2(29, 3), POW2(30, 35), INT32_MAX,                       /* Powers 29 through 31 */
-};
+#define DSDICT_GROUP_WIDTH 16
+#define DSDICT_CTRL_EMPTY ((int8_t)-128)
+#define DSDICT_CTRL_DELETED ((int8_t)-2)
+#define DSDICT_CTRL_SENTINEL ((int8_t)-1)
+
+static const size_t DSDICT_MIN_CAP = 8;
+static const size_t DSDICT_CAPACITY_FACTOR = 2;
+static const size_t DSDICT_INCREMENTAL_MIN_CAP = 1024;
+static const size_t DSDICT_MIGRATE_STEP = 16;
 
 struct DSDict {
-    struct bucket **vals;
+    int8_t *ctrl;                   /* control bytes, followed by the slots */
+    struct bucket *slots;
     size_t cnt;
     size_t cap;
+    size_t growth;                  /* empty slots which may be filled before a rehash */
+    int8_t *oldctrl;                /* table being migrated, or NULL */
+    struct bucket *oldslots;
+    size_t oldcap;
+    size_t migrated;                /* old slots already migrated */
     dsdict_hash_fn hash;
     dsdict_free_fn keyfree;
     dsdict_free_fn valfree;
     dsdict_compare_fn cmp;
+    DSPool *pool;
 };
 
-static bool dsdict_resize(DSDict *dict, size_t newcap);
-static bool transfer_vals(struct bucket **old, size_t oldcap, struct bucket **new, size_t newcap, dsdict_hash_fn hashfn);
+typedef uint32_t groupmask;
+
+static struct bucket *dsdict_find(const DSDict *dict, void *key, uint32_t hash);
+static struct bucket *dsdict_slot(const DSDict *dict, size_t i);
+static bool dsdict_rehash(DSDict *dict, size_t newcap);
+static void dsdict_migrate(DSDict *dict, size_t nslots);
 static void dsdict_free(DSDict *dict);
-static inline size_t compute_index(uint32_t hash, size_t cap);
+static struct bucket *table_find(const DSDict *dict, const int8_t *ctrl, struct bucket *slots,
+                                 size_t cap, void *key, uint32_t hash);
+static size_t table_find_free(const int8_t *ctrl, size_t cap, uint32_t hash);
+static inline size_t table_ctrl_len(size_t cap);
+static inline size_t table_size(size_t cap);
+static inline size_t table_max_load(size_t cap);
+static inline int8_t hash_h2(uint32_t hash);
+static inline groupmask group_match(const int8_t *ctrl, int8_t h2);
+static inline groupmask group_match_empty(const int8_t *ctrl);
+static inline groupmask group_match_free(const int8_t *ctrl);
+static inline unsigned int groupmask_first(groupmask mask);
 
 /*
  * DICTIONARY PUBLIC FUNCTIONS
  */
 
 DSDict *dsdict_new(dsdict_hash_fn hash, dsdict_compare_fn cmpfn, dsdict_free_fn keyfree, dsdict_free_fn valfree) {
+    return dsdict_new_pool(hash, cmpfn, keyfree, valfree, NULL);
+}
+
+DSDict *dsdict_new_pool(dsdict_hash_fn hash, dsdict_compare_fn cmpfn, dsdict_free_fn keyfree, dsdict_free_fn valfree, DSPool *pool) {
     if ((!hash) || (!cmpfn)) { return NULL; }
 
-    DSDict *dict = malloc(sizeof(DSDict));
+    DSDict *dict = dspool_alloc(pool, sizeof(DSDict));
     if (!dict) {
         return NULL;
     }
 
-    size_t cap = DSDICT_DEFAULT_CAP;
-    dict->vals = calloc(cap, sizeof(struct bucket));
-    if (!dict->vals) {
-        free(dict);
-        return NULL;
-    }
-
+    // The table is allocated by the first put, so empty scopes are cheap
+    dict->ctrl = NULL;
+    dict->slots = NULL;
     dict->cnt = 0;
-    dict->cap = DSDICT_DEFAULT_CAP;
+    dict->cap = 0;
+    dict->growth = 0;
+    dict->oldctrl = NULL;
+    dict->oldslots = NULL;
+    dict->oldcap = 0;
+    dict->migrated = 0;
     dict->hash = hash;
     dict->keyfree = keyfree;
     dict->valfree = valfree;
     dict->cmp = cmpfn;
+    dict->pool = pool;
     return dict;
 }
 
 void dsdict_destroy(DSDict *dict) {
     if (!dict) { return; }
     dsdict_free(dict);
-    free(dict->vals);
-    free(dict);
+    dspool_free(dict->pool, dict->oldctrl, table_size(dict->oldcap));
+    dspool_free(dict->pool, dict->ctrl, table_size(dict->cap));
+    dspool_free(dict->pool, dict, sizeof(DSDict));
 }
 
 size_t dsdict_count(const DSDict *dict) {
@@ -100,138 +142,101 @@ size_t dsdict_cap(const DSDict *dict) {
 void dsdict_foreach(DSDict *dict, dsdict_foreach_fn func) {
     if ((!dict) || (!func)) { return; }
 
-    for (size_t i = 0; i < dict->cnt; i++) {
-        if (!dict->vals[i]) { continue; }
-        func(dict->vals[i]->key, dict->vals[i]->data);
-
-        struct bucket *next = dict->vals[i]->next;
-        while ((next)){
-            func(next->key, next->data);
-            next = next->next;
-        }
+    for (size_t i = 0; i < dict->cap + dict->oldcap; i++) {
+        struct bucket *cur = dsdict_slot(dict, i);
+        if (!cur) { continue; }
+        func(cur->key, cur->data);
     }
 }
 
 void dsdict_put(DSDict *dict, void *key, void *val) {
     if ((!dict) || (!key)) { return; }
 
-    unsigned int hash = dict->hash(key);
-    size_t place = compute_index(hash, dict->cap);
-
-    // Get reference to place and see if there is data there;
-    // if not, just set the data
-    struct bucket *cur = dict->vals[place];
-    if (!cur) {
-        dict->vals[place] = malloc(sizeof(struct bucket));
-        if (!dict->vals[place]) { return; }
-        cur = dict->vals[place];
-        goto dsdict_put_op;
-    }
+    uint32_t hash = dict->hash(key);
+    dsdict_migrate(dict, DSDICT_MIGRATE_STEP);
 
-    // If there was data, check if it's the same value;
-    // if so, we can overwrite it and we're done
-    if ((cur->hash == hash) && (dict->cmp(cur->key, key) == 0)) {
+    // If the key is already present, we can overwrite it and we're done
+    struct bucket *cur = dsdict_find(dict, key, hash);
+    if (cur) {
         if (dict->valfree) { dict->valfree(cur->data); }
         cur->data = val;
-        goto cleanup_dsdict_put;
+        return;
     }
 
-    // Otherwise traverse linked list and check if we can
-    // overwrite any connected nodes
-    struct bucket *prev = cur;
-    cur = cur->next;
-    while ((cur)) {
-        prev = cur;
-        if ((cur->hash == hash) && (dict->cmp(cur->key, key) == 0)) {
-            if (dict->valfree) { dict->valfree(cur->data); }
-            cur->data = val;
-            goto cleanup_dsdict_put;
+    // Reusing a deleted slot never requires a rehash; filling an empty one
+    // may, either to grow or just to clear out deleted slots
+    size_t place = (dict->cap > 0) ? table_find_free(dict->ctrl, dict->cap, hash) : 0;
+    if ((dict->cap == 0) ||
+        ((dict->ctrl[place] == DSDICT_CTRL_EMPTY) && (dict->growth == 0))) {
+        // A migration normally completes long before the new table fills,
+        // but one still in progress must finish before the next begins
+        dsdict_migrate(dict, dict->oldcap);
+        size_t newcap = DSDICT_MIN_CAP;
+        if (dict->cap > 0) {
+            newcap = ((dict->cnt + 1) > (table_max_load(dict->cap) / 2)) ?
+                     dict->cap * DSDICT_CAPACITY_FACTOR :
+                     dict->cap;
         }
-        cur = cur->next;
+        if (!dsdict_rehash(dict, newcap)) { return; }
+        place = table_find_free(dict->ctrl, dict->cap, hash);
     }
 
-    // If we made it this far, we need to add a new node at cur
-    prev->next = malloc(sizeof(struct bucket));
-    cur = prev->next;
-
-    // Actually perform the titular "put"
-dsdict_put_op:
-    if (!cur) { return; }
+    if (dict->ctrl[place] == DSDICT_CTRL_EMPTY) {
+        dict->growth--;
+    }
 
+    dict->ctrl[place] = hash_h2(hash);
+    cur = &dict->slots[place];
     cur->hash = hash;
     cur->key = key;
     cur->data = val;
-    cur->next = NULL;
     dict->cnt++;
-
-    // Clean up and decide if we need to resize no
-cleanup_dsdict_put: {
-        double load = ((double)dict->cnt / dict->cap);
-        if (load >= DSDICT_DEFAULT_LOAD) {
-            dsdict_resize(dict, dict->cap * DSDICT_DEFAULT_CAPACITY_FACTOR);
-        }
-    }
-    return;
 }
 
 void *dsdict_get(const DSDict *dict, void *key) {
     if ((!dict) || (!key)) { return NULL; }
 
-    unsigned int hash = dict->hash(key);
-    size_t place = compute_index(hash, dict->cap);
-
-    struct bucket *cur = dict->vals[place];
-    if (!cur) { return NULL; }
-    if ((cur->hash == hash) && (dict->cmp(cur->key, key) == 0)) {
-        return cur->data;
-    }
-
-    cur = cur->next;
-    while ((cur)) {
-        if ((cur->hash == hash) && (dict->cmp(cur->key, key) == 0)) {
-            return cur->data;
-        }
-        cur = cur->next;
-    }
-
-    return NULL;
+    struct bucket *cur = dsdict_find(dict, key, dict->hash(key));
+    return (cur) ? cur->data : NULL;
 }
 
 void *dsdict_del(DSDict *dict, void *key) {
     if ((!dict) || (!key)) { return NULL; }
 
-    unsigned int hash = dict->hash(key);
-    size_t place = compute_index(hash, dict->cap);
+    uint32_t hash = dict->hash(key);
+    dsdict_migrate(dict, DSDICT_MIGRATE_STEP);
 
-    struct bucket *cur = dict->vals[place];
+    struct bucket *cur = dsdict_find(dict, key, hash);
     if (!cur) { return NULL; }
-    if ((cur->hash == hash) && (dict->cmp(cur->key, key) == 0)) {
-        void *cache = cur->data;
-        dict->vals[place] = cur->next;
-        free(cur);
+
+    // Entries which have not been migrated yet are simply marked deleted,
+    // since the old table only shrinks until it is freed
+    if ((cur >= dict->oldslots) && (cur < dict->oldslots + dict->oldcap)) {
+        dict->oldctrl[cur - dict->oldslots] = DSDICT_CTRL_DELETED;
         dict->cnt--;
-        return cache;
+        return cur->data;
     }
 
-    cur = cur->next;
-    while ((cur)) {
-        if ((cur->hash == hash) && (dict->cmp(cur->key, key) == 0)) {
-            void *cache = cur->data;
-            dict->vals[place] = cur->next;
-            free(cur);
-            dict->cnt--;
-            return cache;
-        }
-        cur = cur->next;
+    // A group which still has an empty slot has never been full, so no
+    // probe has ever passed over it and the slot may be emptied outright;
+    // otherwise it must be marked deleted so probes continue past it
+    size_t place = (size_t)(cur - dict->slots);
+    const int8_t *group = &dict->ctrl[place - (place % DSDICT_GROUP_WIDTH)];
+    if (group_match_empty(group)) {
+        dict->ctrl[place] = DSDICT_CTRL_EMPTY;
+        dict->growth++;
+    } else {
+        dict->ctrl[place] = DSDICT_CTRL_DELETED;
     }
 
-    return NULL;
+    dict->cnt--;
+    return cur->data;
 }
 
 DSIter* dsdict_iter(DSDict *dict) {
     if (!dict) { return NULL; }
 
-    DSIter *iter = dsiter_priv_new(ITER_DICT, dict);
+    DSIter *iter = dsiter_priv_new(DSITER_DICT, dict, dict->pool);
     if (!iter) {
         return NULL;
     }
@@ -243,169 +248,261 @@ DSIter* dsdict_iter(DSDict *dict) {
  * PRIVATE FUNCTIONS
  */
 
-// Resize a DSDict upwards
-static bool dsdict_resize(DSDict *dict, size_t newcap) {
+// Find the slot holding the given key, if any.
+static struct bucket *dsdict_find(const DSDict *dict, void *key, uint32_t hash) {
     assert(dict);
 
-    if ((newcap < 1) || (dict->cap >= newcap)) {
-        return false;
+    struct bucket *cur = table_find(dict, dict->ctrl, dict->slots, dict->cap, key, hash);
+    if ((!cur) && (dict->oldctrl)) {
+        cur = table_find(dict, dict->oldctrl, dict->oldslots, dict->oldcap, key, hash);
     }
+    return cur;
+}
 
-    // Make a new bucket and cache the old values so we can transfer them
-    struct bucket **cache = dict->vals;
-    dict->vals = calloc(newcap, sizeof(struct bucket));
-    if (!dict->vals) {
-        dict->vals = cache;
-        return false;
+// Return the full slot at the given position, counting the slots of the
+// current table followed by those of any table being migrated, or NULL if
+// the slot at that position is not full.
+static struct bucket *dsdict_slot(const DSDict *dict, size_t i) {
+    assert(dict);
+    assert(i < dict->cap + dict->oldcap);
+
+    if (i < dict->cap) {
+        return (dict->ctrl[i] >= 0) ? &dict->slots[i] : NULL;
     }
+    i -= dict->cap;
+    return (dict->oldctrl[i] >= 0) ? &dict->oldslots[i] : NULL;
+}
+
+// Move every entry into a new table of the given capacity. Small tables
+// are migrated at once, larger ones a few slots at a time by later puts
+// and deletes.
+static bool dsdict_rehash(DSDict *dict, size_t newcap) {
+    assert(dict);
+    assert(!dict->oldctrl);
+    assert(newcap >= DSDICT_MIN_CAP);
+    assert(table_max_load(newcap) > dict->cnt);
 
-    // Transfer all of the old values into the new buckets
-    size_t oldcap = dict->cap;
-    if (!transfer_vals(cache, oldcap, dict->vals, newcap, dict->hash)) {
-        free(dict->vals);
-        dict->vals = cache;
+    int8_t *ctrl = dspool_alloc(dict->pool, table_size(newcap));
+    if (!ctrl) {
         return false;
     }
+
+    size_t ctrllen = table_ctrl_len(newcap);
+    memset(ctrl, DSDICT_CTRL_EMPTY, newcap);
+    memset(ctrl + newcap, DSDICT_CTRL_SENTINEL, ctrllen - newcap);
+
+    // Entries still to be migrated are counted against the new table now,
+    // so migrating them never requires another rehash
+    dict->oldctrl = dict->ctrl;
+    dict->oldslots = dict->slots;
+    dict->oldcap = dict->cap;
+    dict->migrated = 0;
+    dict->ctrl = ctrl;
+    dict->slots = (struct bucket *)(ctrl + ctrllen);
     dict->cap = newcap;
+    dict->growth = table_max_load(newcap) - dict->cnt;
 
-    // Free the cached buckets, but do not free key/value pairs
-    free(cache);
+    dsdict_migrate(dict, (dict->oldcap < DSDICT_INCREMENTAL_MIN_CAP) ? dict->oldcap : DSDICT_MIGRATE_STEP);
     return true;
 }
 
-// Given a hash value and a capacity, compute the place of the element in the array.
-static inline size_t compute_index(uint32_t hash, size_t cap) {
-    double powerf = floor(log2((double)cap));
-    assert(powerf >= 0);
-    size_t power = (size_t)powerf;
-    size_t mod = (power <= 31) ? DSDICT_MOD_TABLE[power] : (size_t)cap;
-    return (hash % mod);
+// Migrate up to the given number of slots from the table being migrated,
+// freeing it once every slot has been migrated.
+static void dsdict_migrate(DSDict *dict, size_t nslots) {
+    assert(dict);
+    if (!dict->oldctrl) { return; }
+
+    // No keys need comparing, since every entry is already unique
+    size_t end = (nslots < dict->oldcap - dict->migrated) ? dict->migrated + nslots : dict->oldcap;
+    for (size_t i = dict->migrated; i < end; i++) {
+        if (dict->oldctrl[i] < 0) { continue; }
+        size_t place = table_find_free(dict->ctrl, dict->cap, dict->oldslots[i].hash);
+        dict->ctrl[place] = dict->oldctrl[i];
+        dict->slots[place] = dict->oldslots[i];
+        dict->oldctrl[i] = DSDICT_CTRL_DELETED;
+    }
+    dict->migrated = end;
+
+    if (dict->migrated == dict->oldcap) {
+        dspool_free(dict->pool, dict->oldctrl, table_size(dict->oldcap));
+        dict->oldctrl = NULL;
+        dict->oldslots = NULL;
+        dict->oldcap = 0;
+        dict->migrated = 0;
+    }
 }
 
-// Transfer values from the old DSDict bucket cache to the new bucket
-static bool transfer_vals(struct bucket **old, size_t oldcap, struct bucket **new, size_t newcap, dsdict_hash_fn hashfn) {
-    assert(old);
-    assert(new);
-    assert(hashfn);
-
-    // Iterate on every element of the old bucket
-    for (size_t i = 0; i < oldcap; i++) {
-        // Iterate on every hash table element in the old dictionary
-        struct bucket *curold = old[i];
-        while (curold) {
-            // Compute the new placement for the current element
-            size_t place = compute_index(curold->hash, newcap);
-
-            // Get reference to place and see if there is data there;
-            // if so, we need to traverse the linked list to get the last
-            // element and insert the hash table into that
-            struct bucket *curnew = new[place];
-            if (curnew) {
-                struct bucket *prev = curnew;
-                while ((curnew)) {
-                    prev = curnew;
-                    curnew = curnew->next;
-                }
-                prev->next = curold;
-                curold = prev->next->next;
-                prev->next->next = NULL;
-            } else {
-                // Transfer the old element to the new slot
-                new[place] = curold;
-                curold = new[place]->next;
-                new[place]->next = NULL;
-            }
-        }
+// Free all of the keys and values in a DSDict if free functions were given.
+static void dsdict_free(DSDict *dict) {
+    assert(dict);
+    if ((!dict->keyfree) && (!dict->valfree)) { return; }
 
-        old[i] = NULL;
+    for (size_t i = 0; i < dict->cap + dict->oldcap; i++) {
+        struct bucket *cur = dsdict_slot(dict, i);
+        if (!cur) { continue; }
+        if (dict->keyfree) {
+            dict->keyfree(cur->key);
+        }
+        if (dict->valfree) {
+            dict->valfree(cur->data);
+        }
     }
-
-    return true;
 }
 
-// Free all of the value pointers in a DSDict if a free function was given.
-static void dsdict_free(DSDict *dict) {
+// Find the slot holding the given key in one table, if any.
+static struct bucket *table_find(const DSDict *dict, const int8_t *ctrl, struct bucket *slots,
+                                 size_t cap, void *key, uint32_t hash) {
     assert(dict);
-    bool free_keys = (dict->keyfree) ? true : false;
-    bool free_vals = (dict->valfree) ? true : false;
+    if (cap == 0) { return NULL; }
+
+    size_t gmask = (table_ctrl_len(cap) / DSDICT_GROUP_WIDTH) - 1;
+    size_t group = hash & gmask;
+    int8_t h2 = hash_h2(hash);
+
+    for (size_t step = 1; ; step++) {
+        assert(step <= gmask + 1);
+        const int8_t *gctrl = &ctrl[group * DSDICT_GROUP_WIDTH];
 
-    for (size_t i = 0; i < dict->cap; i++) {
-        if (!dict->vals[i]) { continue; }
-        if (free_keys) {
-            dict->keyfree(dict->vals[i]->key);
+        groupmask match = group_match(gctrl, h2);
+        while (match) {
+            struct bucket *cur = &slots[(group * DSDICT_GROUP_WIDTH) + groupmask_first(match)];
+            if ((cur->hash == hash) && (dict->cmp(cur->key, key) == 0)) {
+                return cur;
+            }
+            match &= match - 1;
         }
-        if (free_vals) {
-            dict->valfree(dict->vals[i]->data);
+
+        // Keys are always placed in the first group with a free slot, so
+        // an empty slot here means the key cannot be in any later group
+        if (group_match_empty(gctrl)) {
+            return NULL;
         }
+        group = (group + step) & gmask;
+    }
+}
 
-        struct bucket *cur = NULL;
-        struct bucket *next = dict->vals[i]->next;
-        while ((next)){
-            if (free_keys) {
-                dict->keyfree(next->key);
-            }
-            if (free_vals) {
-                dict->valfree(next->data);
-            }
-            cur = next;
-            next = next->next;
-            free(cur);
+// Find the first empty or deleted slot along the probe sequence of a hash.
+static size_t table_find_free(const int8_t *ctrl, size_t cap, uint32_t hash) {
+    assert(ctrl);
+
+    size_t gmask = (table_ctrl_len(cap) / DSDICT_GROUP_WIDTH) - 1;
+    size_t group = hash & gmask;
+
+    for (size_t step = 1; ; step++) {
+        assert(step <= gmask + 1);
+        groupmask free = group_match_free(&ctrl[group * DSDICT_GROUP_WIDTH]);
+        if (free) {
+            return (group * DSDICT_GROUP_WIDTH) + groupmask_first(free);
         }
+        group = (group + step) & gmask;
+    }
+}
+
+// Return the number of control bytes for a table of the given capacity.
+static inline size_t table_ctrl_len(size_t cap) {
+    return (cap < DSDICT_GROUP_WIDTH) ? DSDICT_GROUP_WIDTH : cap;
+}
+
+// Return the size of the single allocation holding a table's control
+// bytes and slots.
+static inline size_t table_size(size_t cap) {
+    return (cap == 0) ? 0 : table_ctrl_len(cap) + (cap * sizeof(struct bucket));
+}
+
+// Return the number of entries a table may hold before it must grow,
+// which keeps at least one empty slot in every table.
+static inline size_t table_max_load(size_t cap) {
+    return cap - (cap / 8);
+}
+
+// Return the part of a hash stored in the control byte of its slot.
+static inline int8_t hash_h2(uint32_t hash) {
+    return (int8_t)(hash >> 25);
+}
+
+#ifdef DSDICT_USE_SSE2
+
+// Return a mask of the slots in a group whose control byte is h2.
+static inline groupmask group_match(const int8_t *ctrl, int8_t h2) {
+    __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+    return (groupmask)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(h2)));
+}
 
-        free(dict->vals[i]);
-        dict->vals[i] = NULL;
+// Return a mask of the empty slots in a group.
+static inline groupmask group_match_empty(const int8_t *ctrl) {
+    return group_match(ctrl, DSDICT_CTRL_EMPTY);
+}
+
+// Return a mask of the empty or deleted slots in a group, which are the
+// only control bytes less than the sentinel.
+static inline groupmask group_match_free(const int8_t *ctrl) {
+    __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+    return (groupmask)_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(DSDICT_CTRL_SENTINEL), group));
+}
+
+#else
+
+// Return a mask of the slots in a group whose control byte is h2.
+static inline groupmask group_match(const int8_t *ctrl, int8_t h2) {
+    groupmask mask = 0;
+    for (unsigned int i = 0; i < DSDICT_GROUP_WIDTH; i++) {
+        mask |= (groupmask)(ctrl[i] == h2) << i;
+    }
+    return mask;
+}
+
+// Return a mask of the empty slots in a group.
+static inline groupmask group_match_empty(const int8_t *ctrl) {
+    return group_match(ctrl, DSDICT_CTRL_EMPTY);
+}
+
+// Return a mask of the empty or deleted slots in a group, which are the
+// only control bytes less than the sentinel.
+static inline groupmask group_match_free(const int8_t *ctrl) {
+    groupmask mask = 0;
+    for (unsigned int i = 0; i < DSDICT_GROUP_WIDTH; i++) {
+        mask |= (groupmask)(ctrl[i] < DSDICT_CTRL_SENTINEL) << i;
     }
+    return mask;
+}
+
+#endif
+
+// Return the index of the lowest slot set in a non-zero group mask.
+static inline unsigned int groupmask_first(groupmask mask) {
+    assert(mask);
+#if defined(__GNUC__)
+    return (unsigned int)__builtin_ctz(mask);
+#else
+    unsigned int i = 0;
+    while (!(mask & 1)) {
+        mask >>= 1;
+        i++;
+    }
+    return i;
+#endif
 }
 
 // Iterate on the next dictionary entry.
 bool dsiter_dsdict_next(DSIter *iter, bool advance) {
     assert(iter);
-    assert(iter->type == ITER_DICT);
+    assert(iter->type == DSITER_DICT);
 
     // If we already know there are no more elements, quit
     if (DSITER_IS_FINISHED(iter)) {
         return false;
     }
 
-    // Get the initial node pointer
-    if (DSITER_IS_NEW_ITER(iter)) {
-        DSDict *dict = iter->target.dict;
-
-        // We do not need to traverse any linked lists
-        // since this is explicitly the first node
-        for (size_t i = 0; i < dict->cap; i++) {
-            if (dict->vals[i]) {
-                if (advance) {
-                    iter->node.dict = dict->vals[i];
-                    iter->cur = i;
-                    iter->stat = DSITER_NORMAL;
-                }
-                return true;
-            }
-        }
-
-        // No elements found in this dictionary
-        if (advance) {
-            iter->stat = DSITER_NO_MORE_ELEMENTS;
-        }
-        return false;
-    }
-
-    // If there is a next node, set our next pointer to that
-    if (iter->node.dict->next) {
-        if (advance) {
-            iter->node.dict = iter->node.dict->next;
-        }
-        return true;
-    }
-
-    // Otherwise, traverse through the array to find the next pointer
+    // Scan forward from the current slot to the next full slot
     DSDict *dict = iter->target.dict;
-    for (size_t i = (iter->cur + 1); i < dict->cap; i++) {
-        if (dict->vals[i]) {
+    size_t start = (DSITER_IS_NEW_ITER(iter)) ? 0 : (iter->cur + 1);
+    for (size_t i = start; i < dict->cap + dict->oldcap; i++) {
+        struct bucket *cur = dsdict_slot(dict, i);
+        if (cur) {
             if (advance) {
                 iter->cur = i;
-                iter->node.dict = dict->vals[i];
+                iter->node.dict = cur;
+                iter->stat = DSITER_NORMAL;
             }
             return true;
         }
@@ -14,9 +14,13 @@
 #include <stddef.h>
 #include <stdint.h>
 #include "libds/iter.h"
+#include "libds/pool.h"
 
 /**
 * @brief Hash table/dictionary generic data structure.
+*
+* Entries are stored inline in an open addressing table with a power of
+* two capacity, which is not allocated until the first entry is added.
 */
 typedef struct DSDict DSDict;
 
@@ -60,6 +64,24 @@ typedef void (*dsdict_foreach_fn)(const void*, void*);
 */
 DSDict *dsdict_new(dsdict_hash_fn hash, dsdict_compare_fn cmpfn, dsdict_free_fn keyfree, dsdict_free_fn valfree);
 
+/**
+* @brief Create a new @c DSDict object whose internal nodes and iterators
+* are allocated from the given @c DSPool .
+*
+* The pool must outlive the dictionary. Keys and values are not allocated
+* by the dictionary, so they are unaffected. If @c pool is @c NULL , this
+* is the same as @c dsdict_new .
+*
+* @param hash a hashing function used to hash dictionary keys
+* @param cmpfn a function which can compare two dictionary keys by value
+* @param keyfree a function which can free hash table keys
+* @param valfree a function which can free hash table values
+* @param pool a @c DSPool object or @c NULL
+* @returns a new @c DSDict object or @c NULL if no hash function is
+*          specified or memory could not be allocated
+*/
+DSDict *dsdict_new_pool(dsdict_hash_fn hash, dsdict_compare_fn cmpfn, dsdict_free_fn keyfree, dsdict_free_fn valfree, DSPool *pool);
+
 /**
 * @brief Destroy a @c DSDict object.
 *
@@ -111,6 +133,24 @@ void dsdict_foreach(DSDict *dict, dsdict_foreach_fn func);
  */
 DSIter *dsdict_iter(DSDict *dict);
 
+/**
+* @brief Initializer for a @c DSIter over a @c DSDict which does not
+* allocate and need not be destroyed.
+*
+* @code
+* DSIter iter = DSDICT_ITER_INIT(dict);
+* while (dsiter_next(&iter)) { ... }
+* @endcode
+*/
+#define DSDICT_ITER_INIT(d) DSITER_INIT(DSITER_DICT, dict, (d))
+
+/**
+* @brief Iterate over every entry of a @c DSDict with a stack iterator
+* named @c iter, which is only in scope within the loop body.
+*/
+#define DSDICT_FOREACH(d, iter) \
+    for (DSIter iter = DSDICT_ITER_INIT(d); dsiter_next(&iter); )
+
 /**
 * @brief Put the given element in the dictionary by key.
 *
@@ -120,8 +160,10 @@ DSIter *dsdict_iter(DSDict *dict);
 * it is overwritten.
 *
 * A put operation may trigger a resize if the dictionary exceeds its
-* internal load factor. Puts are not guaranteed to be O(1) because
-* hashing collisions in the table are handled with a linked list.
+* internal load factor. Entries are stored inline in an open addressing
+* table, so a put which does not resize performs no allocation. Large
+* tables are resized incrementally, with each subsequent put or delete
+* moving a bounded number of entries into the new table.
 *
 * @param dict a @c DSDict object
 * @param key the key
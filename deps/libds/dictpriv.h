@@ -14,10 +14,9 @@
 #include "libds/dict.h"
 
 struct bucket{
-    unsigned int hash;
+    uint32_t hash;
     void *key;
     void *data;
-    struct bucket *next;
 };
 
 bool dsiter_dsdict_next(DSIter *iter, bool advance);
@@ -9,6 +9,9 @@
  *****************************************************************************/
 
 #include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
 #include "libds/hash.h"
 
 static const uint32_t HASH_LARSON_SEED = 23;
@@ -19,6 +22,18 @@ static const uint32_t HASH_DJB2A_SEED = 5381;
 static const uint32_t HASH_DJB2A_FACTOR = 33;
 static const uint32_t HASH_SDBM_SHIFT1 = 6;
 static const uint32_t HASH_SDBM_SHIFT2 = 16;
+static const uint64_t HASH_WY_SECRET[4] = {
+    0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull,
+    0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull,
+};
+
+/* the seed is mixed once when it is set; this is the mix of seed 0 */
+static uint64_t HASH_SEED = 0xca813bf4c7abf0a9ull;
+
+static inline void hash_wy_mum(uint64_t *a, uint64_t *b);
+static inline uint64_t hash_wy_mix(uint64_t a, uint64_t b);
+static inline uint64_t hash_read8(const uint8_t *p);
+static inline uint64_t hash_read4(const uint8_t *p);
 
 uint32_t hash_larson(const char *str) {
     uint32_t hash = HASH_LARSON_SEED;
@@ -63,3 +78,127 @@ uint32_t hash_sdbm(const char *str) {
 
     return hash;
 }
+
+uint32_t hash_bytes(const void *data, size_t len) {
+    const uint8_t *p = data;
+    const uint64_t *secret = HASH_WY_SECRET;
+    uint64_t seed = HASH_SEED;
+    uint64_t a;
+    uint64_t b;
+
+    if (len <= 16) {
+        if (len >= 4) {
+            // Two (possibly overlapping) pairs of 4 byte reads cover 4-16 bytes
+            size_t off = (len >> 3) << 2;
+            a = (hash_read4(p) << 32) | hash_read4(p + off);
+            b = (hash_read4(p + len - 4) << 32) | hash_read4(p + len - 4 - off);
+        } else if (len > 0) {
+            a = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) | p[len - 1];
+            b = 0;
+        } else {
+            a = 0;
+            b = 0;
+        }
+    } else {
+        size_t i = len;
+        if (i > 48) {
+            // Three independent lanes keep the multiplier busy on long keys
+            uint64_t see1 = seed;
+            uint64_t see2 = seed;
+            do {
+                seed = hash_wy_mix(hash_read8(p) ^ secret[1], hash_read8(p + 8) ^ seed);
+                see1 = hash_wy_mix(hash_read8(p + 16) ^ secret[2], hash_read8(p + 24) ^ see1);
+                see2 = hash_wy_mix(hash_read8(p + 32) ^ secret[3], hash_read8(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = hash_wy_mix(hash_read8(p) ^ secret[1], hash_read8(p + 8) ^ seed);
+            p += 16;
+            i -= 16;
+        }
+        a = hash_read8(p + i - 16);
+        b = hash_read8(p + i - 8);
+    }
+
+    a ^= secret[1];
+    b ^= seed;
+    hash_wy_mum(&a, &b);
+    uint64_t hash = hash_wy_mix(a ^ secret[0] ^ (uint64_t)len, b ^ secret[1]);
+    return (uint32_t)(hash ^ (hash >> 32));
+}
+
+uint32_t hash_cstr(const char *str) {
+    return hash_bytes(str, strlen(str));
+}
+
+void hash_seed(uint64_t seed) {
+    HASH_SEED = seed ^ hash_wy_mix(seed ^ HASH_WY_SECRET[0], HASH_WY_SECRET[1]);
+}
+
+uint64_t hash_seed_random(void) {
+    uint64_t seed = 0;
+
+    FILE *urandom = fopen("/dev/urandom", "rb");
+    if (urandom) {
+        if (fread(&seed, sizeof(seed), 1, urandom) != 1) {
+            seed = 0;
+        }
+        fclose(urandom);
+    }
+
+    if (seed == 0) {
+        int local;
+        seed = hash_wy_mix((uint64_t)time(NULL) ^ (uint64_t)(uintptr_t)&local,
+                           (uint64_t)clock() ^ (uint64_t)(uintptr_t)&HASH_SEED);
+    }
+
+    hash_seed(seed);
+    return seed;
+}
+
+/*
+ * PRIVATE FUNCTIONS
+ */
+
+// Multiply two 64 bit integers, leaving the low and high halves of the
+// 128 bit product in a and b respectively.
+static inline void hash_wy_mum(uint64_t *a, uint64_t *b) {
+#if defined(__SIZEOF_INT128__)
+    __extension__ typedef unsigned __int128 uint128;
+    uint128 r = (uint128)*a * *b;
+    *a = (uint64_t)r;
+    *b = (uint64_t)(r >> 64);
+#else
+    uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t)*a, lb = (uint32_t)*b;
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm0 << 32);
+    uint64_t c = t < rl;
+    uint64_t lo = t + (rm1 << 32);
+    c += lo < t;
+    *a = lo;
+    *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+// Fold the 128 bit product of two 64 bit integers into 64 bits.
+static inline uint64_t hash_wy_mix(uint64_t a, uint64_t b) {
+    hash_wy_mum(&a, &b);
+    return a ^ b;
+}
+
+// Read 8 bytes from a possibly unaligned address.
+static inline uint64_t hash_read8(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+// Read 4 bytes from a possibly unaligned address.
+static inline uint64_t hash_read4(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
@@ -11,6 +11,7 @@
 #ifndef LIBDS_HASH_H
 #define LIBDS_HASH_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 /**
@@ -58,4 +59,53 @@ uint32_t hash_djb2(const char *str);
 */
 uint32_t hash_sdbm(const char *str);
 
+/**
+* @brief Hash an arbitrary sequence of bytes.
+*
+* This is the preferred hash for dictionary keys. It consumes its input
+* eight bytes at a time and is based on Wang Yi's wyhash, described
+* [here](https://github.com/wangyi-fudan/wyhash). Unlike the hashes
+* above, it may hash data which contains @c NUL bytes.
+*
+* The hash is keyed by the process-wide seed set by @c hash_seed, so
+* hash values should never be persisted or compared across processes.
+*
+* @param data a pointer to at least @c len bytes
+* @param len the number of bytes to hash
+* @returns a hash value
+*/
+uint32_t hash_bytes(const void *data, size_t len);
+
+/**
+* @brief Hash a string with @c hash_bytes .
+*
+* @param str a @c NUL terminated C string
+* @returns a hash value
+*/
+uint32_t hash_cstr(const char *str);
+
+/**
+* @brief Set the seed used by @c hash_bytes for the entire process.
+*
+* Choosing an unpredictable seed prevents an attacker from constructing
+* keys which all collide in a dictionary. The default seed is 0.
+*
+* Changing the seed changes the hash of every key, so this must be called
+* before any dictionary using @c hash_bytes is created.
+*
+* @param seed the new seed
+*/
+void hash_seed(uint64_t seed);
+
+/**
+* @brief Set the seed used by @c hash_bytes to an unpredictable value.
+*
+* The seed is read from @c /dev/urandom where it exists, or otherwise
+* mixed from the clock and the address space layout. The same caveats
+* apply as for @c hash_seed .
+*
+* @returns the new seed
+*/
+uint64_t hash_seed_random(void);
+
 #endif //LIBDS_HASH_H
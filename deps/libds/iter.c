@@ -25,11 +25,11 @@ bool dsiter_next(DSIter *iter) {
     if (!iter) { return false; }
 
     switch (iter->type) {
-        case ITER_ARRAY:
+        case DSITER_ARRAY:
             return dsiter_dsarray_next(iter, true);
-        case ITER_DICT:
+        case DSITER_DICT:
             return dsiter_dsdict_next(iter, true);
-        case ITER_LIST:
+        case DSITER_LIST:
             return dsiter_dslist_next(iter, true);
     }
 
@@ -40,11 +40,11 @@ bool dsiter_has_next(DSIter *iter) {
     if (!iter) { return false; }
 
     switch (iter->type) {
-        case ITER_ARRAY:
+        case DSITER_ARRAY:
             return dsiter_dsarray_next(iter, false);
-        case ITER_DICT:
+        case DSITER_DICT:
             return dsiter_dsdict_next(iter, false);
-        case ITER_LIST:
+        case DSITER_LIST:
             return dsiter_dslist_next(iter, false);
     }
 
@@ -55,11 +55,11 @@ void *dsiter_key(DSIter *iter) {
     if (!iter) { return NULL; }
 
     switch(iter->type) {
-        case ITER_ARRAY:
+        case DSITER_ARRAY:
             return NULL;
-        case ITER_DICT:
+        case DSITER_DICT:
             return (iter->node.dict) ? (iter->node.dict->key) : NULL;
-        case ITER_LIST:
+        case DSITER_LIST:
             return NULL;
     }
 
@@ -70,11 +70,11 @@ void *dsiter_value(DSIter *iter) {
     if (!iter) { return NULL; }
 
     switch(iter->type) {
-        case ITER_ARRAY:
+        case DSITER_ARRAY:
             return dsarray_get(iter->target.array, iter->cur);
-        case ITER_DICT:
+        case DSITER_DICT:
             return (iter->node.dict) ? (iter->node.dict->data) : NULL;
-        case ITER_LIST:
+        case DSITER_LIST:
             return (iter->node.list) ? (iter->node.list->data) : NULL;
     }
 
@@ -95,11 +95,11 @@ void dsiter_reset(DSIter *iter) {
 }
 
 void dsiter_destroy(DSIter *iter) {
-    if (!iter) { return; }
+    if ((!iter) || (!iter->heap)) { return; }
 
     set_target(iter, NULL);
     set_node(iter, NULL);
-    free(iter);
+    dspool_free(iter->pool, iter, sizeof(DSIter));
 }
 
 /*
@@ -107,12 +107,14 @@ void dsiter_destroy(DSIter *iter) {
  */
 
 // Create a new DSIter of the given type on the given target.
-DSIter* dsiter_priv_new(enum IterType type, void *target) {
-    DSIter *iter = malloc(sizeof(DSIter));
+DSIter* dsiter_priv_new(DSIterType type, void *target, DSPool *pool) {
+    DSIter *iter = dspool_alloc(pool, sizeof(DSIter));
     if (!iter) {
         return NULL;
     }
 
+    iter->pool = pool;
+    iter->heap = true;
     iter->type = type;
     iter->cur = 0;
     iter->stat = DSITER_NEW_ITERATOR;
@@ -131,13 +133,13 @@ static bool set_target(DSIter *iter, void *val) {
     assert(iter);
 
     switch (iter->type) {
-        case ITER_ARRAY:
+        case DSITER_ARRAY:
             iter->target.array = val;
             return true;
-        case ITER_DICT:
+        case DSITER_DICT:
             iter->target.dict = val;
             return true;
-        case ITER_LIST:
+        case DSITER_LIST:
             iter->target.list = val;
             return true;
         default:
@@ -150,12 +152,12 @@ static bool set_node(DSIter *iter, void *val) {
     assert(iter);
 
     switch (iter->type) {
-        case ITER_ARRAY:
+        case DSITER_ARRAY:
             return true;
-        case ITER_DICT:
+        case DSITER_DICT:
             iter->node.dict = val;
             return true;
-        case ITER_LIST:
+        case DSITER_LIST:
             iter->node.list = val;
             return true;
         default:
@@ -18,6 +18,7 @@
 #define LIBDS_ITER_H
 
 #include <stdbool.h>
+#include <stddef.h>
 
 /**
 * @brief Generic iterator object.
@@ -31,6 +32,62 @@ static const int DSITER_NORMAL = 0;
 static const int DSITER_NEW_ITERATOR = (1 << 0);
 static const int DSITER_NO_MORE_ELEMENTS = (1 << 1);
 
+/**
+* @brief The type of collection a @c DSIter iterates over.
+*/
+typedef enum {
+    DSITER_ARRAY,
+    DSITER_DICT,
+    DSITER_LIST,
+} DSIterType;
+
+/**
+* @brief Generic iterator object.
+*
+* Iterators returned by @c dsarray_iter, @c dsdict_iter and @c dslist_iter
+* are heap allocated and must be freed by @c dsiter_destroy. The structure
+* is public so that iterators may also be declared on the stack (or within
+* other objects) using @c DSARRAY_ITER_INIT, @c DSDICT_ITER_INIT or
+* @c DSLIST_ITER_INIT, none of which touch the allocator.
+* Such iterators hold no memory and need not be destroyed.
+*
+* The fields of this structure should only be accessed by libds.
+*/
+struct DSIter {
+    DSIterType type;
+    union {
+        struct DSArray *array;
+        struct DSDict *dict;
+        struct DSList *list;
+    } target;
+    size_t cur;
+    union {
+        struct bucket *dict;
+        struct node *list;
+    } node;
+    int stat;
+    struct DSPool *pool;
+    bool heap;
+};
+
+/**
+* @brief Initializer for a @c DSIter over the given collection; use the
+* collection specific initializers rather than this macro.
+*
+* @param t the @c DSIterType of @c collection
+* @param member the member of @c target which holds @c collection
+* @param collection a @c DSArray, @c DSDict or @c DSList
+*/
+#define DSITER_INIT(t, member, collection) { \
+        .type = (t), \
+        .target = { .member = (collection) }, \
+        .cur = 0, \
+        .node = { .dict = NULL }, \
+        .stat = DSITER_NEW_ITERATOR, \
+        .pool = NULL, \
+        .heap = false, \
+    }
+
 /**
 * @brief Advance the pointer to next element in the collection.
 *
@@ -97,6 +154,8 @@ void dsiter_reset(DSIter *iter);
 /**
 * @brief Destroy an iterator.
 *
+* Iterators created with @c DSITER_INIT are left untouched.
+*
 * @param iter a @c DSIter object
 */
 void dsiter_destroy(DSIter *iter);
@@ -11,36 +11,12 @@
 #ifndef LIBDS_ITERPRIV_H
 #define LIBDS_ITERPRIV_H
 
+#include "libds/pool.h"
 #include "arraypriv.h"
 #include "dictpriv.h"
 #include "listpriv.h"
 
-enum IterType {
-    ITER_ARRAY,
-    ITER_DICT,
-    ITER_LIST,
-};
-
-union IterTarget {
-    DSArray *array;
-    DSDict *dict;
-    DSList *list;
-};
-
-union IterNode {
-    struct bucket *dict;
-    struct node *list;
-};
-
-struct DSIter {
-    enum IterType type;
-    union IterTarget target;
-    size_t cur;
-    union IterNode node;
-    int stat;
-};
-
-DSIter* dsiter_priv_new(enum IterType type, void *target);
+DSIter* dsiter_priv_new(DSIterType type, void *target, DSPool *pool);
 #define DSITER_IS_NEW_ITER(iter) (iter->stat == DSITER_NEW_ITERATOR)
 #define DSITER_IS_FINISHED(iter) (iter->stat == DSITER_NO_MORE_ELEMENTS)
 
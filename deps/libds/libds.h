@@ -11,11 +11,13 @@
 #ifndef LIBDS_LIBDS_H
 #define LIBDS_LIBDS_H
 
+#include "libds/alloc.h"
 #include "libds/array.h"
 #include "libds/buffer.h"
 #include "libds/dict.h"
 #include "libds/hash.h"
 #include "libds/iter.h"
 #include "libds/list.h"
+#include "libds/pool.h"
 
 #endif //LIBDS_LIBDS_H
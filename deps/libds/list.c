@@ -11,6 +11,7 @@
 #include <assert.h>
 #include <stddef.h>
 #include <stdlib.h>
+#include "libds/alloc.h"
 #include "libds/list.h"
 #include "listpriv.h"
 #include "iterpriv.h"
@@ -31,7 +32,7 @@ static void *remove_node(DSList *list, struct node *cur);
  */
 
 DSList *dslist_new(dslist_compare_fn cmpfn, dslist_free_fn freefn) {
-    DSList *list = malloc(sizeof(struct DSList));
+    DSList *list = dsalloc(sizeof(struct DSList));
     if (!list) {
         return NULL;
     }
@@ -47,7 +48,7 @@ DSList *dslist_new(dslist_compare_fn cmpfn, dslist_free_fn freefn) {
 void dslist_destroy(DSList *list) {
     if (!list) { return; }
     dslist_clear(list);
-    free(list);
+    dsfree(list);
 }
 
 size_t dslist_len(const DSList *list) {
@@ -209,7 +210,7 @@ void *dslist_dequeue(DSList *list){
     head->next = NULL;
     head->prev = NULL;
     head->data = NULL;
-    free(head);
+    dsfree(head);
 
     return data;
 }
@@ -229,7 +230,7 @@ void *dslist_pop(DSList *list){
     foot->next = NULL;
     foot->prev = NULL;
     foot->data = NULL;
-    free(foot);
+    dsfree(foot);
 
     return data;
 }
@@ -245,7 +246,7 @@ void dslist_clear(DSList *list){
             list->free(cur->data);
         }
         cur = cur->next;
-        free(prev);
+        dsfree(prev);
         prev = cur;
         list->len--;
     }
@@ -291,7 +292,7 @@ void dslist_reverse(DSList *list) {
 DSIter *dslist_iter(DSList *list) {
     if (!list) { return NULL; }
 
-    DSIter *iter = dsiter_priv_new(ITER_LIST, list);
+    DSIter *iter = dsiter_priv_new(DSITER_LIST, list, NULL);
     if (!iter) {
         return NULL;
     }
@@ -305,7 +306,7 @@ DSIter *dslist_iter(DSList *list) {
 
 // Wrap the code required to create a new node
 static struct node *make_node(void *elem, struct node *next, struct node *prev) {
-    struct node *newnode = malloc(sizeof(struct node));
+    struct node *newnode = dsalloc(sizeof(struct node));
     if (!newnode) { return false; }
     newnode->data = elem;
     newnode->next = next;
@@ -332,14 +333,14 @@ static void *remove_node(DSList *list, struct node *cur) {
 
     list->len--;
     void *data = cur->data;
-    free(cur);
+    dsfree(cur);
     return data;
 }
 
 // Iterate on the next list entry
 bool dsiter_dslist_next(DSIter *iter, bool advance) {
     assert(iter);
-    assert(iter->type == ITER_LIST);
+    assert(iter->type == DSITER_LIST);
 
     if (DSITER_IS_FINISHED(iter)) {
         return false;
@@ -226,4 +226,22 @@ void dslist_reverse(DSList *list);
 */
 DSIter *dslist_iter(DSList *list);
 
+/**
+* @brief Initializer for a @c DSIter over a @c DSList which does not
+* allocate and need not be destroyed.
+*
+* @code
+* DSIter iter = DSLIST_ITER_INIT(list);
+* while (dsiter_next(&iter)) { ... }
+* @endcode
+*/
+#define DSLIST_ITER_INIT(l) DSITER_INIT(DSITER_LIST, list, (l))
+
+/**
+* @brief Iterate over every element of a @c DSList with a stack iterator
+* named @c iter, which is only in scope within the loop body.
+*/
+#define DSLIST_FOREACH(l, iter) \
+    for (DSIter iter = DSLIST_ITER_INIT(l); dsiter_next(&iter); )
+
 #endif //LIBDS_LIST_H
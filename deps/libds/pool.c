@@ -0,0 +1,221 @@
+/*****************************************************************************
+ * libds :: pool.c
+ *
+ * Size-class pool allocator for small fixed-size objects.
+ *
+ * Author:  Chris Rink <chrisrink10@gmail.com>
+ *
+ * License: MIT (see LICENSE document at source tree root)
+ *****************************************************************************/
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "libds/alloc.h"
+#include "libds/pool.h"
+
+static const size_t DSPOOL_CLASS_SIZES[DSPOOL_NUM_CLASSES] = {
+        16, 32, 48, 64, 96, DSPOOL_MAX_OBJECT_SIZE,
+};
+
+/*
+ * Size class for each request size rounded up to a multiple of 16 bytes
+ * - Array index is ((size + 15) / 16)
+ * - Value at index is the index of the smallest class that fits
+ */
+static const size_t DSPOOL_CLASS_INDEX[] = {
+        0, 0, 1, 2, 3, 4, 4, 5, 5,
+};
+
+#define DSPOOL_SLAB_SIZE ((size_t)16384)
+
+struct slab {
+    struct slab *next;
+    union {
+        long double ld;
+        long long ll;
+        void *p;
+    } data[];                       /* slots (aligned for any object) */
+};
+
+struct slot {
+    struct slot *next;
+};
+
+struct sizeclass {
+    struct slab *slabs;             /* every slab allocated for this class */
+    struct slot *free;              /* slots returned to the class */
+    char *next;                     /* next never used slot in the newest slab */
+    char *end;                      /* end of the newest slab */
+    DSPoolClassStats stats;
+};
+
+struct DSPool {
+    struct sizeclass classes[DSPOOL_NUM_CLASSES];
+    size_t nallocs;
+    size_t nfrees;
+    size_t nlarge;
+    size_t large_bytes;
+};
+
+static inline size_t dspool_class_index(size_t size);
+#ifndef DSPOOL_USE_MALLOC
+static bool dspool_new_slab(struct sizeclass *cls);
+#endif
+
+/*
+ * POOL PUBLIC FUNCTIONS
+ */
+
+DSPool *dspool_new(void) {
+    DSPool *pool = dscalloc(1, sizeof(DSPool));
+    if (!pool) {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < DSPOOL_NUM_CLASSES; i++) {
+        pool->classes[i].stats.size = DSPOOL_CLASS_SIZES[i];
+    }
+
+    return pool;
+}
+
+void dspool_destroy(DSPool *pool) {
+    if (!pool) { return; }
+
+    for (size_t i = 0; i < DSPOOL_NUM_CLASSES; i++) {
+        struct slab *slab = pool->classes[i].slabs;
+        while (slab) {
+            struct slab *next = slab->next;
+            dsfree(slab);
+            slab = next;
+        }
+        pool->classes[i].slabs = NULL;
+    }
+
+    dsfree(pool);
+}
+
+void *dspool_alloc(DSPool *pool, size_t size) {
+    if (!pool) { return dsalloc(size); }
+    assert(size > 0);
+
+    pool->nallocs++;
+    if (size > DSPOOL_MAX_OBJECT_SIZE) {
+        void *ptr = dsalloc(size);
+        if (ptr) {
+            pool->nlarge++;
+            pool->large_bytes += size;
+        }
+        return ptr;
+    }
+
+    struct sizeclass *cls = &pool->classes[dspool_class_index(size)];
+    cls->stats.nlive++;
+    cls->stats.requested += size;
+
+#ifdef DSPOOL_USE_MALLOC
+    return dsalloc(size);
+#else
+    // Prefer recently freed slots, which are most likely to be in cache
+    if (cls->free) {
+        struct slot *slot = cls->free;
+        cls->free = slot->next;
+        return slot;
+    }
+
+    if ((cls->next == cls->end) && (!dspool_new_slab(cls))) {
+        cls->stats.nlive--;
+        cls->stats.requested -= size;
+        return NULL;
+    }
+
+    void *ptr = cls->next;
+    cls->next += cls->stats.size;
+    return ptr;
+#endif
+}
+
+void dspool_free(DSPool *pool, void *ptr, size_t size) {
+    if (!ptr) { return; }
+    if (!pool) {
+        dsfree(ptr);
+        return;
+    }
+
+    pool->nfrees++;
+    if (size > DSPOOL_MAX_OBJECT_SIZE) {
+        assert(pool->nlarge > 0);
+        pool->nlarge--;
+        pool->large_bytes -= size;
+        dsfree(ptr);
+        return;
+    }
+
+    struct sizeclass *cls = &pool->classes[dspool_class_index(size)];
+    assert(cls->stats.nlive > 0);
+    cls->stats.nlive--;
+    cls->stats.requested -= size;
+
+#ifdef DSPOOL_USE_MALLOC
+    dsfree(ptr);
+#else
+    struct slot *slot = ptr;
+    slot->next = cls->free;
+    cls->free = slot;
+#endif
+}
+
+void dspool_stats(const DSPool *pool, DSPoolStats *stats) {
+    assert(pool);
+    assert(stats);
+
+    stats->nallocs = pool->nallocs;
+    stats->nfrees = pool->nfrees;
+    stats->nlarge = pool->nlarge;
+    stats->requested = pool->large_bytes;
+    stats->reserved = pool->large_bytes;
+
+    for (size_t i = 0; i < DSPOOL_NUM_CLASSES; i++) {
+        const DSPoolClassStats *cls = &pool->classes[i].stats;
+        stats->classes[i] = *cls;
+        stats->requested += cls->requested;
+#ifdef DSPOOL_USE_MALLOC
+        stats->reserved += cls->requested;
+#else
+        stats->reserved += cls->nslabs * DSPOOL_SLAB_SIZE;
+#endif
+    }
+}
+
+/*
+ * PRIVATE FUNCTIONS
+ */
+
+// Return the index of the smallest size class which can hold an object.
+static inline size_t dspool_class_index(size_t size) {
+    assert(size <= DSPOOL_MAX_OBJECT_SIZE);
+    return DSPOOL_CLASS_INDEX[(size + 15) / 16];
+}
+
+#ifndef DSPOOL_USE_MALLOC
+// Allocate a new slab for a size class and make it the source of new slots.
+static bool dspool_new_slab(struct sizeclass *cls) {
+    assert(cls);
+
+    struct slab *slab = dsalloc(DSPOOL_SLAB_SIZE);
+    if (!slab) {
+        return false;
+    }
+
+    size_t nslots = (DSPOOL_SLAB_SIZE - sizeof(struct slab)) / cls->stats.size;
+    slab->next = cls->slabs;
+    cls->slabs = slab;
+    cls->next = (char *)slab->data;
+    cls->end = cls->next + (nslots * cls->stats.size);
+    cls->stats.nslabs++;
+    cls->stats.nslots += nslots;
+    return true;
+}
+#endif
@@ -0,0 +1,123 @@
+/**
+ * @file pool.h
+ *
+ * @brief Size-class pool allocator for small fixed-size objects.
+ *
+ * @author Chris Rink <chrisrink10@gmail.com>
+ *
+ * @copyright 2015 Chris Rink. MIT Licensed.
+ */
+
+#ifndef LIBDS_POOL_H
+#define LIBDS_POOL_H
+
+#include <stddef.h>
+
+/**
+* @brief Number of distinct size classes served from pool slabs.
+*/
+#define DSPOOL_NUM_CLASSES 6
+
+/**
+* @brief Size of the largest object served from pool slabs; larger requests
+* are passed straight through to @c dsalloc (and so to the current
+* allocator).
+*/
+#define DSPOOL_MAX_OBJECT_SIZE 128
+
+/**
+* @brief Pool allocator for small fixed-size objects.
+*
+* A @c DSPool carves objects out of slabs of identically sized slots, with
+* one free list per size class, so allocation and deallocation are a few
+* pointer operations and objects of the same size sit next to each other
+* in memory. Objects are freed with their original request size, so slots
+* carry no header.
+*
+* Slabs and large objects are drawn from the current allocator with
+* @c dsalloc . Defining @c DSPOOL_USE_MALLOC at build time makes every pool
+* pass its requests straight through to @c dsalloc and @c dsfree (while
+* still keeping statistics), so the two strategies can be compared.
+*
+* Pools are not thread-safe.
+*/
+typedef struct DSPool DSPool;
+
+/**
+* @brief Occupancy statistics for a single size class.
+*/
+typedef struct {
+    size_t size;                    /** size of each slot in bytes */
+    size_t nslabs;                  /** number of slabs allocated */
+    size_t nslots;                  /** total slots in all slabs */
+    size_t nlive;                   /** slots currently allocated */
+    size_t requested;               /** bytes requested by live objects */
+} DSPoolClassStats;
+
+/**
+* @brief Statistics for an entire @c DSPool .
+*
+* Occupancy for a class is @c nlive / @c nslots ; fragmentation (bytes
+* reserved but not requested) is @c reserved - @c requested .
+*/
+typedef struct {
+    DSPoolClassStats classes[DSPOOL_NUM_CLASSES];
+    size_t nallocs;                 /** total number of allocations */
+    size_t nfrees;                  /** total number of frees */
+    size_t nlarge;                  /** live allocations too large for a size class */
+    size_t requested;               /** bytes requested by all live objects */
+    size_t reserved;                /** bytes held by slabs and large allocations */
+} DSPoolStats;
+
+/**
+* @brief Create a new, empty @c DSPool .
+*
+* @returns a new @c DSPool or @c NULL if memory could not be allocated
+*/
+DSPool *dspool_new(void);
+
+/**
+* @brief Destroy a @c DSPool and every slab it holds.
+*
+* Objects still allocated from the pool's slabs are released along with
+* it; large objects which were never freed are not (nor is anything when
+* built with @c DSPOOL_USE_MALLOC ), so callers should still free every
+* object they allocate.
+*
+* @param pool a @c DSPool object
+*/
+void dspool_destroy(DSPool *pool);
+
+/**
+* @brief Allocate an object of @c size bytes from the pool.
+*
+* If @c pool is @c NULL , the object is allocated with @c dsalloc .
+*
+* @param pool a @c DSPool object or @c NULL
+* @param size the size of the object in bytes
+* @returns a pointer to the new object or @c NULL if memory could not be
+*          allocated
+*/
+void *dspool_alloc(DSPool *pool, size_t size);
+
+/**
+* @brief Return an object of @c size bytes to the pool.
+*
+* @c size must be the same as the size given when the object was
+* allocated. If @c pool is @c NULL , the object is freed with @c dsfree .
+*
+* @param pool a @c DSPool object or @c NULL
+* @param ptr an object allocated by @c dspool_alloc on the same pool
+* @param size the size of the object in bytes
+*/
+void dspool_free(DSPool *pool, void *ptr, size_t size);
+
+/**
+* @brief Fill @c stats with the current statistics of the pool.
+*
+* @param pool a @c DSPool object
+* @param stats the statistics structure to fill
+*/
+void dspool_stats(const DSPool *pool, DSPoolStats *stats);
+
+#endif //LIBDS_POOL_H
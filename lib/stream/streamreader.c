@@ -14,76 +14,106 @@
  *  limitations under the License.
  *----------------------------------------------------------------------------*/
 
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include "libds/alloc.h"
 #include "streamreader.h"
 
+#if defined(__unix__) || (defined(__APPLE__) && defined(__MACH__))
+#include <unistd.h>
+#endif
+
+#if defined(_POSIX_MAPPED_FILES) && (_POSIX_MAPPED_FILES > 0) && !defined(MS_STREAM_NO_MMAP)
+#define MS_STREAM_USE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 enum StreamType {
     TYPE_STRING,
-    TYPE_FILE
-};
-
-union StreamValue {
-    FILE *f;
-    const char *s;
+    TYPE_MAPPED,
+    TYPE_CHUNKED
 };
 
 struct ms_StreamReader {
-    union StreamValue val;  /** value of the stream */
-    enum StreamType type;   /** type of stream (STRING or FILE) */
-    size_t pos;             /** current stream position */
-    size_t len;             /** length of the stream (STRING only) */
-    int cur;                /** current character */
+    const char *start;      /** first character which may be read (or unread) */
+    const char *cur;        /** next character to be read */
+    const char *end;        /** one past the last character currently available */
+    void *data;             /** memory owned by the stream (MAPPED or CHUNKED only) */
+    size_t size;            /** size of the owned memory */
+    FILE *file;             /** file further chunks are read from (CHUNKED only) */
+    bool owned;             /** true if the stream closes the file when destroyed */
+    bool eof;               /** true once the file has no more chunks to read */
+    enum StreamType type;   /** type of stream (STRING, MAPPED, or CHUNKED) */
 };
 
+static const size_t STREAM_CHUNK_SIZE = 64 * 1024;
+
+static ms_StreamReader *StreamNew(enum StreamType type, const char *str, size_t len);
+#ifdef MS_STREAM_USE_MMAP
+static ms_StreamReader *StreamNewMapped(FILE *f);
+#endif
+static ms_StreamReader *StreamNewChunked(FILE *f, bool owned);
+static bool StreamRefill(ms_StreamReader *stream);
+
 ms_StreamReader *ms_StreamNewString(const char *str) {
     size_t len = strlen(str);
     return ms_StreamNewStringL(str, len);
 }
 
 ms_StreamReader *ms_StreamNewStringL(const char *str, size_t len) {
-    ms_StreamReader *stream = malloc(sizeof(ms_StreamReader));
-    if (!stream) {
-        return NULL;
-    }
-
-    stream->type = TYPE_STRING;
-    stream->val.s = str;
-    stream->pos = 0;
-    stream->len = len;
-    stream->cur = EOF;
-    return stream;
+    return StreamNew(TYPE_STRING, str, len);
 }
 
 ms_StreamReader *ms_StreamNewFile(const char *fname) {
-    ms_StreamReader *stream = malloc(sizeof(ms_StreamReader));
-    if (!stream) {
+    FILE *f = fopen(fname, "rb");
+    if (!f) {
         return NULL;
     }
 
-    stream->val.f = fopen(fname, "r");
-    if (!stream->val.f) {
-        ms_StreamDestroy(stream);
+#ifdef MS_STREAM_USE_MMAP
+    ms_StreamReader *stream = StreamNewMapped(f);
+    if (stream) {
+        fclose(f);
+        return stream;
+    }
+#endif
+
+    ms_StreamReader *chunked = StreamNewChunked(f, true);
+    if (!chunked) {
+        fclose(f);
         return NULL;
     }
+    return chunked;
+}
 
-    stream->type = TYPE_FILE;
-    stream->pos = 0;
-    stream->len = 0;
-    stream->cur = EOF;
-    return stream;
+ms_StreamReader *ms_StreamNewFileHandle(FILE *file) {
+    return StreamNewChunked(file, false);
 }
 
 void ms_StreamDestroy(ms_StreamReader *stream) {
     if (!stream) { return; }
-    if ((stream->type == TYPE_FILE) && (stream->val.f)) {
-        int err = fclose(stream->val.f);
-        if (err == EOF) {
-            // TODO: something
-        }
+    switch (stream->type) {
+        case TYPE_MAPPED:
+#ifdef MS_STREAM_USE_MMAP
+            munmap(stream->data, stream->size);
+#endif
+            break;
+        case TYPE_CHUNKED:
+            dsfree(stream->data);
+            if (stream->owned) {
+                fclose(stream->file);
+            }
+            break;
+        case TYPE_STRING:
+            break;
     }
-    free(stream);
+    dsfree(stream);
 }
 
 int ms_StreamNextChar(ms_StreamReader *stream) {
@@ -91,59 +121,140 @@ int ms_StreamNextChar(ms_StreamReader *stream) {
         return EOF;
     }
 
-    switch (stream->type) {
-        case TYPE_FILE:
-            stream->cur = fgetc(stream->val.f);
-            stream->pos += (stream->cur != EOF) ? 1 : 0;
-            return stream->cur;
-        case TYPE_STRING:
-            if (stream->pos < stream->len) {
-                stream->cur = stream->val.s[stream->pos];
-                stream->pos++;
-                return stream->cur;
-            } else {
-                stream->cur = EOF;
-                return EOF;
-            }
-        default:
-            return EOF;
+    if ((stream->cur == stream->end) &&
+        ((stream->type != TYPE_CHUNKED) || (!StreamRefill(stream)))) {
+        return EOF;
     }
+
+    return (unsigned char)*stream->cur++;
 }
 
 int ms_StreamUnread(ms_StreamReader *stream) {
-    if (!stream) {
+    if ((!stream) || (stream->cur == stream->start)) {
         return EOF;
     }
 
-    switch (stream->type) {
-        case TYPE_FILE:
-            if (stream->pos == 0) {
-                return EOF;
-            } else {
-                long pos = stream->pos - 1;
-                int res = fseek(stream->val.f, pos, SEEK_SET);
-                if (res == 0) {
-                    stream->pos--;
-                    stream->cur = fgetc(stream->val.f);
-                    ungetc(stream->cur, stream->val.f);
-                    return stream->cur;
-                }
-                return EOF;
-            }
-        case TYPE_STRING:
-            if (stream->pos == 0) {
-                return EOF;
-            } else if (stream->pos <= stream->len) {
-                do {
-                    stream->pos--;
-                    stream->cur = stream->val.s[stream->pos];
-                } while (stream->cur == '\0');
-                return stream->cur;
-            } else {
-                stream->cur = EOF;
-                return EOF;
-            }
-        default:
-            return EOF;
+    do {
+        stream->cur--;
+    } while ((*stream->cur == '\0') && (stream->cur > stream->start));
+    return (unsigned char)*stream->cur;
+}
+
+const char *ms_StreamAvailable(ms_StreamReader *stream, size_t *len) {
+    assert(len);
+    if ((!stream) ||
+        ((stream->cur == stream->end) &&
+         ((stream->type != TYPE_CHUNKED) || (!StreamRefill(stream))))) {
+        *len = 0;
+        return NULL;
     }
+
+    *len = (size_t)(stream->end - stream->cur);
+    return stream->cur;
+}
+
+void ms_StreamSkip(ms_StreamReader *stream, size_t len) {
+    assert(stream);
+    assert(len <= (size_t)(stream->end - stream->cur));
+    stream->cur += len;
+}
+
+/*
+ * PRIVATE FUNCTIONS
+ */
+
+static ms_StreamReader *StreamNew(enum StreamType type, const char *str, size_t len) {
+    ms_StreamReader *stream = dsalloc(sizeof(ms_StreamReader));
+    if (!stream) {
+        return NULL;
+    }
+
+    stream->start = str;
+    stream->cur = str;
+    stream->end = (str) ? str + len : NULL;
+    stream->data = NULL;
+    stream->size = 0;
+    stream->file = NULL;
+    stream->owned = false;
+    stream->eof = false;
+    stream->type = type;
+    return stream;
+}
+
+#ifdef MS_STREAM_USE_MMAP
+// Create a stream from a regular file mapped into memory. Empty files and
+// anything other than a regular file (pipes, terminals, and so on) cannot
+// be mapped.
+static ms_StreamReader *StreamNewMapped(FILE *f) {
+    int fd = fileno(f);
+    struct stat st;
+    if ((fd < 0) || (fstat(fd, &st) != 0) || (!S_ISREG(st.st_mode)) ||
+        (st.st_size <= 0) || ((unsigned long long)st.st_size > (size_t)-1)) {
+        return NULL;
+    }
+
+    size_t size = (size_t)st.st_size;
+    void *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        return NULL;
+    }
+    (void)posix_madvise(data, size, POSIX_MADV_SEQUENTIAL);
+
+    ms_StreamReader *stream = StreamNew(TYPE_MAPPED, data, size);
+    if (!stream) {
+        munmap(data, size);
+        return NULL;
+    }
+
+    stream->data = data;
+    stream->size = size;
+    return stream;
+}
+#endif
+
+// Create a stream which reads a file one chunk at a time into a fixed size
+// buffer, so the stream holds the same amount of memory for any file.
+static ms_StreamReader *StreamNewChunked(FILE *f, bool owned) {
+    if (!f) {
+        return NULL;
+    }
+
+    ms_StreamReader *stream = StreamNew(TYPE_CHUNKED, NULL, 0);
+    if (!stream) {
+        return NULL;
+    }
+
+    stream->size = MS_STREAM_MAX_PUSHBACK + STREAM_CHUNK_SIZE;
+    stream->data = dsalloc(stream->size);
+    if (!stream->data) {
+        dsfree(stream);
+        return NULL;
+    }
+
+    stream->start = stream->data;
+    stream->cur = stream->data;
+    stream->end = stream->data;
+    stream->file = f;
+    stream->owned = owned;
+    return stream;
+}
+
+// Read the next chunk of a file into the buffer, after the last characters
+// of the previous chunk (which are kept so they may still be unread).
+static bool StreamRefill(ms_StreamReader *stream) {
+    if (stream->eof) {
+        return false;
+    }
+
+    char *buf = stream->data;
+    size_t avail = (size_t)(stream->end - stream->start);
+    size_t keep = (avail < MS_STREAM_MAX_PUSHBACK) ? avail : MS_STREAM_MAX_PUSHBACK;
+    memmove(buf, stream->end - keep, keep);
+
+    size_t nread = fread(&buf[keep], 1, STREAM_CHUNK_SIZE, stream->file);
+    stream->eof = (nread < STREAM_CHUNK_SIZE);
+    stream->start = buf;
+    stream->cur = &buf[keep];
+    stream->end = &buf[keep + nread];
+    return (nread > 0);
 }
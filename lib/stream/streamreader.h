@@ -28,14 +28,30 @@
 * @c fmemopen stream wrapper for a @c char* . A @c ms_StreamReader object
 * is meant to provide a light wrapper around both object types to
 * allow universal access.
+*
+* Every stream reads from a contiguous block of memory: the caller's
+* string, a read-only memory mapping of the file, or (for files which
+* cannot be mapped, such as pipes) a fixed size buffer which is refilled
+* from the file one chunk at a time. Reading or unreading a character is
+* therefore just a pointer increment or decrement, except when a chunked
+* stream reaches the end of its buffer.
 */
 
 #include <stdio.h>
 
+/**
+* @brief Number of characters which may always be unread from any stream.
+*
+* String and mapped file streams allow every character to be unread, but
+* streams which read a file in chunks only keep this many characters from
+* before the current position.
+*/
+#define MS_STREAM_MAX_PUSHBACK 16
+
 /**
 * @brief Stream wrapper object
 *
-* A @c ms_StreamReader object is the wrapper for either a @c FILE or a
+* A @c ms_StreamReader object is the wrapper for either a file or a
 * @c char* C-style string.
 */
 typedef struct ms_StreamReader ms_StreamReader;
@@ -60,12 +76,29 @@ ms_StreamReader *ms_StreamNewStringL(const char *str, size_t len);
 /**
 * @brief Create a new stream from the given file.
 *
+* Regular files are mapped into memory (and closed) where the platform
+* supports it; any other file is kept open and read in chunks, as by
+* @c ms_StreamNewFileHandle , until the stream is destroyed.
+*
 * @param fname the name of a file to open
 * @returns a new @c ms_StreamReader object or NULL if either allocation or
 *          opening the specified file failed
 */
 ms_StreamReader *ms_StreamNewFile(const char *fname);
 
+/**
+* @brief Create a new stream which reads an open file in fixed size chunks.
+*
+* The file may be any readable file, including a pipe or @c stdin , and
+* need not be seekable. The stream holds the same amount of memory for
+* any file. The caller retains ownership of the file, which must remain
+* open until the stream is destroyed.
+*
+* @param file an open @c FILE
+* @returns a new @c ms_StreamReader object or NULL if allocation failed
+*/
+ms_StreamReader *ms_StreamNewFileHandle(FILE *file);
+
 /**
 * @brief Destroy a @c ms_StreamReader object.
 */
@@ -84,11 +117,10 @@ int ms_StreamNextChar(ms_StreamReader *stream);
 * @brief Move the stream pointer back one character, allowing that
 * character to be read again.
 *
-* This function uses @c fseek to seek back one character within @c FILE*
-* streams, so it should theoretically be able to unread every character
-* to the beginning of the stream, unlike @c ungetc which is only
-* guaranteed to unread at most one character from the current pointer
-* position.
+* At least @c MS_STREAM_MAX_PUSHBACK characters may be unread from the
+* current position, and string and mapped file streams allow every
+* character to be unread back to the beginning of the stream, unlike
+* @c ungetc which is only guaranteed to unread at most one character.
 *
 * @param stream the @c ms_StreamReader object to get the next character from
 * @returns the previous character in the stream or EOF if the stream is
@@ -96,4 +128,30 @@ int ms_StreamNextChar(ms_StreamReader *stream);
 */
 int ms_StreamUnread(ms_StreamReader *stream);
 
+/**
+* @brief Return the characters which may be read from the stream without
+* copying them.
+*
+* File streams which have no more characters available are refilled
+* first, so an empty run is only ever returned at the end of the stream.
+* The returned characters remain valid until the stream is next read or
+* refilled, and are not consumed until they are skipped with
+* @c ms_StreamSkip .
+*
+* @param stream the @c ms_StreamReader object to read from
+* @param len will be set to the number of characters available
+* @returns a pointer to the next character in the stream or NULL if there
+*          are no more characters in the stream
+*/
+const char *ms_StreamAvailable(ms_StreamReader *stream, size_t *len);
+
+/**
+* @brief Consume characters previously returned by @c ms_StreamAvailable .
+*
+* @param stream the @c ms_StreamReader object to read from
+* @param len the number of characters to consume, which must not exceed
+*        the number last returned by @c ms_StreamAvailable
+*/
+void ms_StreamSkip(ms_StreamReader *stream, size_t len);
+
 #endif //MSCRIPT_STREAMREADER_H
@@ -17,8 +17,14 @@
 #include <assert.h>
 #include <stdbool.h>
 #include <stdio.h>
+#ifdef MS_USE_PTHREADS
+#include <pthread.h>
+#endif
 #include "bytecode.h"
+#include "libds/alloc.h"
 #include "libds/dict.h"
+#include "image.h"
+#include "intern.h"
 #include "vm.h"
 #include "lang.h"
 
@@ -34,6 +40,7 @@ typedef struct {
     DSArray *values;
     DSArray *idents;
     DSDict *ident_cache;        /** cache of previously used identifier names */
+    ms_ASTArena *arena;         /** arena to retain for lazily compiled functions, or NULL */
     ms_Result res;              /** indicates if any errors or warnings occurred */
     ms_Error **err;             /** error details if an error occurred */
 } CodeGenContext;
@@ -63,10 +70,15 @@ static const int EXPR_OPCODE_STACK_LEN = 50;
 static const int EXPR_VALUE_STACK_LEN = 50;
 static const int EXPR_IDENT_STACK_LEN = 50;
 
+#ifdef MS_USE_PTHREADS
+static pthread_mutex_t FUNC_COMPILE_LOCK = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
 static char *OpCodeArgToString(const ms_VMByteCode *bc, size_t i);
 static char *ByteCodeValueToString(const ms_VMByteCode *bc, size_t i);
 static char *ByteCodeIdentToString(const ms_VMByteCode *bc, size_t i);
 static char *ByteCodeArgToString(const ms_VMByteCode *bc, int arg);
+static ms_Result ByteCodeGenerate(const ms_AST *ast, ms_ASTArena *arena, ms_VMByteCode **code, ms_Error **err);
 static bool CodeGenContextCreate(CodeGenContext *ctx);
 static void CodeGenContextClean(CodeGenContext *ctx);
 static ms_VMByteCode *VMByteCodeNew(const CodeGenContext *ctx);
@@ -101,7 +113,11 @@ static void ExprComponentValueToOpCodes(const ms_Value *val, int index_or_len, C
 static void ExprUnaryOpToOpCode(ms_ExprUnaryOp op, CodeGenContext *ctx);
 static void ExprBinaryOpToOpCode(ms_ExprBinaryOp op, CodeGenContext *ctx);
 static void ExprBinaryAttrListToOpCode(const ms_ExprBinary *b, CodeGenContextExpr *ctx);
+static ms_Result FuncCompile(ms_VMFunc *fn, ms_Error **err);
+static inline void FuncCompileLock(void);
+static inline void FuncCompileUnlock(void);
 static ms_VMFunc *ExprFunctionExprToOpCodes(const ms_ValFunc *fn, CodeGenContext *ctx);
+static ms_VMByteCode *FunctionBodyToOpCodes(const ms_ValFunc *fn, CodeGenContext *ctx);
 static ms_ExprIdentType ExprAtomGetIdentType(const ms_ExprAtom *atom, ms_ExprAtomType type);
 static void PushValue(const ms_Value *val, int *index_or_len, CodeGenContext *ctx);
 static void PushIdent(const ms_Ident *ident, int *index, CodeGenContext *ctx);
@@ -113,43 +129,90 @@ static void CodeGenContextErrorSet(CodeGenContext *ctx, const char *msg);
  */
 
 ms_Result ms_VMByteCodeGenerateFromAST(const ms_AST *ast, ms_VMByteCode **code, ms_Error **err) {
-    if (!ast) {
+    return ByteCodeGenerate(ast, NULL, code, err);
+}
+
+ms_Result ms_VMByteCodeGenerateLazy(ms_ASTArena *arena, ms_VMByteCode **code, ms_Error **err) {
+    if (!arena) {
         return MS_RESULT_ERROR;
     }
 
+    return ByteCodeGenerate(arena->ast, arena, code, err);
+}
+
+ms_Result ms_VMFuncCompile(ms_VMFunc *fn, ms_Error **err) {
+    assert(fn);
+    assert(err);
+
     *err = NULL;
-    CodeGenContext ctx = { .err = err, .res = MS_RESULT_SUCCESS };
-    if (!CodeGenContextCreate(&ctx)) {
-        return MS_RESULT_ERROR;
+    if (__atomic_load_n(&fn->code, __ATOMIC_ACQUIRE)) {
+        return MS_RESULT_SUCCESS;
     }
 
-    size_t len = dsarray_len(ast);
-    for (size_t i = 0; i < len; i++) {
-        ms_Stmt *stmt = dsarray_get(ast, i);
-        StmtToOpCodes(stmt, &ctx);
+    /* the body belongs with the function, which may be part of a script
+     * shared between states rather than of the state which calls it;
+     * functions owned by a state are only called by that state, and may
+     * abandon it on its memory limit, so only shared functions are locked */
+    DSAllocator *owner = dsallocator_owner(fn);
+    if (!owner) {
+        FuncCompileLock();
     }
 
-    *code = VMByteCodeNew(&ctx);
-    CodeGenContextClean(&ctx);
-    return ctx.res;
+    ms_Result res = MS_RESULT_SUCCESS;
+    if ((!fn->code) && ((fn->image) || (fn->fn))) {
+        DSAllocator *prev = dsallocator_swap(owner);
+        res = FuncCompile(fn, err);
+        dsallocator_swap(prev);
+    }
+
+    if (!owner) {
+        FuncCompileUnlock();
+    }
+    return res;
+}
+
+ms_VMByteCode *ms_VMByteCodeNew(ms_VMOpCode *code, size_t nops, ms_VMValue *values, size_t nvals,
+                                DSBuffer **idents, size_t nidents) {
+    ms_VMByteCode *bc = dsalloc(sizeof(ms_VMByteCode));
+    if (!bc) {
+        return NULL;
+    }
+
+    bc->code = code;
+    bc->nops = nops;
+    bc->values = values;
+    bc->nvals = nvals;
+    bc->idents = idents;
+    bc->nidents = nidents;
+    bc->image = NULL;
+    return bc;
 }
 
 void ms_VMByteCodeDestroy(ms_VMByteCode *bc) {
     if (!bc) { return; }
-    free(bc->code);
+
+    /* intern references are released to the allocator they were taken on */
+    DSAllocator *prev = dsallocator_swap(dsallocator_owner(bc));
+    if (bc->image) {
+        ms_VMImageRelease(bc->image);
+        bc->image = NULL;
+    } else {
+        dsfree(bc->code);
+    }
     bc->code = NULL;
     for (size_t i = 0; i < bc->nvals; i++) {
         VMValueClean(&bc->values[i]);
     }
-    free(bc->values);
+    dsfree(bc->values);
     bc->values = NULL;
     for (size_t i = 0; i < bc->nidents; i++) {
-        dsbuf_destroy(bc->idents[i]);
+        ms_InternRelease(bc->idents[i]);
         bc->idents[i] = NULL;
     }
-    free(bc->idents);
+    dsfree(bc->idents);
     bc->idents = NULL;
-    free(bc);
+    dsfree(bc);
+    dsallocator_swap(prev);
 }
 
 void ms_VMByteCodePrint(const ms_VMByteCode *bc) {
@@ -166,7 +229,7 @@ void ms_VMByteCodePrint(const ms_VMByteCode *bc) {
 void ms_VMValueDestroy(ms_VMValue *v) {
     if (!v) { return; }
     VMValueClean(v);
-    free(v);
+    dsfree(v);
 }
 
 ms_VMOpCode ms_VMOpCodeWithArg(ms_VMOpCodeType c, int arg) {
@@ -245,11 +308,82 @@ const char *ms_VMOpCodeToString(ms_VMOpCode c) {
  * PRIVATE FUNCTIONS
  */
 
+// Compile or load the body of a function on the current allocator.
+static ms_Result FuncCompile(ms_VMFunc *fn, ms_Error **err) {
+    assert(fn);
+    assert(err);
+
+    if (fn->image) {
+        ms_VMByteCode *code;
+        if (ms_VMImageLoadChunk(fn->image, fn->chunk, &code, err) == MS_RESULT_ERROR) {
+            return MS_RESULT_ERROR;
+        }
+
+        __atomic_store_n(&fn->code, code, __ATOMIC_RELEASE);
+        ms_VMImageRelease(fn->image);
+        fn->image = NULL;
+        return MS_RESULT_SUCCESS;
+    }
+
+    CodeGenContext ctx = { .err = err, .res = MS_RESULT_SUCCESS, .arena = fn->arena };
+    ms_VMByteCode *code = FunctionBodyToOpCodes(fn->fn, &ctx);
+    if ((!code) || (ctx.res == MS_RESULT_ERROR)) {
+        if (!(*err)) {
+            CodeGenContextErrorSet(&ctx, "could not allocate memory for a function body");
+        }
+        ms_VMByteCodeDestroy(code);
+        return MS_RESULT_ERROR;
+    }
+
+    /* nested functions hold their own references to the arena */
+    __atomic_store_n(&fn->code, code, __ATOMIC_RELEASE);
+    fn->fn = NULL;
+    ms_ASTArenaRelease(fn->arena);
+    fn->arena = NULL;
+    return ctx.res;
+}
+
+/* Take the lock on compiling shared functions, since their scripts may
+ * be executed by states on any thread. */
+static inline void FuncCompileLock(void) {
+#ifdef MS_USE_PTHREADS
+    pthread_mutex_lock(&FUNC_COMPILE_LOCK);
+#endif
+}
+
+static inline void FuncCompileUnlock(void) {
+#ifdef MS_USE_PTHREADS
+    pthread_mutex_unlock(&FUNC_COMPILE_LOCK);
+#endif
+}
+
+static ms_Result ByteCodeGenerate(const ms_AST *ast, ms_ASTArena *arena, ms_VMByteCode **code, ms_Error **err) {
+    if (!ast) {
+        return MS_RESULT_ERROR;
+    }
+
+    *err = NULL;
+    CodeGenContext ctx = { .err = err, .res = MS_RESULT_SUCCESS, .arena = arena };
+    if (!CodeGenContextCreate(&ctx)) {
+        return MS_RESULT_ERROR;
+    }
+
+    size_t len = dsarray_len(ast);
+    for (size_t i = 0; i < len; i++) {
+        ms_Stmt *stmt = dsarray_get(ast, i);
+        StmtToOpCodes(stmt, &ctx);
+    }
+
+    *code = VMByteCodeNew(&ctx);
+    CodeGenContextClean(&ctx);
+    return ctx.res;
+}
+
 static bool CodeGenContextCreate(CodeGenContext *ctx) {
     assert(ctx);
 
     ctx->opcodes = dsarray_new_cap(EXPR_OPCODE_STACK_LEN, NULL,
-                                   (dsarray_free_fn)free);
+                                   (dsarray_free_fn)dsfree);
     if (!ctx->opcodes) {
         return false;
     }
@@ -271,7 +405,7 @@ static bool CodeGenContextCreate(CodeGenContext *ctx) {
 
     ctx->ident_cache = dsdict_new((dsdict_hash_fn)dsbuf_hash,
                                   (dsdict_compare_fn)dsbuf_compare,
-                                  NULL, (dsdict_free_fn)free);
+                                  NULL, (dsdict_free_fn)dsfree);
     if (!ctx->ident_cache) {
         dsarray_destroy(ctx->opcodes);
         dsarray_destroy(ctx->values);
@@ -292,32 +426,33 @@ static void CodeGenContextClean(CodeGenContext *ctx) {
 static ms_VMByteCode *VMByteCodeNew(const CodeGenContext *ctx) {
     if (!ctx) { return NULL; }
 
-    ms_VMByteCode *bc = malloc(sizeof(ms_VMByteCode));
+    ms_VMByteCode *bc = dsalloc(sizeof(ms_VMByteCode));
     if (!bc) {
         return NULL;
     }
 
+    bc->image = NULL;
     bc->nops = dsarray_len(ctx->opcodes);
-    bc->code = malloc(sizeof(ms_VMOpCode) * (bc->nops));
+    bc->code = dsalloc(sizeof(ms_VMOpCode) * (bc->nops));
     if (!bc->code) {
-        free(bc);
+        dsfree(bc);
         return NULL;
     }
 
     bc->nvals = dsarray_len(ctx->values);
-    bc->values = malloc(sizeof(ms_VMValue) * (bc->nvals));
+    bc->values = dsalloc(sizeof(ms_VMValue) * (bc->nvals));
     if (!bc->values) {
-        free(bc->code);
-        free(bc);
+        dsfree(bc->code);
+        dsfree(bc);
         return NULL;
     }
 
     bc->nidents = dsarray_len(ctx->idents);
-    bc->idents = malloc(sizeof(ms_Ident *) * (bc->nidents));
+    bc->idents = dsalloc(sizeof(ms_Ident *) * (bc->nidents));
     if (!bc->idents) {
-        free(bc->values);
-        free(bc->code);
-        free(bc);
+        dsfree(bc->values);
+        dsfree(bc->code);
+        dsfree(bc);
         return NULL;
     }
 
@@ -351,7 +486,7 @@ static void VMValueClean(ms_VMValue *v) {
     switch(v->type) {
         case VMVAL_STR:
             if (v->val.s) {
-                dsbuf_destroy(v->val.s);
+                ms_InternRelease(v->val.s);
                 v->val.s = NULL;
             }
             break;
@@ -361,14 +496,21 @@ static void VMValueClean(ms_VMValue *v) {
                 v->val.fn->args = NULL;
                 ms_VMByteCodeDestroy(v->val.fn->code);
                 v->val.fn->code = NULL;
-                free(v->val.fn);
+                v->val.fn->fn = NULL;
+                ms_ASTArenaRelease(v->val.fn->arena);
+                v->val.fn->arena = NULL;
+                ms_VMImageRelease(v->val.fn->image);
+                v->val.fn->image = NULL;
+                dsfree(v->val.fn);
                 v->val.fn = NULL;
             }
             break;
         case VMVAL_INT:         /* fall through */
         case VMVAL_FLOAT:       /* fall through */
         case VMVAL_BOOL:        /* fall through */
-        case VMVAL_NULL:
+        case VMVAL_NULL:        /* fall through */
+        case VMVAL_ROPE:        /* fall through */
+        case VMVAL_SLICE:       /* ropes and slices are only created at runtime */
             break;
     }
 }
@@ -429,13 +571,19 @@ gen_val_string:
         case VMVAL_FUNC:
             len = snprintf(buf, len, "<func %p>", (void *)v->val.fn);
             break;
+        case VMVAL_ROPE:
+            len = snprintf(buf, len, "<rope %p>", (void *)v->val.r);
+            break;
+        case VMVAL_SLICE:
+            len = snprintf(buf, len, "<slice %p>", (void *)v->val.sl);
+            break;
     }
 
     if (buf) {
         return buf;
     }
 
-    buf = malloc(len + 1);
+    buf = dsalloc(len + 1);
     if (!buf) {
         return NULL;
     }
@@ -451,7 +599,7 @@ static char *ByteCodeIdentToString(const ms_VMByteCode *bc, size_t i) {
 static char *ByteCodeArgToString(const ms_VMByteCode *bc, int arg) {
     assert(bc);
     size_t len = snprintf(NULL, 0, "%d", arg);
-    char *buf = malloc(len + 1);
+    char *buf = dsalloc(len + 1);
     if (!buf) {
         return NULL;
     }
@@ -1457,48 +1605,66 @@ static ms_VMFunc *ExprFunctionExprToOpCodes(const ms_ValFunc *fn, CodeGenContext
     assert(fn);
     assert(ctx);
 
-    if (!CodeGenContextCreate(ctx)) {
-        return NULL;
-    }
-
-    size_t nstmts = dsarray_len(fn->block);
-    for (size_t i = 0; i < nstmts; i++) {
-        ms_Stmt *stmt = dsarray_get(fn->block, i);
-        StmtToOpCodes(stmt, ctx);
-    }
-
-    ms_VMFunc *func = malloc(sizeof(ms_VMFunc));
+    ms_VMFunc *func = dsalloc(sizeof(ms_VMFunc));
     if (!func) {
-        CodeGenContextClean(ctx);
         return NULL;
     }
 
+    func->code = NULL;
+    func->fn = NULL;
+    func->arena = NULL;
+    func->image = NULL;
+    func->chunk = 0;
+
     size_t nargs = dsarray_len(fn->args);
-    func->args = dsarray_new_cap(nargs, (dsarray_compare_fn)dsbuf_compare,
-                                 (dsarray_free_fn)dsbuf_destroy);
+    func->args = dsarray_new_cap(nargs, (dsarray_compare_fn)ms_InternCompare,
+                                 (dsarray_free_fn)ms_InternRelease);
     if (!func->args) {
-        free(func);
-        CodeGenContextClean(ctx);
+        dsfree(func);
         return NULL;
     }
 
     for (size_t i = 0; i < nargs; i++) {
         ms_Ident *ident = dsarray_get(fn->args, i);
-        DSBuffer *name = dsbuf_dup(ident->name);
+        DSBuffer *name = ms_InternStr(ident->name);
         if (!name) {
-            free(func);
             dsarray_destroy(func->args);
-            CodeGenContextClean(ctx);
+            dsfree(func);
             return NULL;
         }
         dsarray_append(func->args, name);
     }
 
-    func->code = VMByteCodeNew(ctx);
-    CodeGenContextClean(ctx);
+    /* leave the body to be compiled when the function is first called */
+    if (ctx->arena) {
+        func->fn = fn;
+        func->arena = ms_ASTArenaRetain(ctx->arena);
+        return func;
+    }
+
+    func->code = FunctionBodyToOpCodes(fn, ctx);
     return func;
 }
 
+static ms_VMByteCode *FunctionBodyToOpCodes(const ms_ValFunc *fn, CodeGenContext *ctx) {
+    assert(fn);
+    assert(ctx);
+
+    if (!CodeGenContextCreate(ctx)) {
+        return NULL;
+    }
+
+    size_t nstmts = dsarray_len(fn->block);
+    for (size_t i = 0; i < nstmts; i++) {
+        ms_Stmt *stmt = dsarray_get(fn->block, i);
+        StmtToOpCodes(stmt, ctx);
+    }
+
+    ms_VMByteCode *code = VMByteCodeNew(ctx);
+    CodeGenContextClean(ctx);
+    return code;
+}
+
 static ms_ExprIdentType ExprAtomGetIdentType(const ms_ExprAtom *atom, ms_ExprAtomType type) {
     assert(atom);
     ms_ExprIdentType ident_type = EXPRIDENT_NONE;
@@ -1522,7 +1688,7 @@ static void PushValue(const ms_Value *val, int *index_or_len, CodeGenContext *ct
     assert(index_or_len);
     assert(ctx);
 
-    ms_VMValue *newv = malloc(sizeof(ms_VMValue));
+    ms_VMValue *newv = dsalloc(sizeof(ms_VMValue));
     if (!newv) {
         ctx->res = MS_RESULT_ERROR;
         CodeGenContextErrorSet(ctx, "could not allocate memory for a value");
@@ -1544,7 +1710,7 @@ static void PushValue(const ms_Value *val, int *index_or_len, CodeGenContext *ct
             break;
         case MSVAL_STR:
             newv->type = VMVAL_STR;
-            newv->val.s = dsbuf_dup(val->val.s);
+            newv->val.s = ms_InternStr(val->val.s);
             if (!newv->val.s) {
                 ctx->res = MS_RESULT_ERROR;
                 CodeGenContextErrorSet(ctx, "could not allocate memory a string");
@@ -1562,7 +1728,7 @@ static void PushValue(const ms_Value *val, int *index_or_len, CodeGenContext *ct
                 ExprToOpCodes(elem, ctx);
             }
             *index_or_len = (int)len;
-            free(newv);
+            dsfree(newv);
             return;     /* return so length isn't overwritten */
         }
         case MSVAL_OBJECT: {
@@ -1573,11 +1739,11 @@ static void PushValue(const ms_Value *val, int *index_or_len, CodeGenContext *ct
                 ExprToOpCodes(tuple->val, ctx);
             }
             *index_or_len = (int)(len * 2);
-            free(newv);
+            dsfree(newv);
             return;     /* return so length isn't overwritten */
         }
         case MSVAL_FUNC: {
-            CodeGenContext fnctx = { .err = ctx->err, .res = MS_RESULT_SUCCESS };
+            CodeGenContext fnctx = { .err = ctx->err, .res = MS_RESULT_SUCCESS, .arena = ctx->arena };
             newv->type = VMVAL_FUNC;
             newv->val.fn = ExprFunctionExprToOpCodes(val->val.fn, &fnctx);
             if (fnctx.res == MS_RESULT_ERROR) {
@@ -1612,8 +1778,8 @@ static void PushIdent(const ms_Ident *ident, int *index, CodeGenContext *ctx) {
         return;
     }
 
-    /* push the identifer onto the context stack */
-    DSBuffer *name = dsbuf_dup(ident->name);
+    /* push the canonical identifer onto the context stack */
+    DSBuffer *name = ms_InternStr(ident->name);
     if (!name) {
         ctx->res = MS_RESULT_ERROR;
         CodeGenContextErrorSet(ctx, "could not allocate memory for an ident");
@@ -1628,7 +1794,7 @@ static void PushIdent(const ms_Ident *ident, int *index, CodeGenContext *ctx) {
     *index = (int)(nidents - 1);
 
     /* cache this identifier */
-    size_t *new_index = malloc(sizeof(size_t));
+    size_t *new_index = dsalloc(sizeof(size_t));
     if (!new_index) {
         ctx->res = MS_RESULT_ERROR;
         CodeGenContextErrorSet(ctx, "could not allocate memory for an ident index");
@@ -1643,7 +1809,7 @@ static void PushOpCode(ms_VMOpCodeType type, int arg, CodeGenContext *ctx) {
     assert(ctx);
     assert(arg <= OPC_ARG_MAX);
 
-    ms_VMOpCode *o = malloc(sizeof(ms_VMOpCode));
+    ms_VMOpCode *o = dsalloc(sizeof(ms_VMOpCode));
     if (!o) {
         ctx->res = MS_RESULT_ERROR;
         CodeGenContextErrorSet(ctx, "could not allocate memory for an opcode");
@@ -1659,7 +1825,7 @@ static void CodeGenContextErrorSet(CodeGenContext *ctx, const char *msg) {
 
     ms_Error **err = ctx->err;
     assert(!(*err));
-    *err = malloc(sizeof(ms_Error));
+    *err = dsalloc(sizeof(ms_Error));
     if (!(*err)) {
         return;
     }
@@ -1671,7 +1837,7 @@ static void CodeGenContextErrorSet(CodeGenContext *ctx, const char *msg) {
     }
 
     (*err)->len = (size_t)len;
-    (*err)->msg = malloc((size_t)len + 1);
+    (*err)->msg = dsalloc((size_t)len + 1);
     if ((*err)->msg) {
         snprintf((*err)->msg, len + 1, msg);
     }
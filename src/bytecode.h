@@ -96,10 +96,17 @@ typedef long long ms_VMInt;
 typedef DSBuffer ms_VMStr;
 typedef bool ms_VMBool;
 typedef const void ms_VMNull;
+typedef struct ms_VMRope ms_VMRope;
+typedef struct ms_VMSlice ms_VMSlice;
+typedef struct ms_VMImage ms_VMImage;
 
 typedef struct {
     DSArray *args;
-    ms_VMByteCode *code;
+    ms_VMByteCode *code;                            /* function body, once compiled (set atomically) */
+    const ms_ValFunc *fn;                           /* function to compile on first call, or NULL */
+    ms_ASTArena *arena;                             /* arena holding `fn` until it is compiled */
+    ms_VMImage *image;                              /* image to load the body from on first call, or NULL */
+    size_t chunk;                                   /* chunk of `image` holding the body */
 } ms_VMFunc;
 
 typedef enum {
@@ -109,6 +116,8 @@ typedef enum {
     VMVAL_BOOL,
     VMVAL_NULL,
     VMVAL_FUNC,
+    VMVAL_ROPE,
+    VMVAL_SLICE,
 } ms_VMDataType;
 
 typedef union {
@@ -118,6 +127,8 @@ typedef union {
     ms_VMBool b;
     ms_VMNull *n;
     ms_VMFunc *fn;
+    ms_VMRope *r;
+    ms_VMSlice *sl;
 } ms_VMData;
 
 typedef struct {
@@ -132,6 +143,7 @@ struct ms_VMByteCode {
     size_t nops;                                    /* number of opcodes */
     size_t nvals;                                   /* number of values */
     size_t nidents;                                 /* number of idents */
+    ms_VMImage *image;                              /* image holding `code`, or NULL if `code` is owned */
 };
 
 /**
@@ -139,6 +151,38 @@ struct ms_VMByteCode {
 */
 ms_Result ms_VMByteCodeGenerateFromAST(const ms_AST *ast, ms_VMByteCode **code, ms_Error **err);
 
+/**
+* @brief Generate mscript VM bytecode from the abstract syntax tree held by
+* an arena, deferring the compilation of each function body until it is
+* first called.
+*
+* Functions which have not yet been compiled hold a reference to @c arena ,
+* so the (verified) tree remains valid until they are compiled or destroyed.
+*/
+ms_Result ms_VMByteCodeGenerateLazy(ms_ASTArena *arena, ms_VMByteCode **code, ms_Error **err);
+
+/**
+* @brief Compile the body of a function generated by
+* @c ms_VMByteCodeGenerateLazy (or load it from the image it was loaded
+* from), if it has not been compiled already.
+*
+* Functions of scripts shared between states may be called on several
+* threads at once; the body is compiled by only one of them, and the
+* others wait for it.
+*/
+ms_Result ms_VMFuncCompile(ms_VMFunc *fn, ms_Error **err);
+
+/**
+* @brief Create bytecode from arrays of opcodes, values and identifiers
+* which were generated elsewhere (such as by @c ms_ParserCompile ).
+*
+* The new bytecode takes ownership of each array; string values and
+* identifiers must be interned. If @c NULL is returned, the arrays remain
+* owned by the caller.
+*/
+ms_VMByteCode *ms_VMByteCodeNew(ms_VMOpCode *code, size_t nops, ms_VMValue *values, size_t nvals,
+                                DSBuffer **idents, size_t nidents);
+
 /**
 * @brief Print a representation of the bytecode format to the stdout.
 */
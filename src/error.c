@@ -14,6 +14,7 @@
  *  limitations under the License.
  *----------------------------------------------------------------------------*/
 
+#include "libds/alloc.h"
 #include "error.h"
 
 void ms_ErrorDestroy(ms_Error *err) {
@@ -30,7 +31,7 @@ void ms_ErrorDestroy(ms_Error *err) {
             break;
     }
 
-    free(err->msg);
+    dsfree(err->msg);
     err->msg = NULL;
-    free(err);
+    dsfree(err);
 }
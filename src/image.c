@@ -0,0 +1,1036 @@
+/*------------------------------------------------------------------------------
+ *    Copyright 2016 Chris Rink
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *----------------------------------------------------------------------------*/
+
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "libds/alloc.h"
+#include "libds/array.h"
+#include "libds/dict.h"
+#include "image.h"
+#include "intern.h"
+#include "vm.h"
+
+#define IMAGE_ALIGN (8)
+#define IMAGE_TEMP_SUFFIX ".XXXXXX"
+
+static const uint32_t IMAGE_BYTE_ORDER = 0x01020304;
+static const uint64_t IMAGE_CHECKSUM_BASIS = UINT64_C(0xcbf29ce484222325);
+static const uint64_t IMAGE_CHECKSUM_PRIME = UINT64_C(0x100000001b3);
+
+static const char *const ERR_CANNOT_READ_FILE = "could not read file '%s'";
+static const char *const ERR_CANNOT_WRITE_FILE = "could not write file '%s'";
+static const char *const ERR_NOT_AN_IMAGE = "'%s' is not a bytecode file";
+static const char *const ERR_IMAGE_VERSION = "'%s' was written for bytecode version %u (expected %u)";
+static const char *const ERR_IMAGE_PLATFORM = "'%s' was written by an incompatible machine";
+static const char *const ERR_IMAGE_CORRUPT = "bytecode file is corrupt";
+static const char *const ERR_CONSTANT_NOT_SERIALIZABLE = "bytecode constant cannot be written";
+static const char *const ERR_OUT_OF_MEMORY = "out of memory";
+
+typedef struct {
+    char magic[4];                  /** MS_VM_IMAGE_MAGIC */
+    uint32_t version;               /** MS_VM_IMAGE_VERSION of the writer */
+    uint32_t byteorder;             /** IMAGE_BYTE_ORDER, in the byte order of the writer */
+    uint32_t opcodesize;            /** size of an opcode on the writer */
+    uint64_t size;                  /** size of the whole image in bytes */
+    uint64_t nchunks;               /** number of chunks; the module is chunk 0 */
+    uint64_t chunks;                /** offset of the chunk table */
+    uint64_t nparams;               /** number of script parameter names */
+    uint64_t params;                /** offset of the script parameter names */
+    uint64_t strings;               /** offset of the string section */
+    uint64_t nstrbytes;             /** length of the string section in bytes */
+    uint64_t checksum;              /** checksum of the header, chunk table, parameter names and strings */
+} ImageHeader;
+
+typedef struct {
+    uint64_t off;                   /** offset of the bytes within the string section */
+    uint64_t len;                   /** length of the string in bytes */
+} ImageString;
+
+typedef struct {
+    uint64_t code;                  /** offset of the opcodes */
+    uint64_t nops;                  /** number of opcodes */
+    uint64_t values;                /** offset of the constants */
+    uint64_t nvals;                 /** number of constants */
+    uint64_t idents;                /** offset of the identifier names */
+    uint64_t nidents;               /** number of identifiers */
+    uint64_t size;                  /** number of bytes from `code` to the end of the chunk's tables */
+    uint64_t checksum;              /** checksum of those bytes */
+} ImageChunk;
+
+typedef struct {
+    uint32_t type;                  /** ms_VMDataType of the constant */
+    uint32_t chunk;                 /** chunk holding the body of a function */
+    union {
+        int64_t i;
+        double f;
+        uint64_t b;
+        ImageString s;              /** string bytes */
+        ImageString args;           /** offset and number of the names of function arguments */
+    } val;
+} ImageValue;
+
+struct ms_VMImage {
+    const char *base;               /** start of the mapped file */
+    size_t size;                    /** size of the mapped file in bytes */
+    size_t refs;                    /** number of references held to the image, changed atomically */
+};
+
+typedef struct {
+    size_t values;                  /** least depth of the data stack on any path to the opcode, or SIZE_MAX */
+    size_t blocks;                  /** least depth of the block stack on any path to the opcode */
+    bool queued;                    /** true if the opcode is waiting to be checked */
+} ImageStackDepth;
+
+typedef struct {
+    char *buf;                      /** bytes written so far */
+    size_t len;                     /** number of bytes written */
+    size_t cap;                     /** capacity of `buf` */
+    bool failed;                    /** true if any write could not be made */
+} ImageBuffer;
+
+typedef struct {
+    ImageBuffer data;               /** header, chunks and tables */
+    ImageBuffer strs;               /** string section */
+    ImageBuffer table;              /** chunk table, appended to `data` once complete */
+    DSArray *chunks;                /** bytecode for each chunk, in chunk order */
+    DSDict *strcache;               /** offset (plus one) of each interned string already written */
+    ms_Error **err;                 /** error, if any */
+} ImageWriter;
+
+static bool ImageWriteChunk(ImageWriter *w, ms_VMByteCode *bc);
+static bool ImageWriteValue(ImageWriter *w, const ms_VMValue *v, ImageValue *iv);
+static uint64_t ImageWriteNames(ImageWriter *w, DSBuffer *const *names, const DSArray *list, size_t n);
+static ImageString ImageWriteString(ImageWriter *w, const DSBuffer *str);
+static bool ImageWriteFile(const char *fname, const void *data, size_t len);
+static uint64_t ImageBufferAppend(ImageBuffer *b, const void *data, size_t len);
+static uint64_t ImageBufferReserve(ImageBuffer *b, size_t len);
+static void ImageBufferAlign(ImageBuffer *b);
+static inline const ImageHeader *ImageGetHeader(const ms_VMImage *img);
+static bool ImageLoadValue(ms_VMImage *img, const ImageValue *iv, ms_VMValue *v);
+static bool ImageChunkValid(const ms_VMImage *img, const ImageChunk *c);
+static bool ImageLoadOpCodes(const ms_VMByteCode *bc);
+static bool ImageVerifyStack(const ms_VMByteCode *bc);
+static void ImageStackMerge(ImageStackDepth *depths, size_t *work, size_t *nwork,
+                            size_t ip, size_t values, size_t blocks);
+static DSBuffer *ImageInternString(const ms_VMImage *img, const ImageString *str);
+static bool ImageTableValid(const ms_VMImage *img, uint64_t off, uint64_t n, size_t size);
+static bool ImageStringValid(const ms_VMImage *img, const ImageString *str);
+static uint64_t ImageHeaderChecksum(const char *base);
+static uint64_t ImageChecksum(uint64_t sum, const void *data, size_t len);
+static void ImageErrorSet(ms_Error **err, const char *msg, ...);
+
+/*
+ * PUBLIC FUNCTIONS
+ */
+
+ms_Result ms_VMImageWrite(ms_VMByteCode *bc, DSBuffer *const *params, size_t nparams,
+                          const char *fname, ms_Error **err) {
+    assert(bc);
+    assert(params || (nparams == 0));
+    assert(fname);
+    assert(err);
+
+    *err = NULL;
+    DSAllocator *prev = dsallocator_swap(NULL);
+    ms_Result res = MS_RESULT_ERROR;
+
+    ImageWriter w = { .err = err };
+    w.chunks = dsarray_new(NULL, NULL);
+    w.strcache = dsdict_new((dsdict_hash_fn)ms_InternHash,
+                            (dsdict_compare_fn)ms_InternCompare, NULL, NULL);
+    if ((!w.chunks) || (!w.strcache) || (!dsarray_append(w.chunks, bc))) {
+        goto cleanup_image_write;
+    }
+
+    /* nested functions are appended to the chunk list as they are found */
+    ImageHeader hdr = { .version = MS_VM_IMAGE_VERSION };
+    ImageBufferReserve(&w.data, sizeof(ImageHeader));
+    for (size_t i = 0; i < dsarray_len(w.chunks); i++) {
+        if (!ImageWriteChunk(&w, dsarray_get(w.chunks, i))) {
+            goto cleanup_image_write;
+        }
+    }
+
+    hdr.nparams = nparams;
+    hdr.params = ImageWriteNames(&w, params, NULL, nparams);
+    hdr.nchunks = dsarray_len(w.chunks);
+    ImageBufferAlign(&w.data);
+    hdr.chunks = ImageBufferAppend(&w.data, w.table.buf, w.table.len);
+    ImageBufferAlign(&w.data);
+    hdr.nstrbytes = w.strs.len;
+    hdr.strings = ImageBufferAppend(&w.data, w.strs.buf, w.strs.len);
+    if ((w.data.failed) || (w.strs.failed) || (w.table.failed)) {
+        goto cleanup_image_write;
+    }
+
+    memcpy(hdr.magic, MS_VM_IMAGE_MAGIC, sizeof(hdr.magic));
+    hdr.byteorder = IMAGE_BYTE_ORDER;
+    hdr.opcodesize = sizeof(ms_VMOpCode);
+    hdr.size = w.data.len;
+    memcpy(w.data.buf, &hdr, sizeof(ImageHeader));
+    hdr.checksum = ImageHeaderChecksum(w.data.buf);
+    memcpy(w.data.buf, &hdr, sizeof(ImageHeader));
+
+    if (!ImageWriteFile(fname, w.data.buf, w.data.len)) {
+        ImageErrorSet(err, ERR_CANNOT_WRITE_FILE, fname);
+        goto cleanup_image_write;
+    }
+    res = MS_RESULT_SUCCESS;
+
+cleanup_image_write:
+    if ((res == MS_RESULT_ERROR) && (!(*err))) {
+        ImageErrorSet(err, ERR_OUT_OF_MEMORY);
+    }
+    dsfree(w.data.buf);
+    dsfree(w.strs.buf);
+    dsfree(w.table.buf);
+    dsarray_destroy(w.chunks);
+    dsdict_destroy(w.strcache);
+    dsallocator_swap(prev);
+    return res;
+}
+
+bool ms_VMImageIsFile(const char *fname) {
+    assert(fname);
+
+    char magic[sizeof(MS_VM_IMAGE_MAGIC) - 1];
+    FILE *f = fopen(fname, "rb");
+    if (!f) {
+        return false;
+    }
+
+    size_t len = fread(magic, 1, sizeof(magic), f);
+    fclose(f);
+    return (len == sizeof(magic)) && (memcmp(magic, MS_VM_IMAGE_MAGIC, sizeof(magic)) == 0);
+}
+
+ms_VMImage *ms_VMImageOpen(const char *fname, ms_Error **err) {
+    assert(fname);
+    assert(err);
+
+    *err = NULL;
+    int fd = open(fname, O_RDONLY);
+    if (fd < 0) {
+        ImageErrorSet(err, ERR_CANNOT_READ_FILE, fname);
+        return NULL;
+    }
+
+    struct stat st;
+    if ((fstat(fd, &st) != 0) || (st.st_size < (off_t)sizeof(ImageHeader))) {
+        close(fd);
+        ImageErrorSet(err, ERR_NOT_AN_IMAGE, fname);
+        return NULL;
+    }
+
+    /* the mapping remains valid once the file is closed */
+    size_t size = (size_t)st.st_size;
+    void *base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        ImageErrorSet(err, ERR_CANNOT_READ_FILE, fname);
+        return NULL;
+    }
+
+    ms_VMImage tmp = { .base = base, .size = size, .refs = 1 };
+    const ImageHeader *hdr = ImageGetHeader(&tmp);
+    if (memcmp(hdr->magic, MS_VM_IMAGE_MAGIC, sizeof(hdr->magic)) != 0) {
+        ImageErrorSet(err, ERR_NOT_AN_IMAGE, fname);
+    } else if (hdr->byteorder != IMAGE_BYTE_ORDER) {
+        ImageErrorSet(err, ERR_IMAGE_PLATFORM, fname);
+    } else if (hdr->version != MS_VM_IMAGE_VERSION) {
+        ImageErrorSet(err, ERR_IMAGE_VERSION, fname, (unsigned)hdr->version, (unsigned)MS_VM_IMAGE_VERSION);
+    } else if (hdr->opcodesize != sizeof(ms_VMOpCode)) {
+        ImageErrorSet(err, ERR_IMAGE_PLATFORM, fname);
+    } else if ((hdr->size != size) || (hdr->nchunks == 0) || (hdr->nchunks > UINT32_MAX) ||
+               (!ImageTableValid(&tmp, hdr->chunks, hdr->nchunks, sizeof(ImageChunk))) ||
+               (!ImageTableValid(&tmp, hdr->params, hdr->nparams, sizeof(ImageString))) ||
+               (!ImageTableValid(&tmp, hdr->strings, hdr->nstrbytes, 1)) ||
+               (ImageHeaderChecksum(base) != hdr->checksum)) {
+        ImageErrorSet(err, ERR_IMAGE_CORRUPT);
+    }
+
+    if (*err) {
+        munmap(base, size);
+        return NULL;
+    }
+
+    DSAllocator *prev = dsallocator_swap(NULL);
+    ms_VMImage *img = dsalloc(sizeof(ms_VMImage));
+    dsallocator_swap(prev);
+    if (!img) {
+        munmap(base, size);
+        ImageErrorSet(err, ERR_OUT_OF_MEMORY);
+        return NULL;
+    }
+
+    *img = tmp;
+    return img;
+}
+
+size_t ms_VMImageParamCount(const ms_VMImage *img) {
+    assert(img);
+    return (size_t)ImageGetHeader(img)->nparams;
+}
+
+DSBuffer *ms_VMImageParam(const ms_VMImage *img, size_t i) {
+    assert(img);
+    const ImageHeader *hdr = ImageGetHeader(img);
+    assert(i < hdr->nparams);
+
+    const ImageString *params = (const ImageString *)(img->base + hdr->params);
+    return ImageInternString(img, &params[i]);
+}
+
+ms_Result ms_VMImageLoadChunk(ms_VMImage *img, size_t chunk, ms_VMByteCode **code, ms_Error **err) {
+    assert(img);
+    assert(code);
+    assert(err);
+
+    *err = NULL;
+    *code = NULL;
+    const ImageHeader *hdr = ImageGetHeader(img);
+    if (chunk >= hdr->nchunks) {
+        ImageErrorSet(err, ERR_IMAGE_CORRUPT);
+        return MS_RESULT_ERROR;
+    }
+
+    const ImageChunk *c = &((const ImageChunk *)(img->base + hdr->chunks))[chunk];
+    if (!ImageChunkValid(img, c)) {
+        ImageErrorSet(err, ERR_IMAGE_CORRUPT);
+        return MS_RESULT_ERROR;
+    }
+
+    /* chunks may be loaded on behalf of any state, but belong to none */
+    DSAllocator *prev = dsallocator_swap(NULL);
+    ms_VMByteCode *bc = dscalloc(1, sizeof(ms_VMByteCode));
+    if (!bc) {
+        goto cleanup_load_chunk;
+    }
+
+    /* opcodes are executed in place */
+    bc->image = ms_VMImageRetain(img);
+    bc->code = (ms_VMOpCode *)(img->base + c->code);
+    bc->nops = (size_t)c->nops;
+
+    if (c->nvals > 0) {
+        bc->values = dscalloc((size_t)c->nvals, sizeof(ms_VMValue));
+        if (!bc->values) {
+            goto cleanup_load_chunk;
+        }
+    }
+
+    const ImageValue *values = (const ImageValue *)(img->base + c->values);
+    for (; bc->nvals < c->nvals; bc->nvals++) {
+        if (!ImageLoadValue(img, &values[bc->nvals], &bc->values[bc->nvals])) {
+            goto cleanup_load_chunk;
+        }
+    }
+
+    if (c->nidents > 0) {
+        bc->idents = dscalloc((size_t)c->nidents, sizeof(DSBuffer *));
+        if (!bc->idents) {
+            goto cleanup_load_chunk;
+        }
+    }
+
+    const ImageString *idents = (const ImageString *)(img->base + c->idents);
+    for (; bc->nidents < c->nidents; bc->nidents++) {
+        bc->idents[bc->nidents] = ImageInternString(img, &idents[bc->nidents]);
+        if (!bc->idents[bc->nidents]) {
+            goto cleanup_load_chunk;
+        }
+    }
+
+    if (!ImageLoadOpCodes(bc)) {
+        goto cleanup_load_chunk;
+    }
+
+    dsallocator_swap(prev);
+    *code = bc;
+    return MS_RESULT_SUCCESS;
+
+cleanup_load_chunk:
+    /* every constant which failed to load has been reset to null */
+    ms_VMByteCodeDestroy(bc);
+    dsallocator_swap(prev);
+    ImageErrorSet(err, (bc) ? ERR_IMAGE_CORRUPT : ERR_OUT_OF_MEMORY);
+    return MS_RESULT_ERROR;
+}
+
+ms_Result ms_VMImageVerify(const ms_VMImage *img, ms_Error **err) {
+    assert(img);
+    assert(err);
+
+    *err = NULL;
+    DSAllocator *prev = dsallocator_swap(NULL);
+    const ImageHeader *hdr = ImageGetHeader(img);
+    const ImageChunk *chunks = (const ImageChunk *)(img->base + hdr->chunks);
+    bool valid = true;
+    for (size_t i = 0; (valid) && (i < hdr->nchunks); i++) {
+        const ImageChunk *c = &chunks[i];
+        valid = ImageChunkValid(img, c);
+        if (valid) {
+            /* opcodes are checked against the sizes of their tables alone */
+            ms_VMByteCode bc = {
+                .code = (ms_VMOpCode *)(img->base + c->code),
+                .nops = (size_t)c->nops,
+                .nvals = (size_t)c->nvals,
+                .nidents = (size_t)c->nidents,
+            };
+            valid = ImageLoadOpCodes(&bc);
+        }
+    }
+    dsallocator_swap(prev);
+
+    if (!valid) {
+        ImageErrorSet(err, ERR_IMAGE_CORRUPT);
+        return MS_RESULT_ERROR;
+    }
+    return MS_RESULT_SUCCESS;
+}
+
+ms_VMImage *ms_VMImageRetain(ms_VMImage *img) {
+    assert(img);
+
+    /* references are taken and dropped by scripts running on any thread */
+    __atomic_add_fetch(&img->refs, 1, __ATOMIC_RELAXED);
+    return img;
+}
+
+void ms_VMImageRelease(ms_VMImage *img) {
+    if (!img) { return; }
+    size_t refs = __atomic_sub_fetch(&img->refs, 1, __ATOMIC_ACQ_REL);
+    assert(refs != SIZE_MAX);
+    if (refs > 0) {
+        return;
+    }
+
+    munmap((void *)img->base, img->size);
+    dsfree(img);
+}
+
+/*
+ * WRITER FUNCTIONS
+ */
+
+// Write the opcodes, constants and identifiers of one chunk, queueing
+// the body of each function it defines to be written as a later chunk.
+static bool ImageWriteChunk(ImageWriter *w, ms_VMByteCode *bc) {
+    assert(w);
+    assert(bc);
+
+    ImageChunk c = { .nops = bc->nops, .nvals = bc->nvals, .nidents = bc->nidents };
+    ImageBufferAlign(&w->data);
+    c.code = ImageBufferAppend(&w->data, bc->code, bc->nops * sizeof(ms_VMOpCode));
+
+    ImageBufferAlign(&w->data);
+    c.values = ImageBufferReserve(&w->data, bc->nvals * sizeof(ImageValue));
+    for (size_t i = 0; i < bc->nvals; i++) {
+        ImageValue iv = { .type = (uint32_t)bc->values[i].type };
+        if (!ImageWriteValue(w, &bc->values[i], &iv)) {
+            return false;
+        }
+        if (!w->data.failed) {
+            memcpy(w->data.buf + c.values + (i * sizeof(ImageValue)), &iv, sizeof(ImageValue));
+        }
+    }
+
+    c.idents = ImageWriteNames(w, bc->idents, NULL, bc->nidents);
+    c.size = w->data.len - c.code;
+    if (!w->data.failed) {
+        c.checksum = ImageChecksum(IMAGE_CHECKSUM_BASIS, w->data.buf + c.code, (size_t)c.size);
+    }
+    ImageBufferAppend(&w->table, &c, sizeof(ImageChunk));
+    return true;
+}
+
+static bool ImageWriteValue(ImageWriter *w, const ms_VMValue *v, ImageValue *iv) {
+    assert(w);
+    assert(v);
+    assert(iv);
+
+    switch (v->type) {
+        case VMVAL_FLOAT:
+            iv->val.f = v->val.f;
+            return true;
+        case VMVAL_INT:
+            iv->val.i = v->val.i;
+            return true;
+        case VMVAL_BOOL:
+            iv->val.b = (v->val.b) ? 1 : 0;
+            return true;
+        case VMVAL_NULL:
+            return true;
+        case VMVAL_STR:
+            iv->val.s = ImageWriteString(w, v->val.s);
+            return true;
+        case VMVAL_FUNC: {
+            ms_VMFunc *fn = v->val.fn;
+            if (ms_VMFuncCompile(fn, w->err) == MS_RESULT_ERROR) {
+                return false;
+            }
+
+            iv->chunk = (uint32_t)dsarray_len(w->chunks);
+            if (!dsarray_append(w->chunks, fn->code)) {
+                return false;
+            }
+
+            size_t nargs = dsarray_len(fn->args);
+            iv->val.args.len = nargs;
+            iv->val.args.off = ImageWriteNames(w, NULL, fn->args, nargs);
+            return true;
+        }
+        case VMVAL_ROPE:        /* fall through */
+        case VMVAL_SLICE:       /* ropes and slices are only created at runtime */
+            break;
+    }
+
+    ImageErrorSet(w->err, ERR_CONSTANT_NOT_SERIALIZABLE);
+    return false;
+}
+
+// Write a table of references to names in the string section, returning
+// the offset of the table. Names are taken from `list` if it is given.
+static uint64_t ImageWriteNames(ImageWriter *w, DSBuffer *const *names, const DSArray *list, size_t n) {
+    assert(w);
+
+    ImageBufferAlign(&w->data);
+    uint64_t off = ImageBufferReserve(&w->data, n * sizeof(ImageString));
+    for (size_t i = 0; i < n; i++) {
+        ImageString str = ImageWriteString(w, (list) ? dsarray_get(list, i) : names[i]);
+        if (!w->data.failed) {
+            memcpy(w->data.buf + off + (i * sizeof(ImageString)), &str, sizeof(ImageString));
+        }
+    }
+    return off;
+}
+
+// Write an interned string to the string section, once per image.
+static ImageString ImageWriteString(ImageWriter *w, const DSBuffer *str) {
+    assert(w);
+    assert(str);
+
+    ImageString res = { .len = dsbuf_len(str) };
+    uintptr_t cached = (uintptr_t)dsdict_get(w->strcache, (void *)str);
+    if (cached) {
+        res.off = (uint64_t)(cached - 1);
+        return res;
+    }
+
+    res.off = ImageBufferAppend(&w->strs, dsbuf_char_ptr(str), res.len);
+    dsdict_put(w->strcache, (void *)str, (void *)(uintptr_t)(res.off + 1));
+    return res;
+}
+
+// Write a complete image to a temporary file beside `fname` and rename it
+// into place. Images are mapped rather than read, so a file which is being
+// executed must never be truncated or rewritten underneath its readers;
+// they keep the old file until they unmap it.
+static bool ImageWriteFile(const char *fname, const void *data, size_t len) {
+    assert(fname);
+    assert(data);
+
+    size_t namelen = strlen(fname);
+    char *tmpname = dsalloc(namelen + sizeof(IMAGE_TEMP_SUFFIX));
+    if (!tmpname) {
+        return false;
+    }
+    memcpy(tmpname, fname, namelen);
+    memcpy(tmpname + namelen, IMAGE_TEMP_SUFFIX, sizeof(IMAGE_TEMP_SUFFIX));
+
+    int fd = mkstemp(tmpname);
+    if (fd < 0) {
+        goto cleanup_write_file;
+    }
+
+    /* temporary files are private, but images are readable by anyone */
+    (void)fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+
+    FILE *f = fdopen(fd, "wb");
+    if (!f) {
+        close(fd);
+        goto cleanup_remove_file;
+    }
+
+    size_t written = fwrite(data, 1, len, f);
+    if ((fclose(f) != 0) || (written != len)) {
+        goto cleanup_remove_file;
+    }
+
+    if (rename(tmpname, fname) != 0) {
+        goto cleanup_remove_file;
+    }
+
+    dsfree(tmpname);
+    return true;
+
+cleanup_remove_file:
+    remove(tmpname);
+cleanup_write_file:
+    dsfree(tmpname);
+    return false;
+}
+
+// Append `len` bytes to the buffer, returning the offset at which they
+// were written. Failures are recorded in the buffer, so a sequence of
+// writes need only be checked once.
+static uint64_t ImageBufferAppend(ImageBuffer *b, const void *data, size_t len) {
+    assert(b);
+
+    uint64_t off = ImageBufferReserve(b, len);
+    if ((!b->failed) && (len > 0)) {
+        memcpy(b->buf + off, data, len);
+    }
+    return off;
+}
+
+// Reserve `len` zeroed bytes at the end of the buffer, returning their offset.
+static uint64_t ImageBufferReserve(ImageBuffer *b, size_t len) {
+    assert(b);
+
+    uint64_t off = b->len;
+    if (b->failed) {
+        return off;
+    }
+
+    if (b->len + len > b->cap) {
+        size_t cap = (b->cap > 0) ? b->cap : 256;
+        while (cap < b->len + len) {
+            cap *= 2;
+        }
+
+        char *buf = dsrealloc(b->buf, cap);
+        if (!buf) {
+            b->failed = true;
+            return off;
+        }
+        b->buf = buf;
+        b->cap = cap;
+    }
+
+    memset(b->buf + b->len, 0, len);
+    b->len += len;
+    return off;
+}
+
+static void ImageBufferAlign(ImageBuffer *b) {
+    assert(b);
+    size_t pad = (IMAGE_ALIGN - (b->len % IMAGE_ALIGN)) % IMAGE_ALIGN;
+    ImageBufferReserve(b, pad);
+}
+
+/*
+ * LOADER FUNCTIONS
+ */
+
+static inline const ImageHeader *ImageGetHeader(const ms_VMImage *img) {
+    return (const ImageHeader *)img->base;
+}
+
+// Load one constant from the image. Constants which cannot be loaded are
+// left as null, so the partially loaded chunk may be destroyed.
+static bool ImageLoadValue(ms_VMImage *img, const ImageValue *iv, ms_VMValue *v) {
+    assert(img);
+    assert(iv);
+    assert(v);
+
+    const ImageHeader *hdr = ImageGetHeader(img);
+    v->type = VMVAL_NULL;
+    v->val.n = MS_VM_NULL_POINTER;
+
+    switch (iv->type) {
+        case VMVAL_FLOAT:
+            v->type = VMVAL_FLOAT;
+            v->val.f = iv->val.f;
+            return true;
+        case VMVAL_INT:
+            v->type = VMVAL_INT;
+            v->val.i = iv->val.i;
+            return true;
+        case VMVAL_BOOL:
+            v->type = VMVAL_BOOL;
+            v->val.b = (iv->val.b != 0);
+            return true;
+        case VMVAL_NULL:
+            return true;
+        case VMVAL_STR: {
+            DSBuffer *s = ImageInternString(img, &iv->val.s);
+            if (!s) {
+                return false;
+            }
+            v->type = VMVAL_STR;
+            v->val.s = s;
+            return true;
+        }
+        case VMVAL_FUNC: {
+            if ((iv->chunk >= hdr->nchunks) ||
+                (!ImageTableValid(img, iv->val.args.off, iv->val.args.len, sizeof(ImageString)))) {
+                return false;
+            }
+
+            size_t nargs = (size_t)iv->val.args.len;
+            ms_VMFunc *fn = dscalloc(1, sizeof(ms_VMFunc));
+            if (!fn) {
+                return false;
+            }
+
+            fn->args = dsarray_new_cap((nargs > 0) ? nargs : 1, (dsarray_compare_fn)ms_InternCompare,
+                                       (dsarray_free_fn)ms_InternRelease);
+            if (!fn->args) {
+                dsfree(fn);
+                return false;
+            }
+
+            const ImageString *args = (const ImageString *)(img->base + iv->val.args.off);
+            for (size_t i = 0; i < nargs; i++) {
+                DSBuffer *name = ImageInternString(img, &args[i]);
+                if ((!name) || (!dsarray_append(fn->args, name))) {
+                    ms_InternRelease(name);
+                    dsarray_destroy(fn->args);
+                    dsfree(fn);
+                    return false;
+                }
+            }
+
+            /* the body is loaded when the function is first called */
+            fn->image = ms_VMImageRetain(img);
+            fn->chunk = iv->chunk;
+            v->type = VMVAL_FUNC;
+            v->val.fn = fn;
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+// Return true if the tables of a chunk lie within the image and its bytes
+// match their checksum.
+static bool ImageChunkValid(const ms_VMImage *img, const ImageChunk *c) {
+    assert(img);
+    assert(c);
+
+    return (ImageTableValid(img, c->code, c->nops, sizeof(ms_VMOpCode))) &&
+           (ImageTableValid(img, c->values, c->nvals, sizeof(ImageValue))) &&
+           (ImageTableValid(img, c->idents, c->nidents, sizeof(ImageString))) &&
+           (ImageTableValid(img, c->code, c->size, 1)) &&
+           (ImageChecksum(IMAGE_CHECKSUM_BASIS, img->base + c->code, (size_t)c->size) == c->checksum);
+}
+
+// Check that every opcode refers to a constant, identifier or jump target
+// which exists and never pops from an empty stack, since the VM trusts the
+// bytecode it executes.
+static bool ImageLoadOpCodes(const ms_VMByteCode *bc) {
+    assert(bc);
+
+    for (size_t i = 0; i < bc->nops; i++) {
+        ms_VMOpCodeType type = ms_VMOpCodeGetCode(bc->code[i]);
+        int arg = ms_VMOpCodeGetArg(bc->code[i]);
+        switch (type) {
+            case OPC_PUSH:
+                if ((arg < 0) || ((size_t)arg >= bc->nvals)) { return false; }
+                break;
+            case OPC_NEW_NAME:          /* fall through */
+            case OPC_GET_NAME:          /* fall through */
+            case OPC_SET_NAME:          /* fall through */
+            case OPC_DEL_NAME:
+                if ((arg < 0) || ((size_t)arg >= bc->nidents)) { return false; }
+                break;
+            case OPC_JUMP_IF_FALSE:     /* fall through */
+            case OPC_GOTO:              /* fall through */
+            case OPC_BREAK:             /* fall through */
+            case OPC_CONTINUE:
+                if ((arg < 0) || ((size_t)arg > bc->nops)) { return false; }
+                break;
+            default:
+                if ((unsigned)type > OPC_CONTINUE) { return false; }
+                break;
+        }
+    }
+
+    return ImageVerifyStack(bc);
+}
+
+// Walk every path through the opcodes, tracking the least depth of the data
+// and block stacks on entry to each opcode, and fail if any opcode could
+// find fewer values or blocks than it uses. Depths only ever fall as paths
+// are merged, so the walk ends even when the code loops.
+static bool ImageVerifyStack(const ms_VMByteCode *bc) {
+    assert(bc);
+
+    bool res = false;
+    size_t nwork = 0;
+    ImageStackDepth *depths = dsalloc((bc->nops + 1) * sizeof(ImageStackDepth));
+    size_t *work = dsalloc((bc->nops + 1) * sizeof(size_t));
+    if ((!depths) || (!work)) {
+        goto cleanup_verify_stack;
+    }
+
+    for (size_t i = 0; i <= bc->nops; i++) {
+        depths[i].values = SIZE_MAX;
+        depths[i].blocks = SIZE_MAX;
+        depths[i].queued = false;
+    }
+
+    /* every frame begins with an empty data stack and a single block */
+    ImageStackMerge(depths, work, &nwork, 0, 0, 1);
+    while (nwork > 0) {
+        size_t ip = work[--nwork];
+        ImageStackDepth *d = &depths[ip];
+        d->queued = false;
+        if (ip == bc->nops) {
+            continue;
+        }
+
+        ms_VMOpCodeType type = ms_VMOpCodeGetCode(bc->code[ip]);
+        int arg = ms_VMOpCodeGetArg(bc->code[ip]);
+        size_t pops = 0;
+        size_t pushes = 0;
+        size_t blocks = d->blocks;
+        bool next = true;
+        bool jump = false;
+        switch (type) {
+            case OPC_PUSH:              /* fall through */
+            case OPC_GET_NAME:
+                pushes = 1;
+                break;
+            case OPC_POP:               /* fall through */
+            case OPC_SET_NAME:
+                pops = 1;
+                break;
+            case OPC_SWAP:
+                pops = 2;
+                pushes = 2;
+                break;
+            case OPC_DUP:
+                pops = 1;
+                pushes = 2;
+                break;
+            case OPC_PRINT:             /* fall through */
+            case OPC_NEGATE:            /* fall through */
+            case OPC_BITWISE_NOT:       /* fall through */
+            case OPC_NOT:               /* fall through */
+            case OPC_CALL:
+                pops = 1;
+                pushes = 1;
+                break;
+            case OPC_ADD:               /* fall through */
+            case OPC_SUBTRACT:          /* fall through */
+            case OPC_MULTIPLY:          /* fall through */
+            case OPC_DIVIDE:            /* fall through */
+            case OPC_IDIVIDE:           /* fall through */
+            case OPC_MODULO:            /* fall through */
+            case OPC_EXPONENTIATE:      /* fall through */
+            case OPC_SHIFT_LEFT:        /* fall through */
+            case OPC_SHIFT_RIGHT:       /* fall through */
+            case OPC_BITWISE_AND:       /* fall through */
+            case OPC_BITWISE_XOR:       /* fall through */
+            case OPC_BITWISE_OR:        /* fall through */
+            case OPC_LE:                /* fall through */
+            case OPC_LT:                /* fall through */
+            case OPC_GE:                /* fall through */
+            case OPC_GT:                /* fall through */
+            case OPC_EQ:                /* fall through */
+            case OPC_NOT_EQ:            /* fall through */
+            case OPC_AND:               /* fall through */
+            case OPC_OR:                /* fall through */
+            case OPC_GET_ATTR:          /* fall through */
+            case OPC_SET_ATTR:          /* fall through */
+            case OPC_DEL_ATTR:
+                pops = 2;
+                pushes = 1;
+                break;
+            case OPC_PUSH_BLOCK:
+                blocks++;
+                break;
+            case OPC_POP_BLOCK:
+                /* the block belonging to the frame itself is never popped */
+                if (blocks < 2) { goto cleanup_verify_stack; }
+                blocks--;
+                break;
+            case OPC_NEW_NAME:          /* fall through */
+            case OPC_DEL_NAME:
+                break;
+            case OPC_JUMP_IF_FALSE:
+                pops = 1;
+                pushes = 1;
+                jump = true;
+                break;
+            case OPC_GOTO:              /* fall through */
+            case OPC_BREAK:             /* fall through */
+            case OPC_CONTINUE:
+                next = false;
+                jump = true;
+                break;
+            case OPC_CALL_BUILTIN:      /* fall through */
+            case OPC_RETURN:            /* fall through */
+            case OPC_GET_GLO:           /* fall through */
+            case OPC_SET_GLO:           /* fall through */
+            case OPC_DEL_GLO:           /* fall through */
+            case OPC_MAKE_LIST:         /* fall through */
+            case OPC_MAKE_OBJ:          /* fall through */
+            case OPC_NEXT:              /* fall through */
+            case OPC_IMPORT:
+                /* the VM stops with an error before it touches the stack */
+                next = false;
+                break;
+        }
+
+        if (d->values < pops) {
+            goto cleanup_verify_stack;
+        }
+
+        size_t values = d->values - pops + pushes;
+        if (next) {
+            ImageStackMerge(depths, work, &nwork, ip + 1, values, blocks);
+        }
+        if (jump) {
+            ImageStackMerge(depths, work, &nwork, (size_t)arg, values, blocks);
+        }
+    }
+    res = true;
+
+cleanup_verify_stack:
+    dsfree(depths);
+    dsfree(work);
+    return res;
+}
+
+// Record that the opcode at `ip` may be reached with the given stack depths,
+// queueing it to be checked again if either is lower than any seen before.
+static void ImageStackMerge(ImageStackDepth *depths, size_t *work, size_t *nwork,
+                            size_t ip, size_t values, size_t blocks) {
+    assert(depths);
+    assert(work);
+    assert(nwork);
+
+    ImageStackDepth *d = &depths[ip];
+    if ((values >= d->values) && (blocks >= d->blocks)) {
+        return;
+    }
+
+    d->values = (values < d->values) ? values : d->values;
+    d->blocks = (blocks < d->blocks) ? blocks : d->blocks;
+    if (!d->queued) {
+        d->queued = true;
+        work[(*nwork)++] = ip;
+    }
+}
+
+// Return a new reference to the interned copy of a string in the image.
+static DSBuffer *ImageInternString(const ms_VMImage *img, const ImageString *str) {
+    assert(img);
+    assert(str);
+
+    if (!ImageStringValid(img, str)) {
+        return NULL;
+    }
+
+    const ImageHeader *hdr = ImageGetHeader(img);
+    DSBuffer *tmp = dsbuf_new_l(img->base + hdr->strings + str->off, (size_t)str->len);
+    if (!tmp) {
+        return NULL;
+    }
+
+    DSBuffer *interned = ms_InternStr(tmp);
+    dsbuf_destroy(tmp);
+    return interned;
+}
+
+// Return true if a table of `n` elements of `size` bytes at `off` lies
+// within the image and is aligned for its elements.
+static bool ImageTableValid(const ms_VMImage *img, uint64_t off, uint64_t n, size_t size) {
+    assert(img);
+    assert(size > 0);
+
+    if ((off > img->size) || ((size > 1) && (off % IMAGE_ALIGN != 0))) {
+        return false;
+    }
+    return (n <= (img->size - off) / size);
+}
+
+static bool ImageStringValid(const ms_VMImage *img, const ImageString *str) {
+    const ImageHeader *hdr = ImageGetHeader(img);
+    return (str->off <= hdr->nstrbytes) && (str->len <= hdr->nstrbytes - str->off);
+}
+
+// Checksum the header (less its own checksum), the chunk table, the script
+// parameter names and the string section. Each chunk carries a checksum of
+// its own which is checked as it is loaded, so opening an image need not
+// touch the pages of chunks which are never executed.
+static uint64_t ImageHeaderChecksum(const char *base) {
+    assert(base);
+
+    ImageHeader hdr;
+    memcpy(&hdr, base, sizeof(ImageHeader));
+    hdr.checksum = 0;
+
+    uint64_t sum = ImageChecksum(IMAGE_CHECKSUM_BASIS, &hdr, sizeof(ImageHeader));
+    sum = ImageChecksum(sum, base + hdr.chunks, (size_t)hdr.nchunks * sizeof(ImageChunk));
+    sum = ImageChecksum(sum, base + hdr.params, (size_t)hdr.nparams * sizeof(ImageString));
+    return ImageChecksum(sum, base + hdr.strings, (size_t)hdr.nstrbytes);
+}
+
+// Continue a 64-bit FNV-1a checksum over `len` more bytes.
+static uint64_t ImageChecksum(uint64_t sum, const void *data, size_t len) {
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < len; i++) {
+        sum ^= bytes[i];
+        sum *= IMAGE_CHECKSUM_PRIME;
+    }
+    return sum;
+}
+
+static void ImageErrorSet(ms_Error **err, const char *msg, ...) {
+    assert(err);
+
+    DSAllocator *prev = dsallocator_swap(NULL);
+    ms_Error *e = dsalloc(sizeof(ms_Error));
+    if (e) {
+        e->type = MS_ERROR_VM;
+        e->msg = NULL;
+
+        va_list args;
+        va_list argscpy;
+        va_start(args, msg);
+        va_copy(argscpy, args);
+
+        int len = vsnprintf(NULL, 0, msg, args);
+        e->len = (len > 0) ? (size_t)len : 0;
+        e->msg = dsalloc(e->len + 1);
+        if (e->msg) {
+            vsnprintf(e->msg, e->len + 1, msg, argscpy);
+        }
+
+        va_end(args);
+        va_end(argscpy);
+    }
+
+    dsallocator_swap(prev);
+    ms_ErrorDestroy(*err);
+    *err = e;
+}
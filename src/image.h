@@ -0,0 +1,118 @@
+/*------------------------------------------------------------------------------
+ *    Copyright 2016 Chris Rink
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *----------------------------------------------------------------------------*/
+
+
+#ifndef MSCRIPT_IMAGE_H
+#define MSCRIPT_IMAGE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "libds/buffer.h"
+#include "bytecode.h"
+#include "error.h"
+
+/*
+ * A bytecode image is the serialized form of a module and every function
+ * nested within it. Images are position independent: each chunk of
+ * bytecode (the module is chunk 0, followed by one chunk per function body)
+ * refers to its opcodes, constants, identifiers and nested functions by
+ * offset or by index, never by address.
+ *
+ * Loaded images are mapped into memory rather than read. Opcodes are
+ * executed directly from the mapping; constants and identifiers are interned
+ * as each chunk is loaded, and each function body is only loaded when it is
+ * first called, so starting a large image only touches the pages which are
+ * actually executed.
+ *
+ * Images are written in the byte order and opcode width of the machine
+ * which wrote them, and may only be loaded by a matching machine.
+ *
+ * The header, chunk table and strings of an image are checksummed together
+ * and checked when the image is opened; each chunk carries a checksum of its
+ * own which is checked when the chunk is loaded, along with its opcodes.
+ *
+ * Images are shared by every state, so they (and the bytecode loaded from
+ * them) are always allocated from the default allocator.
+ */
+
+#define MS_VM_IMAGE_MAGIC "MSBC"
+#define MS_VM_IMAGE_VERSION (2)
+
+/**
+* @brief Write @c bc (including every nested function) as an image to the
+* file at @c fname , along with the names of @c nparams script parameters.
+*
+* Function bodies which have not yet been compiled are compiled first.
+*/
+ms_Result ms_VMImageWrite(ms_VMByteCode *bc, DSBuffer *const *params, size_t nparams,
+                          const char *fname, ms_Error **err);
+
+/**
+* @brief Return true if the file at @c fname begins like an image.
+*/
+bool ms_VMImageIsFile(const char *fname);
+
+/**
+* @brief Map the image file at @c fname into memory, checking that it was
+* written by a compatible machine, that its tables are well formed and that
+* they match their checksum.
+*
+* @returns a new @c ms_VMImage holding one reference or @c NULL on error
+*/
+ms_VMImage *ms_VMImageOpen(const char *fname, ms_Error **err);
+
+/**
+* @brief Return the number of script parameters recorded in the image.
+*/
+size_t ms_VMImageParamCount(const ms_VMImage *img);
+
+/**
+* @brief Return a new reference to the interned name of a script parameter.
+*/
+DSBuffer *ms_VMImageParam(const ms_VMImage *img, size_t i);
+
+/**
+* @brief Load one chunk of bytecode from the image.
+*
+* Chunks which do not match their checksum, or whose opcodes could refer to
+* constants, identifiers or jump targets which do not exist or pop from an
+* empty stack, are rejected.
+*
+* The opcodes of the new bytecode refer directly into the image, which it
+* holds a reference to. Nested functions hold their own references, and are
+* loaded by @c ms_VMFuncCompile when first called.
+*/
+ms_Result ms_VMImageLoadChunk(ms_VMImage *img, size_t chunk, ms_VMByteCode **code, ms_Error **err);
+
+/**
+* @brief Check the checksum and opcodes of every chunk of the image, which
+* are otherwise only checked as each chunk is loaded.
+*/
+ms_Result ms_VMImageVerify(const ms_VMImage *img, ms_Error **err);
+
+/**
+* @brief Acquire a new reference to an image. References may be acquired
+* and released on any thread.
+*/
+ms_VMImage *ms_VMImageRetain(ms_VMImage *img);
+
+/**
+* @brief Release a reference to an image, unmapping it once no references
+* remain.
+*/
+void ms_VMImageRelease(ms_VMImage *img);
+
+#endif //MSCRIPT_IMAGE_H
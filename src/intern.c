@@ -0,0 +1,396 @@
+/*------------------------------------------------------------------------------
+ *    Copyright 2016 Chris Rink
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *----------------------------------------------------------------------------*/
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#ifdef MS_USE_PTHREADS
+#include <pthread.h>
+#endif
+#include "libds/alloc.h"
+#include "libds/dict.h"
+#include "intern.h"
+
+/*
+ * FORWARD DECLARATIONS
+ */
+
+typedef struct {
+    DSBuffer *str;                  /** canonical string (also the table key) */
+    size_t refs;                    /** number of outstanding references */
+} InternEntry;
+
+static DSDict *INTERN_TABLE = NULL;
+static ms_InternStats INTERN_STATS;
+
+/* references counted against each tracked allocator, keyed by allocator;
+ * each ledger maps a canonical string to its count, shifted above a flag
+ * which is set once the string has been charged to the allocator */
+static DSDict *INTERN_LEDGERS = NULL;
+static const uintptr_t INTERN_CHARGED = 1;
+
+#ifdef MS_USE_PTHREADS
+static pthread_mutex_t INTERN_LOCK = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static DSBuffer *InternStr(const DSBuffer *str);
+static void InternReleaseOne(DSBuffer *str);
+static bool InternLedgerAdd(DSAllocator *alloc, DSBuffer *str);
+static bool InternLedgerDrop(DSAllocator *alloc, DSBuffer *str);
+static bool InternCharge(DSAllocator *alloc, DSBuffer *str);
+static inline size_t InternSize(const DSBuffer *str);
+static bool InternTableCreate(void);
+static void InternTableDestroyIfEmpty(void);
+static void InternLedgersDestroyIfEmpty(void);
+static inline void InternLock(void);
+static inline void InternUnlock(void);
+
+/*
+ * PUBLIC FUNCTIONS
+ */
+
+DSBuffer *ms_InternStr(const DSBuffer *str) {
+    /* the table is shared by every state, so it is never allocated from
+     * one; the string is charged to the current allocator instead */
+    DSAllocator *alloc = dsallocator_swap(NULL);
+    InternLock();
+    DSBuffer *interned = InternStr(str);
+    bool charge = (interned) && (InternLedgerAdd(alloc, interned));
+    InternUnlock();
+    dsallocator_swap(alloc);
+
+    if ((charge) && (!InternCharge(alloc, interned))) {
+        ms_InternRelease(interned);
+        return NULL;
+    }
+    return interned;
+}
+
+DSBuffer *ms_InternRetain(DSBuffer *str) {
+    if (!str) {
+        return NULL;
+    }
+
+    DSAllocator *alloc = dsallocator_swap(NULL);
+    InternLock();
+    assert(INTERN_TABLE);
+    InternEntry *entry = dsdict_get(INTERN_TABLE, str);
+    assert(entry);
+    assert(entry->str == str);
+    entry->refs++;
+    INTERN_STATS.nrefs++;
+    bool charge = InternLedgerAdd(alloc, str);
+    InternUnlock();
+    dsallocator_swap(alloc);
+
+    /* a reference cannot be refused, so one which does not fit is simply
+     * left uncharged (unless the limit handler abandons the caller) */
+    if (charge) {
+        (void)InternCharge(alloc, str);
+    }
+    return str;
+}
+
+void ms_InternRelease(DSBuffer *str) {
+    if (!str) { return; }
+
+    DSAllocator *alloc = dsallocator_swap(NULL);
+    InternLock();
+    size_t size = InternSize(str);
+    bool discharge = InternLedgerDrop(alloc, str);
+    InternReleaseOne(str);
+    InternUnlock();
+    dsallocator_swap(alloc);
+
+    if (discharge) {
+        dsallocator_discharge(alloc, size);
+    }
+}
+
+bool ms_InternTrack(DSAllocator *alloc) {
+    assert(alloc);
+
+    DSAllocator *prev = dsallocator_swap(NULL);
+    InternLock();
+    if (!INTERN_LEDGERS) {
+        INTERN_LEDGERS = dsdict_new((dsdict_hash_fn)ms_InternHash,
+                                    (dsdict_compare_fn)ms_InternCompare,
+                                    NULL, NULL);
+    }
+
+    DSDict *ledger = (INTERN_LEDGERS) ?
+                     dsdict_new((dsdict_hash_fn)ms_InternHash,
+                                (dsdict_compare_fn)ms_InternCompare, NULL, NULL) :
+                     NULL;
+    if (ledger) {
+        dsdict_put(INTERN_LEDGERS, alloc, ledger);
+        if (dsdict_get(INTERN_LEDGERS, alloc) != ledger) {
+            dsdict_destroy(ledger);
+            ledger = NULL;
+        }
+    }
+    InternLedgersDestroyIfEmpty();
+    InternUnlock();
+    dsallocator_swap(prev);
+    return (ledger != NULL);
+}
+
+void ms_InternUntrack(DSAllocator *alloc) {
+    assert(alloc);
+
+    DSAllocator *prev = dsallocator_swap(NULL);
+    InternLock();
+    DSDict *ledger = (INTERN_LEDGERS) ? dsdict_del(INTERN_LEDGERS, alloc) : NULL;
+    if (ledger) {
+        DSDICT_FOREACH(ledger, iter) {
+            DSBuffer *str = dsiter_key(&iter);
+            for (uintptr_t n = (uintptr_t)dsiter_value(&iter) >> 1; n > 0; n--) {
+                InternReleaseOne(str);
+            }
+        }
+        dsdict_destroy(ledger);
+    }
+    InternLedgersDestroyIfEmpty();
+    InternUnlock();
+    dsallocator_swap(prev);
+}
+
+void ms_InternMerge(DSAllocator *into, DSAllocator *from) {
+    assert(into);
+    assert(from);
+
+    DSAllocator *prev = dsallocator_swap(NULL);
+    InternLock();
+    DSDict *src = (INTERN_LEDGERS) ? dsdict_del(INTERN_LEDGERS, from) : NULL;
+    DSDict *dest = (INTERN_LEDGERS) ? dsdict_get(INTERN_LEDGERS, into) : NULL;
+    size_t discharge = 0;
+    if (src) {
+        DSDICT_FOREACH(src, iter) {
+            DSBuffer *str = dsiter_key(&iter);
+            uintptr_t add = (uintptr_t)dsiter_value(&iter);
+            uintptr_t has = (dest) ? (uintptr_t)dsdict_get(dest, str) : INTERN_CHARGED;
+
+            /* a string held by both is only charged to `into` once, and
+             * nothing is charged to an untracked allocator */
+            if ((has & INTERN_CHARGED) && (add & INTERN_CHARGED)) {
+                discharge += InternSize(str);
+            }
+            if (!dest) {
+                continue;
+            }
+            uintptr_t val = ((has >> 1) + (add >> 1)) << 1;
+            val |= (has | add) & INTERN_CHARGED;
+            dsdict_put(dest, str, (void *)val);
+        }
+    }
+    if (src) {
+        dsdict_destroy(src);
+    }
+    InternLedgersDestroyIfEmpty();
+    InternUnlock();
+    dsallocator_swap(prev);
+    dsallocator_discharge(from, discharge);
+}
+
+uint32_t ms_InternHash(const DSBuffer *str) {
+    /* buffers are heap allocated, so the low bits carry no information */
+    uintptr_t p = (uintptr_t)str;
+    p ^= (p >> 17);
+    return (uint32_t)((p >> 4) * 2654435761u);
+}
+
+int ms_InternCompare(const DSBuffer *left, const DSBuffer *right) {
+    return (left == right) ? 0 : 1;
+}
+
+void ms_InternGetStats(ms_InternStats *stats) {
+    assert(stats);
+    InternLock();
+    *stats = INTERN_STATS;
+    InternUnlock();
+}
+
+/*
+ * PRIVATE FUNCTIONS
+ */
+
+/* Return the canonical copy of a string, creating it if needed. */
+static DSBuffer *InternStr(const DSBuffer *str) {
+    if (!str) {
+        return NULL;
+    }
+
+    if (!InternTableCreate()) {
+        return NULL;
+    }
+
+    InternEntry *entry = dsdict_get(INTERN_TABLE, (void *)str);
+    if (entry) {
+        entry->refs++;
+        INTERN_STATS.nrefs++;
+        return entry->str;
+    }
+
+    entry = dsalloc(sizeof(InternEntry));
+    if (!entry) {
+        InternTableDestroyIfEmpty();
+        return NULL;
+    }
+
+    entry->str = dsbuf_dup(str);
+    if (!entry->str) {
+        dsfree(entry);
+        InternTableDestroyIfEmpty();
+        return NULL;
+    }
+    entry->refs = 1;
+
+    /* a put which cannot grow the table drops the entry */
+    dsdict_put(INTERN_TABLE, entry->str, entry);
+    if (dsdict_get(INTERN_TABLE, entry->str) != entry) {
+        dsbuf_destroy(entry->str);
+        dsfree(entry);
+        InternTableDestroyIfEmpty();
+        return NULL;
+    }
+    INTERN_STATS.nstrs++;
+    INTERN_STATS.nbytes += dsbuf_len(entry->str);
+    INTERN_STATS.nrefs++;
+    return entry->str;
+}
+
+/* Release one reference to an interned string with the lock held. */
+static void InternReleaseOne(DSBuffer *str) {
+    assert(INTERN_TABLE);
+    InternEntry *entry = dsdict_get(INTERN_TABLE, str);
+    assert(entry);
+    assert(entry->str == str);
+    assert(entry->refs > 0);
+
+    entry->refs--;
+    INTERN_STATS.nrefs--;
+    if (entry->refs == 0) {
+        (void)dsdict_del(INTERN_TABLE, str);
+        INTERN_STATS.nstrs--;
+        INTERN_STATS.nbytes -= dsbuf_len(entry->str);
+        dsbuf_destroy(entry->str);
+        dsfree(entry);
+        InternTableDestroyIfEmpty();
+    }
+}
+
+/* Count a new reference against the ledger of an allocator, if it is
+ * tracked. Returns true if the string is not yet charged to it. A
+ * reference which cannot be counted is left to the caller alone, just as
+ * references taken on an untracked allocator are. */
+static bool InternLedgerAdd(DSAllocator *alloc, DSBuffer *str) {
+    DSDict *ledger = (INTERN_LEDGERS) ? dsdict_get(INTERN_LEDGERS, alloc) : NULL;
+    if (!ledger) {
+        return false;
+    }
+
+    uintptr_t val = (uintptr_t)dsdict_get(ledger, str) + 2;
+    dsdict_put(ledger, str, (void *)val);
+    if (dsdict_get(ledger, str) != (void *)val) {
+        return false;
+    }
+    return !(val & INTERN_CHARGED);
+}
+
+/* Drop a reference from the ledger of an allocator, if it is counted
+ * there. Returns true if the string should be discharged from it. */
+static bool InternLedgerDrop(DSAllocator *alloc, DSBuffer *str) {
+    DSDict *ledger = (INTERN_LEDGERS) ? dsdict_get(INTERN_LEDGERS, alloc) : NULL;
+    uintptr_t val = (ledger) ? (uintptr_t)dsdict_get(ledger, str) : 0;
+    if (val < 2) {
+        return false;
+    }
+
+    val -= 2;
+    if (val >= 2) {
+        dsdict_put(ledger, str, (void *)val);
+        return false;
+    }
+    (void)dsdict_del(ledger, str);
+    return (val & INTERN_CHARGED);
+}
+
+/* Charge an interned string to an allocator, which may abandon the caller
+ * through the allocator's limit handler, and note it in the ledger. */
+static bool InternCharge(DSAllocator *alloc, DSBuffer *str) {
+    if (!dsallocator_charge(alloc, InternSize(str))) {
+        return false;
+    }
+
+    DSAllocator *prev = dsallocator_swap(NULL);
+    InternLock();
+    DSDict *ledger = (INTERN_LEDGERS) ? dsdict_get(INTERN_LEDGERS, alloc) : NULL;
+    uintptr_t val = (ledger) ? (uintptr_t)dsdict_get(ledger, str) : 0;
+    if (val >= 2) {
+        dsdict_put(ledger, str, (void *)(val | INTERN_CHARGED));
+    }
+    InternUnlock();
+    dsallocator_swap(prev);
+    return true;
+}
+
+/* Return the number of bytes charged for holding an interned string. */
+static inline size_t InternSize(const DSBuffer *str) {
+    return sizeof(InternEntry) + dsbuf_len(str);
+}
+
+/* Lazily create the global intern table. */
+static bool InternTableCreate(void) {
+    if (INTERN_TABLE) {
+        return true;
+    }
+
+    INTERN_TABLE = dsdict_new((dsdict_hash_fn)dsbuf_hash,
+                              (dsdict_compare_fn)dsbuf_compare,
+                              NULL, NULL);
+    return (INTERN_TABLE != NULL);
+}
+
+/* Free the table itself once the last interned string is released, so
+ * that no memory is held by the intern table between independent runs. */
+static void InternTableDestroyIfEmpty(void) {
+    if ((INTERN_TABLE) && (dsdict_count(INTERN_TABLE) == 0)) {
+        dsdict_destroy(INTERN_TABLE);
+        INTERN_TABLE = NULL;
+    }
+}
+
+/* Free the table of ledgers once no allocator is tracked. */
+static void InternLedgersDestroyIfEmpty(void) {
+    if ((INTERN_LEDGERS) && (dsdict_count(INTERN_LEDGERS) == 0)) {
+        dsdict_destroy(INTERN_LEDGERS);
+        INTERN_LEDGERS = NULL;
+    }
+}
+
+/* Take the table lock, since the table is shared by every state on every
+ * thread. */
+static inline void InternLock(void) {
+#ifdef MS_USE_PTHREADS
+    pthread_mutex_lock(&INTERN_LOCK);
+#endif
+}
+
+static inline void InternUnlock(void) {
+#ifdef MS_USE_PTHREADS
+    pthread_mutex_unlock(&INTERN_LOCK);
+#endif
+}
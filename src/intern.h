@@ -0,0 +1,125 @@
+/*------------------------------------------------------------------------------
+ *    Copyright 2016 Chris Rink
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *----------------------------------------------------------------------------*/
+
+#ifndef MSCRIPT_INTERN_H
+#define MSCRIPT_INTERN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "libds/alloc.h"
+#include "libds/buffer.h"
+
+/*
+ * The intern table holds exactly one canonical @c DSBuffer for every distinct
+ * identifier and string constant produced by the code generator. Canonical
+ * buffers are reference counted and are shared by every piece of bytecode
+ * (across functions, modules, and REPL lines) and every VM environment which
+ * refers to them, so two interned strings are equal if and only if their
+ * pointers are equal.
+ *
+ * Canonical buffers must never be modified by callers.
+ *
+ * The intern table is shared by every state, so it is guarded by a lock
+ * where POSIX threads are available (@c MS_USE_PTHREADS ); states on
+ * different threads may then intern and release strings at once. Without
+ * threads, the table must only be used from one thread.
+ *
+ * Since canonical buffers are shared, they are never allocated from the
+ * allocator of any one state. Instead, references taken while a tracked
+ * allocator is current (see @c dsallocator_swap ) are counted against it,
+ * and each string it refers to is charged to it once, as though it held
+ * its own copy. The references still counted when a tracked allocator is
+ * untracked are dropped with it, so memory which is released all at once
+ * (such as that of a state over its limit) does not pin its strings.
+ * References must therefore be released with the allocator current which
+ * was current when they were taken.
+ */
+
+typedef struct {
+    size_t nstrs;                   /** number of distinct interned strings */
+    size_t nbytes;                  /** total length of the interned strings */
+    size_t nrefs;                   /** number of live references to interned strings */
+} ms_InternStats;
+
+/**
+* @brief Return the canonical copy of the given string, creating it if needed.
+*
+* The caller receives a new reference to the canonical buffer, which must be
+* released by @c ms_InternRelease .
+*
+* @param str a @c DSBuffer containing the string to intern
+* @returns the canonical @c DSBuffer or @c NULL if memory could not be allocated
+*/
+DSBuffer *ms_InternStr(const DSBuffer *str);
+
+/**
+* @brief Acquire a new reference to an already interned string.
+*/
+DSBuffer *ms_InternRetain(DSBuffer *str);
+
+/**
+* @brief Release a reference to an interned string, freeing it once no
+* references remain.
+*/
+void ms_InternRelease(DSBuffer *str);
+
+/**
+* @brief Count the references taken while @c alloc is the current allocator
+* and charge the strings they refer to against it.
+*
+* @returns false if the allocator could not be tracked
+*/
+bool ms_InternTrack(DSAllocator *alloc);
+
+/**
+* @brief Stop tracking @c alloc , dropping every reference still counted
+* against it.
+*
+* This is intended for allocators whose blocks are about to be released
+* all at once, taking with them whatever held those references. Charges
+* are left to be cleared by @c dsallocator_release .
+*/
+void ms_InternUntrack(DSAllocator *alloc);
+
+/**
+* @brief Move the references counted against @c from to @c into (if it is
+* tracked), ahead of merging the allocators' blocks, and stop tracking
+* @c from .
+*
+* Strings charged to both are discharged from @c from , so that merging the
+* allocators does not charge them to @c into twice. If @c into is not
+* tracked, the references are left to their holders and every string is
+* discharged from @c from .
+*/
+void ms_InternMerge(DSAllocator *into, DSAllocator *from);
+
+/**
+* @brief Hash an interned string by identity, suitable for @c DSDict keys.
+*/
+uint32_t ms_InternHash(const DSBuffer *str);
+
+/**
+* @brief Compare two interned strings by identity, suitable for @c DSDict keys.
+*/
+int ms_InternCompare(const DSBuffer *left, const DSBuffer *right);
+
+/**
+* @brief Fill @c stats with the current occupancy of the intern table.
+*/
+void ms_InternGetStats(ms_InternStats *stats);
+
+#endif //MSCRIPT_INTERN_H
@@ -18,9 +18,33 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/errno.h>
+#include "libds/alloc.h"
 #include "bytecode.h"
 #include "lang.h"
 
+/* expressions are allocated in a single block together with their
+ * component, from the current AST pool if one is set */
+typedef struct {
+    ms_Expr expr;
+    ms_ExprUnary u;
+} ExprUnaryNode;
+
+typedef struct {
+    ms_Expr expr;
+    ms_ExprBinary b;
+} ExprBinaryNode;
+
+typedef struct {
+    ms_Expr expr;
+    ms_ExprConditional c;
+} ExprConditionalNode;
+
+/* each thread has its own pool, so trees may be built on several at once */
+static DS_THREAD_LOCAL DSPool *AST_POOL = NULL;
+
+static void *ASTNodeAlloc(size_t size);
+static void ASTNodeFree(void *node, size_t size);
+static size_t ExprNodeSize(ms_ExprType type);
 static bool ExprAtomDup(const ms_ExprAtom *src, ms_ExprAtom *dest, ms_ExprAtomType type);
 static bool ExprAtomValDup(const ms_Value *src, ms_Value *dest);
 static void ExprAtomDestroy(ms_ExprAtom *atom, ms_ExprAtomType type);
@@ -38,41 +62,48 @@ static void StmtDeclarationDestroy(ms_StmtDeclaration *decl);
  * PUBLIC FUNCTIONS
  */
 
-ms_Expr *ms_ExprNew(ms_ExprType type) {
-    ms_Expr *expr = malloc(sizeof(ms_Expr));
-    if (!expr) {
-        return NULL;
-    }
+DSPool *ms_ASTPoolSwap(DSPool *pool) {
+    DSPool *prev = AST_POOL;
+    AST_POOL = pool;
+    return prev;
+}
 
-    expr->type = type;
+ms_Expr *ms_ExprNew(ms_ExprType type) {
+    ms_Expr *expr = NULL;
     switch (type) {
-        case EXPRTYPE_UNARY:
-            expr->cmpnt.u = malloc(sizeof(ms_ExprUnary));
-            if (!expr->cmpnt.u) {
-                free(expr);
+        case EXPRTYPE_UNARY: {
+            ExprUnaryNode *node = ASTNodeAlloc(sizeof(ExprUnaryNode));
+            if (!node) {
                 return NULL;
             }
+            expr = &node->expr;
+            expr->cmpnt.u = &node->u;
             expr->cmpnt.u->atom.expr = NULL;
+            expr->cmpnt.u->type = EXPRATOM_EMPTY;
             expr->cmpnt.u->op = UNARY_NONE;
             break;
-        case EXPRTYPE_BINARY:
-            expr->cmpnt.b = malloc(sizeof(ms_ExprBinary));
-            if (!expr->cmpnt.b) {
-                free(expr);
+        }
+        case EXPRTYPE_BINARY: {
+            ExprBinaryNode *node = ASTNodeAlloc(sizeof(ExprBinaryNode));
+            if (!node) {
                 return NULL;
             }
+            expr = &node->expr;
+            expr->cmpnt.b = &node->b;
             expr->cmpnt.b->latom.expr = NULL;
             expr->cmpnt.b->ltype = EXPRATOM_EMPTY;
             expr->cmpnt.b->op = BINARY_EMPTY;
             expr->cmpnt.b->rtype = EXPRATOM_EMPTY;
             expr->cmpnt.b->ratom.expr = NULL;
             break;
-        case EXPRTYPE_CONDITIONAL:
-            expr->cmpnt.c = malloc(sizeof(ms_ExprConditional));
-            if (!expr->cmpnt.c) {
-                free(expr);
+        }
+        case EXPRTYPE_CONDITIONAL: {
+            ExprConditionalNode *node = ASTNodeAlloc(sizeof(ExprConditionalNode));
+            if (!node) {
                 return NULL;
             }
+            expr = &node->expr;
+            expr->cmpnt.c = &node->c;
             expr->cmpnt.c->cond.expr = NULL;
             expr->cmpnt.c->condtype = EXPRATOM_EMPTY;
             expr->cmpnt.c->iftrue.expr = NULL;
@@ -80,8 +111,13 @@ ms_Expr *ms_ExprNew(ms_ExprType type) {
             expr->cmpnt.c->iffalse.expr = NULL;
             expr->cmpnt.c->falsetype = EXPRATOM_EMPTY;
             break;
+        }
     }
 
+    if (expr) {
+        expr->type = type;
+        expr->refs = 1;
+    }
     return expr;
 }
 
@@ -104,17 +140,9 @@ ms_Expr *ms_ExprNewWithIdent(const char *name, size_t len) {
         return NULL;
     }
 
-    expr->cmpnt.u->atom.ident = malloc(sizeof(ms_Ident));
+    expr->cmpnt.u->atom.ident = ms_IdentNew(name, len);
     if (!expr->cmpnt.u->atom.ident) {
-        free(expr);
-        return NULL;
-    }
-
-    expr->cmpnt.u->atom.ident->name = dsbuf_new_l(name, len);
-    expr->cmpnt.u->atom.ident->type = ms_IdentGetType(name);
-    if (!expr->cmpnt.u->atom.ident->name) {
-        free(expr->cmpnt.u->atom.ident);
-        free(expr);
+        ms_ExprDestroy(expr);
         return NULL;
     }
 
@@ -227,6 +255,9 @@ ms_Expr *ms_ExprDup(const ms_Expr *src) {
             break;
         case EXPRTYPE_CONDITIONAL:
             assert(expr->cmpnt.c);
+            expr->cmpnt.c->condtype = src->cmpnt.c->condtype;
+            expr->cmpnt.c->truetype = src->cmpnt.c->truetype;
+            expr->cmpnt.c->falsetype = src->cmpnt.c->falsetype;
             if (!ExprAtomDup(&src->cmpnt.c->cond, &expr->cmpnt.c->cond, expr->cmpnt.c->condtype)) {
                 goto expr_dup_fail;
             }
@@ -246,11 +277,22 @@ expr_dup_fail:
     return NULL;
 }
 
+ms_Expr *ms_ExprRetain(ms_Expr *expr) {
+    if (!expr) { return NULL; }
+
+    assert(expr->refs > 0);
+    expr->refs++;
+    return expr;
+}
+
 ms_Expr *ms_ExprFlatten(ms_Expr *outer, ms_Expr *inner, ms_ExprLocation loc) {
     if ((!outer) || (!inner)) { return NULL; }
 
+    /* a shared expression is referenced whole, since its atom is
+     * still owned by its other references */
     bool should_flatten = (inner->type == EXPRTYPE_UNARY) &&
-                          (inner->cmpnt.u->op == UNARY_NONE);
+                          (inner->cmpnt.u->op == UNARY_NONE) &&
+                          (inner->refs == 1);
 
     switch (loc) {
         case EXPRLOC_UNARY:
@@ -413,6 +455,23 @@ ms_ExprIdentType ms_ExprGetIdentType(const ms_Expr *expr) {
     }
 }
 
+ms_Ident *ms_IdentNew(const char *name, size_t len) {
+    assert(name);
+
+    ms_Ident *ident = ASTNodeAlloc(sizeof(ms_Ident));
+    if (!ident) {
+        return NULL;
+    }
+
+    ident->name = dsbuf_new_l(name, len);
+    if (!ident->name) {
+        ASTNodeFree(ident, sizeof(ms_Ident));
+        return NULL;
+    }
+    ident->type = ms_IdentGetType(name);
+    return ident;
+}
+
 ms_IdentType ms_IdentGetType(const char *ident) {
     assert(ident);
 
@@ -430,7 +489,7 @@ void ms_IdentDestroy(ms_Ident *ident) {
     if (!ident) { return; }
     dsbuf_destroy(ident->name);
     ident->name = NULL;
-    free(ident);
+    ASTNodeFree(ident, sizeof(ms_Ident));
 }
 
 void ms_ValObjectTupleDestroy(ms_ValObjectTuple *tuple) {
@@ -439,7 +498,7 @@ void ms_ValObjectTupleDestroy(ms_ValObjectTuple *tuple) {
     tuple->key = NULL;
     ms_ExprDestroy(tuple->val);
     tuple->val = NULL;
-    free(tuple);
+    dsfree(tuple);
 }
 
 void ms_ValFuncDestroy(ms_ValFunc *fn) {
@@ -450,17 +509,21 @@ void ms_ValFuncDestroy(ms_ValFunc *fn) {
     fn->args = NULL;
     dsarray_destroy(fn->block);
     fn->block = NULL;
-    free(fn);
+    dsfree(fn);
 }
 
 void ms_ExprDestroy(ms_Expr *expr) {
     if (!expr) { return; }
 
+    assert(expr->refs > 0);
+    if (--expr->refs > 0) {
+        return;
+    }
+
     switch (expr->type) {
         case EXPRTYPE_UNARY:
             if (expr->cmpnt.u) {
                 ExprAtomDestroy(&expr->cmpnt.u->atom, expr->cmpnt.u->type);
-                free(expr->cmpnt.u);
                 expr->cmpnt.u = NULL;
             }
             break;
@@ -468,7 +531,6 @@ void ms_ExprDestroy(ms_Expr *expr) {
             if (expr->cmpnt.b) {
                 ExprAtomDestroy(&expr->cmpnt.b->latom, expr->cmpnt.b->ltype);
                 ExprAtomDestroy(&expr->cmpnt.b->ratom, expr->cmpnt.b->rtype);
-                free(expr->cmpnt.b);
                 expr->cmpnt.b = NULL;
             }
             break;
@@ -477,13 +539,12 @@ void ms_ExprDestroy(ms_Expr *expr) {
                 ExprAtomDestroy(&expr->cmpnt.c->cond, expr->cmpnt.c->condtype);
                 ExprAtomDestroy(&expr->cmpnt.c->iftrue, expr->cmpnt.c->truetype);
                 ExprAtomDestroy(&expr->cmpnt.c->iffalse, expr->cmpnt.c->falsetype);
-                free(expr->cmpnt.c);
                 expr->cmpnt.c = NULL;
             }
             break;
     }
 
-    free(expr);
+    ASTNodeFree(expr, ExprNodeSize(expr->type));
 }
 
 void ms_StmtDestroy(ms_Stmt *stmt) {
@@ -528,35 +589,98 @@ void ms_StmtDestroy(ms_Stmt *stmt) {
             break;
     }
 
-    free(stmt);
+    dsfree(stmt);
+}
+
+ms_ASTArena *ms_ASTArenaNew(void) {
+    ms_ASTArena *arena = dsalloc(sizeof(ms_ASTArena));
+    if (!arena) {
+        return NULL;
+    }
+
+    arena->pool = dspool_new();
+    if (!arena->pool) {
+        dsfree(arena);
+        return NULL;
+    }
+
+    arena->ast = NULL;
+    arena->refs = 1;
+    return arena;
+}
+
+ms_ASTArena *ms_ASTArenaRetain(ms_ASTArena *arena) {
+    assert(arena);
+    assert(arena->refs > 0);
+    arena->refs++;
+    return arena;
+}
+
+void ms_ASTArenaClear(ms_ASTArena *arena) {
+    assert(arena);
+
+    DSPool *prev = ms_ASTPoolSwap(arena->pool);
+    ms_ASTDestroy(arena->ast);
+    arena->ast = NULL;
+    ms_ASTPoolSwap(prev);
+}
+
+void ms_ASTArenaRelease(ms_ASTArena *arena) {
+    if (!arena) { return; }
+    assert(arena->refs > 0);
+    if (--arena->refs > 0) { return; }
+
+    ms_ASTArenaClear(arena);
+    dspool_destroy(arena->pool);
+    arena->pool = NULL;
+    dsfree(arena);
 }
 
 /*
  * PRIVATE FUNCTIONS
  */
 
+/* Allocate an AST node, packing nodes of the same size together in the
+ * current pool (if there is one) to keep trees compact. */
+static void *ASTNodeAlloc(size_t size) {
+    return (AST_POOL) ? dspool_alloc(AST_POOL, size) : dsalloc(size);
+}
+
+static void ASTNodeFree(void *node, size_t size) {
+    if (AST_POOL) {
+        dspool_free(AST_POOL, node, size);
+    } else {
+        dsfree(node);
+    }
+}
+
+static size_t ExprNodeSize(ms_ExprType type) {
+    switch (type) {
+        case EXPRTYPE_CONDITIONAL:
+            return sizeof(ExprConditionalNode);
+        case EXPRTYPE_BINARY:
+            return sizeof(ExprBinaryNode);
+        case EXPRTYPE_UNARY:
+            return sizeof(ExprUnaryNode);
+    }
+
+    assert(false && "invalid expression type");
+    return 0;
+}
+
 static bool ExprAtomDup(const ms_ExprAtom *src, ms_ExprAtom *dest, ms_ExprAtomType type) {
     assert(src);
     assert(dest);
 
     switch(type) {
         case EXPRATOM_EXPRESSION:
-            dest->expr = ms_ExprDup(src->expr);
-            if (!dest->expr) {
-                goto expr_atom_dup_fail;
-            }
+            dest->expr = ms_ExprRetain(src->expr);
             break;
         case EXPRATOM_IDENT:
-            dest->ident = malloc(sizeof(ms_Ident));
+            dest->ident = ms_IdentNew(dsbuf_char_ptr(src->ident->name), dsbuf_len(src->ident->name));
             if (!dest->ident) {
                 goto expr_atom_dup_fail;
             }
-
-            dest->ident->type = src->ident->type;
-            dest->ident->name = dsbuf_dup(src->ident->name);
-            if (!dest->ident->name) {
-                goto expr_atom_dup_fail;
-            }
             break;
         case EXPRATOM_EXPRLIST: {
             size_t srclen = dsarray_cap(src->list);
@@ -567,13 +691,7 @@ static bool ExprAtomDup(const ms_ExprAtom *src, ms_ExprAtom *dest, ms_ExprAtomTy
 
             size_t len = dsarray_len(src->list);
             for (size_t i = 0; i < len; i++) {
-                const ms_Expr *e = dsarray_get(src->list, i);
-                ms_Expr *e2 = ms_ExprDup(e);
-                if (!e2) {
-                    goto expr_atom_dup_fail;
-                }
-
-                dsarray_append(dest->list, e2);
+                dsarray_append(dest->list, ms_ExprRetain(dsarray_get(src->list, i)));
             }
             break;
         }
@@ -612,53 +730,34 @@ static bool ExprAtomValDup(const ms_Value *src, ms_Value *dest) {
             }
             break;
         case MSVAL_ARRAY: {
-            size_t len = dsarray_cap(src->val.a);
-            dest->val.a = dsarray_new_cap(len, NULL, (dsarray_free_fn)ms_ExprDestroy);
+            dest->val.a = dsarray_new_cap(dsarray_cap(src->val.a), NULL, (dsarray_free_fn)ms_ExprDestroy);
             if (!dest->val.a) {
                 return false;
             }
 
+            size_t len = dsarray_len(src->val.a);
             for (size_t i = 0; i < len; i++) {
-                const ms_Expr *e = dsarray_get(src->val.a, i);
-                ms_Expr *e2 = ms_ExprDup(e);
-                if (!e2) {
-                    return false;
-                }
-
-                dsarray_append(dest->val.a, e2);
+                dsarray_append(dest->val.a, ms_ExprRetain(dsarray_get(src->val.a, i)));
             }
             break;
         }
         case MSVAL_OBJECT: {
-            size_t len = dsarray_cap(src->val.o);
-            dest->val.o = dsarray_new_cap(len, NULL, (dsarray_free_fn)ms_ValObjectTupleDestroy);
+            dest->val.o = dsarray_new_cap(dsarray_cap(src->val.o), NULL, (dsarray_free_fn)ms_ValObjectTupleDestroy);
             if (!dest->val.o) {
                 return false;
             }
 
+            size_t len = dsarray_len(src->val.o);
             for (size_t i = 0; i < len; i++) {
                 const ms_ValObjectTuple *srctuple = dsarray_get(src->val.o, i);
 
-                ms_ValObjectTuple *desttuple = malloc(sizeof(ms_ValObjectTuple));
+                ms_ValObjectTuple *desttuple = dsalloc(sizeof(ms_ValObjectTuple));
                 if (!desttuple) {
                     return false;
                 }
 
-                ms_Expr *key = ms_ExprDup(srctuple->key);
-                if (!key) {
-                    free(desttuple);
-                    return false;
-                }
-
-                ms_Expr *val = ms_ExprDup(srctuple->val);
-                if (!val) {
-                    free(desttuple);
-                    ms_ExprDestroy(key);
-                    return false;
-                }
-
-                desttuple->key = key;
-                desttuple->val = val;
+                desttuple->key = ms_ExprRetain(srctuple->key);
+                desttuple->val = ms_ExprRetain(srctuple->val);
                 dsarray_append(dest->val.o, desttuple);
             }
             break;
@@ -723,7 +822,7 @@ static void StmtDeleteDestroy(ms_StmtDelete *del) {
     if (!del) { return; }
     ms_ExprDestroy(del->expr);
     del->expr = NULL;
-    free(del);
+    dsfree(del);
 }
 
 static void StmtForDestroy(ms_StmtFor *forstmt) {
@@ -740,7 +839,7 @@ static void StmtForDestroy(ms_StmtFor *forstmt) {
                 forstmt->clause.inc->end = NULL;
                 ms_ExprDestroy(forstmt->clause.inc->step);
                 forstmt->clause.inc->step = NULL;
-                free(forstmt->clause.inc);
+                dsfree(forstmt->clause.inc);
             }
             break;
         case FORSTMT_ITERATOR:
@@ -749,21 +848,21 @@ static void StmtForDestroy(ms_StmtFor *forstmt) {
                 forstmt->clause.iter->ident = NULL;
                 ms_ExprDestroy(forstmt->clause.iter->iter);
                 forstmt->clause.iter->iter = NULL;
-                free(forstmt->clause.iter);
+                dsfree(forstmt->clause.iter);
             }
             break;
         case FORSTMT_EXPR:
             if (forstmt->clause.expr) {
                 ms_ExprDestroy(forstmt->clause.expr->expr);
                 forstmt->clause.expr->expr = NULL;
-                free(forstmt->clause.expr);
+                dsfree(forstmt->clause.expr);
             }
             break;
     }
 
     dsarray_destroy(forstmt->block);
     forstmt->block = NULL;
-    free(forstmt);
+    dsfree(forstmt);
 }
 
 static void StmtIfDestroy(ms_StmtIf *ifstmt) {
@@ -785,10 +884,10 @@ static void StmtIfDestroy(ms_StmtIf *ifstmt) {
                 ifstmt->elif->clause.elstmt = NULL;
                 break;
         }
-        free(ifstmt->elif);
+        dsfree(ifstmt->elif);
     }
 
-    free(ifstmt);
+    dsfree(ifstmt);
 }
 
 static void StmtImportDestroy(ms_StmtImport *import) {
@@ -797,21 +896,21 @@ static void StmtImportDestroy(ms_StmtImport *import) {
     import->ident = NULL;
     ms_IdentDestroy(import->alias);
     import->alias = NULL;
-    free(import);
+    dsfree(import);
 }
 
 static void StmtElseDestroy(ms_StmtElse *elstmt) {
     if (!elstmt) { return; }
     dsarray_destroy(elstmt->block);
     elstmt->block = NULL;
-    free(elstmt);
+    dsfree(elstmt);
 }
 
 static void StmtReturnDestroy(ms_StmtReturn *ret) {
     if (!ret) { return; }
     ms_ExprDestroy(ret->expr);
     ret->expr = NULL;
-    free(ret);
+    dsfree(ret);
 }
 
 static void StmtAssignmentDestroy(ms_StmtAssignment *assign) {
@@ -824,7 +923,7 @@ static void StmtAssignmentDestroy(ms_StmtAssignment *assign) {
         ident->target = NULL;
         ident = ident->next;
         prev->next = NULL;
-        free(prev);
+        dsfree(prev);
     }
 
     ms_StmtAssignExpr *expr = assign->expr;
@@ -834,10 +933,10 @@ static void StmtAssignmentDestroy(ms_StmtAssignment *assign) {
         expr->expr = NULL;
         expr = expr->next;
         prev->next = NULL;
-        free(prev);
+        dsfree(prev);
     }
 
-    free(assign);
+    dsfree(assign);
 }
 
 static void StmtDeclarationDestroy(ms_StmtDeclaration *decl) {
@@ -848,5 +947,5 @@ static void StmtDeclarationDestroy(ms_StmtDeclaration *decl) {
     decl->expr = NULL;
     StmtDeclarationDestroy(decl->next);
     decl->next = NULL;
-    free(decl);
+    dsfree(decl);
 }
@@ -17,8 +17,10 @@
 #ifndef MSCRIPT_LANG_H
 #define MSCRIPT_LANG_H
 
+#include <stdint.h>
 #include "libds/array.h"
 #include "libds/buffer.h"
+#include "libds/pool.h"
 #include "lexer.h"
 
 typedef struct ms_Expr ms_Expr;
@@ -191,6 +193,7 @@ typedef enum {
 struct ms_Expr {
     ms_ExprComponent cmpnt;
     ms_ExprType type;
+    uint32_t refs;
 };
 
 /* Enumeration used to indicate which part of an expression to flatten
@@ -352,11 +355,32 @@ typedef DSArray ms_Module;
 
 typedef ms_Module ms_AST;
 
+/*
+ * A parsed module together with the pool holding its expressions and
+ * identifiers. Functions which are compiled lazily keep the arena of the
+ * module they were declared in alive until their bodies are compiled.
+ */
+typedef struct {
+    ms_AST *ast;                    /** parsed module, or NULL */
+    DSPool *pool;                   /** pool holding the nodes of the module */
+    size_t refs;                    /** number of references held to the arena */
+} ms_ASTArena;
+
 /**
 * @brief Create a new @c ms_Expr object.
 */
 ms_Expr *ms_ExprNew(ms_ExprType type);
 
+/**
+* @brief Set the pool from which new expressions and identifiers are
+* allocated by the calling thread, returning the previously set pool.
+*
+* Nodes are returned to the pool which is set when they are destroyed, so
+* a tree must be destroyed with the same pool set as when it was built.
+* Trees built while no pool is set are allocated with @c dsalloc .
+*/
+DSPool *ms_ASTPoolSwap(DSPool *pool);
+
 /**
 * @brief Create a new @c ms_Expr object with a primitive value.
 */
@@ -391,16 +415,30 @@ ms_Expr *ms_ExprIntFromString(const char *str);
 
 /**
 * @brief Duplicate the given expression.
+*
+* Expressions are not modified once they are constructed, so only the
+* outermost expression is copied. Nested expressions are shared with
+* @c src and retained by the copy.
 */
 ms_Expr *ms_ExprDup(const ms_Expr *src);
 
+/**
+* @brief Acquire another reference to the given expression.
+*
+* Expressions may be shared by several parents in the tree; each reference
+* is released by @c ms_ExprDestroy and the expression is freed with the
+* last of them.
+*/
+ms_Expr *ms_ExprRetain(ms_Expr *expr);
+
 /**
 * @brief Flatten two expressions such that the expression tree does not
 * become too deep too quickly.
 *
 * This function WILL FREE @c inner if it is no longer needed (i.e. if the
 * expression is flattened). Be careful to NULL out any remaining pointers
-* you have to @c inner after calling this function.
+* you have to @c inner after calling this function. Expressions with more
+* than one reference are never flattened.
 *
 * @param outer the outer/containing @c ms_Expr object
 * @param inner the inner/contained @c ms_Expr object; this memory may be
@@ -420,6 +458,11 @@ ms_Expr *ms_ExprFlatten(ms_Expr *outer, ms_Expr *inner, ms_ExprLocation loc);
 */
 ms_ExprIdentType ms_ExprGetIdentType(const ms_Expr *expr);
 
+/**
+* @brief Create a new @c ms_Ident with a copy of the given name.
+*/
+ms_Ident *ms_IdentNew(const char *name, size_t len);
+
 /**
 * @brief Determine the type of identifier.
 */
@@ -441,7 +484,8 @@ void ms_ValObjectTupleDestroy(ms_ValObjectTuple *tuple);
 void ms_ValFuncDestroy(ms_ValFunc *fn);
 
 /**
-* @brief Destroy the given @c ms_Expr and any nested expressions.
+* @brief Release a reference to the given @c ms_Expr , destroying it and
+* any nested expressions once no references remain.
 */
 void ms_ExprDestroy(ms_Expr *expr);
 
@@ -455,4 +499,26 @@ void ms_StmtDestroy(ms_Stmt *stmt);
 */
 #define ms_ASTDestroy(ast) dsarray_destroy(ast)
 
+/**
+* @brief Create a new, empty @c ms_ASTArena with one reference.
+*/
+ms_ASTArena *ms_ASTArenaNew(void);
+
+/**
+* @brief Add a reference to an @c ms_ASTArena , returning the arena.
+*/
+ms_ASTArena *ms_ASTArenaRetain(ms_ASTArena *arena);
+
+/**
+* @brief Destroy the module held by an @c ms_ASTArena , returning its nodes
+* to the arena's pool for the next module.
+*/
+void ms_ASTArenaClear(ms_ASTArena *arena);
+
+/**
+* @brief Release a reference to an @c ms_ASTArena , destroying the arena
+* and its module when the last reference is released.
+*/
+void ms_ASTArenaRelease(ms_ASTArena *arena);
+
 #endif //MSCRIPT_LANG_H
@@ -16,8 +16,11 @@
 
 #include <assert.h>
 #include <string.h>
-#include "libds/dict.h"
-#include "libds/hash.h"
+#if defined(__SSE2__) && defined(__GNUC__)
+#include <emmintrin.h>
+#define MS_LEXER_USE_SSE2
+#endif
+#include "libds/alloc.h"
 #include "stream/streamreader.h"
 #include "lexer.h"
 
@@ -102,42 +105,42 @@ const char *const TOK_FLOAT_NUMBER = "FLOAT_NUMBER";
 const char *const TOK_HEX_NUMBER = "HEX_NUMBER";
 
 // Default token buffer size
-static const int DEFAULT_TOKEN_BUFFER = 10;
-
-// Important private constants
-static const char *const BASE_10_DIGITS = "0123456789";
-static const char *const BASE_16_DIGITS = "0123456789abcdefABCDEF";
-static const char *const ALPHANUMERIC = "abcdefghijklmnopqrstuvwxyz_ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
-static const char *const SYMBOLS = "/*+-=)(&^%$#@![]{}\\|'\":;,.<>?`~ \f\t\n\r;?`#";    // Includes invalid symbols:  ;?`#
-
-// mscript language keywords
-typedef struct KeywordTuple {
-    const char *kw;
-    ms_TokenType type;
-} KeywordTuple;
-static KeywordTuple KEYWORDS[] = {
-    // Current/valid keywords
-    { "if", KW_IF }, { "else", KW_ELSE }, { "return", KW_RETURN },
-    { "true", KW_TRUE }, { "false", KW_FALSE }, { "null", KW_NULL },
-    { "func", KW_FUNC }, { "del", KW_DEL }, { "continue", KW_CONTINUE },
-    { "break", KW_BREAK }, { "import", KW_IMPORT }, { "var", KW_VAR },
-    { "in", KW_IN }, { "is", KW_IS }, { "for", KW_FOR }, { "select", KW_SELECT },
-
-    // Unused and reserved keywords
-    { "switch", RESERVED_KW }, { "error", RESERVED_KW }, { "goto", RESERVED_KW },
-    { "class", RESERVED_KW }, { "private", RESERVED_KW },
-    { "public", RESERVED_KW }, { "protected", RESERVED_KW },
-    { "yield", RESERVED_KW }, { "from", RESERVED_KW }, { "try", RESERVED_KW },
-    { "finally", RESERVED_KW }, { "do", RESERVED_KW }, { "and", RESERVED_KW },
-    { "or", RESERVED_KW }, { "mut", RESERVED_KW }, { "const", RESERVED_KW },
-    { "async", RESERVED_KW }, { "await", RESERVED_KW },
-    { "repeat", RESERVED_KW }, { "until", RESERVED_KW },
-    { "while", RESERVED_KW }, { "except", RESERVED_KW }, { "num", RESERVED_KW },
-    { "str", RESERVED_KW }, { "bool", RESERVED_KW }, { "datetime", RESERVED_KW },
-    { "obj", RESERVED_KW }, { "as", RESERVED_KW }, { "package", RESERVED_KW },
-    { "with", RESERVED_KW }, { "using", RESERVED_KW }, { "spawn", RESERVED_KW },
-    { "val", RESERVED_KW }, { "merge", RESERVED_KW }
+static const size_t DEFAULT_TOKEN_BUFFER = 64;
+
+// Character classes, so runs of input may be classified by table lookup
+enum CharClass {
+    CC_SPACE = 0x01,            /** Insignificant whitespace */
+    CC_DIGIT = 0x02,            /** Base 10 digits */
+    CC_HEX = 0x04,              /** Base 16 digits */
+    CC_SYMBOL = 0x08,           /** Characters which end a word (including whitespace) */
 };
+static const unsigned char CHAR_CLASS[256] = {
+    ['\t'] = CC_SPACE | CC_SYMBOL, ['\n'] = CC_SPACE | CC_SYMBOL,
+    ['\f'] = CC_SPACE | CC_SYMBOL, ['\r'] = CC_SPACE | CC_SYMBOL,
+    [' '] = CC_SPACE | CC_SYMBOL,
+
+    ['0'] = CC_DIGIT | CC_HEX, ['1'] = CC_DIGIT | CC_HEX, ['2'] = CC_DIGIT | CC_HEX,
+    ['3'] = CC_DIGIT | CC_HEX, ['4'] = CC_DIGIT | CC_HEX, ['5'] = CC_DIGIT | CC_HEX,
+    ['6'] = CC_DIGIT | CC_HEX, ['7'] = CC_DIGIT | CC_HEX, ['8'] = CC_DIGIT | CC_HEX,
+    ['9'] = CC_DIGIT | CC_HEX,
+    ['a'] = CC_HEX, ['b'] = CC_HEX, ['c'] = CC_HEX, ['d'] = CC_HEX, ['e'] = CC_HEX,
+    ['f'] = CC_HEX, ['A'] = CC_HEX, ['B'] = CC_HEX, ['C'] = CC_HEX, ['D'] = CC_HEX,
+    ['E'] = CC_HEX, ['F'] = CC_HEX,
+
+    // Includes invalid symbols: `#
+    ['/'] = CC_SYMBOL, ['*'] = CC_SYMBOL, ['+'] = CC_SYMBOL, ['-'] = CC_SYMBOL,
+    ['='] = CC_SYMBOL, [')'] = CC_SYMBOL, ['('] = CC_SYMBOL, ['&'] = CC_SYMBOL,
+    ['^'] = CC_SYMBOL, ['%'] = CC_SYMBOL, ['$'] = CC_SYMBOL, ['#'] = CC_SYMBOL,
+    ['@'] = CC_SYMBOL, ['!'] = CC_SYMBOL, ['['] = CC_SYMBOL, [']'] = CC_SYMBOL,
+    ['{'] = CC_SYMBOL, ['}'] = CC_SYMBOL, ['\\'] = CC_SYMBOL, ['|'] = CC_SYMBOL,
+    ['\''] = CC_SYMBOL, ['"'] = CC_SYMBOL, [':'] = CC_SYMBOL, [';'] = CC_SYMBOL,
+    [','] = CC_SYMBOL, ['.'] = CC_SYMBOL, ['<'] = CC_SYMBOL, ['>'] = CC_SYMBOL,
+    ['?'] = CC_SYMBOL, ['`'] = CC_SYMBOL, ['~'] = CC_SYMBOL,
+};
+
+// mscript language keywords are recognized by a switch on their length
+// and first character in LexerGetWordTokenType; this compares the rest
+#define KEYWORD_IS(word, kw) (memcmp((word), (kw), sizeof(kw) - 1) == 0)
 
 /*
  * FORWARD DECLARATIONS
@@ -148,45 +151,50 @@ struct ms_Lexer {
     size_t line;                /** Current line in the input stream */
     size_t col;                 /** Current column of the current line */
     ms_StreamReader *reader;    /** Input stream (either string or file) */
-    DSBuffer *buffer;           /** Current token value buffer */
-    DSDict *kwcache;            /** Cache of keyword tokens for fast lookup */
+    char *buffer;               /** Current token value (always NUL terminated) */
+    size_t len;                 /** Length of the current token value */
+    size_t cap;                 /** Capacity of the token value buffer */
+    ms_TokenView tok;           /** Most recently lexed token */
 };
 
 // Forward declarations used by the public API
-static inline ms_Token *LexerTokenNew(ms_Lexer *lex, enum ms_TokenType type, const char *value, size_t len);
-static inline ms_Token *LexerTokenError(ms_Lexer *lex, const char *msg);
-static inline ms_Token *LexerTokenFromBuffer(ms_Lexer *lex, ms_TokenType type);
+static inline const ms_TokenView *LexerTokenNew(ms_Lexer *lex, enum ms_TokenType type, const char *value, size_t len);
+static inline const ms_TokenView *LexerTokenError(ms_Lexer *lex, const char *msg);
+static inline const ms_TokenView *LexerTokenFromBuffer(ms_Lexer *lex, ms_TokenType type);
 static inline int LexerNextChar(ms_Lexer *lex);
 static inline int LexerPeek(ms_Lexer *lex);
-static ms_Token *LexerLexNumber(ms_Lexer *lex, int prev);
-static ms_Token *LexerLexWord(ms_Lexer *lex, int prev);
-static ms_Token *LexerLexString(ms_Lexer *lex, int first);
-static bool LexerAcceptOne(ms_Lexer *lex, const char *valid);
-static int LexerAcceptRun(ms_Lexer *lex, const char *valid);
-static int LexerAcceptExcept(ms_Lexer *lex, const char *invalid);
+static const ms_TokenView *LexerLexNumber(ms_Lexer *lex, int prev);
+static const ms_TokenView *LexerLexWord(ms_Lexer *lex, int prev);
+static const ms_TokenView *LexerLexString(ms_Lexer *lex, int first);
+static void LexerSkipComment(ms_Lexer *lex);
+static bool LexerAcceptOne(ms_Lexer *lex, int lower, int upper);
+static size_t LexerAcceptRun(ms_Lexer *lex, unsigned char mask, unsigned char match);
+static size_t LexerScanRun(ms_Lexer *lex, unsigned char mask, unsigned char match, bool keep);
 static inline void LexerIncrementLine(ms_Lexer *lex);
 static inline void LexerBackup(ms_Lexer *lex);
 static inline void LexerAddToBuffer(ms_Lexer *lex, int c);
-static inline bool LexerResetBuffer(ms_Lexer *lex);
+static void LexerAddRunToBuffer(ms_Lexer *lex, const char *run, size_t len);
+static inline void LexerResetBuffer(ms_Lexer *lex);
 static ms_TokenType LexerGetWordTokenType(ms_Lexer *lex);
-static bool LexerConstructKeywordCache(ms_Lexer *lex);
-static inline bool InStr(int needle, const char *haystack);
+static inline bool CharIs(int c, unsigned char cls);
+static size_t FindAny(const char *str, size_t len, char a, char b, char c);
 
 /*
  * PUBLIC FUNCTIONS
  */
 
 ms_Lexer *ms_LexerNew(void) {
-    ms_Lexer* lex = calloc(sizeof(ms_Lexer), sizeof(ms_Lexer));
+    ms_Lexer* lex = dscalloc(sizeof(ms_Lexer), sizeof(ms_Lexer));
     if (!lex) {
         return NULL;
     }
 
     lex->reader = NULL;
-    lex->buffer = NULL;
-    lex->kwcache = NULL;
-    if (!LexerConstructKeywordCache(lex)) {
-        free(lex);
+    lex->len = 0;
+    lex->cap = DEFAULT_TOKEN_BUFFER;
+    lex->buffer = dscalloc(lex->cap, 1);
+    if (!lex->buffer) {
+        dsfree(lex);
         return NULL;
     }
     return lex;
@@ -195,7 +203,6 @@ ms_Lexer *ms_LexerNew(void) {
 bool ms_LexerInitFile(ms_Lexer *lex, const char *fname) {
     assert(lex);
 
-    dsbuf_destroy(lex->buffer);
     ms_StreamDestroy(lex->reader);
     lex->reader = ms_StreamNewFile(fname);
     if (!lex->reader) {
@@ -203,9 +210,24 @@ bool ms_LexerInitFile(ms_Lexer *lex, const char *fname) {
     }
 
     lex->line = 1;
-    lex->col = 0;
-    lex->buffer = NULL;
-    return LexerResetBuffer(lex);;
+    lex->col = 1;
+    LexerResetBuffer(lex);
+    return true;
+}
+
+bool ms_LexerInitFileHandle(ms_Lexer *lex, FILE *file) {
+    assert(lex);
+
+    ms_StreamDestroy(lex->reader);
+    lex->reader = ms_StreamNewFileHandle(file);
+    if (!lex->reader) {
+        return false;
+    }
+
+    lex->line = 1;
+    lex->col = 1;
+    LexerResetBuffer(lex);
+    return true;
 }
 
 bool ms_LexerInitString(ms_Lexer *lex, const char *str) {
@@ -215,7 +237,6 @@ bool ms_LexerInitString(ms_Lexer *lex, const char *str) {
 bool ms_LexerInitStringL(ms_Lexer *lex, const char *str, size_t len) {
     assert(lex);
 
-    dsbuf_destroy(lex->buffer);
     ms_StreamDestroy(lex->reader);
     lex->reader = ms_StreamNewStringL(str, len);
     if (!lex->reader) {
@@ -224,22 +245,35 @@ bool ms_LexerInitStringL(ms_Lexer *lex, const char *str, size_t len) {
 
     lex->line = 1;
     lex->col = 1;
-    lex->buffer = NULL;
-    return LexerResetBuffer(lex);
+    LexerResetBuffer(lex);
+    return true;
+}
+
+void ms_LexerCloseInput(ms_Lexer *lex) {
+    assert(lex);
+    ms_StreamDestroy(lex->reader);
+    lex->reader = NULL;
 }
 
 void ms_LexerDestroy(ms_Lexer *lex) {
     if (!lex) { return; }
     ms_StreamDestroy(lex->reader);
     lex->reader = NULL;
-    dsbuf_destroy(lex->buffer);
+    dsfree(lex->buffer);
     lex->buffer = NULL;
-    dsdict_destroy(lex->kwcache);
-    lex->kwcache = NULL;
-    free(lex);
+    dsfree(lex);
 }
 
 ms_Token *ms_LexerNextToken(ms_Lexer *lex) {
+    const ms_TokenView *tok = ms_LexerNextTokenView(lex);
+    if (!tok) {
+        return NULL;
+    }
+
+    return ms_TokenNew(tok->type, tok->text, tok->len, tok->line, tok->col);
+}
+
+const ms_TokenView *ms_LexerNextTokenView(ms_Lexer *lex) {
     assert(lex);
     int n = LexerNextChar(lex);
     if (n == EOF) { return NULL; }
@@ -256,6 +290,7 @@ begin_lex:              // Jump label for ignored input
         case ' ':
         case '\t':
         case '\f':
+            (void)LexerScanRun(lex, CC_SPACE, CC_SPACE, false);
             n = LexerNextChar(lex);
             goto begin_lex;
 
@@ -267,8 +302,8 @@ begin_lex:              // Jump label for ignored input
             } else if (n != '/') {
                 return LexerTokenNew(lex, OP_DIVIDE, "/", 1);
             }
-            n = LexerNextChar(lex);    // Ignore to the end of the line
-            while (n != '\n' && n != '\r') { n = LexerNextChar(lex); }
+            LexerSkipComment(lex);     // Ignore to the end of the line
+            n = LexerNextChar(lex);
             goto begin_lex;
 
             // Equality check
@@ -442,26 +477,26 @@ begin_lex:              // Jump label for ignored input
             // Potential numeric
         case '.':
             n = LexerPeek(lex);
-            if (InStr(n, BASE_10_DIGITS)) {
-                if (!LexerResetBuffer(lex)) { return NULL; }
+            if (CharIs(n, CC_DIGIT)) {
+                LexerResetBuffer(lex);
                 return LexerLexNumber(lex, '.');
             }
             return LexerTokenNew(lex, PERIOD, ".", 1);
 
             // Built-in functions
         case '$':
-            if (!LexerResetBuffer(lex)) { return NULL; }
+            LexerResetBuffer(lex);
             return LexerLexWord(lex, n);
 
             // Database (global) reference
         case '@':
-            if (!LexerResetBuffer(lex)) { return NULL; }
+            LexerResetBuffer(lex);
             return LexerLexWord(lex, n);
 
             // Strings
         case '"':
         case '\'':
-            if (!LexerResetBuffer(lex)) { return NULL; }
+            LexerResetBuffer(lex);
             return LexerLexString(lex, n);
 
             // Numeric value
@@ -475,7 +510,7 @@ begin_lex:              // Jump label for ignored input
         case '7':
         case '8':
         case '9':
-            if (!LexerResetBuffer(lex)) { return NULL; }
+            LexerResetBuffer(lex);
             return LexerLexNumber(lex, n);
 
             // Unused (but invalid) symbols
@@ -486,7 +521,7 @@ begin_lex:              // Jump label for ignored input
 
             // Word
         default:
-            if (!LexerResetBuffer(lex)) { return NULL; }
+            LexerResetBuffer(lex);
             return LexerLexWord(lex, n);
     }
 
@@ -494,7 +529,7 @@ begin_lex:              // Jump label for ignored input
 }
 
 ms_Token *ms_TokenNew(ms_TokenType type, const char *value, size_t len, size_t line, size_t col) {
-    ms_Token *tok = malloc(sizeof(ms_Token));
+    ms_Token *tok = dsalloc(sizeof(ms_Token));
     if (!tok) {
         goto cleanup_token;
     }
@@ -513,7 +548,7 @@ ms_Token *ms_TokenNew(ms_TokenType type, const char *value, size_t len, size_t l
 cleanup_token_value:
     dsbuf_destroy(tok->value);
 cleanup_token:
-    free(tok);
+    dsfree(tok);
     return NULL;
 }
 
@@ -532,7 +567,7 @@ gen_token_string:
         return buf;
     }
 
-    buf = malloc(len + 1);
+    buf = dsalloc(len + 1);
     if (!buf) {
         return NULL;
     }
@@ -544,7 +579,7 @@ void ms_TokenDestroy(ms_Token *tok) {
     if (!tok) { return; }
     dsbuf_destroy(tok->value);
     tok->value = NULL;
-    free(tok);
+    dsfree(tok);
 }
 
 const char *ms_TokenName(ms_Token *tok) {
@@ -638,26 +673,29 @@ const char *ms_TokenTypeName(ms_TokenType type) {
  * PRIVATE FUNCTIONS
  */
 
-// Create a new token with the given type and value.
-static inline ms_Token *LexerTokenNew(ms_Lexer *lex, ms_TokenType type, const char *value, size_t len) {
+// Set the lexer's current token to the given type and value.
+static inline const ms_TokenView *LexerTokenNew(ms_Lexer *lex, ms_TokenType type, const char *value, size_t len) {
     assert(lex);
-    return ms_TokenNew(type, value, len, lex->line, lex->col);
+    lex->tok.type = type;
+    lex->tok.text = value;
+    lex->tok.len = len;
+    lex->tok.line = lex->line;
+    lex->tok.col = lex->col;
+    return &lex->tok;
 }
 
-// Create a new Error token with the given message
-static inline ms_Token *LexerTokenError(ms_Lexer *lex, const char *msg) {
+// Set the lexer's current token to an Error with the given message
+static inline const ms_TokenView *LexerTokenError(ms_Lexer *lex, const char *msg) {
     assert(lex);
     assert(msg);
-    return ms_TokenNew(ERROR, msg, strlen(msg), lex->line, lex->col);
+    return LexerTokenNew(lex, ERROR, msg, strlen(msg));
 }
 
 // Return a token from the value stored in the current Lexer buffer
-static inline ms_Token *LexerTokenFromBuffer(ms_Lexer *lex, ms_TokenType type) {
+static inline const ms_TokenView *LexerTokenFromBuffer(ms_Lexer *lex, ms_TokenType type) {
     assert(lex);
     assert(lex->buffer);
-    const char *buf = dsbuf_char_ptr(lex->buffer);
-    size_t len = dsbuf_len(lex->buffer);
-    return LexerTokenNew(lex, type, buf, len);
+    return LexerTokenNew(lex, type, lex->buffer, lex->len);
 }
 
 // Return the next character in the stream.
@@ -682,13 +720,13 @@ static inline int LexerPeek(ms_Lexer *lex) {
 
 // Starting at the character prev, attempt to lex an entire
 // numeric token and return it to the caller.
-static ms_Token *LexerLexNumber(ms_Lexer *lex, int prev) {
+static const ms_TokenView *LexerLexNumber(ms_Lexer *lex, int prev) {
     assert(lex);
     LexerAddToBuffer(lex, prev);
 
     // Accept hexadecimal numbers
-    if ((prev == '0') && (LexerAcceptOne(lex, "xX"))) {
-        if (LexerAcceptRun(lex, BASE_16_DIGITS) <= 0) {
+    if ((prev == '0') && (LexerAcceptOne(lex, 'x', 'X'))) {
+        if (LexerAcceptRun(lex, CC_HEX, CC_HEX) == 0) {
             return LexerTokenFromBuffer(lex, ERROR);
         }
         return LexerTokenFromBuffer(lex, HEX_NUMBER);
@@ -696,17 +734,17 @@ static ms_Token *LexerLexNumber(ms_Lexer *lex, int prev) {
 
     // Accept basic digits
     ms_TokenType type = (prev == '.') ? FLOAT_NUMBER : INT_NUMBER;
-    LexerAcceptRun(lex, BASE_10_DIGITS);
+    LexerAcceptRun(lex, CC_DIGIT, CC_DIGIT);
 
     // Accept standard decimal digits
-    if ((prev != '.') && (LexerAcceptOne(lex, "."))) {
-        LexerAcceptRun(lex, BASE_10_DIGITS);
+    if ((prev != '.') && (LexerAcceptOne(lex, '.', '.'))) {
+        LexerAcceptRun(lex, CC_DIGIT, CC_DIGIT);
         type = FLOAT_NUMBER;
     }
 
     // Accept exponential notation
-    if (LexerAcceptOne(lex, "eE")) {
-        LexerAcceptRun(lex, BASE_10_DIGITS);
+    if (LexerAcceptOne(lex, 'e', 'E')) {
+        LexerAcceptRun(lex, CC_DIGIT, CC_DIGIT);
         type = FLOAT_NUMBER;
     }
 
@@ -715,12 +753,12 @@ static ms_Token *LexerLexNumber(ms_Lexer *lex, int prev) {
 
 // Starting at the character prev, attempt to lex an entire
 // word token and return it to the caller.
-static ms_Token *LexerLexWord(ms_Lexer *lex, int prev) {
+static const ms_TokenView *LexerLexWord(ms_Lexer *lex, int prev) {
     assert(lex);
 
     // Accept every character except symbols and spaces
     LexerAddToBuffer(lex, prev);
-    int num = LexerAcceptExcept(lex, SYMBOLS);
+    size_t num = LexerAcceptRun(lex, CC_SYMBOL, 0);
 
     // Determine token type (since there are a few others)
     // Make sure we got at least one character for our
@@ -745,18 +783,33 @@ static ms_Token *LexerLexWord(ms_Lexer *lex, int prev) {
 
 // Starting at the character prev, attempt to lex an entire
 // string token and return it to the caller.
-static ms_Token *LexerLexString(ms_Lexer *lex, int first) {
+static const ms_TokenView *LexerLexString(ms_Lexer *lex, int first) {
     assert(lex);
 
-    int n;
     int prev = EOF;
+    size_t avail;
+    const char *run;
 
     // Accept every next character but:
     // - an escaped version of the opening quotation mark
     // - a new line (this is an error)
-    while ((n = LexerNextChar(lex)) != EOF) {
+    while ((run = ms_StreamAvailable(lex->reader, &avail)) != NULL) {
+        size_t len = FindAny(run, avail, (char)first, '\n', '\r');
+        if (len > 0) {
+            LexerAddRunToBuffer(lex, run, len);
+            prev = (unsigned char)run[len - 1];
+        }
+        if (len == avail) {
+            ms_StreamSkip(lex->reader, len);
+            lex->col += len;
+            continue;
+        }
+
+        int n = (unsigned char)run[len];
+        ms_StreamSkip(lex->reader, len + 1);
+        lex->col += len + 1;
         if ((n == first) && (prev != '\\')) {
-            break;
+            return LexerTokenFromBuffer(lex, STRING);
         }
         if ((n == '\n') || (n == '\r')) {
             LexerIncrementLine(lex);
@@ -766,24 +819,40 @@ static ms_Token *LexerLexString(ms_Lexer *lex, int first) {
         prev = n;
     }
 
-    if ((n == EOF) && (prev != first)) {
+    if (prev != first) {
         return LexerTokenFromBuffer(lex, ERROR);
     }
     return LexerTokenFromBuffer(lex, STRING);
 }
 
-// Accept the next character in the stream if it appears within
-// the string valid. Return true if that character was accepted.
+// Skip the remainder of a comment, up to (but not including) the
+// end of the line.
+static void LexerSkipComment(ms_Lexer *lex) {
+    assert(lex);
+
+    size_t avail;
+    const char *run;
+    while ((run = ms_StreamAvailable(lex->reader, &avail)) != NULL) {
+        size_t len = FindAny(run, avail, '\n', '\r', '\r');
+        ms_StreamSkip(lex->reader, len);
+        lex->col += len;
+        if (len < avail) {
+            break;
+        }
+    }
+}
+
+// Accept the next character in the stream if it is either of the
+// given characters. Return true if that character was accepted.
 //
-// Does not consume the next character.
-static bool LexerAcceptOne(ms_Lexer *lex, const char *valid) {
+// Does not consume the next character otherwise.
+static bool LexerAcceptOne(ms_Lexer *lex, int lower, int upper) {
     assert(lex);
-    assert(valid);
 
     int n = LexerNextChar(lex);
     if (n == EOF) { return false; }
 
-    if (InStr(n, valid)) {
+    if ((n == lower) || (n == upper)) {
         LexerAddToBuffer(lex, n);
         return true;
     }
@@ -792,42 +861,36 @@ static bool LexerAcceptOne(ms_Lexer *lex, const char *valid) {
     return false;
 }
 
-// Accept the as many characters from the stream as possible which
-// appear in the input string valid.
-static int LexerAcceptRun(ms_Lexer *lex, const char *valid) {
-    assert(lex);
-    assert(valid);
-
-    int count = 0;
-    int n;
-    while ((n = LexerNextChar(lex)) != EOF) {
-        if (InStr(n, valid)) {
-            count++;
-            LexerAddToBuffer(lex, n);
-        } else {
-            LexerBackup(lex);
-            break;  // Break if the last character didn't match
-        }
-    }
-
-    return count;
+// Accept as many characters from the stream as possible whose class
+// (masked by mask) is match, returning the number accepted.
+static size_t LexerAcceptRun(ms_Lexer *lex, unsigned char mask, unsigned char match) {
+    return LexerScanRun(lex, mask, match, true);
 }
 
-// Accept any character outside of the range given by the "invalid"
-// string input.
-static int LexerAcceptExcept(ms_Lexer *lex, const char *invalid) {
+// Consume the run of characters whose class (masked by mask) is match,
+// adding them to the lexer's buffer if keep is true. Each run available
+// from the stream is classified in one pass and copied in one piece.
+static size_t LexerScanRun(ms_Lexer *lex, unsigned char mask, unsigned char match, bool keep) {
     assert(lex);
-    assert(invalid);
 
-    int count = 0;
-    int n;
-    while ((n = LexerNextChar(lex)) != EOF) {
-        if (InStr(n, invalid)) {
-            LexerBackup(lex);
+    size_t count = 0;
+    size_t avail;
+    const char *run;
+    while ((run = ms_StreamAvailable(lex->reader, &avail)) != NULL) {
+        const unsigned char *cur = (const unsigned char *)run;
+        size_t len = 0;
+        while ((len < avail) && ((CHAR_CLASS[cur[len]] & mask) == match)) {
+            len++;
+        }
+
+        if (keep) {
+            LexerAddRunToBuffer(lex, run, len);
+        }
+        ms_StreamSkip(lex->reader, len);
+        lex->col += len;
+        count += len;
+        if (len < avail) {
             break;  // Break if the last character didn't match
-        } else {
-            count++;
-            LexerAddToBuffer(lex, n);
         }
     }
 
@@ -852,64 +915,252 @@ static inline void LexerBackup(ms_Lexer *lex) {
 
 // Add the given character to the lexer's buffer
 static inline void LexerAddToBuffer(ms_Lexer *lex, int c) {
+    assert(lex);
+    char ch = (char)c;
+    LexerAddRunToBuffer(lex, &ch, 1);
+}
+
+// Add a run of characters to the lexer's buffer, growing the buffer
+// if necessary. The buffer is always left NUL terminated.
+static void LexerAddRunToBuffer(ms_Lexer *lex, const char *run, size_t len) {
     assert(lex);
     assert(lex->buffer);
-    dsbuf_append_char(lex->buffer, c);
+
+    if (lex->len + len >= lex->cap) {
+        size_t cap = lex->cap * 2;
+        while (lex->len + len >= cap) {
+            cap *= 2;
+        }
+
+        char *buffer = dsrealloc(lex->buffer, cap);
+        if (!buffer) {
+            return;
+        }
+        lex->buffer = buffer;
+        lex->cap = cap;
+    }
+
+    memcpy(&lex->buffer[lex->len], run, len);
+    lex->len += len;
+    lex->buffer[lex->len] = '\0';
 }
 
 // Reset the internal buffer
-static inline bool LexerResetBuffer(ms_Lexer *lex) {
+static inline void LexerResetBuffer(ms_Lexer *lex) {
     assert(lex);
-    dsbuf_destroy(lex->buffer);
-    lex->buffer = dsbuf_new_buffer(DEFAULT_TOKEN_BUFFER);
-    if (!lex->buffer) { return false; }
-    return true;
+    assert(lex->buffer);
+    lex->len = 0;
+    lex->buffer[0] = '\0';
 }
 
 // Check if the value in the current lexer buffer is a keyword.
 static ms_TokenType LexerGetWordTokenType(ms_Lexer *lex) {
     assert(lex);
     assert(lex->buffer);
-    assert(lex->kwcache);
 
-    const char *word = dsbuf_char_ptr(lex->buffer);
-    ms_TokenType *type = dsdict_get(lex->kwcache, (void *)word);
-    if (!type) {
-        return IDENTIFIER;
+    const char *word = lex->buffer;
+    size_t len = lex->len;
+    switch (len) {
+        case 2:
+            switch (word[0]) {
+                case 'a':
+                    if (KEYWORD_IS(word, "as")) { return RESERVED_KW; }
+                    break;
+                case 'd':
+                    if (KEYWORD_IS(word, "do")) { return RESERVED_KW; }
+                    break;
+                case 'i':
+                    if (KEYWORD_IS(word, "if")) { return KW_IF; }
+                    if (KEYWORD_IS(word, "in")) { return KW_IN; }
+                    if (KEYWORD_IS(word, "is")) { return KW_IS; }
+                    break;
+                case 'o':
+                    if (KEYWORD_IS(word, "or")) { return RESERVED_KW; }
+                    break;
+            }
+            break;
+        case 3:
+            switch (word[0]) {
+                case 'a':
+                    if (KEYWORD_IS(word, "and")) { return RESERVED_KW; }
+                    break;
+                case 'd':
+                    if (KEYWORD_IS(word, "del")) { return KW_DEL; }
+                    break;
+                case 'f':
+                    if (KEYWORD_IS(word, "for")) { return KW_FOR; }
+                    break;
+                case 'm':
+                    if (KEYWORD_IS(word, "mut")) { return RESERVED_KW; }
+                    break;
+                case 'n':
+                    if (KEYWORD_IS(word, "num")) { return RESERVED_KW; }
+                    break;
+                case 'o':
+                    if (KEYWORD_IS(word, "obj")) { return RESERVED_KW; }
+                    break;
+                case 's':
+                    if (KEYWORD_IS(word, "str")) { return RESERVED_KW; }
+                    break;
+                case 't':
+                    if (KEYWORD_IS(word, "try")) { return RESERVED_KW; }
+                    break;
+                case 'v':
+                    if (KEYWORD_IS(word, "var")) { return KW_VAR; }
+                    if (KEYWORD_IS(word, "val")) { return RESERVED_KW; }
+                    break;
+            }
+            break;
+        case 4:
+            switch (word[0]) {
+                case 'b':
+                    if (KEYWORD_IS(word, "bool")) { return RESERVED_KW; }
+                    break;
+                case 'e':
+                    if (KEYWORD_IS(word, "else")) { return KW_ELSE; }
+                    break;
+                case 'f':
+                    if (KEYWORD_IS(word, "func")) { return KW_FUNC; }
+                    if (KEYWORD_IS(word, "from")) { return RESERVED_KW; }
+                    break;
+                case 'g':
+                    if (KEYWORD_IS(word, "goto")) { return RESERVED_KW; }
+                    break;
+                case 'n':
+                    if (KEYWORD_IS(word, "null")) { return KW_NULL; }
+                    break;
+                case 't':
+                    if (KEYWORD_IS(word, "true")) { return KW_TRUE; }
+                    break;
+                case 'w':
+                    if (KEYWORD_IS(word, "with")) { return RESERVED_KW; }
+                    break;
+            }
+            break;
+        case 5:
+            switch (word[0]) {
+                case 'a':
+                    if (KEYWORD_IS(word, "async")) { return RESERVED_KW; }
+                    if (KEYWORD_IS(word, "await")) { return RESERVED_KW; }
+                    break;
+                case 'b':
+                    if (KEYWORD_IS(word, "break")) { return KW_BREAK; }
+                    break;
+                case 'c':
+                    if (KEYWORD_IS(word, "class")) { return RESERVED_KW; }
+                    if (KEYWORD_IS(word, "const")) { return RESERVED_KW; }
+                    break;
+                case 'e':
+                    if (KEYWORD_IS(word, "error")) { return RESERVED_KW; }
+                    break;
+                case 'f':
+                    if (KEYWORD_IS(word, "false")) { return KW_FALSE; }
+                    break;
+                case 'm':
+                    if (KEYWORD_IS(word, "merge")) { return RESERVED_KW; }
+                    break;
+                case 's':
+                    if (KEYWORD_IS(word, "spawn")) { return RESERVED_KW; }
+                    break;
+                case 'u':
+                    if (KEYWORD_IS(word, "until")) { return RESERVED_KW; }
+                    if (KEYWORD_IS(word, "using")) { return RESERVED_KW; }
+                    break;
+                case 'w':
+                    if (KEYWORD_IS(word, "while")) { return RESERVED_KW; }
+                    break;
+                case 'y':
+                    if (KEYWORD_IS(word, "yield")) { return RESERVED_KW; }
+                    break;
+            }
+            break;
+        case 6:
+            switch (word[0]) {
+                case 'e':
+                    if (KEYWORD_IS(word, "except")) { return RESERVED_KW; }
+                    break;
+                case 'i':
+                    if (KEYWORD_IS(word, "import")) { return KW_IMPORT; }
+                    break;
+                case 'p':
+                    if (KEYWORD_IS(word, "public")) { return RESERVED_KW; }
+                    break;
+                case 'r':
+                    if (KEYWORD_IS(word, "return")) { return KW_RETURN; }
+                    if (KEYWORD_IS(word, "repeat")) { return RESERVED_KW; }
+                    break;
+                case 's':
+                    if (KEYWORD_IS(word, "select")) { return KW_SELECT; }
+                    if (KEYWORD_IS(word, "switch")) { return RESERVED_KW; }
+                    break;
+            }
+            break;
+        case 7:
+            switch (word[0]) {
+                case 'f':
+                    if (KEYWORD_IS(word, "finally")) { return RESERVED_KW; }
+                    break;
+                case 'p':
+                    if (KEYWORD_IS(word, "private")) { return RESERVED_KW; }
+                    if (KEYWORD_IS(word, "package")) { return RESERVED_KW; }
+                    break;
+            }
+            break;
+        case 8:
+            switch (word[0]) {
+                case 'c':
+                    if (KEYWORD_IS(word, "continue")) { return KW_CONTINUE; }
+                    break;
+                case 'd':
+                    if (KEYWORD_IS(word, "datetime")) { return RESERVED_KW; }
+                    break;
+            }
+            break;
+        case 9:
+            switch (word[0]) {
+                case 'p':
+                    if (KEYWORD_IS(word, "protected")) { return RESERVED_KW; }
+                    break;
+            }
+            break;
     }
 
-    return *type;
+    return IDENTIFIER;
 }
 
-// Construct the keyword cache hash table
-static bool LexerConstructKeywordCache(ms_Lexer *lex) {
-    assert(lex);
-    if (lex->kwcache) { return true; }
-
-    lex->kwcache = dsdict_new((dsdict_hash_fn)hash_fnv1,
-                              (dsdict_compare_fn)strcmp, NULL, NULL);
-    if (!lex->kwcache) {
-        return false;
-    }
-
-    size_t len = sizeof(KEYWORDS) / sizeof(KEYWORDS[0]);
-    for (size_t i = 0; i < len; i++) {
-        dsdict_put(lex->kwcache, (void *)KEYWORDS[i].kw, &KEYWORDS[i].type);
-    }
-
-    return true;
+// Check if a character (which may be EOF) belongs to any of the given classes.
+static inline bool CharIs(int c, unsigned char cls) {
+    return (c != EOF) && ((CHAR_CLASS[(unsigned char)c] & cls) != 0);
 }
 
-// Check if a single character is in a string.
-static inline bool InStr(int needle, const char *haystack) {
-    assert(needle != '\0');
-    assert(haystack);
-
-    for (int i = 0; haystack[i]; i++) {
-        if (needle == haystack[i]) {
-            return true;
+// Return the index of the first of the characters a, b, or c in the first
+// len characters of str, or len if none of them appear. String bodies and
+// comments are typically long, so they are searched 16 characters at a
+// time where SSE2 is available.
+static size_t FindAny(const char *str, size_t len, char a, char b, char c) {
+    assert(str);
+    size_t i = 0;
+
+#ifdef MS_LEXER_USE_SSE2
+    const __m128i va = _mm_set1_epi8(a);
+    const __m128i vb = _mm_set1_epi8(b);
+    const __m128i vc = _mm_set1_epi8(c);
+    for (; i + 16 <= len; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)&str[i]);
+        __m128i eq = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, va),
+                                               _mm_cmpeq_epi8(chunk, vb)),
+                                  _mm_cmpeq_epi8(chunk, vc));
+        int mask = _mm_movemask_epi8(eq);
+        if (mask != 0) {
+            return i + (size_t)__builtin_ctz((unsigned)mask);
         }
     }
+#endif
 
-    return false;
+    for (; i < len; i++) {
+        if ((str[i] == a) || (str[i] == b) || (str[i] == c)) {
+            return i;
+        }
+    }
+    return len;
 }
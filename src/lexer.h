@@ -18,6 +18,7 @@
 #define MSCRIPT_LEXER_H
 
 #include <stdbool.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include "libds/buffer.h"
 
@@ -180,6 +181,21 @@ typedef struct ms_Token {
     size_t col;
 } ms_Token;
 
+/**
+* @brief A lexer token which refers to text owned by the lexer, rather than
+* holding its own copy.
+*
+* The text is @c NUL terminated, but is only valid until the lexer is next
+* called; callers which need it for longer must copy it.
+*/
+typedef struct ms_TokenView {
+    ms_TokenType type;
+    const char *text;
+    size_t len;
+    size_t line;
+    size_t col;
+} ms_TokenView;
+
 typedef struct ms_Lexer ms_Lexer;
 
 /**
@@ -202,6 +218,24 @@ ms_Lexer *ms_LexerNew(void);
 */
 bool ms_LexerInitFile(ms_Lexer *lex, const char *fname);
 
+/**
+* @brief Initialize a lexer object with an open file, such as @c stdin .
+*
+* The file is read in fixed size chunks, so it need not be seekable and
+* its size does not affect the memory held by the lexer. The caller
+* retains ownership of the file, which must remain open until the lexer
+* is destroyed or initialized with another input.
+*
+* This is safe to call on an existing lexer. The old stream will
+* be disposed of prior to opening the new stream.
+*
+* @param lex the lexer object
+* @param file an open @c FILE
+* @returns true if the lexer was initialized with the given file;
+*          false otherwise
+*/
+bool ms_LexerInitFileHandle(ms_Lexer *lex, FILE *file);
+
 /**
 * @brief Initialize a lexer object with a string.
 *
@@ -229,6 +263,17 @@ bool ms_LexerInitString(ms_Lexer *lex, const char *str);
 */
 bool ms_LexerInitStringL(ms_Lexer *lex, const char *str, size_t len);
 
+/**
+* @brief Close the input of a lexer, without disposing of the lexer.
+*
+* This releases the stream (closing any file it opened, or unmapping it)
+* where the lexer itself cannot safely be destroyed, such as after its
+* memory limit is exceeded; the lexer reads no further input afterwards.
+*
+* @param lex the lexer object
+*/
+void ms_LexerCloseInput(ms_Lexer *lex);
+
 /**
 * @brief Dispose of the lexer object and free memory it is holding.
 *
@@ -248,6 +293,16 @@ void ms_LexerDestroy(ms_Lexer *lex);
 */
 ms_Token *ms_LexerNextToken(ms_Lexer *lex);
 
+/**
+* @brief Return the next available token in the stream without allocating.
+*
+* @param lex the lexer object
+* @returns a view of the next token in the input stream, which is owned by
+*          the lexer and valid until it is next called; or NULL once the
+*          EOF has been reached
+*/
+const ms_TokenView *ms_LexerNextTokenView(ms_Lexer *lex);
+
 /**
 * @brief Create a new lexer token of the given type with the value and
 * positional information provided.
@@ -27,8 +27,16 @@ typedef struct {
     bool show_help;
     bool show_version;
     bool print_bytecode;
+    bool eager_compile;
     bool execute_string;
     char *code;
+    bool compile_script;
+    char *compile_input;
+    char *compile_output;
+    size_t mem_limit;
+    char *cache_dir;
+    bool set_threads;
+    size_t compile_threads;
     bool execute_script;
     char *script;
     size_t nargs;
@@ -36,12 +44,22 @@ typedef struct {
 } CommandLineArgs;
 
 static void PrintHelp(const char *prog) {
-    printf("usage: %s -h -v -a -s [code] [script [args]]\n", prog);
+    printf("usage: %s -h -v -a -e -m [bytes] -j [threads] -b [dir] -s [code] -c [script] -o [file] [script | - [args]]\n", prog);
     puts("Options:");
     puts("  -h        show this help text and exit");
     puts("  -v        show the version and exit");
     puts("  -a        print bytecode for all inputs");
+    puts("  -e        compile function bodies when loaded, not on first call");
+    puts("  -m [bytes] limit the memory held by the interpreter to `bytes`");
+    puts("  -j [threads] compile large scripts on `threads` threads (0: one per processor)");
+    puts("  -b [dir]  cache compiled bytecode for scripts in directory `dir`");
     puts("  -s [code] execute string `code`");
+    puts("  -c [script] compile `script` to a bytecode file rather than executing it");
+    puts("  -o [file] write compiled bytecode to `file` (default: `script` + 'c')");
+    puts("  -         read the script from stdin");
+    puts("Compiled bytecode files may be executed in place of scripts.");
+    puts("Environment:");
+    puts("  MSCRIPT_HASH_SEED  fixed hash seed, rather than a random one per run");
 }
 
 static void PrintVersion(void) {
@@ -55,7 +73,7 @@ static int ParseCommandLineOpts(CommandLineArgs *opts, int argc, char *argv[]) {
     for (int i = 1; i < argc; ) {
         char *arg = argv[i];
 
-        if (arg[0] == '-') {
+        if ((arg[0] == '-') && (arg[1] != '\0')) {
             switch (arg[1]) {
                 case 'h':
                     opts->show_help = true;
@@ -69,6 +87,10 @@ static int ParseCommandLineOpts(CommandLineArgs *opts, int argc, char *argv[]) {
                     opts->print_bytecode = true;
                     i += 1;
                     break;
+                case 'e':
+                    opts->eager_compile = true;
+                    i += 1;
+                    break;
                 case 's':
                     opts->execute_string = true;
                     i += 1;
@@ -81,6 +103,73 @@ static int ParseCommandLineOpts(CommandLineArgs *opts, int argc, char *argv[]) {
                         return EXIT_FAILURE;
                     }
                     break;
+                case 'c':
+                    opts->compile_script = true;
+                    i += 1;
+                    if (i < argc) {
+                        opts->compile_input = argv[i];
+                        i += 1;
+                    } else {
+                        printf("%s: expected argument `script`", argv[0]);
+                        PrintHelp(argv[0]);
+                        return EXIT_FAILURE;
+                    }
+                    break;
+                case 'o':
+                    i += 1;
+                    if (i < argc) {
+                        opts->compile_output = argv[i];
+                        i += 1;
+                    } else {
+                        printf("%s: expected argument `file`", argv[0]);
+                        PrintHelp(argv[0]);
+                        return EXIT_FAILURE;
+                    }
+                    break;
+                case 'b':
+                    i += 1;
+                    if (i < argc) {
+                        opts->cache_dir = argv[i];
+                        i += 1;
+                    } else {
+                        printf("%s: expected argument `dir`", argv[0]);
+                        PrintHelp(argv[0]);
+                        return EXIT_FAILURE;
+                    }
+                    break;
+                case 'm':
+                    i += 1;
+                    if (i < argc) {
+                        char *end;
+                        opts->mem_limit = (size_t)strtoull(argv[i], &end, 10);
+                        if ((end == argv[i]) || (*end != '\0')) {
+                            printf("%s: invalid memory limit '%s'\n", argv[0], argv[i]);
+                            return EXIT_FAILURE;
+                        }
+                        i += 1;
+                    } else {
+                        printf("%s: expected argument `bytes`", argv[0]);
+                        PrintHelp(argv[0]);
+                        return EXIT_FAILURE;
+                    }
+                    break;
+                case 'j':
+                    i += 1;
+                    if (i < argc) {
+                        char *end;
+                        opts->set_threads = true;
+                        opts->compile_threads = (size_t)strtoull(argv[i], &end, 10);
+                        if ((end == argv[i]) || (*end != '\0')) {
+                            printf("%s: invalid thread count '%s'\n", argv[0], argv[i]);
+                            return EXIT_FAILURE;
+                        }
+                        i += 1;
+                    } else {
+                        printf("%s: expected argument `threads`", argv[0]);
+                        PrintHelp(argv[0]);
+                        return EXIT_FAILURE;
+                    }
+                    break;
                 default:
                     printf("%s: unrecognized option '-%c'\n", argv[0], arg[1]);
                     PrintHelp(argv[0]);
@@ -99,10 +188,80 @@ static int ParseCommandLineOpts(CommandLineArgs *opts, int argc, char *argv[]) {
     return EXIT_SUCCESS;
 }
 
+// Scripts may come from anywhere, so choose an unpredictable hash seed
+// unless a fixed one is requested (for reproducible table layouts).
+static int SeedHash(const char *prog) {
+    const char *seed = getenv("MSCRIPT_HASH_SEED");
+    if (!seed) {
+        (void)ms_SeedHashRandom();
+        return EXIT_SUCCESS;
+    }
+
+    char *end;
+    unsigned long long val = strtoull(seed, &end, 10);
+    if ((end == seed) || (*end != '\0')) {
+        printf("%s: invalid MSCRIPT_HASH_SEED '%s'\n", prog, seed);
+        return EXIT_FAILURE;
+    }
+    ms_SeedHash(val);
+    return EXIT_SUCCESS;
+}
+
+static int CompileScript(const char *prog, CommandLineArgs *args) {
+    char *output = args->compile_output;
+    if (!output) {
+        size_t len = strlen(args->compile_input);
+        output = malloc(len + 2);
+        if (!output) {
+            printf("%s: out of memory\n", prog);
+            return EXIT_FAILURE;
+        }
+        memcpy(output, args->compile_input, len);
+        output[len] = 'c';
+        output[len + 1] = '\0';
+    }
+
+    int status = EXIT_SUCCESS;
+    ms_Error *err;
+    ms_Script *script = ms_ScriptCompileFile(args->compile_input, NULL, 0, &err);
+    if ((!script) || (ms_ScriptSave(script, output, &err) == MS_RESULT_ERROR)) {
+        printf("%s: \n%s\n", prog, (err) ? err->msg : "");
+        ms_ErrorDestroy(err);
+        status = EXIT_FAILURE;
+    }
+
+    ms_ScriptDestroy(script);
+    if (output != args->compile_output) {
+        free(output);
+    }
+    return status;
+}
+
+static int ExecuteCompiledScript(const char *prog, ms_State *ms, const char *fname) {
+    ms_Error *lerr;
+    ms_Script *script = ms_ScriptLoad(fname, &lerr);
+    if (!script) {
+        printf("%s: \n%s\n", prog, (lerr) ? lerr->msg : "");
+        ms_ErrorDestroy(lerr);
+        return EXIT_FAILURE;
+    }
+
+    const ms_Error *err;
+    if (ms_StateExecuteScript(ms, script, NULL, 0, &err) == MS_RESULT_ERROR) {
+        printf("%s: \n%s\n", prog, err->msg);
+    }
+
+    ms_ScriptDestroy(script);
+    return EXIT_SUCCESS;
+}
+
 static int ExecuteScript(const char *prog, CommandLineArgs *args) {
     ms_StateOptions opts = {
         .interactive_mode = false,
         .print_bytecode = args->print_bytecode,
+        .eager_compile = args->eager_compile,
+        .mem_limit = args->mem_limit,
+        .cache_dir = args->cache_dir,
     };
     ms_State *ms = ms_StateNewOptions(&opts);
     if (!ms) {
@@ -110,8 +269,18 @@ static int ExecuteScript(const char *prog, CommandLineArgs *args) {
         return EXIT_FAILURE;
     }
 
+    bool is_stdin = (strcmp(args->script, "-") == 0);
+    if ((!is_stdin) && (ms_ScriptFileIsCompiled(args->script))) {
+        int status = ExecuteCompiledScript(prog, ms, args->script);
+        ms_StateDestroy(ms);
+        return status;
+    }
+
     const ms_Error *err;
-    if (ms_StateExecuteFile(ms, args->script, &err) == MS_RESULT_ERROR) {
+    ms_Result res = (is_stdin) ?
+                    ms_StateExecuteFileHandle(ms, stdin, &err) :
+                    ms_StateExecuteFile(ms, args->script, &err);
+    if (res == MS_RESULT_ERROR) {
         printf("%s: \n%s\n", prog, err->msg);
     }
 
@@ -123,6 +292,8 @@ static int ExecuteString(const char *prog, CommandLineArgs *args) {
     ms_StateOptions opts = {
         .interactive_mode = false,
         .print_bytecode = args->print_bytecode,
+        .eager_compile = args->eager_compile,
+        .mem_limit = args->mem_limit,
     };
     ms_State *ms = ms_StateNewOptions(&opts);
     if (!ms) {
@@ -143,6 +314,8 @@ static int StartREPL(const char *prog, CommandLineArgs *args) {
     ms_StateOptions opts = {
         .interactive_mode = true,
         .print_bytecode = args->print_bytecode,
+        .eager_compile = args->eager_compile,
+        .mem_limit = args->mem_limit,
     };
     ms_State *ms = ms_StateNewOptions(&opts);
     if (!ms) {
@@ -190,6 +363,18 @@ int main(int argc, char *argv[]) {
         return EXIT_SUCCESS;
     }
 
+    if (SeedHash(argv[0]) == EXIT_FAILURE) {
+        return EXIT_FAILURE;
+    }
+
+    if (args.set_threads) {
+        ms_SetCompileThreads(args.compile_threads);
+    }
+
+    if (args.compile_script) {
+        return CompileScript(argv[0], &args);
+    }
+
     if (args.execute_string) {
         return ExecuteString(argv[0], &args);
     }
@@ -15,8 +15,22 @@
  *----------------------------------------------------------------------------*/
 
 #include <assert.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#ifdef MS_USE_PTHREADS
+#include <pthread.h>
+#endif
+#include "libds/alloc.h"
+#include "libds/hash.h"
+#include "image.h"
+#include "intern.h"
 #include "mscript.h"
+#include "parallel.h"
 #include "parser.h"
 #include "verifier.h"
 #include "vm.h"
@@ -28,16 +42,81 @@
 static ms_StateOptions DEFAULT_STATE_OPTIONS = {
     .interactive_mode = false,
     .print_bytecode = false,
+    .eager_compile = false,
+    .alloc = NULL,
+    .alloc_ctx = NULL,
+    .mem_limit = 0,
+    .cache_dir = NULL,
 };
 
+static const char *const ERR_MEMORY_LIMIT = "memory limit of %zu bytes exceeded";
+static const char *const ERR_CANNOT_READ_FILE = "could not read file '%s'";
+static const char *const ERR_OUT_OF_MEMORY = "out of memory";
+static const char *const ERR_SCRIPT_PARAMS = "script takes %zu parameters but %zu were given";
+
+#define SCRIPT_PARAM_STACK_CAP (16)
+
+/* identifies the compiler in bytecode cache keys; change it whenever code
+ * generation changes, so entries written by older compilers are ignored */
+static const char *const SCRIPT_CACHE_COMPILER = "mscript-codegen-1";
+static const char *const SCRIPT_CACHE_EXT = ".msc";
+
+#define SCRIPT_CACHE_FNV_OFFSET (14695981039346656037ULL)
+#define SCRIPT_CACHE_FNV_PRIME (1099511628211ULL)
+
+static size_t LIVE_STATES = 0;
+#ifdef MS_USE_PTHREADS
+static pthread_mutex_t LIVE_STATES_LOCK = PTHREAD_MUTEX_INITIALIZER;
+#endif
+static size_t COMPILE_THREADS = 1;
+
 struct ms_State {
     ms_Parser *prs;
     ms_VM *vm;
     ms_StateOptions *opts;
     ms_Error *err;
+    DSAllocator mem;                                /* source of every allocation made for the state */
+    DSAllocator *prev;                              /* allocator to restore on leaving the state */
+    DSPool *prev_pool;                              /* AST pool to restore on leaving the state */
+    jmp_buf limit;                                  /* return point if the memory limit is exceeded */
+    bool exhausted;                                 /* true once the memory limit has been exceeded */
 };
 
+struct ms_Script {
+    ms_VMByteCode *code;                            /* compiled script (never modified) */
+    DSBuffer **params;                              /* interned parameter names */
+    size_t nparams;                                 /* number of parameters */
+};
+
+static ms_Result StateExecuteInput(ms_State *state, const char *str, size_t len, FILE *file, bool single_pass, const ms_Error **err);
+static ms_Result StateCompileAndExecute(ms_State *state, const char *str, size_t len, const ms_Error **err);
 static ms_Result StateParseAndExecute(ms_State *state, const ms_Error **err);
+static ms_Result StateExecuteByteCode(ms_State *state, ms_VMByteCode *code, const ms_Error **err);
+static ms_Result StateExecuteCompiled(ms_State *state, const ms_Script *script, const ms_Param params[], const ms_Error **err);
+static ms_Result StateExecuteCached(ms_State *state, const char *src, size_t len, const ms_Error **err);
+static ms_Script *StateCacheScript(ms_State *state, const char *src, size_t len);
+static ms_Result StateExecuteSplit(ms_State *state, const char *src, size_t len, const ms_Error **err);
+static ms_Result StateExecuteFileStream(ms_State *state, const char *fname, const ms_Error **err);
+static char *StateReadFile(ms_State *state, FILE *f, size_t *len, bool *seekable);
+static inline bool StateCacheEnabled(const ms_State *state);
+static inline bool StateSplitEnabled(const ms_State *state);
+static void StateEnter(ms_State *state);
+static void StateLeave(ms_State *state);
+static void StateMemoryLimitHit(DSAllocator *alloc);
+static ms_Result StateErrorSet(ms_State *state, const ms_Error **err, const char *msg, ...);
+static void *StateRawAlloc(ms_StateOptions *opts, void *ptr, size_t size);
+static ms_Script *ScriptCompile(const char *str, size_t len, const char *fname, const char *const params[], size_t nparams,
+                                DSAllocator *alloc, ms_Error **err);
+static ms_Result ScriptParseAndGenerate(ms_Script *script, ms_Parser *prs, const ms_ArgList *args, ms_Error **err);
+static char *ScriptReadFile(const char *fname, size_t *len);
+static ms_Script *ScriptCacheLoad(const char *path);
+static char *ScriptCachePath(const char *dir, const char *src, size_t len);
+static uint64_t ScriptCacheHash(uint64_t hash, const void *data, size_t len);
+static ms_Error *ErrorNew(const char *msg, va_list args);
+static void ErrorSet(ms_Error **err, const char *msg, ...);
+static bool StateHashSeedable(void);
+static inline void StatesLock(void);
+static inline void StatesUnlock(void);
 
 /*
  * PUBLIC FUNCTIONS
@@ -48,26 +127,43 @@ ms_State *ms_StateNew(void) {
 }
 
 ms_State *ms_StateNewOptions(ms_StateOptions *opts) {
-    ms_State *state = malloc(sizeof(ms_State));
+    assert(opts);
+
+    /* the state holds its own allocator, so it cannot come from it */
+    ms_State *state = StateRawAlloc(opts, NULL, sizeof(ms_State));
     if (!state) {
         return NULL;
     }
 
-    state->prs = ms_ParserNew();
-    if (!state->prs) {
-        free(state);
+    state->prs = NULL;
+    state->vm = NULL;
+    state->opts = opts;
+    state->err = NULL;
+    state->exhausted = false;
+    dsallocator_init(&state->mem, opts->alloc, opts->alloc_ctx, opts->mem_limit);
+    state->mem.on_limit = StateMemoryLimitHit;
+    if (!ms_InternTrack(&state->mem)) {
+        StateRawAlloc(opts, state, 0);
         return NULL;
     }
 
-    state->vm = ms_VMNew();
-    if (!state->vm) {
-        ms_ParserDestroy(state->prs);
-        free(state);
+    StateEnter(state);
+    if (setjmp(state->limit) == 0) {
+        state->prs = ms_ParserNew();
+        state->vm = (state->prs) ? ms_VMNew() : NULL;
+    }
+    StateLeave(state);
+
+    if ((!state->prs) || (!state->vm)) {
+        ms_InternUntrack(&state->mem);
+        dsallocator_release(&state->mem);
+        StateRawAlloc(opts, state, 0);
         return NULL;
     }
 
-    state->opts = opts;
-    state->err = NULL;
+    StatesLock();
+    LIVE_STATES++;
+    StatesUnlock();
     return state;
 }
 
@@ -80,23 +176,85 @@ ms_Result ms_StateExecuteStringL(ms_State *state, const char *str, size_t len, c
         return MS_RESULT_ERROR;
     }
 
-    if (!ms_ParserInitStringL(state->prs, str, len)) {
+    return StateExecuteInput(state, str, len, NULL, true, err);
+}
+
+ms_Result ms_StateExecuteFile(ms_State *state, const char *fname, const ms_Error **err) {
+    if (!state) {
         return MS_RESULT_ERROR;
     }
 
-    return StateParseAndExecute(state, err);
+    /* only the cache and split compilation need the whole source at once;
+     * otherwise the file is parsed straight from a stream over it */
+    if ((!StateCacheEnabled(state)) && (!StateSplitEnabled(state))) {
+        return StateExecuteFileStream(state, fname, err);
+    }
+
+    FILE *f = fopen(fname, "rb");
+    if (!f) {
+        return StateErrorSet(state, err, ERR_CANNOT_READ_FILE, fname);
+    }
+
+    /* read a regular file whole up front; anything which cannot be sized
+     * in advance (such as a pipe) is read in chunks as it is parsed */
+    size_t len;
+    bool seekable;
+    ms_Result res;
+    char *src = StateReadFile(state, f, &len, &seekable);
+    if (src) {
+        res = (StateCacheEnabled(state)) ?
+              StateExecuteCached(state, src, len, err) :
+              StateExecuteSplit(state, src, len, err);
+        dsfree(src);
+    } else if (!seekable) {
+        res = StateExecuteInput(state, NULL, 0, f, false, err);
+    } else {
+        res = (state->mem.exceeded) ?
+              StateErrorSet(state, err, ERR_MEMORY_LIMIT, state->mem.limit) :
+              StateErrorSet(state, err, ERR_CANNOT_READ_FILE, fname);
+    }
+
+    fclose(f);
+    return res;
 }
 
-ms_Result ms_StateExecuteFile(ms_State *state, const char *fname, const ms_Error **err) {
-    if (!state) {
+ms_Result ms_StateExecuteFileHandle(ms_State *state, FILE *file, const ms_Error **err) {
+    if ((!state) || (!file)) {
         return MS_RESULT_ERROR;
     }
 
-    if (!ms_ParserInitFile(state->prs, fname)) {
+    /* the file is read in chunks as it is parsed, so its size does not
+     * matter; the caller owns it, so nothing leaks if execution is
+     * abandoned */
+    return StateExecuteInput(state, NULL, 0, file, false, err);
+}
+
+ms_Result ms_StateExecuteScript(ms_State *state, const ms_Script *script, const ms_Param params[], size_t nparams, const ms_Error **err) {
+    if ((!state) || (!script)) {
         return MS_RESULT_ERROR;
     }
 
-    return StateParseAndExecute(state, err);
+    if (state->exhausted) {
+        return StateErrorSet(state, err, ERR_MEMORY_LIMIT, state->mem.limit);
+    }
+
+    if (nparams != script->nparams) {
+        return StateErrorSet(state, err, ERR_SCRIPT_PARAMS, script->nparams, nparams);
+    }
+
+    volatile ms_Result res = MS_RESULT_ERROR;
+    StateEnter(state);
+    if (setjmp(state->limit) == 0) {
+        res = StateExecuteCompiled(state, script, params, err);
+    } else {
+        state->exhausted = true;
+    }
+    StateLeave(state);
+
+    if (state->exhausted) {
+        return StateErrorSet(state, err, ERR_MEMORY_LIMIT, state->mem.limit);
+    }
+    return res;
 }
 
 void ms_StateErrorClear(ms_State *state) {
@@ -105,20 +263,205 @@ void ms_StateErrorClear(ms_State *state) {
     state->err = NULL;
 }
 
+size_t ms_StateMemoryUsed(const ms_State *state) {
+    assert(state);
+    return state->mem.used;
+}
+
+size_t ms_StateMemoryPeak(const ms_State *state) {
+    assert(state);
+    return state->mem.peak;
+}
+
+ms_Script *ms_ScriptCompileString(const char *str, const char *const params[], size_t nparams, ms_Error **err) {
+    return ms_ScriptCompileStringL(str, strlen(str), params, nparams, err);
+}
+
+ms_Script *ms_ScriptCompileStringL(const char *str, size_t len, const char *const params[], size_t nparams, ms_Error **err) {
+    assert(str);
+    return ScriptCompile(str, len, NULL, params, nparams, NULL, err);
+}
+
+ms_Script *ms_ScriptCompileFile(const char *fname, const char *const params[], size_t nparams, ms_Error **err) {
+    assert(fname);
+
+    /* source is only split once it has been read whole */
+    if (COMPILE_THREADS != 1) {
+        size_t len;
+        char *src = ScriptReadFile(fname, &len);
+        if (src) {
+            ms_Script *script = ScriptCompile(src, len, NULL, params, nparams, NULL, err);
+            dsfree(src);
+            return script;
+        }
+    }
+
+    return ScriptCompile(NULL, 0, fname, params, nparams, NULL, err);
+}
+
+ms_Result ms_ScriptSave(ms_Script *script, const char *fname, ms_Error **err) {
+    assert(script);
+    assert(fname);
+    return ms_VMImageWrite(script->code, script->params, script->nparams, fname, err);
+}
+
+ms_Script *ms_ScriptLoad(const char *fname, ms_Error **err) {
+    assert(fname);
+    assert(err);
+
+    ms_VMImage *img = ms_VMImageOpen(fname, err);
+    if (!img) {
+        return NULL;
+    }
+
+    DSAllocator *prev = dsallocator_swap(NULL);
+    size_t nparams = ms_VMImageParamCount(img);
+    ms_Script *script = dscalloc(1, sizeof(ms_Script));
+    if ((!script) || ((nparams > 0) && (!(script->params = dscalloc(nparams, sizeof(DSBuffer *)))))) {
+        goto cleanup_script_load;
+    }
+
+    for (; script->nparams < nparams; script->nparams++) {
+        script->params[script->nparams] = ms_VMImageParam(img, script->nparams);
+        if (!script->params[script->nparams]) {
+            goto cleanup_script_load;
+        }
+    }
+
+    if (ms_VMImageLoadChunk(img, 0, &script->code, err) == MS_RESULT_ERROR) {
+        goto cleanup_script_load;
+    }
+
+    ms_VMImageRelease(img);
+    dsallocator_swap(prev);
+    return script;
+
+cleanup_script_load:
+    if (!(*err)) {
+        ErrorSet(err, ERR_OUT_OF_MEMORY);
+    }
+    ms_VMImageRelease(img);
+    dsallocator_swap(prev);
+    ms_ScriptDestroy(script);
+    return NULL;
+}
+
+bool ms_ScriptFileIsCompiled(const char *fname) {
+    assert(fname);
+    return ms_VMImageIsFile(fname);
+}
+
+void ms_ScriptDestroy(ms_Script *script) {
+    if (!script) { return; }
+    DSAllocator *prev = dsallocator_swap(dsallocator_owner(script));
+    ms_VMByteCodeDestroy(script->code);
+    for (size_t i = 0; i < script->nparams; i++) {
+        ms_InternRelease(script->params[i]);
+    }
+    dsfree(script->params);
+    dsfree(script);
+    dsallocator_swap(prev);
+}
+
+void ms_SeedHash(unsigned long long seed) {
+    /* reseeding would strand every key already hashed by a live table */
+    assert(StateHashSeedable());
+    hash_seed((uint64_t)seed);
+}
+
+unsigned long long ms_SeedHashRandom(void) {
+    assert(StateHashSeedable());
+    return (unsigned long long)hash_seed_random();
+}
+
+void ms_SetCompileThreads(size_t nthreads) {
+    COMPILE_THREADS = nthreads;
+}
+
 void ms_StateDestroy(ms_State *state) {
     if (!state) { return; }
-    ms_ParserDestroy(state->prs);
+    ms_StateErrorClear(state);
+
+    /* an exhausted state may be inconsistent, so its memory is released
+     * wholesale rather than walked, along with the intern references held
+     * by anything in it */
+    if (!state->exhausted) {
+        StateEnter(state);
+        ms_ParserDestroy(state->prs);
+        ms_VMDestroy(state->vm);
+        StateLeave(state);
+    }
     state->prs = NULL;
-    ms_VMDestroy(state->vm);
     state->vm = NULL;
-    ms_StateErrorClear(state);
-    free(state);
+
+    ms_InternUntrack(&state->mem);
+    dsallocator_release(&state->mem);
+    StateRawAlloc(state->opts, state, 0);
+    StatesLock();
+    LIVE_STATES--;
+    StatesUnlock();
 }
 
 /*
  * PRIVATE FUNCTIONS
  */
 
+// Parse and execute the given source code, read from `file` if it is
+// given. Strings may be compiled in a single pass if `single_pass` is set.
+// If the state exceeds its memory limit, execution is abandoned and the
+// state may not be used for anything other than producing the same error
+// again.
+static ms_Result StateExecuteInput(ms_State *state, const char *str, size_t len, FILE *file, bool single_pass, const ms_Error **err) {
+    assert(state);
+    assert(err);
+
+    if (state->exhausted) {
+        return StateErrorSet(state, err, ERR_MEMORY_LIMIT, state->mem.limit);
+    }
+
+    volatile ms_Result res = MS_RESULT_ERROR;
+    StateEnter(state);
+    if (setjmp(state->limit) == 0) {
+        bool ready = (file) ?
+                     ms_ParserInitFileHandle(state->prs, file) :
+                     ms_ParserInitStringL(state->prs, str, len);
+        if (ready) {
+            res = ((single_pass) && (!file)) ?
+                  StateCompileAndExecute(state, str, len, err) :
+                  StateParseAndExecute(state, err);
+        }
+    } else {
+        state->exhausted = true;
+    }
+    StateLeave(state);
+
+    if (state->exhausted) {
+        return StateErrorSet(state, err, ERR_MEMORY_LIMIT, state->mem.limit);
+    }
+    return res;
+}
+
+// Compile a string straight to bytecode and execute it. Short inputs
+// (such as REPL lines) are mostly simple statements, which do not need an
+// AST; anything else is parsed again from the start and executed as usual.
+static ms_Result StateCompileAndExecute(ms_State *state, const char *str, size_t len, const ms_Error **err) {
+    assert(state);
+    assert(err);
+
+    *err = NULL;
+    ms_StateErrorClear(state);
+
+    ms_VMByteCode *code;    /* freed by the VM */
+    if (!ms_ParserCompile(state->prs, &code)) {
+        if (!ms_ParserInitStringL(state->prs, str, len)) {
+            return MS_RESULT_ERROR;
+        }
+        return StateParseAndExecute(state, err);
+    }
+
+    return StateExecuteByteCode(state, code, err);
+}
+
 static ms_Result StateParseAndExecute(ms_State *state, const ms_Error **err) {
     assert(state);
     assert(err);
@@ -139,11 +482,24 @@ static ms_Result StateParseAndExecute(ms_State *state, const ms_Error **err) {
 
     assert(!state->err);
     ms_VMByteCode *code;    /* freed by the VM */
-    if (ms_VMByteCodeGenerateFromAST(ast, &code, &state->err) == MS_RESULT_ERROR) {
+    ms_Result gres = (state->opts->eager_compile) ?
+                     ms_VMByteCodeGenerateFromAST(ast, &code, &state->err) :
+                     ms_VMByteCodeGenerateLazy(ms_ParserArena(state->prs), &code, &state->err);
+    if (gres == MS_RESULT_ERROR) {
         *err = state->err;
         return MS_RESULT_ERROR;
     }
 
+    return StateExecuteByteCode(state, code, err);
+}
+
+// Execute bytecode compiled by either path (printing it first if the
+// state was asked to), passing it to the VM which frees it.
+static ms_Result StateExecuteByteCode(ms_State *state, ms_VMByteCode *code, const ms_Error **err) {
+    assert(state);
+    assert(code);
+    assert(err);
+
     if (state->opts->print_bytecode) {
         ms_VMByteCodePrint(code);
     }
@@ -159,3 +515,586 @@ static ms_Result StateParseAndExecute(ms_State *state, const ms_Error **err) {
 
     return MS_RESULT_SUCCESS;
 }
+
+// Execute a compiled script with its parameters bound to the given values.
+// String parameters are copied into the state for the duration of the
+// call; nothing the script creates can outlive it, so they are freed
+// again once it completes.
+static ms_Result StateExecuteCompiled(ms_State *state, const ms_Script *script, const ms_Param params[], const ms_Error **err) {
+    assert(state);
+    assert(script);
+    assert(err);
+
+    *err = NULL;
+    ms_StateErrorClear(state);
+
+    ms_VMValue stackvals[SCRIPT_PARAM_STACK_CAP];
+    ms_VMValue *vals = stackvals;
+    if (script->nparams > SCRIPT_PARAM_STACK_CAP) {
+        vals = dscalloc(script->nparams, sizeof(ms_VMValue));
+        if (!vals) {
+            return StateErrorSet(state, err, ERR_OUT_OF_MEMORY);
+        }
+    }
+
+    size_t nvals;
+    for (nvals = 0; nvals < script->nparams; nvals++) {
+        const ms_Param *p = &params[nvals];
+        ms_VMValue *v = &vals[nvals];
+        switch (p->type) {
+            case MS_PARAM_BOOL:
+                v->type = VMVAL_BOOL;
+                v->val.b = p->val.b;
+                break;
+            case MS_PARAM_INT:
+                v->type = VMVAL_INT;
+                v->val.i = p->val.i;
+                break;
+            case MS_PARAM_FLOAT:
+                v->type = VMVAL_FLOAT;
+                v->val.f = p->val.f;
+                break;
+            case MS_PARAM_STR:
+                v->type = VMVAL_STR;
+                v->val.s = dsbuf_new_l(p->val.s, p->len);
+                break;
+            case MS_PARAM_NULL:
+            default:
+                v->type = VMVAL_NULL;
+                v->val.n = MS_VM_NULL_POINTER;
+                break;
+        }
+
+        if ((v->type == VMVAL_STR) && (!v->val.s)) {
+            break;
+        }
+    }
+
+    ms_Result res;
+    if (nvals < script->nparams) {
+        res = StateErrorSet(state, err, ERR_OUT_OF_MEMORY);
+    } else {
+        res = ms_VMExecuteBound(state->vm, script->code, script->params,
+                                vals, nvals, &state->err);
+        *err = state->err;
+    }
+
+    for (size_t i = 0; i < nvals; i++) {
+        if (vals[i].type == VMVAL_STR) {
+            dsbuf_destroy(vals[i].val.s);
+        }
+    }
+    if (vals != stackvals) {
+        dsfree(vals);
+    }
+    return res;
+}
+
+// Execute source read from a file through the bytecode cache, compiling
+// and caching it only if no usable entry exists. Entries which cannot be
+// loaded (because they are missing, stale or corrupt) are replaced, and
+// failing to write an entry is not an error. Source which does not compile
+// is executed as usual, so that errors are reported just as they would be
+// without the cache.
+//
+// Compiling a missing entry is charged to the state, and abandoned like any
+// other call if it exceeds the memory limit. Entries are mapped from files
+// shared by every state, so the bytecode loaded from them (like the buffers
+// used to write them) is not charged.
+static ms_Result StateExecuteCached(ms_State *state, const char *src, size_t len, const ms_Error **err) {
+    assert(state);
+    assert(src);
+    assert(err);
+
+    if (state->exhausted) {
+        return StateErrorSet(state, err, ERR_MEMORY_LIMIT, state->mem.limit);
+    }
+
+    ms_Script *script = NULL;
+    StateEnter(state);
+    if (setjmp(state->limit) == 0) {
+        script = StateCacheScript(state, src, len);
+    } else {
+        state->exhausted = true;
+    }
+    StateLeave(state);
+
+    if (state->exhausted) {
+        return StateErrorSet(state, err, ERR_MEMORY_LIMIT, state->mem.limit);
+    }
+
+    if (!script) {
+        return StateExecuteInput(state, src, len, NULL, false, err);
+    }
+
+    ms_Result res = ms_StateExecuteScript(state, script, NULL, 0, err);
+    ms_ScriptDestroy(script);
+    return res;
+}
+
+// Return the script cached for source read from a file, compiling and
+// caching it if no usable entry exists, or NULL if it does not compile.
+static ms_Script *StateCacheScript(ms_State *state, const char *src, size_t len) {
+    assert(state);
+    assert(src);
+
+    char *path = ScriptCachePath(state->opts->cache_dir, src, len);
+    if (!path) {
+        return NULL;
+    }
+
+    ms_Script *script = ScriptCacheLoad(path);
+    if (!script) {
+        ms_Error *err;
+        script = ScriptCompile(src, len, NULL, NULL, 0, &state->mem, &err);
+        ms_ErrorDestroy(err);
+        if ((script) && (ms_ScriptSave(script, path, &err) == MS_RESULT_ERROR)) {
+            ms_ErrorDestroy(err);
+        }
+    }
+
+    dsfree(path);
+    return script;
+}
+
+// Execute source read from a file as a script compiled on several threads.
+// Source which is too small to split, or which does not compile, is
+// executed as usual.
+static ms_Result StateExecuteSplit(ms_State *state, const char *src, size_t len, const ms_Error **err) {
+    assert(state);
+    assert(src);
+    assert(err);
+
+    if (state->exhausted) {
+        return StateErrorSet(state, err, ERR_MEMORY_LIMIT, state->mem.limit);
+    }
+
+    /* the bytecode is charged to the state; a module which does not fit
+     * is compiled as usual, which reports the limit as any call would */
+    DSAllocator *prev = dsallocator_swap(NULL);
+    ms_VMByteCode *code;
+    ms_Script *script = NULL;
+    if (ms_ParserCompileParallel(src, len, NULL, COMPILE_THREADS, &state->mem, &code)) {
+        script = dscalloc(1, sizeof(ms_Script));
+        if (script) {
+            script->code = code;
+        } else {
+            ms_VMByteCodeDestroy(code);
+        }
+    }
+    dsallocator_swap(prev);
+
+    if (!script) {
+        return StateExecuteInput(state, src, len, NULL, false, err);
+    }
+
+    ms_Result res = ms_StateExecuteScript(state, script, NULL, 0, err);
+    ms_ScriptDestroy(script);
+    return res;
+}
+
+// Execute a file parsed straight from a stream over it, so the source is
+// never copied into the state's memory: regular files are mapped, and any
+// other file is read in chunks. The stream is opened without the memory
+// limit's handler, so a refusal cannot strand an open file or a mapping,
+// and it is closed if the limit is exceeded while the file is executed,
+// since the parser is then abandoned rather than destroyed.
+static ms_Result StateExecuteFileStream(ms_State *state, const char *fname, const ms_Error **err) {
+    assert(state);
+    assert(err);
+
+    if (state->exhausted) {
+        return StateErrorSet(state, err, ERR_MEMORY_LIMIT, state->mem.limit);
+    }
+
+    state->mem.exceeded = false;
+    state->mem.on_limit = NULL;
+    StateEnter(state);
+    bool ready = ms_ParserInitFile(state->prs, fname);
+    StateLeave(state);
+    state->mem.on_limit = StateMemoryLimitHit;
+    if (!ready) {
+        return (state->mem.exceeded) ?
+               StateErrorSet(state, err, ERR_MEMORY_LIMIT, state->mem.limit) :
+               StateErrorSet(state, err, ERR_CANNOT_READ_FILE, fname);
+    }
+
+    volatile ms_Result res = MS_RESULT_ERROR;
+    StateEnter(state);
+    if (setjmp(state->limit) == 0) {
+        res = StateParseAndExecute(state, err);
+    } else {
+        state->exhausted = true;
+        ms_ParserCloseInput(state->prs);
+    }
+    StateLeave(state);
+
+    if (state->exhausted) {
+        return StateErrorSet(state, err, ERR_MEMORY_LIMIT, state->mem.limit);
+    }
+    return res;
+}
+
+// Read the entire contents of a file into a new NUL terminated buffer
+// allocated from the state. Exceeding the memory limit here simply fails,
+// since there is no partial work to abandon. Files which cannot be sized
+// by seeking are left unread, with `seekable` set to false.
+static char *StateReadFile(ms_State *state, FILE *f, size_t *len, bool *seekable) {
+    assert(state);
+    assert(f);
+    assert(len);
+    assert(seekable);
+
+    long size;
+    *seekable = ((fseek(f, 0, SEEK_END) == 0) && ((size = ftell(f)) >= 0) &&
+                 (fseek(f, 0, SEEK_SET) == 0));
+    if (!(*seekable)) {
+        clearerr(f);
+        return NULL;
+    }
+
+    state->mem.exceeded = false;
+    state->mem.on_limit = NULL;
+    StateEnter(state);
+    char *src = dsalloc((size_t)size + 1);
+    StateLeave(state);
+    state->mem.on_limit = StateMemoryLimitHit;
+    if (!src) {
+        return NULL;
+    }
+
+    *len = fread(src, 1, (size_t)size, f);
+    if (ferror(f)) {
+        dsfree(src);
+        return NULL;
+    }
+    src[*len] = '\0';
+    return src;
+}
+
+// Return true if files executed by the state go through the bytecode
+// cache. Interactive and bytecode printing states always compile, since
+// they report on the compiled code.
+static inline bool StateCacheEnabled(const ms_State *state) {
+    assert(state);
+    return (state->opts->cache_dir) &&
+           (!state->opts->interactive_mode) &&
+           (!state->opts->print_bytecode);
+}
+
+// Return true if files executed by the state may be compiled on several
+// threads. Like the cache, this is not used by interactive and bytecode
+// printing states.
+static inline bool StateSplitEnabled(const ms_State *state) {
+    assert(state);
+    return (COMPILE_THREADS != 1) &&
+           (!state->opts->interactive_mode) &&
+           (!state->opts->print_bytecode);
+}
+
+// Make the state's allocator current for the duration of a call.
+static void StateEnter(ms_State *state) {
+    assert(state);
+    state->prev = dsallocator_swap(&state->mem);
+    state->prev_pool = ms_ASTPoolSwap(NULL);
+}
+
+// Restore the allocator and AST pool which were current before the state
+// was entered, including when the state's pool was left current by a call
+// abandoned on the memory limit.
+static void StateLeave(ms_State *state) {
+    assert(state);
+    ms_ASTPoolSwap(state->prev_pool);
+    dsallocator_swap(state->prev);
+}
+
+// Abandon the current operation of the state whose allocator has just
+// refused a request, since the interpreter does not unwind from failed
+// allocations in general.
+static void StateMemoryLimitHit(DSAllocator *alloc) {
+    ms_State *state = (ms_State *)((char *)alloc - offsetof(ms_State, mem));
+    longjmp(state->limit, 1);
+}
+
+// Replace the state error with a new VM error. The error is not charged
+// to the state, since it may be reporting that the state is out of memory.
+static ms_Result StateErrorSet(ms_State *state, const ms_Error **err, const char *msg, ...) {
+    assert(state);
+    assert(err);
+
+    ms_StateErrorClear(state);
+
+    va_list args;
+    va_start(args, msg);
+    state->err = ErrorNew(msg, args);
+    va_end(args);
+
+    *err = state->err;
+    return MS_RESULT_ERROR;
+}
+
+// Allocate, resize, or free (if size is 0) memory directly from the
+// allocation function given in the state options.
+static void *StateRawAlloc(ms_StateOptions *opts, void *ptr, size_t size) {
+    assert(opts);
+
+    if (opts->alloc) {
+        return opts->alloc(opts->alloc_ctx, ptr, size);
+    }
+
+    if (size == 0) {
+        free(ptr);
+        return NULL;
+    }
+    return realloc(ptr, size);
+}
+
+// Return true if no table keyed by the process-wide hash seed exists.
+static bool StateHashSeedable(void) {
+    StatesLock();
+    size_t live = LIVE_STATES;
+    StatesUnlock();
+
+    ms_InternStats stats;
+    ms_InternGetStats(&stats);
+    return (live == 0) && (stats.nstrs == 0);
+}
+
+/* Take the lock on the count of live states, since states may be created
+ * and destroyed on any thread. */
+static inline void StatesLock(void) {
+#ifdef MS_USE_PTHREADS
+    pthread_mutex_lock(&LIVE_STATES_LOCK);
+#endif
+}
+
+static inline void StatesUnlock(void) {
+#ifdef MS_USE_PTHREADS
+    pthread_mutex_unlock(&LIVE_STATES_LOCK);
+#endif
+}
+
+// Compile a script from a string or, if `fname` is given, from the file at
+// that path. Scripts are independent of every state, so everything they
+// hold comes from `alloc`, which is the default allocator (NULL) unless the
+// script is only compiled to be executed once by a state; function bodies
+// are compiled eagerly, so executing a script never modifies it.
+static ms_Script *ScriptCompile(const char *str, size_t len, const char *fname, const char *const params[], size_t nparams,
+                                DSAllocator *alloc, ms_Error **err) {
+    assert(str || fname);
+    assert(params || (nparams == 0));
+    assert(err);
+
+    *err = NULL;
+    DSAllocator *prev = dsallocator_swap(alloc);
+
+    ms_Parser *prs = NULL;
+    ms_ArgList *args = NULL;
+    ms_Script *script = dscalloc(1, sizeof(ms_Script));
+    if (!script) {
+        goto cleanup_script_compile;
+    }
+
+    if (nparams > 0) {
+        script->params = dscalloc(nparams, sizeof(DSBuffer *));
+        args = dsarray_new_cap(nparams, NULL, (dsarray_free_fn)ms_IdentDestroy);
+        if ((!script->params) || (!args)) {
+            goto cleanup_script_compile;
+        }
+    }
+
+    for (size_t i = 0; i < nparams; i++) {
+        ms_Ident *ident = ms_IdentNew(params[i], strlen(params[i]));
+        if ((!ident) || (!dsarray_append(args, ident))) {
+            ms_IdentDestroy(ident);
+            goto cleanup_script_compile;
+        }
+
+        script->params[i] = ms_InternStr(ident->name);
+        if (!script->params[i]) {
+            goto cleanup_script_compile;
+        }
+        script->nparams++;
+    }
+
+    if ((str) && (COMPILE_THREADS != 1) &&
+        (ms_ParserCompileParallel(str, len, args, COMPILE_THREADS, alloc, &script->code))) {
+        dsarray_destroy(args);
+        dsallocator_swap(prev);
+        return script;
+    }
+
+    prs = ms_ParserNew();
+    if (!prs) {
+        goto cleanup_script_compile;
+    }
+
+    bool ready = (fname) ?
+                 ms_ParserInitFile(prs, fname) :
+                 ms_ParserInitStringL(prs, str, len);
+    if (!ready) {
+        if (fname) {
+            ErrorSet(err, ERR_CANNOT_READ_FILE, fname);
+        }
+        goto cleanup_script_compile;
+    }
+
+    if (ScriptParseAndGenerate(script, prs, args, err) == MS_RESULT_SUCCESS) {
+        ms_ParserDestroy(prs);
+        dsarray_destroy(args);
+        dsallocator_swap(prev);
+        return script;
+    }
+
+cleanup_script_compile:
+    if (!(*err)) {
+        ErrorSet(err, ERR_OUT_OF_MEMORY);
+    }
+    ms_ParserDestroy(prs);
+    dsarray_destroy(args);
+    dsallocator_swap(prev);
+    ms_ScriptDestroy(script);
+    return NULL;
+}
+
+static ms_Result ScriptParseAndGenerate(ms_Script *script, ms_Parser *prs, const ms_ArgList *args, ms_Error **err) {
+    assert(script);
+    assert(prs);
+    assert(err);
+
+    const ms_AST *ast;
+    if (ms_ParserParse(prs, &ast, err) == MS_RESULT_ERROR) {
+        return MS_RESULT_ERROR;
+    }
+
+    if (ms_ParserVerifyASTParams(ast, args, err) == MS_RESULT_ERROR) {
+        return MS_RESULT_ERROR;
+    }
+
+    return ms_VMByteCodeGenerateFromAST(ast, &script->code, err);
+}
+
+// Read the entire contents of the file at `fname` into a new NUL
+// terminated buffer allocated from the default allocator, or return NULL
+// if it cannot be read whole.
+static char *ScriptReadFile(const char *fname, size_t *len) {
+    assert(fname);
+    assert(len);
+
+    FILE *f = fopen(fname, "rb");
+    if (!f) {
+        return NULL;
+    }
+
+    long size;
+    char *src = NULL;
+    if ((fseek(f, 0, SEEK_END) == 0) && ((size = ftell(f)) >= 0) &&
+        (fseek(f, 0, SEEK_SET) == 0)) {
+        DSAllocator *prev = dsallocator_swap(NULL);
+        src = dsalloc((size_t)size + 1);
+        dsallocator_swap(prev);
+    }
+
+    if (src) {
+        *len = fread(src, 1, (size_t)size, f);
+        if (ferror(f)) {
+            dsfree(src);
+            src = NULL;
+        } else {
+            src[*len] = '\0';
+        }
+    }
+
+    fclose(f);
+    return src;
+}
+
+// Load a bytecode cache entry, checking every chunk of it up front, so a
+// damaged entry is compiled again rather than failing once it is executed.
+static ms_Script *ScriptCacheLoad(const char *path) {
+    assert(path);
+
+    ms_Error *err;
+    ms_Script *script = ms_ScriptLoad(path, &err);
+    if ((script) && (ms_VMImageVerify(script->code->image, &err) == MS_RESULT_ERROR)) {
+        ms_ScriptDestroy(script);
+        script = NULL;
+    }
+    ms_ErrorDestroy(err);
+    return script;
+}
+
+// Return the path of the bytecode cache entry for the given source in
+// `dir`. Entries are named for a hash of the compiler and the source, and
+// for the length of the source, so an edited script never matches the
+// entry of its previous contents.
+static char *ScriptCachePath(const char *dir, const char *src, size_t len) {
+    assert(dir);
+    assert(src);
+
+    uint32_t version = MS_VM_IMAGE_VERSION;
+    uint64_t hash = SCRIPT_CACHE_FNV_OFFSET;
+    hash = ScriptCacheHash(hash, SCRIPT_CACHE_COMPILER, strlen(SCRIPT_CACHE_COMPILER));
+    hash = ScriptCacheHash(hash, &version, sizeof(version));
+    hash = ScriptCacheHash(hash, src, len);
+
+    size_t dirlen = strlen(dir);
+    int namelen = snprintf(NULL, 0, "/%016llx-%zx%s", (unsigned long long)hash, len, SCRIPT_CACHE_EXT);
+    char *path = dsalloc(dirlen + (size_t)namelen + 1);
+    if (!path) {
+        return NULL;
+    }
+
+    memcpy(path, dir, dirlen);
+    snprintf(path + dirlen, (size_t)namelen + 1, "/%016llx-%zx%s", (unsigned long long)hash, len, SCRIPT_CACHE_EXT);
+    return path;
+}
+
+// Continue a 64-bit FNV-1a hash over `len` bytes. Cache keys must be the
+// same in every process, so the seeded table hash cannot be used.
+static uint64_t ScriptCacheHash(uint64_t hash, const void *data, size_t len) {
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= bytes[i];
+        hash *= SCRIPT_CACHE_FNV_PRIME;
+    }
+    return hash;
+}
+
+// Create a new VM error from a format string. The error always comes from
+// the default allocator.
+static ms_Error *ErrorNew(const char *msg, va_list args) {
+    assert(msg);
+
+    DSAllocator *prev = dsallocator_swap(NULL);
+    ms_Error *e = dsalloc(sizeof(ms_Error));
+    if (e) {
+        e->type = MS_ERROR_VM;
+        e->msg = NULL;
+
+        va_list argscpy;
+        va_copy(argscpy, args);
+
+        int len = vsnprintf(NULL, 0, msg, args);
+        e->len = (len > 0) ? (size_t)len : 0;
+        e->msg = dsalloc(e->len + 1);
+        if (e->msg) {
+            vsnprintf(e->msg, e->len + 1, msg, argscpy);
+        }
+
+        va_end(argscpy);
+    }
+
+    dsallocator_swap(prev);
+    return e;
+}
+
+// Set `err` to a new VM error.
+static void ErrorSet(ms_Error **err, const char *msg, ...) {
+    assert(err);
+
+    va_list args;
+    va_start(args, msg);
+    *err = ErrorNew(msg, args);
+    va_end(args);
+}
@@ -17,21 +17,135 @@
 #ifndef MSCRIPT_MSCRIPT_H
 #define MSCRIPT_MSCRIPT_H
 
+#include <stddef.h>
+#include <stdio.h>
 #include "error.h"
 
 typedef struct ms_State ms_State;
+typedef struct ms_Script ms_Script;
 
+/*
+ * Allocation function for a state. If `ptr` is NULL, allocate `size` bytes;
+ * if `size` is 0, free `ptr` and return NULL; otherwise resize `ptr` to
+ * `size` bytes, as `realloc`.
+ */
+typedef void *(*ms_AllocatorFunc)(void *ctx, void *ptr, size_t size);
+
+/*
+ * Every allocation made on behalf of a state comes from `alloc` and counts
+ * against `mem_limit`. A call which would take the state over its limit is
+ * abandoned with an MS_ERROR_VM error; the state then reports that error for
+ * every later call and should be destroyed. Files compiled on several
+ * threads (see `ms_SetCompileThreads`) are charged for their bytecode once
+ * it is compiled, but not for the memory their parts need while they are
+ * compiled; a file whose bytecode does not fit is compiled on one thread,
+ * as is every file of a state with its own `alloc` function.
+ *
+ * If `cache_dir` names an existing directory, files executed by
+ * `ms_StateExecuteFile` are compiled once and saved there as bytecode
+ * files, keyed by a hash of their source; later executions of an
+ * unchanged file load the bytecode rather than compiling it. Cached files
+ * are executed as compiled scripts (see `ms_Script`), so names they declare
+ * do not outlive the call. Entries are checked in full before they are
+ * executed, and damaged entries are compiled again. Compiling an entry is
+ * charged to the state, but bytecode loaded from the cache is mapped from
+ * files shared by every state, so it is not counted against `mem_limit`.
+ * The cache is not used in interactive mode or when printing bytecode.
+ */
 typedef struct {
     bool interactive_mode;
     bool print_bytecode;
+    bool eager_compile;                             /* compile function bodies when loaded, not on first call */
+    ms_AllocatorFunc alloc;                         /* allocation function, or NULL for malloc */
+    void *alloc_ctx;                                /* context passed to `alloc` */
+    size_t mem_limit;                               /* maximum bytes held by the state, or 0 */
+    const char *cache_dir;                          /* directory of cached bytecode for files, or NULL */
 } ms_StateOptions;
 
+/*
+ * Value bound to a script parameter for one execution. Strings are copied
+ * into the state, so `s` need only be valid for the duration of the call.
+ */
+typedef enum {
+    MS_PARAM_NULL,
+    MS_PARAM_BOOL,
+    MS_PARAM_INT,
+    MS_PARAM_FLOAT,
+    MS_PARAM_STR,
+} ms_ParamType;
+
+typedef struct {
+    ms_ParamType type;
+    union {
+        bool b;
+        long long i;
+        double f;
+        const char *s;
+    } val;
+    size_t len;                                     /* length of `val.s` in bytes */
+} ms_Param;
+
 ms_State *ms_StateNew(void);
 ms_State *ms_StateNewOptions(ms_StateOptions *opts);
 ms_Result ms_StateExecuteString(ms_State *state, const char *str, const ms_Error **err);
 ms_Result ms_StateExecuteStringL(ms_State *state, const char *str, size_t len, const ms_Error **err);
 ms_Result ms_StateExecuteFile(ms_State *state, const char *fname, const ms_Error **err);
+ms_Result ms_StateExecuteFileHandle(ms_State *state, FILE *file, const ms_Error **err);
+ms_Result ms_StateExecuteScript(ms_State *state, const ms_Script *script, const ms_Param params[], size_t nparams, const ms_Error **err);
 void ms_StateErrorClear(ms_State *state);
+size_t ms_StateMemoryUsed(const ms_State *state);
+size_t ms_StateMemoryPeak(const ms_State *state);
 void ms_StateDestroy(ms_State *state);
 
+/*
+ * A script is compiled once, independently of any state, and may then be
+ * executed any number of times against any state without being parsed or
+ * compiled again. Each of the `nparams` names in `params` is declared in
+ * the outermost scope of the script and bound to the corresponding value
+ * given to `ms_StateExecuteScript`. Names declared by the script do not
+ * outlive its execution.
+ *
+ * Compiled scripts are never modified by execution, other than to load
+ * function bodies from a bytecode file (see `ms_ScriptLoad`); they must
+ * outlive any call executing them and be destroyed by `ms_ScriptDestroy`.
+ * On failure, NULL is returned and `err` receives an error which the
+ * caller must destroy with `ms_ErrorDestroy`.
+ */
+ms_Script *ms_ScriptCompileString(const char *str, const char *const params[], size_t nparams, ms_Error **err);
+ms_Script *ms_ScriptCompileStringL(const char *str, size_t len, const char *const params[], size_t nparams, ms_Error **err);
+ms_Script *ms_ScriptCompileFile(const char *fname, const char *const params[], size_t nparams, ms_Error **err);
+void ms_ScriptDestroy(ms_Script *script);
+
+/*
+ * Compiled scripts may be saved to a bytecode file and loaded again by
+ * later processes without being compiled. Loading maps the file into
+ * memory: opcodes are executed directly from the file and each function
+ * body is only loaded when it is first called. Bytecode files may only be
+ * loaded on machines of the same byte order and opcode width as the
+ * machine which saved them.
+ */
+ms_Result ms_ScriptSave(ms_Script *script, const char *fname, ms_Error **err);
+ms_Script *ms_ScriptLoad(const char *fname, ms_Error **err);
+bool ms_ScriptFileIsCompiled(const char *fname);
+
+/*
+ * String keyed tables in every state share one process-wide hash seed. An
+ * unpredictable seed stops untrusted scripts from choosing names which all
+ * collide. The seed must be set before the first state is created; the
+ * default seed is 0.
+ */
+void ms_SeedHash(unsigned long long seed);
+unsigned long long ms_SeedHashRandom(void);
+
+/*
+ * Large scripts, and large files executed by `ms_StateExecuteFile`, may be
+ * compiled on up to `nthreads` threads (or one per processor, if 0): the
+ * source is split between top-level statements and each part is compiled
+ * on its own thread. Files compiled this way are executed as compiled
+ * scripts, so names they declare do not outlive the call. Compilation only
+ * uses several threads from within a call; each state must still only be
+ * used from one thread at a time. The default is a single thread.
+ */
+void ms_SetCompileThreads(size_t nthreads);
+
 #endif //MSCRIPT_MSCRIPT_H
@@ -87,6 +87,7 @@ static int ms_StrNotEqual(ms_VM *vm);
 static int ms_StrNot(ms_VM *vm);
 static int ms_StrAnd(ms_VM *vm);
 static int ms_StrOr(ms_VM *vm);
+static int ms_StrGetAttr(ms_VM *vm);
 
 static int ms_BoolToStr(ms_VM *vm);
 static int ms_BoolToFloat(ms_VM *vm);
@@ -205,6 +206,7 @@ const ms_FuncDef MS_STR_PROTOTYPE[] = {
     { "__not__", ms_StrNot },
     { "__and__", ms_StrAnd },
     { "__or__", ms_StrOr },
+    { "__getattr__", ms_StrGetAttr },
     { NULL, NULL },
 };
 
@@ -1069,7 +1071,17 @@ static int ms_StrToBool(ms_VM *vm) {
 }
 
 static int ms_StrAdd(ms_VM *vm) {
-    return 0;
+    assert(vm);
+    ms_VMValue r = ms_VMPop(vm);
+    ms_VMValue l = ms_VMPop(vm);
+    switch (r.type) {
+        case VMVAL_STR:         /* fall through */
+        case VMVAL_ROPE:        /* fall through */
+        case VMVAL_SLICE:
+            return (ms_VMPushStrConcat(vm, l, r)) ? 1 : 0;
+        default:
+            return 0;
+    }
 }
 
 static int ms_StrLessThan(ms_VM *vm) {
@@ -1108,6 +1120,23 @@ static int ms_StrOr(ms_VM *vm) {
     return 0;
 }
 
+static int ms_StrGetAttr(ms_VM *vm) {
+    assert(vm);
+    ms_VMValue r = ms_VMPop(vm);
+    ms_VMValue l = ms_VMPop(vm);
+    switch (r.type) {
+        case VMVAL_INT: {
+            if ((r.val.i < 0) || ((size_t)r.val.i >= ms_VMStrLen(&l))) {
+                ms_VMErrorSet(vm, "string index %lld out of range", r.val.i);
+                return 0;
+            }
+            return (ms_VMPushStrSlice(vm, &l, (size_t)r.val.i, 1)) ? 1 : 0;
+        }
+        default:
+            return 0;
+    }
+}
+
 /*
  * BOOL PROTOTYPE FUNCTIONS
  */
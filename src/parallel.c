@@ -0,0 +1,634 @@
+/*------------------------------------------------------------------------------
+ *    Copyright 2016 Chris Rink
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *----------------------------------------------------------------------------*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#ifdef MS_USE_PTHREADS
+#include <pthread.h>
+#include <unistd.h>
+#endif
+#include "libds/alloc.h"
+#include "libds/dict.h"
+#include "intern.h"
+#include "parallel.h"
+#include "parser.h"
+#include "verifier.h"
+
+#ifdef MS_USE_PTHREADS
+
+/*
+ * FORWARD DECLARATIONS
+ */
+
+typedef struct {
+    const char *src;                /** source of the part */
+    size_t len;                     /** length of `src` in bytes */
+    ms_Parser *prs;                 /** parser holding the AST of the part, or NULL */
+    const ms_AST *ast;              /** AST of the part, once parsed */
+    ms_VMByteCode *code;            /** bytecode of the part, once compiled */
+    DSAllocator mem;                /** allocator the part is compiled on, if it is charged */
+} ParallelPart;
+
+typedef struct ParallelCompiler ParallelCompiler;
+typedef bool (*ParallelStageFn)(ParallelCompiler *pc, size_t i);
+
+struct ParallelCompiler {
+    ParallelPart *parts;            /** parts of the module, in source order */
+    size_t nparts;                  /** number of parts */
+    const ms_ArgList *params;       /** names declared at the start of the module, or NULL */
+    DSAllocator *alloc;             /** allocator charged for the module, or NULL */
+    DSDict *names;                  /** first part (as index + 1) declaring each top-level name */
+    ParallelStageFn stage;          /** stage currently being run on every part */
+    size_t next;                    /** index of the next part to run the stage on */
+    bool failed;                    /** true once the stage has failed on any part */
+    pthread_mutex_t lock;           /** guards `next` and `failed` */
+};
+
+/* parts smaller than this are not worth a thread, so smaller modules are
+ * never split */
+static const size_t PARALLEL_MIN_PART = 16 * 1024;
+
+/* each thread is given a few parts, so that threads which are handed
+ * cheap parts can take on more of the work */
+static const size_t PARALLEL_PARTS_PER_THREAD = 4;
+
+/* the linked module must not need a larger opcode argument than this */
+static const size_t PARALLEL_ARG_MAX = 0x7fff;
+
+static size_t ParallelSplit(const char *str, size_t len, size_t target, size_t *cuts, size_t maxcuts);
+static size_t ParallelSkipSpace(const char *str, size_t len, size_t i);
+static inline bool ParallelIsWordStart(char c);
+static inline bool ParallelIsWordChar(char c);
+static bool ParallelRun(ParallelCompiler *pc, ParallelStageFn stage, size_t nthreads);
+static void *ParallelWorker(void *arg);
+static bool ParallelParse(ParallelCompiler *pc, size_t i);
+static bool ParallelGenerate(ParallelCompiler *pc, size_t i);
+static bool ParallelRelease(ParallelCompiler *pc, size_t i);
+static bool ParallelCollectNames(ParallelCompiler *pc);
+static bool ParallelCharge(ParallelCompiler *pc);
+static bool ParallelLink(ParallelCompiler *pc, ms_VMByteCode **code);
+static size_t ParallelThreads(size_t nthreads);
+
+#endif
+
+/*
+ * PUBLIC FUNCTIONS
+ */
+
+bool ms_ParserCompileParallel(const char *str, size_t len, const ms_ArgList *params, size_t nthreads, DSAllocator *alloc, ms_VMByteCode **code) {
+    assert(str);
+    assert(code);
+
+    *code = NULL;
+#ifdef MS_USE_PTHREADS
+    size_t maxparts = len / PARALLEL_MIN_PART;
+    nthreads = ParallelThreads(nthreads);
+    if (nthreads > maxparts) {
+        nthreads = maxparts;
+    }
+    if ((nthreads < 2) || ((alloc) && (alloc->fn))) {
+        return false;
+    }
+
+    if (maxparts > nthreads * PARALLEL_PARTS_PER_THREAD) {
+        maxparts = nthreads * PARALLEL_PARTS_PER_THREAD;
+    }
+    size_t target = len / maxparts;
+
+    bool res = false;
+    DSAllocator *prev = dsallocator_swap(NULL);
+    ParallelCompiler pc = { .params = params, .alloc = alloc };
+    dsalloc_limit_fn on_limit = (alloc) ? alloc->on_limit : NULL;
+    size_t *cuts = dscalloc(maxparts, sizeof(size_t));
+    if (!cuts) {
+        goto cleanup_compile_parallel;
+    }
+
+    size_t ncuts = ParallelSplit(str, len, target, cuts, maxparts - 1);
+    if (ncuts == 0) {
+        goto cleanup_compile_parallel;
+    }
+
+    pc.parts = dscalloc(ncuts + 1, sizeof(ParallelPart));
+    if (!pc.parts) {
+        goto cleanup_compile_parallel;
+    }
+
+    for (size_t start = 0; pc.nparts <= ncuts; pc.nparts++) {
+        ParallelPart *part = &pc.parts[pc.nparts];
+        size_t end = (pc.nparts < ncuts) ? cuts[pc.nparts] : len;
+        part->src = &str[start];
+        part->len = end - start;
+        start = end;
+        if (alloc) {
+            dsallocator_init(&part->mem, NULL, NULL, 0);
+            if (!ms_InternTrack(&part->mem)) {
+                pc.nparts++;
+                goto cleanup_compile_parallel;
+            }
+        }
+    }
+
+    if (pthread_mutex_init(&pc.lock, NULL) != 0) {
+        goto cleanup_compile_parallel;
+    }
+
+    /* names declared by every part must be known before any part can be
+     * verified, so parts are parsed before any is compiled */
+    res = (ParallelRun(&pc, ParallelParse, nthreads)) &&
+          (ParallelCollectNames(&pc)) &&
+          (ParallelRun(&pc, ParallelGenerate, nthreads));
+    dsdict_destroy(pc.names);
+    pc.names = NULL;
+    (void)ParallelRun(&pc, ParallelRelease, nthreads);
+    pthread_mutex_destroy(&pc.lock);
+
+    res = (res) && (ParallelCharge(&pc)) && (ParallelLink(&pc, code));
+
+cleanup_compile_parallel:
+    for (size_t i = 0; i < pc.nparts; i++) {
+        ms_VMByteCodeDestroy(pc.parts[i].code);
+        if (alloc) {
+            ms_InternUntrack(&pc.parts[i].mem);
+            dsallocator_release(&pc.parts[i].mem);
+        }
+    }
+    dsfree(pc.parts);
+    dsfree(cuts);
+    if (alloc) {
+        alloc->on_limit = on_limit;
+    }
+    dsallocator_swap(prev);
+    return res;
+#else
+    (void)len;
+    (void)params;
+    (void)nthreads;
+    (void)alloc;
+    return false;
+#endif
+}
+
+/*
+ * PRIVATE FUNCTIONS
+ */
+
+#ifdef MS_USE_PTHREADS
+
+// Find up to `maxcuts` places to split the source, each at the boundary
+// between two top-level statements and at least `target` bytes from the
+// previous cut and from the end of the source. Top-level statements end
+// with a `;`, or with the `}` closing a block when the next word does not
+// continue the statement (as `else` does). Strings and comments are
+// skipped just as the lexer skips them. Returns the number of cuts found.
+static size_t ParallelSplit(const char *str, size_t len, size_t target, size_t *cuts, size_t maxcuts) {
+    assert(str);
+    assert(cuts);
+
+    size_t ncuts = 0;
+    size_t last = 0;
+    size_t depth = 0;
+    size_t i = 0;
+    while ((i < len) && (ncuts < maxcuts)) {
+        char c = str[i++];
+        switch (c) {
+            case '"':
+            case '\'': {
+                char prev = '\0';
+                while (i < len) {
+                    char n = str[i++];
+                    if ((n == '\n') || (n == '\r') || ((n == c) && (prev != '\\'))) {
+                        break;
+                    }
+                    prev = n;
+                }
+                continue;
+            }
+            case '/':
+                if ((i < len) && (str[i] == '/')) {
+                    i = ParallelSkipSpace(str, len, i - 1);
+                }
+                continue;
+            case '(':
+            case '[':
+            case '{':
+                depth++;
+                continue;
+            case ')':
+            case ']':
+                if (depth == 0) {
+                    return 0;   /* unbalanced, so the module is left whole */
+                }
+                depth--;
+                continue;
+            case '}':
+                if (depth == 0) {
+                    return 0;
+                }
+                depth--;
+                break;
+            case ';':
+                break;
+            default:
+                continue;
+        }
+
+        if ((depth > 0) || (i - last < target) || (len - i < target)) {
+            continue;
+        }
+
+        if (c == '}') {
+            size_t n = ParallelSkipSpace(str, len, i);
+            if ((n == len) || (!ParallelIsWordStart(str[n]))) {
+                continue;
+            }
+            if ((len - n >= 4) && (memcmp(&str[n], "else", 4) == 0) &&
+                ((len - n == 4) || (!ParallelIsWordChar(str[n + 4])))) {
+                continue;
+            }
+        }
+
+        cuts[ncuts++] = i;
+        last = i;
+    }
+
+    return ncuts;
+}
+
+// Return the index of the first character at or after `i` which is
+// neither whitespace nor part of a comment.
+static size_t ParallelSkipSpace(const char *str, size_t len, size_t i) {
+    assert(str);
+
+    while (i < len) {
+        switch (str[i]) {
+            case ' ':
+            case '\t':
+            case '\f':
+            case '\n':
+            case '\r':
+                i++;
+                break;
+            case '/':
+                if ((i + 1 >= len) || (str[i + 1] != '/')) {
+                    return i;
+                }
+                while ((i < len) && (str[i] != '\n') && (str[i] != '\r')) {
+                    i++;
+                }
+                break;
+            default:
+                return i;
+        }
+    }
+
+    return i;
+}
+
+static inline bool ParallelIsWordStart(char c) {
+    return ((c >= 'a') && (c <= 'z')) ||
+           ((c >= 'A') && (c <= 'Z')) ||
+           (c == '_');
+}
+
+static inline bool ParallelIsWordChar(char c) {
+    return (ParallelIsWordStart(c)) || ((c >= '0') && (c <= '9'));
+}
+
+// Run a stage on every part, on up to `nthreads` threads (including the
+// calling thread). Threads claim parts in order until none remain, or
+// until the stage fails on any part. Returns false if the stage failed.
+static bool ParallelRun(ParallelCompiler *pc, ParallelStageFn stage, size_t nthreads) {
+    assert(pc);
+    assert(stage);
+
+    pc->stage = stage;
+    pc->next = 0;
+    pc->failed = false;
+
+    if (nthreads > pc->nparts) {
+        nthreads = pc->nparts;
+    }
+
+    /* any thread which cannot be started simply leaves its share of the
+     * parts to the others */
+    size_t nstarted = 0;
+    pthread_t *threads = dscalloc(nthreads, sizeof(pthread_t));
+    for (size_t i = 1; (threads) && (i < nthreads); i++) {
+        if (pthread_create(&threads[nstarted], NULL, ParallelWorker, pc) == 0) {
+            nstarted++;
+        }
+    }
+
+    (void)ParallelWorker(pc);
+    for (size_t i = 0; i < nstarted; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    dsfree(threads);
+    return !pc->failed;
+}
+
+static void *ParallelWorker(void *arg) {
+    ParallelCompiler *pc = arg;
+    assert(pc);
+
+    for (;;) {
+        pthread_mutex_lock(&pc->lock);
+        size_t i = pc->next++;
+        bool done = (pc->failed) || (i >= pc->nparts);
+        pthread_mutex_unlock(&pc->lock);
+        if (done) {
+            break;
+        }
+
+        /* an allocator may only be used by one thread at a time, so each
+         * part is compiled on its own until it is charged to the caller */
+        DSAllocator *prev = dsallocator_swap((pc->alloc) ? &pc->parts[i].mem : NULL);
+        bool ok = pc->stage(pc, i);
+        dsallocator_swap(prev);
+        if (!ok) {
+            pthread_mutex_lock(&pc->lock);
+            pc->failed = true;
+            pthread_mutex_unlock(&pc->lock);
+        }
+    }
+
+    return NULL;
+}
+
+static bool ParallelParse(ParallelCompiler *pc, size_t i) {
+    assert(pc);
+    assert(i < pc->nparts);
+
+    ParallelPart *part = &pc->parts[i];
+    part->prs = ms_ParserNew();
+    if ((!part->prs) || (!ms_ParserInitStringL(part->prs, part->src, part->len))) {
+        return false;
+    }
+
+    ms_Error *err;
+    if (ms_ParserParse(part->prs, &part->ast, &err) == MS_RESULT_ERROR) {
+        ms_ErrorDestroy(err);
+        return false;
+    }
+
+    return true;
+}
+
+static bool ParallelGenerate(ParallelCompiler *pc, size_t i) {
+    assert(pc);
+    assert(i < pc->nparts);
+
+    ParallelPart *part = &pc->parts[i];
+    ms_Error *err;
+    if (ms_ParserVerifyASTPart(part->ast, pc->params, pc->names, i, &err) == MS_RESULT_ERROR) {
+        ms_ErrorDestroy(err);
+        return false;
+    }
+
+    if (ms_VMByteCodeGenerateFromAST(part->ast, &part->code, &err) == MS_RESULT_ERROR) {
+        ms_ErrorDestroy(err);
+        return false;
+    }
+
+    return true;
+}
+
+// Free the AST of a part, which other parts may refer to (through the
+// table of top-level names) until every part has been compiled.
+static bool ParallelRelease(ParallelCompiler *pc, size_t i) {
+    assert(pc);
+    assert(i < pc->nparts);
+
+    ms_ParserDestroy(pc->parts[i].prs);
+    pc->parts[i].prs = NULL;
+    pc->parts[i].ast = NULL;
+    return true;
+}
+
+// Map each name declared at the top level of the module to the first part
+// which declares it, so that each part can be verified in the context of
+// the whole module.
+static bool ParallelCollectNames(ParallelCompiler *pc) {
+    assert(pc);
+
+    pc->names = dsdict_new((dsdict_hash_fn)dsbuf_hash,
+                           (dsdict_compare_fn)dsbuf_compare, NULL, NULL);
+    if (!pc->names) {
+        return false;
+    }
+
+    for (size_t i = 0; i < pc->nparts; i++) {
+        const ms_AST *ast = pc->parts[i].ast;
+        size_t len = dsarray_len(ast);
+        for (size_t j = 0; j < len; j++) {
+            const ms_Stmt *stmt = dsarray_get(ast, j);
+            if (stmt->type != STMTTYPE_DECLARATION) {
+                continue;
+            }
+
+            for (ms_StmtDeclaration *decl = stmt->cmpnt.decl; decl; decl = decl->next) {
+                if (!dsdict_get(pc->names, decl->ident->name)) {
+                    dsdict_put(pc->names, decl->ident->name, (void *)(uintptr_t)(i + 1));
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+// Charge the bytecode of every part (and the strings it refers to) to the
+// caller's allocator and make it current, so that the linked module is
+// allocated from it too. The limit
+// handler is suspended until compilation is over, since it could not
+// unwind the parts; a module which does not fit fails to compile instead.
+static bool ParallelCharge(ParallelCompiler *pc) {
+    assert(pc);
+
+    DSAllocator *alloc = pc->alloc;
+    if (!alloc) {
+        return true;
+    }
+
+    alloc->on_limit = NULL;
+    size_t used = 0;
+    for (size_t i = 0; i < pc->nparts; i++) {
+        used += pc->parts[i].mem.used;
+    }
+
+    if ((alloc->limit > 0) &&
+        ((alloc->used > alloc->limit) || (used > alloc->limit - alloc->used))) {
+        alloc->exceeded = true;
+        return false;
+    }
+
+    for (size_t i = 0; i < pc->nparts; i++) {
+        ms_InternMerge(alloc, &pc->parts[i].mem);
+        dsallocator_merge(alloc, &pc->parts[i].mem);
+    }
+    (void)dsallocator_swap(alloc);
+    return true;
+}
+
+// Link the bytecode of every part into a single module. Opcodes which
+// refer to a constant or a position in the module are moved along by the
+// number of constants or opcodes in earlier parts, and those which refer
+// to an identifier are pointed at its first occurrence in the module.
+// Nothing is taken from the parts unless linking succeeds.
+static bool ParallelLink(ParallelCompiler *pc, ms_VMByteCode **code) {
+    assert(pc);
+    assert(code);
+
+    size_t nops = 0;
+    size_t nvals = 0;
+    size_t nidents = 0;
+    for (size_t i = 0; i < pc->nparts; i++) {
+        nops += pc->parts[i].code->nops;
+        nvals += pc->parts[i].code->nvals;
+        nidents += pc->parts[i].code->nidents;
+    }
+
+    if (nvals > PARALLEL_ARG_MAX + 1) {
+        return false;
+    }
+
+    bool res = false;
+    ms_VMOpCode *ops = dsalloc(sizeof(ms_VMOpCode) * nops);
+    ms_VMValue *vals = dsalloc(sizeof(ms_VMValue) * nvals);
+    DSBuffer **idents = dsalloc(sizeof(DSBuffer *) * nidents);
+    size_t *remap = dsalloc(sizeof(size_t) * nidents);
+    DSDict *index = dsdict_new((dsdict_hash_fn)ms_InternHash,
+                               (dsdict_compare_fn)ms_InternCompare, NULL, NULL);
+    if ((!ops) || (!vals) || (!idents) || (!remap) || (!index)) {
+        goto cleanup_link;
+    }
+
+    /* `remap` holds the module index of each identifier of each part */
+    size_t nmerged = 0;
+    for (size_t i = 0, base = 0; i < pc->nparts; i++) {
+        const ms_VMByteCode *bc = pc->parts[i].code;
+        for (size_t j = 0; j < bc->nidents; j++, base++) {
+            size_t found = (size_t)(uintptr_t)dsdict_get(index, bc->idents[j]);
+            if (!found) {
+                if (nmerged > PARALLEL_ARG_MAX) {
+                    goto cleanup_link;
+                }
+                idents[nmerged++] = bc->idents[j];
+                dsdict_put(index, bc->idents[j], (void *)(uintptr_t)nmerged);
+                if (!dsdict_get(index, bc->idents[j])) {
+                    goto cleanup_link;
+                }
+                found = nmerged;
+            }
+            remap[base] = found - 1;
+        }
+    }
+
+    for (size_t i = 0, op = 0, val = 0, base = 0; i < pc->nparts; i++) {
+        const ms_VMByteCode *bc = pc->parts[i].code;
+        for (size_t j = 0; j < bc->nops; j++) {
+            ms_VMOpCodeType type = ms_VMOpCodeGetCode(bc->code[j]);
+            size_t arg = (size_t)ms_VMOpCodeGetArg(bc->code[j]);
+            switch (type) {
+                case OPC_PUSH:
+                    arg += val;
+                    break;
+                case OPC_CALL_BUILTIN:
+                case OPC_NEW_NAME:
+                case OPC_GET_NAME:
+                case OPC_SET_NAME:
+                case OPC_DEL_NAME:
+                    assert(arg < bc->nidents);
+                    arg = remap[base + arg];
+                    break;
+                case OPC_JUMP_IF_FALSE:
+                case OPC_GOTO:
+                    arg += op;
+                    break;
+                default:
+                    ops[op + j] = bc->code[j];
+                    continue;
+            }
+
+            if (arg > PARALLEL_ARG_MAX) {
+                goto cleanup_link;
+            }
+            ops[op + j] = ms_VMOpCodeWithArg(type, (int)arg);
+        }
+
+        op += bc->nops;
+        val += bc->nvals;
+        base += bc->nidents;
+    }
+
+    *code = ms_VMByteCodeNew(ops, nops, vals, nvals, idents, nmerged);
+    if (!(*code)) {
+        goto cleanup_link;
+    }
+
+    /* the module now takes the values and identifiers of every part,
+     * dropping the references held for identifiers it already had (which
+     * were merged in order, so each first occurrence takes the next index) */
+    for (size_t i = 0, val = 0, base = 0, taken = 0; i < pc->nparts; i++) {
+        ms_VMByteCode *bc = pc->parts[i].code;
+        memcpy(&vals[val], bc->values, sizeof(ms_VMValue) * bc->nvals);
+        for (size_t j = 0; j < bc->nidents; j++, base++) {
+            if (remap[base] == taken) {
+                taken++;
+            } else {
+                ms_InternRelease(bc->idents[j]);
+            }
+        }
+        val += bc->nvals;
+
+        dsfree(bc->code);
+        dsfree(bc->values);
+        dsfree(bc->idents);
+        dsfree(bc);
+        pc->parts[i].code = NULL;
+    }
+
+    ops = NULL;
+    vals = NULL;
+    idents = NULL;
+    res = true;
+
+cleanup_link:
+    dsdict_destroy(index);
+    dsfree(remap);
+    dsfree(idents);
+    dsfree(vals);
+    dsfree(ops);
+    return res;
+}
+
+// Return the number of threads to compile on, given the number requested.
+static size_t ParallelThreads(size_t nthreads) {
+    if (nthreads > 0) {
+        return nthreads;
+    }
+
+    long nprocs = sysconf(_SC_NPROCESSORS_ONLN);
+    return (nprocs > 0) ? (size_t)nprocs : 1;
+}
+
+#endif
@@ -0,0 +1,70 @@
+/*------------------------------------------------------------------------------
+ *    Copyright 2016 Chris Rink
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *----------------------------------------------------------------------------*/
+
+
+#ifndef MSCRIPT_PARALLEL_H
+#define MSCRIPT_PARALLEL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "libds/alloc.h"
+#include "bytecode.h"
+#include "lang.h"
+
+/*
+ * Large modules may be compiled on several threads at once. The source is
+ * first scanned (without being lexed) for the boundaries between top-level
+ * statements, and split into parts at some of them. Each part is then
+ * parsed, verified and compiled on its own thread, and the bytecode of the
+ * parts is linked into a single module: opcodes are concatenated (with
+ * jump targets and constant indices moved along), constants are
+ * concatenated, and identifiers are merged so that each appears once.
+ *
+ * The linked module is exactly the bytecode which compiling the whole
+ * source on one thread would have produced, with every function body
+ * compiled eagerly.
+ *
+ * Each part is compiled on an allocator of its own, since an allocator may
+ * only be used by one thread at a time. Once every part is compiled, their
+ * bytecode is charged to the caller's allocator (if any), and the module
+ * is linked from it. Memory which is only needed while the parts are
+ * compiled (such as their ASTs) is released before it is charged.
+ */
+
+/**
+* @brief Compile a module from source on up to @c nthreads threads.
+*
+* @param str the source of the module
+* @param len the length of @c str in bytes
+* @param params names declared at the start of the module, or NULL
+* @param nthreads the maximum number of threads to compile on, or 0 for
+*        one per processor
+* @param alloc the allocator charged for the new bytecode, or NULL for the
+*        default allocator; its limit handler is not called, and a module
+*        which would take it over its limit is not compiled. Modules are
+*        never split for an allocator with its own allocation function,
+*        which need not be safe to call from several threads at once
+* @param code if compilation succeeds, set to the new bytecode, which is
+*        allocated from @c alloc and owned by the caller
+* @returns true if the module was compiled; false if it is too small to
+*          split, threads are unavailable, it cannot be charged to
+*          @c alloc ,
+*          or it contains any error, in which case it should be compiled
+*          as usual (which will report any error)
+*/
+bool ms_ParserCompileParallel(const char *str, size_t len, const ms_ArgList *params, size_t nthreads, DSAllocator *alloc, ms_VMByteCode **code);
+
+#endif //MSCRIPT_PARALLEL_H
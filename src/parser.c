@@ -15,12 +15,16 @@
  *----------------------------------------------------------------------------*/
 
 #include <assert.h>
+#include <errno.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include "libds/alloc.h"
 #include "libds/array.h"
 #include "libds/dict.h"
 #include "libds/hash.h"
+#include "intern.h"
 #include "lexer.h"
 #include "parser.h"
 #include "lang.h"
@@ -31,18 +35,32 @@
  * FORWARD DECLARATIONS
  */
 
-static const size_t ARGUMENT_LIST_DEFAULT_CAP = 10;
-static const size_t EXPRESSION_LIST_DEFAULT_CAP = 10;
+/* most blocks and lists hold only a few elements, which are stored inline */
+static const size_t ARGUMENT_LIST_DEFAULT_CAP = 4;
+static const size_t EXPRESSION_LIST_DEFAULT_CAP = 4;
 static const size_t MODULE_DEFAULT_CAP = 10;
-static const size_t STATEMENT_BLOCK_DEFAULT_CAP = 10;
+static const size_t STATEMENT_BLOCK_DEFAULT_CAP = 4;
+
+/* tokens are lexed into a fixed ring holding the current token and the
+ * lookahead token, each with storage for its text which is reused */
+#define PARSER_TOKEN_RING_SIZE 2
+static const size_t PARSER_TOKEN_TEXT_DEFAULT_CAP = 32;
+
+typedef struct {
+    ms_TokenView tok;                       /** token, whose text is stored in the slot */
+    char *text;                             /** token text storage */
+    size_t cap;                             /** capacity of the text storage */
+} ParserTokenSlot;
 
 struct ms_Parser {
     ms_Lexer *lex;                          /** lexer object */
-    ms_Token *cur;                          /** current token */
-    ms_Token *nxt;                          /** "lookahead" token */
+    ParserTokenSlot ring[PARSER_TOKEN_RING_SIZE];  /** current and lookahead token storage */
+    size_t head;                            /** ring index of the current token */
+    const ms_TokenView *cur;                /** current token */
+    const ms_TokenView *nxt;                /** "lookahead" token */
     size_t line;                            /** current line */
     size_t col;                             /** current column */
-    ms_AST *ast;                            /** current abstract syntax tree */
+    ms_ASTArena *arena;                     /** arena holding the current abstract syntax tree */
     ms_Error **err;                         /** pointer to current parser error (not owned by the parser) */
 };
 
@@ -61,6 +79,91 @@ static const char *const ERR_MUST_ASSIGN_TO_QIDENT = "Assignment target must be
 static const char *const ERR_MUST_IMPORT_QIDENT = "Imported module must be identifier or qualified identifier (ln: %d, col: %d)";
 static const char *const ERR_FOR_LOOP_MUST_END = "For loop must have a start expression and end expression (ln: %d, col: %d)";
 
+/* binary operator precedence levels, from loosest to tightest binding */
+typedef enum {
+    PREC_NONE = 0,
+    PREC_OR,
+    PREC_AND,
+    PREC_EQUALITY,
+    PREC_COMPARISON,
+    PREC_BITWISE_OR,
+    PREC_BITWISE_XOR,
+    PREC_BITWISE_AND,
+    PREC_BIT_SHIFT,
+    PREC_ARITHMETIC,
+    PREC_TERM,
+    PREC_POWER,
+} ParserPrecedence;
+
+typedef struct {
+    ms_ExprBinaryOp op;                     /** binary operator produced by the token */
+    ParserPrecedence prec;                  /** precedence; PREC_NONE if the token is not a binary operator */
+    ms_VMOpCodeType opc;                    /** opcode applying the operator */
+} ParserBinaryOp;
+
+static const ParserBinaryOp BINARY_OPS[NEWLINE_TOK + 1] = {
+    [OP_OR] =           { BINARY_OR,            PREC_OR,            OPC_OR },
+    [OP_AND] =          { BINARY_AND,           PREC_AND,           OPC_AND },
+    [OP_DOUBLE_EQ] =    { BINARY_EQ,            PREC_EQUALITY,      OPC_EQ },
+    [OP_NOT_EQ] =       { BINARY_NOT_EQ,        PREC_EQUALITY,      OPC_NOT_EQ },
+    [OP_GT] =           { BINARY_GT,            PREC_COMPARISON,    OPC_GT },
+    [OP_GE] =           { BINARY_GE,            PREC_COMPARISON,    OPC_GE },
+    [OP_LT] =           { BINARY_LT,            PREC_COMPARISON,    OPC_LT },
+    [OP_LE] =           { BINARY_LE,            PREC_COMPARISON,    OPC_LE },
+    [OP_BITWISE_OR] =   { BINARY_BITWISE_OR,    PREC_BITWISE_OR,    OPC_BITWISE_OR },
+    [OP_BITWISE_XOR] =  { BINARY_BITWISE_XOR,   PREC_BITWISE_XOR,   OPC_BITWISE_XOR },
+    [OP_BITWISE_AND] =  { BINARY_BITWISE_AND,   PREC_BITWISE_AND,   OPC_BITWISE_AND },
+    [OP_SHIFT_LEFT] =   { BINARY_SHIFT_LEFT,    PREC_BIT_SHIFT,     OPC_SHIFT_LEFT },
+    [OP_SHIFT_RIGHT] =  { BINARY_SHIFT_RIGHT,   PREC_BIT_SHIFT,     OPC_SHIFT_RIGHT },
+    [OP_PLUS] =         { BINARY_PLUS,          PREC_ARITHMETIC,    OPC_ADD },
+    [OP_MINUS] =        { BINARY_MINUS,         PREC_ARITHMETIC,    OPC_SUBTRACT },
+    [OP_TIMES] =        { BINARY_TIMES,         PREC_TERM,          OPC_MULTIPLY },
+    [OP_DIVIDE] =       { BINARY_DIVIDE,        PREC_TERM,          OPC_DIVIDE },
+    [OP_IDIVIDE] =      { BINARY_IDIVIDE,       PREC_TERM,          OPC_IDIVIDE },
+    [OP_MODULO] =       { BINARY_MODULO,        PREC_TERM,          OPC_MODULO },
+    [OP_EXPONENTIATE] = { BINARY_EXPONENTIATE,  PREC_POWER,         OPC_EXPONENTIATE },
+};
+
+/* compound assignment operators, which apply the binary operator of the
+ * same precedence to the target and the assigned expression */
+static const ParserBinaryOp COMPOUND_OPS[NEWLINE_TOK + 1] = {
+    [OP_PLUS_EQUALS] =          { BINARY_PLUS,          PREC_ARITHMETIC,    OPC_ADD },
+    [OP_MINUS_EQUALS] =         { BINARY_MINUS,         PREC_ARITHMETIC,    OPC_SUBTRACT },
+    [OP_TIMES_EQUALS] =         { BINARY_TIMES,         PREC_TERM,          OPC_MULTIPLY },
+    [OP_DIVIDE_EQUALS] =        { BINARY_DIVIDE,        PREC_TERM,          OPC_DIVIDE },
+    [OP_IDIVIDE_EQUALS] =       { BINARY_IDIVIDE,       PREC_TERM,          OPC_IDIVIDE },
+    [OP_MODULO_EQUALS] =        { BINARY_MODULO,        PREC_TERM,          OPC_MODULO },
+    [OP_BITWISE_AND_EQUALS] =   { BINARY_BITWISE_AND,   PREC_BITWISE_AND,   OPC_BITWISE_AND },
+    [OP_BITWISE_OR_EQUALS] =    { BINARY_BITWISE_OR,    PREC_BITWISE_OR,    OPC_BITWISE_OR },
+    [OP_BITWISE_XOR_EQUALS] =   { BINARY_BITWISE_XOR,   PREC_BITWISE_XOR,   OPC_BITWISE_XOR },
+    [OP_SHIFT_LEFT_EQUALS] =    { BINARY_SHIFT_LEFT,    PREC_BIT_SHIFT,     OPC_SHIFT_LEFT },
+    [OP_SHIFT_RIGHT_EQUALS] =   { BINARY_SHIFT_RIGHT,   PREC_BIT_SHIFT,     OPC_SHIFT_RIGHT },
+};
+
+/* the single pass compiler leaves any input needing a larger opcode
+ * argument than this to the full pipeline */
+static const size_t PARSER_COMPILE_ARG_MAX = 0x7fff;
+static const size_t PARSER_COMPILE_DEFAULT_CAP = 16;
+
+typedef struct {
+    bool declared;                          /** true once the name has been declared */
+    int index;                              /** index of the name in the identifier table, or -1 */
+} ParserCompileName;
+
+typedef struct {
+    ms_Parser *prs;                         /** parser supplying tokens */
+    ms_VMOpCode *code;                      /** opcodes emitted so far */
+    size_t nops;                            /** number of opcodes */
+    size_t opcap;                           /** capacity of the opcode array */
+    ms_VMValue *values;                     /** constant values emitted so far */
+    size_t nvals;                           /** number of values */
+    size_t valcap;                          /** capacity of the value array */
+    DSBuffer **idents;                      /** interned identifiers emitted so far */
+    size_t nidents;                         /** number of identifiers */
+    size_t identcap;                        /** capacity of the identifier array */
+    DSDict *names;                          /** map of interned names to their ParserCompileName */
+} ParserCompiler;
+
 static ms_Result ParserParseModule(ms_Parser *prs, ms_Module **module);
 static ms_Result ParserParseStatement(ms_Parser *prs, ms_Stmt **stmt);
 static ms_Result ParserParseBlock(ms_Parser *prs, ms_StmtBlock **block);
@@ -84,17 +187,7 @@ static ms_Result ParserParseExpression(ms_Parser *prs, ms_Expr **expr);
 static ms_Result ParserParseSelectExpr(ms_Parser *prs, ms_Expr **expr);
 static ms_Result ParserParseSelectBody(ms_Parser *prs, bool saw_full_pair, ms_Expr **select);
 static ms_Result ParserParseConditionalExpr(ms_Parser *prs, ms_Expr **expr);
-static ms_Result ParserParseOrExpr(ms_Parser *prs, ms_Expr **expr);
-static ms_Result ParserParseAndExpr(ms_Parser *prs, ms_Expr **expr);
-static ms_Result ParserParseEqualityExpr(ms_Parser *prs, ms_Expr **expr);
-static ms_Result ParserParseComparisonExpr(ms_Parser *prs, ms_Expr **expr);
-static ms_Result ParserParseBitwiseOrExpr(ms_Parser *prs, ms_Expr **expr);
-static ms_Result ParserParseBitwiseXorExpr(ms_Parser *prs, ms_Expr **expr);
-static ms_Result ParserParseBitwiseAndExpr(ms_Parser *prs, ms_Expr **expr);
-static ms_Result ParserParseBitShiftExpr(ms_Parser *prs, ms_Expr **expr);
-static ms_Result ParserParseArithmeticExpr(ms_Parser *prs, ms_Expr **expr);
-static ms_Result ParserParseTermExpr(ms_Parser *prs, ms_Expr **expr);
-static ms_Result ParserParsePowerExpr(ms_Parser *prs, ms_Expr **expr);
+static ms_Result ParserParseBinaryExpr(ms_Parser *prs, ParserPrecedence minprec, ms_Expr **expr);
 static ms_Result ParserParseUnaryExpr(ms_Parser *prs, ms_Expr **expr);
 static ms_Result ParserParseAtomExpr(ms_Parser *prs, ms_Expr **expr);
 static ms_Result ParserParseAccessor(ms_Parser *prs, ms_Expr **expr, ms_ExprBinaryOp *op);
@@ -107,13 +200,29 @@ static ms_Result ParserExprRewriteAttrAccess(ms_Parser *prs, ms_Expr *left, ms_E
 static ms_Result ParserExprCombineConditional(ms_Parser *prs, ms_Expr *cond, ms_Expr *iftrue, ms_Expr *iffalse, ms_Expr **newexpr);
 static ms_Result ParserExprCombineBinary(ms_Parser *prs, ms_Expr *left, ms_ExprBinaryOp op, ms_Expr *right, ms_Expr **newexpr);
 static ms_Result ParserExprCombineUnary(ms_Parser *prs, ms_Expr *inner, ms_ExprUnaryOp op, ms_Expr **newexpr);
+static bool ParserCompileStatement(ParserCompiler *c);
+static bool ParserCompileDeclaration(ParserCompiler *c);
+static bool ParserCompileAssignment(ParserCompiler *c);
+static bool ParserCompileTerminator(ParserCompiler *c);
+static bool ParserCompileExpr(ParserCompiler *c, ParserPrecedence minprec);
+static bool ParserCompileUnaryExpr(ParserCompiler *c);
+static bool ParserCompileAtom(ParserCompiler *c);
+static ParserCompileName *ParserCompileLookup(ParserCompiler *c, const ms_TokenView *tok, DSBuffer **name);
+static bool ParserCompileIdent(ParserCompiler *c, DSBuffer *name, ParserCompileName *entry, size_t *index);
+static bool ParserCompileValue(ParserCompiler *c, ms_VMValue val);
+static bool ParserCompileEmit(ParserCompiler *c, ms_VMOpCodeType type, size_t arg);
+static bool ParserCompilerGrow(void **data, size_t *cap, size_t len, size_t size);
+static void ParserCompilerClean(ParserCompiler *c);
 static bool ParserIdentIsInvalidAssignmentTarget(ms_ExprIdentType type);
+static bool ParserReset(ms_Parser *prs);
+static bool ParserArenaReset(ms_Parser *prs);
 
-static inline ms_Token *ParserAdvanceToken(ms_Parser *prs);
+static const ms_TokenView *ParserLexToken(ms_Parser *prs, ParserTokenSlot *slot);
+static DSBuffer *ParserTokenText(const ms_TokenView *tok);
 static inline void ParserConsumeToken(ms_Parser *prs);
 static inline bool ParserExpectToken(ms_Parser *prs, ms_TokenType type);
 static inline bool ParserExpectTokenAny(ms_Parser *prs, ms_TokenType type[], size_t n);
-static void ParserErrorSet(ms_Parser *prs, const char* msg, const ms_Token *tok, ...);
+static void ParserErrorSet(ms_Parser *prs, const char* msg, const ms_TokenView *tok, ...);
 static void ParserErrorClear(ms_Parser *prs);
 
 /*
@@ -121,21 +230,32 @@ static void ParserErrorClear(ms_Parser *prs);
  */
 
 ms_Parser *ms_ParserNew(void) {
-    ms_Parser * prs = malloc(sizeof(ms_Parser));
+    ms_Parser * prs = dsalloc(sizeof(ms_Parser));
     if (!prs) {
         return NULL;
     }
 
+    for (size_t i = 0; i < PARSER_TOKEN_RING_SIZE; i++) {
+        prs->ring[i].text = NULL;
+        prs->ring[i].cap = 0;
+    }
+    prs->head = 0;
+    prs->cur = NULL;
+    prs->nxt = NULL;
+    prs->err = NULL;
+    prs->lex = NULL;
+
+    prs->arena = ms_ASTArenaNew();
+    if (!prs->arena) {
+        ms_ParserDestroy(prs);
+        return NULL;
+    }
+
     prs->lex = ms_LexerNew();
     if (!prs->lex) {
         ms_ParserDestroy(prs);
         return NULL;
     }
-
-    prs->cur = NULL;
-    prs->nxt = NULL;
-    prs->ast = NULL;
-    prs->err = NULL;
     return prs;
 }
 
@@ -148,21 +268,19 @@ bool ms_ParserInitFile(ms_Parser *prs, const char *fname) {
         return false;
     }
 
-    ms_TokenDestroy(prs->cur);
-    prs->cur = ms_LexerNextToken(prs->lex);
-    if (!prs->cur) {
+    return ParserReset(prs);
+}
+
+bool ms_ParserInitFileHandle(ms_Parser *prs, FILE *file) {
+    if (!prs) {
         return false;
     }
-    prs->line = prs->cur->line;
-    prs->col = prs->cur->col;
 
-    ms_TokenDestroy(prs->nxt);
-    prs->nxt = ms_LexerNextToken(prs->lex);
+    if (!ms_LexerInitFileHandle(prs->lex, file)) {
+        return false;
+    }
 
-    ms_ASTDestroy(prs->ast);
-    prs->ast = NULL;
-    prs->err = NULL;
-    return true;
+    return ParserReset(prs);
 }
 
 bool ms_ParserInitString(ms_Parser *prs, const char *str) {
@@ -178,21 +296,7 @@ bool ms_ParserInitStringL(ms_Parser *prs, const char *str, size_t len) {
         return false;
     }
 
-    ms_TokenDestroy(prs->cur);
-    prs->cur = ms_LexerNextToken(prs->lex);
-    if (!prs->cur) {
-        return false;
-    }
-    prs->line = prs->cur->line;
-    prs->col = prs->cur->col;
-
-    ms_TokenDestroy(prs->nxt);
-    prs->nxt = ms_LexerNextToken(prs->lex);
-
-    ms_ASTDestroy(prs->ast);
-    prs->ast = NULL;
-    prs->err = NULL;
-    return true;
+    return ParserReset(prs);
 }
 
 ms_Result ms_ParserParse(ms_Parser *prs, const ms_AST **ast, ms_Error **err) {
@@ -200,41 +304,90 @@ ms_Result ms_ParserParse(ms_Parser *prs, const ms_AST **ast, ms_Error **err) {
     assert(ast);
     assert(err);
 
-    if (prs->ast) {
-        ms_ASTDestroy(prs->ast);
-        prs->ast = NULL;
-    }
-
     *err = NULL;
     prs->err = err;
-    ms_Result res = ParserParseModule(prs, &prs->ast);
+    if (!ParserArenaReset(prs)) {
+        ParserErrorSet(prs, ERR_OUT_OF_MEMORY, prs->cur);
+        return MS_RESULT_ERROR;
+    }
+
+    /* expressions and identifiers are pooled by size class in the arena's pool */
+    DSPool *prev = ms_ASTPoolSwap(prs->arena->pool);
+    ms_Result res = ParserParseModule(prs, &prs->arena->ast);
+    ms_ASTPoolSwap(prev);
 
     if (res == MS_RESULT_ERROR) {
         return res;
     } else {
         if (prs->cur) {
             ParserErrorSet(prs, ERR_INVALID_SYNTAX_GOT_TOK, prs->cur,
-                           dsbuf_char_ptr(prs->cur->value), prs->line, prs->col);
+                           prs->cur->text, prs->line, prs->col);
             return MS_RESULT_ERROR;
         }
     }
 
-    *ast = prs->ast;
+    *ast = prs->arena->ast;
     return res;
 }
 
+bool ms_ParserCompile(ms_Parser *prs, ms_VMByteCode **code) {
+    assert(prs);
+    assert(code);
+
+    *code = NULL;
+    ParserCompiler c = { .prs = prs };
+    c.names = dsdict_new((dsdict_hash_fn)ms_InternHash,
+                         (dsdict_compare_fn)ms_InternCompare,
+                         (dsdict_free_fn)ms_InternRelease,
+                         (dsdict_free_fn)dsfree);
+    if (!c.names) {
+        return false;
+    }
+
+    bool compiled = true;
+    while ((compiled) && (prs->cur)) {
+        compiled = ParserCompileStatement(&c);
+    }
+
+    if (compiled) {
+        *code = ms_VMByteCodeNew(c.code, c.nops, c.values, c.nvals, c.idents, c.nidents);
+        if (*code) {
+            c.code = NULL;
+            c.values = NULL;
+            c.nvals = 0;
+            c.idents = NULL;
+            c.nidents = 0;
+        }
+    }
+
+    ParserCompilerClean(&c);
+    return (*code != NULL);
+}
+
+ms_ASTArena *ms_ParserArena(ms_Parser *prs) {
+    assert(prs);
+    return prs->arena;
+}
+
+void ms_ParserCloseInput(ms_Parser *prs) {
+    if (!prs) { return; }
+    ms_LexerCloseInput(prs->lex);
+}
+
 void ms_ParserDestroy(ms_Parser *prs) {
     if (!prs) { return; }
     ms_LexerDestroy(prs->lex);
     prs->lex = NULL;
-    ms_TokenDestroy(prs->cur);
+    for (size_t i = 0; i < PARSER_TOKEN_RING_SIZE; i++) {
+        dsfree(prs->ring[i].text);
+        prs->ring[i].text = NULL;
+    }
     prs->cur = NULL;
-    ms_TokenDestroy(prs->nxt);
     prs->nxt = NULL;
-    ms_ASTDestroy(prs->ast);
-    prs->ast = NULL;
+    ms_ASTArenaRelease(prs->arena);
+    prs->arena = NULL;
     prs->err = NULL;
-    free(prs);
+    dsfree(prs);
 }
 
 /*
@@ -332,14 +485,14 @@ static ms_Result ParserParseStatement(ms_Parser *prs, ms_Stmt **stmt) {
     assert(stmt);
 
     ms_Result res;
-    ms_Token *cur = prs->cur;
+    const ms_TokenView *cur = prs->cur;
 
     if (!cur) {
         ParserErrorSet(prs, ERR_EXPECTED_STATEMENT, NULL, prs->line, prs->col);
         return MS_RESULT_ERROR;
     }
 
-    *stmt = calloc(1, sizeof(ms_Stmt));
+    *stmt = dscalloc(1, sizeof(ms_Stmt));
     if (!(*stmt)) {
         ParserErrorSet(prs, ERR_OUT_OF_MEMORY, prs->cur);
         return MS_RESULT_ERROR;
@@ -448,7 +601,7 @@ static ms_Result ParserParseDeleteStatement(ms_Parser *prs, ms_StmtDelete **del)
     assert(prs);
     assert(del);
 
-    *del = calloc(1, sizeof(ms_StmtDelete));
+    *del = dscalloc(1, sizeof(ms_StmtDelete));
     if (!(*del)) {
         ParserErrorSet(prs, ERR_OUT_OF_MEMORY, prs->cur);
         return MS_RESULT_ERROR;
@@ -471,7 +624,7 @@ static ms_Result ParserParseForStatement(ms_Parser *prs, ms_StmtFor **forstmt) {
     assert(prs);
     assert(forstmt);
 
-    *forstmt = calloc(1, sizeof(ms_StmtFor));
+    *forstmt = dscalloc(1, sizeof(ms_StmtFor));
     if (!(*forstmt)) {
         ParserErrorSet(prs, ERR_OUT_OF_MEMORY, prs->cur);
         return MS_RESULT_ERROR;
@@ -541,7 +694,7 @@ static ms_Result ParserParseForIncrement(ms_Parser *prs, ms_Expr *ident, bool de
         }
     }
 
-    *inc = calloc(1, sizeof(ms_StmtForIncrement));
+    *inc = dscalloc(1, sizeof(ms_StmtForIncrement));
     if (!(*inc)) {
         ParserErrorSet(prs, ERR_OUT_OF_MEMORY, prs->cur);
         return MS_RESULT_ERROR;
@@ -607,7 +760,7 @@ static ms_Result ParserParseForIterator(ms_Parser *prs, ms_Expr *ident, bool dec
         }
     }
 
-    *iter = calloc(1, sizeof(ms_StmtForIterator));
+    *iter = dscalloc(1, sizeof(ms_StmtForIterator));
     if (!(*iter)) {
         ParserErrorSet(prs, ERR_OUT_OF_MEMORY, prs->cur);
         return MS_RESULT_ERROR;
@@ -627,7 +780,7 @@ static ms_Result ParserParseForExpr(ms_Parser *prs, ms_Expr *expr, ms_StmtForExp
     assert(expr);
     assert(forexpr);
 
-    *forexpr = calloc(1, sizeof(ms_StmtForExpr));
+    *forexpr = dscalloc(1, sizeof(ms_StmtForExpr));
     if (!(*forexpr)) {
         ms_ExprDestroy(expr);
         ParserErrorSet(prs, ERR_OUT_OF_MEMORY, prs->cur);
@@ -641,7 +794,7 @@ static ms_Result ParserParseIfStatement(ms_Parser *prs, ms_StmtIf **ifstmt) {
     assert(prs);
     assert(ifstmt);
 
-    *ifstmt = calloc(1, sizeof(ms_StmtIf));
+    *ifstmt = dscalloc(1, sizeof(ms_StmtIf));
     if (!(*ifstmt)) {
         ParserErrorSet(prs, ERR_OUT_OF_MEMORY, prs->cur);
         return MS_RESULT_ERROR;
@@ -672,7 +825,7 @@ static ms_Result ParserParseElseStatement(ms_Parser *prs, ms_StmtIfElse **elif)
     assert(prs);
     assert(elif);
 
-    *elif = calloc(1, sizeof(ms_StmtIfElse));
+    *elif = dscalloc(1, sizeof(ms_StmtIfElse));
     if (!(*elif)) {
         ParserErrorSet(prs, ERR_OUT_OF_MEMORY, prs->cur);
         return MS_RESULT_ERROR;
@@ -689,7 +842,7 @@ static ms_Result ParserParseElseStatement(ms_Parser *prs, ms_StmtIfElse **elif)
         return ParserParseIfStatement(prs, &(*elif)->clause.ifstmt);
     }
 
-    (*elif)->clause.elstmt = malloc(sizeof(ms_StmtElse));
+    (*elif)->clause.elstmt = dsalloc(sizeof(ms_StmtElse));
     if (!(*elif)->clause.elstmt) {
         ParserErrorSet(prs, ERR_OUT_OF_MEMORY, prs->cur);
         return MS_RESULT_ERROR;
@@ -703,7 +856,7 @@ static ms_Result ParserParseImportStatement(ms_Parser *prs, ms_StmtImport **impo
     assert(prs);
     assert(import);
 
-    *import = calloc(1, sizeof(ms_StmtImport));
+    *import = dscalloc(1, sizeof(ms_StmtImport));
     if (!(*import)) {
         ParserErrorSet(prs, ERR_OUT_OF_MEMORY, prs->cur);
         return MS_RESULT_ERROR;
@@ -736,16 +889,12 @@ static ms_Result ParserParseImportStatement(ms_Parser *prs, ms_StmtImport **impo
         return MS_RESULT_ERROR;
     }
 
-    /* steal the identifier from the token */
-    (*import)->alias = malloc(sizeof(ms_Ident));
+    /* copy the identifier from the token */
+    (*import)->alias = ms_IdentNew(prs->cur->text, prs->cur->len);
     if (!(*import)->alias) {
         ParserErrorSet(prs, ERR_OUT_OF_MEMORY, prs->cur);
         return MS_RESULT_ERROR;
     }
-
-    (*import)->alias->name = prs->cur->value;
-    (*import)->alias->type = ms_IdentGetType(dsbuf_char_ptr(prs->cur->value));
-    prs->cur->value = NULL;
     ParserConsumeToken(prs);
     return ParserParseStatementTerminator(prs);
 }
@@ -754,7 +903,7 @@ static ms_Result ParserParseReturnStatement(ms_Parser *prs, ms_StmtReturn **ret)
     assert(prs);
     assert(ret);
 
-    *ret = calloc(1, sizeof(ms_StmtReturn));
+    *ret = dscalloc(1, sizeof(ms_StmtReturn));
     if (!(*ret)) {
         ParserErrorSet(prs, ERR_OUT_OF_MEMORY, prs->cur);
         return MS_RESULT_ERROR;
@@ -790,7 +939,7 @@ static ms_Result ParserParseFunctionDeclaration(ms_Parser *prs, ms_StmtDeclarati
     assert(prs);
     assert(decl);
 
-    *decl = calloc(1, sizeof(ms_StmtDeclaration));
+    *decl = dscalloc(1, sizeof(ms_StmtDeclaration));
     if (!(*decl)) {
         ParserErrorSet(prs, ERR_OUT_OF_MEMORY, prs->cur);
         return MS_RESULT_ERROR;
@@ -801,17 +950,11 @@ static ms_Result ParserParseFunctionDeclaration(ms_Parser *prs, ms_StmtDeclarati
     }
 
     const ms_Ident *ident = (*decl)->expr->cmpnt.u->atom.val.val.fn->ident;  /* just... lol */
-    (*decl)->ident = malloc(sizeof(ms_Ident));
+    (*decl)->ident = ms_IdentNew(dsbuf_char_ptr(ident->name), dsbuf_len(ident->name));
     if (!(*decl)->ident) {
         return MS_RESULT_ERROR;
     }
 
-    (*decl)->ident->name = dsbuf_dup(ident->name);
-    (*decl)->ident->type = ident->type;
-    if (!(*decl)->ident->name) {
-        return MS_RESULT_ERROR;
-    }
-
     return MS_RESULT_SUCCESS;
 }
 
@@ -819,7 +962,7 @@ static ms_Result ParserParseDeclaration(ms_Parser *prs, bool req_keyword, ms_Stm
     assert(prs);
     assert(decl);
 
-    *decl = calloc(1, sizeof(ms_StmtDeclaration));
+    *decl = dscalloc(1, sizeof(ms_StmtDeclaration));
     if (!(*decl)) {
         ParserErrorSet(prs, ERR_OUT_OF_MEMORY, prs->cur);
         return MS_RESULT_ERROR;
@@ -836,16 +979,12 @@ static ms_Result ParserParseDeclaration(ms_Parser *prs, bool req_keyword, ms_Stm
         return MS_RESULT_ERROR;
     }
 
-    /* take the identifier from the current token so the buffer isn't destroyed */
-    (*decl)->ident = malloc(sizeof(ms_Ident));
+    /* copy the identifier from the current token */
+    (*decl)->ident = ms_IdentNew(prs->cur->text, prs->cur->len);
     if (!(*decl)->ident) {
         ParserErrorSet(prs, ERR_OUT_OF_MEMORY, prs->cur);
         return MS_RESULT_ERROR;
     }
-
-    (*decl)->ident->name = prs->cur->value;
-    (*decl)->ident->type = ms_IdentGetType(dsbuf_char_ptr(prs->cur->value));
-    prs->cur->value = NULL;
     ParserConsumeToken(prs);
 
     /* allow a declaration without initialization */
@@ -945,7 +1084,7 @@ static ms_Result ParserParseSimpleAssignment(ms_Parser *prs, ms_Expr *name, ms_S
     assert(stmt);
 
     ParserConsumeToken(prs);
-    (*stmt)->cmpnt.assign = calloc(1, sizeof(ms_StmtAssignment));
+    (*stmt)->cmpnt.assign = dscalloc(1, sizeof(ms_StmtAssignment));
     if (!((*stmt)->cmpnt.assign)) {
         ms_ExprDestroy(name);
         ParserErrorSet(prs, ERR_OUT_OF_MEMORY, prs->cur);
@@ -953,7 +1092,7 @@ static ms_Result ParserParseSimpleAssignment(ms_Parser *prs, ms_Expr *name, ms_S
     }
 
     (*stmt)->type = STMTTYPE_ASSIGNMENT;
-    (*stmt)->cmpnt.assign->ident = malloc(sizeof(ms_StmtAssignTarget));
+    (*stmt)->cmpnt.assign->ident = dsalloc(sizeof(ms_StmtAssignTarget));
     if (!(*stmt)->cmpnt.assign->ident) {
         ms_ExprDestroy(name);
         ParserErrorSet(prs, ERR_OUT_OF_MEMORY, prs->cur);
@@ -962,7 +1101,7 @@ static ms_Result ParserParseSimpleAssignment(ms_Parser *prs, ms_Expr *name, ms_S
     (*stmt)->cmpnt.assign->ident->target = name;
     (*stmt)->cmpnt.assign->ident->next = NULL;
 
-    (*stmt)->cmpnt.assign->expr = malloc(sizeof(ms_StmtAssignExpr));
+    (*stmt)->cmpnt.assign->expr = dsalloc(sizeof(ms_StmtAssignExpr));
     if (!(*stmt)->cmpnt.assign->expr) {
         ParserErrorSet(prs, ERR_OUT_OF_MEMORY, prs->cur);
         return MS_RESULT_ERROR;
@@ -978,7 +1117,7 @@ static ms_Result ParserParseMultipleAssignment(ms_Parser *prs, ms_Expr *first, m
     assert(first);
     assert(stmt);
 
-    (*stmt)->cmpnt.assign = calloc(1, sizeof(ms_StmtAssignment));
+    (*stmt)->cmpnt.assign = dscalloc(1, sizeof(ms_StmtAssignment));
     if (!((*stmt)->cmpnt.assign)) {
         ms_ExprDestroy(first);
         ParserErrorSet(prs, ERR_OUT_OF_MEMORY, prs->cur);
@@ -987,7 +1126,7 @@ static ms_Result ParserParseMultipleAssignment(ms_Parser *prs, ms_Expr *first, m
     (*stmt)->type = STMTTYPE_ASSIGNMENT;
 
     /* initial assignment target */
-    (*stmt)->cmpnt.assign->ident = malloc(sizeof(ms_StmtAssignTarget));
+    (*stmt)->cmpnt.assign->ident = dsalloc(sizeof(ms_StmtAssignTarget));
     if (!(*stmt)->cmpnt.assign->ident) {
         ms_ExprDestroy(first);
         ParserErrorSet(prs, ERR_OUT_OF_MEMORY, prs->cur);
@@ -1002,7 +1141,7 @@ static ms_Result ParserParseMultipleAssignment(ms_Parser *prs, ms_Expr *first, m
     do {
         ParserConsumeToken(prs);
 
-        *target = malloc(sizeof(ms_StmtAssignTarget));
+        *target = dsalloc(sizeof(ms_StmtAssignTarget));
         if (!(*target)) {
             ParserErrorSet(prs, ERR_OUT_OF_MEMORY, prs->cur);
             return MS_RESULT_ERROR;
@@ -1041,7 +1180,7 @@ static ms_Result ParserParseMultipleAssignment(ms_Parser *prs, ms_Expr *first, m
             }
         }
 
-        *expr = malloc(sizeof(ms_StmtAssignExpr));
+        *expr = dsalloc(sizeof(ms_StmtAssignExpr));
         if (!(*expr)) {
             ParserErrorSet(prs, ERR_OUT_OF_MEMORY, prs->cur);
             return MS_RESULT_ERROR;
@@ -1065,26 +1204,15 @@ static ms_Result ParserParseCompoundAssignment(ms_Parser *prs, ms_Expr *name, ms
     assert(stmt);
 
     /* translate compound operator to binary op */
-    ms_ExprBinaryOp op;
-    switch (prs->cur->type) {
-        case OP_PLUS_EQUALS:            op = BINARY_PLUS;           break;
-        case OP_MINUS_EQUALS:           op = BINARY_MINUS;          break;
-        case OP_TIMES_EQUALS:           op = BINARY_TIMES;          break;
-        case OP_DIVIDE_EQUALS:          op = BINARY_DIVIDE;         break;
-        case OP_IDIVIDE_EQUALS:         op = BINARY_IDIVIDE;        break;
-        case OP_MODULO_EQUALS:          op = BINARY_MODULO;         break;
-        case OP_BITWISE_AND_EQUALS:     op = BINARY_BITWISE_AND;    break;
-        case OP_BITWISE_OR_EQUALS:      op = BINARY_BITWISE_OR;     break;
-        case OP_BITWISE_XOR_EQUALS:     op = BINARY_BITWISE_XOR;    break;
-        case OP_SHIFT_LEFT_EQUALS:      op = BINARY_SHIFT_LEFT;     break;
-        case OP_SHIFT_RIGHT_EQUALS:     op = BINARY_SHIFT_RIGHT;    break;
-        default:
-            ParserErrorSet(prs, ERR_EXPECTED_ASSIGNMENT, prs->cur, prs->line, prs->col);
-            return MS_RESULT_ERROR;
+    const ParserBinaryOp *compound = &COMPOUND_OPS[prs->cur->type];
+    if (compound->prec == PREC_NONE) {
+        ParserErrorSet(prs, ERR_EXPECTED_ASSIGNMENT, prs->cur, prs->line, prs->col);
+        return MS_RESULT_ERROR;
     }
+    ms_ExprBinaryOp op = compound->op;
 
     ParserConsumeToken(prs);
-    (*stmt)->cmpnt.assign = calloc(1, sizeof(ms_StmtAssignment));
+    (*stmt)->cmpnt.assign = dscalloc(1, sizeof(ms_StmtAssignment));
     if (!((*stmt)->cmpnt.assign)) {
         ms_ExprDestroy(name);
         ParserErrorSet(prs, ERR_OUT_OF_MEMORY, prs->cur);
@@ -1092,7 +1220,7 @@ static ms_Result ParserParseCompoundAssignment(ms_Parser *prs, ms_Expr *name, ms
     }
 
     (*stmt)->type = STMTTYPE_ASSIGNMENT;
-    (*stmt)->cmpnt.assign->ident = malloc(sizeof(ms_StmtAssignTarget));
+    (*stmt)->cmpnt.assign->ident = dsalloc(sizeof(ms_StmtAssignTarget));
     if (!(*stmt)->cmpnt.assign->ident) {
         ms_ExprDestroy(name);
         ParserErrorSet(prs, ERR_OUT_OF_MEMORY, prs->cur);
@@ -1107,14 +1235,9 @@ static ms_Result ParserParseCompoundAssignment(ms_Parser *prs, ms_Expr *name, ms
         return MS_RESULT_ERROR;
     }
 
-    /* duplicate the identifier expression being set to be used in
-     * the left piece of the resulting compound expression */
-    ms_Expr *left = ms_ExprDup(name);
-    if (!left) {
-        ms_ExprDestroy(right);
-        ParserErrorSet(prs, ERR_OUT_OF_MEMORY, prs->cur);
-        return MS_RESULT_ERROR;
-    }
+    /* the identifier expression being set is shared with the left
+     * piece of the resulting compound expression */
+    ms_Expr *left = ms_ExprRetain(name);
 
     /* combine the two pieces of the compound expression */
     ms_Expr *combined;
@@ -1124,7 +1247,7 @@ static ms_Result ParserParseCompoundAssignment(ms_Parser *prs, ms_Expr *name, ms
         return MS_RESULT_ERROR;
     }
 
-    (*stmt)->cmpnt.assign->expr = malloc(sizeof(ms_StmtAssignExpr));
+    (*stmt)->cmpnt.assign->expr = dsalloc(sizeof(ms_StmtAssignExpr));
     if (!(*stmt)->cmpnt.assign->expr) {
         ms_ExprDestroy(combined);
         ParserErrorSet(prs, ERR_OUT_OF_MEMORY, prs->cur);
@@ -1246,7 +1369,7 @@ static ms_Result ParserParseConditionalExpr(ms_Parser *prs, ms_Expr **expr) {
 
     ms_Result res;
     ms_Expr *cond = NULL;
-    if ((res = ParserParseOrExpr(prs, &cond)) == MS_RESULT_ERROR) {
+    if ((res = ParserParseBinaryExpr(prs, PREC_OR, &cond)) == MS_RESULT_ERROR) {
         *expr = cond;
         return res;
     }
@@ -1258,7 +1381,7 @@ static ms_Result ParserParseConditionalExpr(ms_Parser *prs, ms_Expr **expr) {
 
     ParserConsumeToken(prs);
     ms_Expr *iftrue = NULL;
-    if ((res = ParserParseOrExpr(prs, &iftrue)) == MS_RESULT_ERROR) {
+    if ((res = ParserParseBinaryExpr(prs, PREC_OR, &iftrue)) == MS_RESULT_ERROR) {
         ms_ExprDestroy(cond);
         return res;
     }
@@ -1272,7 +1395,7 @@ static ms_Result ParserParseConditionalExpr(ms_Parser *prs, ms_Expr **expr) {
 
     ParserConsumeToken(prs);
     ms_Expr *iffalse = NULL;
-    if ((res = ParserParseOrExpr(prs, &iffalse)) == MS_RESULT_ERROR) {
+    if ((res = ParserParseBinaryExpr(prs, PREC_OR, &iffalse)) == MS_RESULT_ERROR) {
         ms_ExprDestroy(cond);
         ms_ExprDestroy(iftrue);
         return res;
@@ -1290,36 +1413,46 @@ static ms_Result ParserParseConditionalExpr(ms_Parser *prs, ms_Expr **expr) {
     return res;
 }
 
-static ms_Result ParserParseOrExpr(ms_Parser *prs, ms_Expr **expr) {
+/*
+ * Binary operators are parsed by precedence climbing rather than by one
+ * function per grammar level. Each operand is a unary expression; the
+ * loop folds operators binding at least as tightly as `minprec` into the
+ * left operand, parsing the right operand at the next tighter level so
+ * operators of equal precedence associate to the left.
+ *
+ * The exception is '**', whose right operand is parsed at the term level
+ * (as in the grammar above), so it is right associative and `a ** b * c`
+ * is parsed as `a ** (b * c)`.
+ */
+static ms_Result ParserParseBinaryExpr(ms_Parser *prs, ParserPrecedence minprec, ms_Expr **expr) {
     assert(prs);
     assert(expr);
+    assert(minprec > PREC_NONE);
 
     ms_Result res;
     ms_Expr *left = NULL;
-    if ((res = ParserParseAndExpr(prs, &left)) == MS_RESULT_ERROR) {
+    if ((res = ParserParseUnaryExpr(prs, &left)) == MS_RESULT_ERROR) {
         *expr = left;
         return res;
     }
 
     while (prs->cur) {
-        ms_Token *cur = prs->cur;
-        ms_ExprBinaryOp op;
-        switch (cur->type) {
-            case OP_OR:          op = BINARY_OR;             break;
-            default:
-                *expr = left;
-                return res;
+        const ParserBinaryOp *binop = &BINARY_OPS[prs->cur->type];
+        if (binop->prec < minprec) {
+            break;
         }
 
+        ParserPrecedence rprec = (binop->prec == PREC_POWER) ? PREC_TERM : binop->prec + 1;
+
         ParserConsumeToken(prs);
         ms_Expr *right = NULL;
-        if ((res = ParserParseAndExpr(prs, &right)) == MS_RESULT_ERROR) {
+        if ((res = ParserParseBinaryExpr(prs, rprec, &right)) == MS_RESULT_ERROR) {
             ms_ExprDestroy(left);
             return res;
         }
 
         ms_Expr *combined;
-        if ((res = ParserExprCombineBinary(prs, left, op, right, &combined)) == MS_RESULT_ERROR) {
+        if ((res = ParserExprCombineBinary(prs, left, binop->op, right, &combined)) == MS_RESULT_ERROR) {
             ms_ExprDestroy(left);
             ms_ExprDestroy(right);
             return res;
@@ -1331,81 +1464,90 @@ static ms_Result ParserParseOrExpr(ms_Parser *prs, ms_Expr **expr) {
     return res;
 }
 
-static ms_Result ParserParseAndExpr(ms_Parser *prs, ms_Expr **expr) {
+static ms_Result ParserParseUnaryExpr(ms_Parser *prs, ms_Expr **expr) {
     assert(prs);
     assert(expr);
 
-    ms_Result res;
-    ms_Expr *left = NULL;
-    if ((res = ParserParseEqualityExpr(prs, &left)) == MS_RESULT_ERROR) {
-        *expr = left;
-        return res;
-    }
+    ms_Result res = MS_RESULT_ERROR;
+    *expr = NULL;
 
-    while (prs->cur) {
-        ms_Token *cur = prs->cur;
-        ms_ExprBinaryOp op;
+    if (prs->cur) {
+        const ms_TokenView *cur = prs->cur;
+        ms_ExprUnaryOp op;
         switch (cur->type) {
-            case OP_AND:          op = BINARY_AND;             break;
+            case OP_BITWISE_NOT:        op = UNARY_BITWISE_NOT;     break;
+            case OP_NOT:                op = UNARY_NOT;             break;
+            case OP_MINUS:              /* fallthrough */
+            case OP_UMINUS:             op = UNARY_MINUS;           break;
             default:
-                *expr = left;
-                return res;
+                if ((res = ParserParseAtomExpr(prs, expr)) == MS_RESULT_ERROR) {
+                    return res;
+                }
+                goto parse_unary_expr_end_loop;
         }
 
         ParserConsumeToken(prs);
-        ms_Expr *right = NULL;
-        if ((res = ParserParseEqualityExpr(prs, &right)) == MS_RESULT_ERROR) {
-            ms_ExprDestroy(left);
+
+        ms_Expr *inner = NULL;
+        if ((res = ParserParseUnaryExpr(prs, &inner)) == MS_RESULT_ERROR) {
+            ms_ExprDestroy(inner);
             return res;
         }
-
-        ms_Expr *combined;
-        if ((res = ParserExprCombineBinary(prs, left, op, right, &combined)) == MS_RESULT_ERROR) {
-            ms_ExprDestroy(left);
-            ms_ExprDestroy(right);
+        if ((res = ParserExprCombineUnary(prs, inner, op, expr)) == MS_RESULT_ERROR) {
+            ms_ExprDestroy(inner);
             return res;
         }
-        left = combined;
     }
 
-    *expr = left;
+parse_unary_expr_end_loop:
+    if (!(*expr)) {
+        ParserErrorSet(prs, ERR_EXPECTED_EXPRESSION, NULL, prs->line, prs->col);
+    }
+
     return res;
 }
 
-static ms_Result ParserParseEqualityExpr(ms_Parser *prs, ms_Expr **expr) {
+static ms_Result ParserParseAtomExpr(ms_Parser *prs, ms_Expr **expr) {
     assert(prs);
     assert(expr);
 
     ms_Result res;
     ms_Expr *left = NULL;
-    if ((res = ParserParseComparisonExpr(prs, &left)) == MS_RESULT_ERROR) {
+    if ((res = ParserParseAtom(prs, &left)) == MS_RESULT_ERROR) {
         *expr = left;
         return res;
     }
 
-    while (prs->cur) {
-        ms_Token *cur = prs->cur;
-        ms_ExprBinaryOp op;
-        switch (cur->type) {
-            case OP_DOUBLE_EQ:          op = BINARY_EQ;             break;
-            case OP_NOT_EQ:             op = BINARY_NOT_EQ;         break;
-            default:
-                *expr = left;
-                return res;
-        }
+    static ms_TokenType accessor_tokens[] = {
+        LPAREN, LBRACKET, PERIOD, OP_SAFE_REFERENCE, OP_SAFE_GETATTR
+    };
 
-        ParserConsumeToken(prs);
-        ms_Expr *right = NULL;
-        if ((res = ParserParseComparisonExpr(prs, &right)) == MS_RESULT_ERROR) {
+    while (ParserExpectTokenAny(prs, accessor_tokens, sizeof(accessor_tokens) / sizeof(accessor_tokens[0]))) {
+        ms_TokenType ttype = prs->cur->type;
+        ms_ExprBinaryOp op;
+        ms_Expr *right;
+        if ((res = ParserParseAccessor(prs, &right, &op)) == MS_RESULT_ERROR) {
             ms_ExprDestroy(left);
             return res;
         }
 
         ms_Expr *combined;
-        if ((res = ParserExprCombineBinary(prs, left, op, right, &combined)) == MS_RESULT_ERROR) {
-            ms_ExprDestroy(left);
-            ms_ExprDestroy(right);
-            return res;
+        if ((ttype == LBRACKET) || (ttype == OP_SAFE_GETATTR)) {
+            /* rewrite attribute access from an expression list to nested
+             * expressions, since that is easier to deal with in bytecode
+             * and is more representative of the actual meaning of attribute
+             * access via brackets */
+            if ((res = ParserExprRewriteAttrAccess(prs, left, op, right, &combined)) == MS_RESULT_ERROR) {
+                ms_ExprDestroy(right);
+                ms_ExprDestroy(left);
+                return res;
+            }
+        } else {
+            if ((res = ParserExprCombineBinary(prs, left, op, right, &combined)) == MS_RESULT_ERROR) {
+                ms_ExprDestroy(right);
+                ms_ExprDestroy(left);
+                return res;
+            }
         }
         left = combined;
     }
@@ -1414,500 +1556,75 @@ static ms_Result ParserParseEqualityExpr(ms_Parser *prs, ms_Expr **expr) {
     return res;
 }
 
-static ms_Result ParserParseComparisonExpr(ms_Parser *prs, ms_Expr **expr) {
+static ms_Result ParserParseAccessor(ms_Parser *prs, ms_Expr **expr, ms_ExprBinaryOp *op) {
     assert(prs);
     assert(expr);
 
-    ms_Result res;
-    ms_Expr *left = NULL;
-    if ((res = ParserParseBitwiseOrExpr(prs, &left)) == MS_RESULT_ERROR) {
-        *expr = left;
-        return res;
-    }
+    ms_TokenType type = prs->cur->type;
+    switch (type) {
+        case LPAREN:
+            ParserConsumeToken(prs);
+            *op = BINARY_CALL;
+            return ParserParseExprList(prs, expr, RPAREN);
+        case OP_SAFE_GETATTR:           /* fall through */
+        case LBRACKET:
+            ParserConsumeToken(prs);
+            *op = (type == LBRACKET) ?
+                  BINARY_GETATTR :
+                  BINARY_SAFEGETATTR;
+            return ParserParseExprList(prs, expr, RBRACKET);
+        case OP_SAFE_REFERENCE:         /* fall through */
+        case PERIOD: {
+            ParserConsumeToken(prs);
 
-    while (prs->cur) {
-        ms_Token *cur = prs->cur;
-        ms_ExprBinaryOp op;
-        switch (cur->type) {
-            case OP_GT:          op = BINARY_GT;          break;
-            case OP_GE:          op = BINARY_GE;          break;
-            case OP_LT:          op = BINARY_LT;          break;
-            case OP_LE:          op = BINARY_LE;          break;
-            default:
-                *expr = left;
-                return res;
-        }
+            if (!ParserExpectToken(prs, IDENTIFIER)) {
+                ParserErrorSet(prs, ERR_EXPECTED_IDENTIFIER, prs->cur, prs->line, prs->col);
+                return MS_RESULT_ERROR;
+            }
 
-        ParserConsumeToken(prs);
-        ms_Expr *right = NULL;
-        if ((res = ParserParseBitwiseOrExpr(prs, &right)) == MS_RESULT_ERROR) {
-            ms_ExprDestroy(left);
-            return res;
-        }
+            ms_ValData p;
+            p.s = ParserTokenText(prs->cur);
+            *expr = (p.s) ? ms_ExprNewWithVal(MSVAL_STR, p) : NULL;
+            if (!(*expr)) {
+                dsbuf_destroy(p.s);
+                ParserErrorSet(prs, ERR_OUT_OF_MEMORY, prs->cur);
+                return MS_RESULT_ERROR;
+            }
 
-        ms_Expr *combined;
-        if ((res = ParserExprCombineBinary(prs, left, op, right, &combined)) == MS_RESULT_ERROR) {
-            ms_ExprDestroy(left);
-            ms_ExprDestroy(right);
-            return res;
+            ParserConsumeToken(prs);
+            *op = (type == PERIOD) ?
+                  (BINARY_GETATTR) :
+                  (BINARY_SAFEGETATTR);
+            return MS_RESULT_SUCCESS;
         }
-        left = combined;
+        default:
+            return MS_RESULT_SUCCESS;
     }
-
-    *expr = left;
-    return res;
 }
 
-static ms_Result ParserParseBitwiseOrExpr(ms_Parser *prs, ms_Expr **expr) {
+static ms_Result ParserParseExprList(ms_Parser *prs, ms_Expr **list, ms_TokenType closer) {
     assert(prs);
-    assert(expr);
+    assert(list);
 
-    ms_Result res;
-    ms_Expr *left = NULL;
-    if ((res = ParserParseBitwiseXorExpr(prs, &left)) == MS_RESULT_ERROR) {
-        *expr = left;
-        return res;
+    DSArray *params = dsarray_new_cap(EXPRESSION_LIST_DEFAULT_CAP, NULL,
+                                      (dsarray_free_fn)ms_ExprDestroy);
+    if (!params) {
+        ParserErrorSet(prs, ERR_OUT_OF_MEMORY, prs->cur);
+        return MS_RESULT_ERROR;
     }
 
-    while (prs->cur) {
-        ms_Token *cur = prs->cur;
-        ms_ExprBinaryOp op;
-        switch (cur->type) {
-            case OP_BITWISE_OR:          op = BINARY_BITWISE_OR;          break;
-            default:
-                *expr = left;
-                return res;
-        }
+    *list = ms_ExprNewWithList(params);
+    if (!(*list)) {
+        ParserErrorSet(prs, ERR_OUT_OF_MEMORY, prs->cur);
+        dsarray_destroy(params);
+        return MS_RESULT_ERROR;
+    }
 
+    /* no parameters, close and return */
+    if ((prs->cur) && (prs->cur->type == closer)) {
         ParserConsumeToken(prs);
-        ms_Expr *right = NULL;
-        if ((res = ParserParseBitwiseXorExpr(prs, &right)) == MS_RESULT_ERROR) {
-            ms_ExprDestroy(left);
-            return res;
-        }
-
-        ms_Expr *combined;
-        if ((res = ParserExprCombineBinary(prs, left, op, right, &combined)) == MS_RESULT_ERROR) {
-            ms_ExprDestroy(left);
-            ms_ExprDestroy(right);
-            return res;
-        }
-        left = combined;
-    }
-
-    *expr = left;
-    return res;
-}
-
-static ms_Result ParserParseBitwiseXorExpr(ms_Parser *prs, ms_Expr **expr) {
-    assert(prs);
-    assert(expr);
-
-    ms_Result res;
-    ms_Expr *left;
-    if ((res = ParserParseBitwiseAndExpr(prs, &left)) == MS_RESULT_ERROR) {
-        *expr = left;
-        return res;
-    }
-
-    while (prs->cur) {
-        ms_Token *cur = prs->cur;
-        ms_ExprBinaryOp op;
-        switch (cur->type) {
-            case OP_BITWISE_XOR:          op = BINARY_BITWISE_XOR;          break;
-            default:
-                *expr = left;
-                return res;
-        }
-
-        ParserConsumeToken(prs);
-        ms_Expr *right;
-        if ((res = ParserParseBitwiseAndExpr(prs, &right)) == MS_RESULT_ERROR) {
-            return res;
-        }
-
-        ms_Expr *combined;
-        if ((res = ParserExprCombineBinary(prs, left, op, right, &combined)) == MS_RESULT_ERROR) {
-            return res;
-        }
-        left = combined;
-    }
-
-    *expr = left;
-    return res;
-}
-
-static ms_Result ParserParseBitwiseAndExpr(ms_Parser *prs, ms_Expr **expr) {
-    assert(prs);
-    assert(expr);
-
-    ms_Result res;
-    ms_Expr *left = NULL;
-    if ((res = ParserParseBitShiftExpr(prs, &left)) == MS_RESULT_ERROR) {
-        *expr = left;
-        return res;
-    }
-
-    while (prs->cur) {
-        ms_Token *cur = prs->cur;
-        ms_ExprBinaryOp op;
-        switch (cur->type) {
-            case OP_BITWISE_AND:          op = BINARY_BITWISE_AND;          break;
-            default:
-                *expr = left;
-                return res;
-        }
-
-        ParserConsumeToken(prs);
-        ms_Expr *right = NULL;
-        if ((res = ParserParseBitShiftExpr(prs, &right)) == MS_RESULT_ERROR) {
-            ms_ExprDestroy(left);
-            return res;
-        }
-
-        ms_Expr *combined;
-        if ((res = ParserExprCombineBinary(prs, left, op, right, &combined)) == MS_RESULT_ERROR) {
-            ms_ExprDestroy(left);
-            ms_ExprDestroy(right);
-            return res;
-        }
-        left = combined;
-    }
-
-    *expr = left;
-    return res;
-}
-
-static ms_Result ParserParseBitShiftExpr(ms_Parser *prs, ms_Expr **expr) {
-    assert(prs);
-    assert(expr);
-
-    ms_Result res;
-    ms_Expr *left = NULL;
-    if ((res = ParserParseArithmeticExpr(prs, &left)) == MS_RESULT_ERROR) {
-        *expr = left;
-        return res;
-    }
-
-    while (prs->cur) {
-        ms_Token *cur = prs->cur;
-        ms_ExprBinaryOp op;
-        switch (cur->type) {
-            case OP_SHIFT_LEFT:          op = BINARY_SHIFT_LEFT;          break;
-            case OP_SHIFT_RIGHT:         op = BINARY_SHIFT_RIGHT;         break;
-            default:
-                *expr = left;
-                return res;
-        }
-
-        ParserConsumeToken(prs);
-        ms_Expr *right = NULL;
-        if ((res = ParserParseArithmeticExpr(prs, &right)) == MS_RESULT_ERROR) {
-            ms_ExprDestroy(left);
-            return res;
-        }
-
-        ms_Expr *combined;
-        if ((res = ParserExprCombineBinary(prs, left, op, right, &combined)) == MS_RESULT_ERROR) {
-            ms_ExprDestroy(left);
-            ms_ExprDestroy(right);
-            return res;
-        }
-        left = combined;
-    }
-
-    *expr = left;
-    return res;
-}
-
-static ms_Result ParserParseArithmeticExpr(ms_Parser *prs, ms_Expr **expr) {
-    assert(prs);
-    assert(expr);
-
-    ms_Result res;
-    ms_Expr *left = NULL;
-    if ((res = ParserParseTermExpr(prs, &left)) == MS_RESULT_ERROR) {
-        *expr = left;
-        return res;
-    }
-
-    while (prs->cur) {
-        ms_Token *cur = prs->cur;
-        ms_ExprBinaryOp op;
-        switch (cur->type) {
-            case OP_PLUS:          op = BINARY_PLUS;          break;
-            case OP_MINUS:         op = BINARY_MINUS;         break;
-            default:
-                *expr = left;
-                return res;
-        }
-
-        ParserConsumeToken(prs);
-        ms_Expr *right = NULL;
-        if ((res = ParserParseTermExpr(prs, &right)) == MS_RESULT_ERROR) {
-            ms_ExprDestroy(left);
-            return res;
-        }
-
-        ms_Expr *combined;
-        if ((res = ParserExprCombineBinary(prs, left, op, right, &combined)) == MS_RESULT_ERROR) {
-            ms_ExprDestroy(left);
-            ms_ExprDestroy(right);
-            return res;
-        }
-        left = combined;
-    }
-
-    *expr = left;
-    return res;
-}
-
-static ms_Result ParserParseTermExpr(ms_Parser *prs, ms_Expr **expr) {
-    assert(prs);
-    assert(expr);
-
-    ms_Result res;
-    ms_Expr *left = NULL;
-    if ((res = ParserParsePowerExpr(prs, &left)) == MS_RESULT_ERROR) {
-        *expr = left;
-        return res;
-    }
-
-    while (prs->cur) {
-        ms_Token *cur = prs->cur;
-        ms_ExprBinaryOp op;
-        switch (cur->type) {
-            case OP_TIMES:          op = BINARY_TIMES;          break;
-            case OP_DIVIDE:         op = BINARY_DIVIDE;         break;
-            case OP_IDIVIDE:        op = BINARY_IDIVIDE;        break;
-            case OP_MODULO:         op = BINARY_MODULO;         break;
-            default:
-                *expr = left;
-                return res;
-        }
-
-        ParserConsumeToken(prs);
-        ms_Expr *right = NULL;
-        if ((res = ParserParsePowerExpr(prs, &right)) == MS_RESULT_ERROR) {
-            ms_ExprDestroy(left);
-            return res;
-        }
-
-        ms_Expr *combined;
-        if ((res = ParserExprCombineBinary(prs, left, op, right, &combined)) == MS_RESULT_ERROR) {
-            ms_ExprDestroy(left);
-            ms_ExprDestroy(right);
-            return res;
-        }
-        left = combined;
-    }
-
-    *expr = left;
-    return res;
-}
-
-static ms_Result ParserParsePowerExpr(ms_Parser *prs, ms_Expr **expr) {
-    assert(prs);
-    assert(expr);
-
-    ms_Result res;
-    ms_Expr *left = NULL;
-    if ((res = ParserParseUnaryExpr(prs, &left)) == MS_RESULT_ERROR) {
-        *expr = left;
-        return res;
-    }
-
-    while (prs->cur) {
-        ms_Token *cur = prs->cur;
-        ms_ExprBinaryOp op;
-        switch (cur->type) {
-            case OP_EXPONENTIATE:   op = BINARY_EXPONENTIATE;   break;
-            default:
-                *expr = left;
-                return res;
-        }
-
-        ParserConsumeToken(prs);
-        ms_Expr *right = NULL;
-        if ((res = ParserParseTermExpr(prs, &right)) == MS_RESULT_ERROR) {
-            ms_ExprDestroy(left);
-            return res;
-        }
-
-        ms_Expr *combined;
-        if ((res = ParserExprCombineBinary(prs, left, op, right, &combined)) == MS_RESULT_ERROR) {
-            ms_ExprDestroy(left);
-            ms_ExprDestroy(right);
-            return res;
-        }
-        left = combined;
-    }
-
-    *expr = left;
-    return res;
-}
-
-static ms_Result ParserParseUnaryExpr(ms_Parser *prs, ms_Expr **expr) {
-    assert(prs);
-    assert(expr);
-
-    ms_Result res = MS_RESULT_ERROR;
-    *expr = NULL;
-
-    if (prs->cur) {
-        ms_Token *cur = prs->cur;
-        ms_ExprUnaryOp op;
-        switch (cur->type) {
-            case OP_BITWISE_NOT:        op = UNARY_BITWISE_NOT;     break;
-            case OP_NOT:                op = UNARY_NOT;             break;
-            case OP_MINUS:              /* fallthrough */
-            case OP_UMINUS:             op = UNARY_MINUS;           break;
-            default:
-                if ((res = ParserParseAtomExpr(prs, expr)) == MS_RESULT_ERROR) {
-                    return res;
-                }
-                goto parse_unary_expr_end_loop;
-        }
-
-        ParserConsumeToken(prs);
-
-        ms_Expr *inner = NULL;
-        if ((res = ParserParseUnaryExpr(prs, &inner)) == MS_RESULT_ERROR) {
-            ms_ExprDestroy(inner);
-            return res;
-        }
-        if ((res = ParserExprCombineUnary(prs, inner, op, expr)) == MS_RESULT_ERROR) {
-            ms_ExprDestroy(inner);
-            return res;
-        }
-    }
-
-parse_unary_expr_end_loop:
-    if (!(*expr)) {
-        ParserErrorSet(prs, ERR_EXPECTED_EXPRESSION, NULL, prs->line, prs->col);
-    }
-
-    return res;
-}
-
-static ms_Result ParserParseAtomExpr(ms_Parser *prs, ms_Expr **expr) {
-    assert(prs);
-    assert(expr);
-
-    ms_Result res;
-    ms_Expr *left = NULL;
-    if ((res = ParserParseAtom(prs, &left)) == MS_RESULT_ERROR) {
-        *expr = left;
-        return res;
-    }
-
-    static ms_TokenType accessor_tokens[] = {
-        LPAREN, LBRACKET, PERIOD, OP_SAFE_REFERENCE, OP_SAFE_GETATTR
-    };
-
-    while (ParserExpectTokenAny(prs, accessor_tokens, sizeof(accessor_tokens) / sizeof(accessor_tokens[0]))) {
-        ms_TokenType ttype = prs->cur->type;
-        ms_ExprBinaryOp op;
-        ms_Expr *right;
-        if ((res = ParserParseAccessor(prs, &right, &op)) == MS_RESULT_ERROR) {
-            ms_ExprDestroy(left);
-            return res;
-        }
-
-        ms_Expr *combined;
-        if ((ttype == LBRACKET) || (ttype == OP_SAFE_GETATTR)) {
-            /* rewrite attribute access from an expression list to nested
-             * expressions, since that is easier to deal with in bytecode
-             * and is more representative of the actual meaning of attribute
-             * access via brackets */
-            if ((res = ParserExprRewriteAttrAccess(prs, left, op, right, &combined)) == MS_RESULT_ERROR) {
-                ms_ExprDestroy(right);
-                ms_ExprDestroy(left);
-                return res;
-            }
-        } else {
-            if ((res = ParserExprCombineBinary(prs, left, op, right, &combined)) == MS_RESULT_ERROR) {
-                ms_ExprDestroy(right);
-                ms_ExprDestroy(left);
-                return res;
-            }
-        }
-        left = combined;
-    }
-
-    *expr = left;
-    return res;
-}
-
-static ms_Result ParserParseAccessor(ms_Parser *prs, ms_Expr **expr, ms_ExprBinaryOp *op) {
-    assert(prs);
-    assert(expr);
-
-    ms_TokenType type = prs->cur->type;
-    switch (type) {
-        case LPAREN:
-            ParserConsumeToken(prs);
-            *op = BINARY_CALL;
-            return ParserParseExprList(prs, expr, RPAREN);
-        case OP_SAFE_GETATTR:           /* fall through */
-        case LBRACKET:
-            ParserConsumeToken(prs);
-            *op = (type == LBRACKET) ?
-                  BINARY_GETATTR :
-                  BINARY_SAFEGETATTR;
-            return ParserParseExprList(prs, expr, RBRACKET);
-        case OP_SAFE_REFERENCE:         /* fall through */
-        case PERIOD: {
-            ParserConsumeToken(prs);
-
-            if (!ParserExpectToken(prs, IDENTIFIER)) {
-                ParserErrorSet(prs, ERR_EXPECTED_IDENTIFIER, prs->cur, prs->line, prs->col);
-                return MS_RESULT_ERROR;
-            }
-
-            ms_ValData p;
-            p.s = prs->cur->value;
-            prs->cur->value = NULL;
-            *expr = ms_ExprNewWithVal(MSVAL_STR, p);
-            if (!(*expr)) {
-                ParserErrorSet(prs, ERR_OUT_OF_MEMORY, prs->cur);
-                return MS_RESULT_ERROR;
-            }
-
-            ParserConsumeToken(prs);
-            *op = (type == PERIOD) ?
-                  (BINARY_GETATTR) :
-                  (BINARY_SAFEGETATTR);
-            return MS_RESULT_SUCCESS;
-        }
-        default:
-            return MS_RESULT_SUCCESS;
-    }
-}
-
-static ms_Result ParserParseExprList(ms_Parser *prs, ms_Expr **list, ms_TokenType closer) {
-    assert(prs);
-    assert(list);
-
-    DSArray *params = dsarray_new_cap(EXPRESSION_LIST_DEFAULT_CAP, NULL,
-                                      (dsarray_free_fn)ms_ExprDestroy);
-    if (!params) {
-        ParserErrorSet(prs, ERR_OUT_OF_MEMORY, prs->cur);
-        return MS_RESULT_ERROR;
-    }
-
-    *list = ms_ExprNewWithList(params);
-    if (!(*list)) {
-        ParserErrorSet(prs, ERR_OUT_OF_MEMORY, prs->cur);
-        dsarray_destroy(params);
-        return MS_RESULT_ERROR;
-    }
-
-    /* no parameters, close and return */
-    if ((prs->cur) && (prs->cur->type == closer)) {
-        ParserConsumeToken(prs);
-        return MS_RESULT_SUCCESS;
-    }
+        return MS_RESULT_SUCCESS;
+    }
 
     /* produce the set of parameters */
     while(prs->cur) {
@@ -1939,7 +1656,7 @@ static ms_Result ParserParseAtom(ms_Parser *prs, ms_Expr **expr) {
     assert(expr);
 
     ms_Result res = MS_RESULT_SUCCESS;
-    ms_Token *cur = prs->cur;
+    const ms_TokenView *cur = prs->cur;
 
     if (!cur) {
         ParserErrorSet(prs, ERR_EXPECTED_EXPRESSION, NULL, prs->line, prs->col);
@@ -1949,7 +1666,7 @@ static ms_Result ParserParseAtom(ms_Parser *prs, ms_Expr **expr) {
     switch (cur->type) {
             /* floating point number literals */
         case FLOAT_NUMBER: {
-            const char *val = dsbuf_char_ptr(cur->value);
+            const char *val = cur->text;
             *expr = ms_ExprFloatFromString(val);
             if (!(*expr)) {
                 ParserErrorSet(prs, ERR_OUT_OF_MEMORY, cur);
@@ -1961,7 +1678,7 @@ static ms_Result ParserParseAtom(ms_Parser *prs, ms_Expr **expr) {
             /* integer literals */
         case INT_NUMBER:
         case HEX_NUMBER: {
-            const char *val = dsbuf_char_ptr(cur->value);
+            const char *val = cur->text;
             *expr = ms_ExprIntFromString(val);
             if (!(*expr)) {
                 ParserErrorSet(prs, ERR_OUT_OF_MEMORY, cur);
@@ -1973,13 +1690,13 @@ static ms_Result ParserParseAtom(ms_Parser *prs, ms_Expr **expr) {
             /* string literals */
         case STRING: {
             ms_ValData p;
-            p.s = cur->value;
-            *expr = ms_ExprNewWithVal(MSVAL_STR, p);
+            p.s = ParserTokenText(cur);
+            *expr = (p.s) ? ms_ExprNewWithVal(MSVAL_STR, p) : NULL;
             if (!(*expr)) {
+                dsbuf_destroy(p.s);
                 ParserErrorSet(prs, ERR_OUT_OF_MEMORY, cur);
                 res = MS_RESULT_ERROR;
             }
-            cur->value = NULL; /* prevent the buffer being destroyed when the token is destroyed */
             break;
         }
 
@@ -2012,7 +1729,7 @@ static ms_Result ParserParseAtom(ms_Parser *prs, ms_Expr **expr) {
         case IDENTIFIER:
         case BUILTIN_FUNC:
         case GLOBAL: {
-            *expr = ms_ExprNewWithIdent(dsbuf_char_ptr(cur->value), dsbuf_len(cur->value));
+            *expr = ms_ExprNewWithIdent(cur->text, cur->len);
             if (!(*expr)) {
                 ParserErrorSet(prs, ERR_OUT_OF_MEMORY, cur);
                 res = MS_RESULT_ERROR;
@@ -2088,7 +1805,7 @@ static ms_Result ParserParseFunctionExpression(ms_Parser *prs, bool require_name
      * anonymous functions declared as expressions.
      */
 
-    ms_ValFunc *fn = calloc(1, sizeof(ms_ValFunc));
+    ms_ValFunc *fn = dscalloc(1, sizeof(ms_ValFunc));
     if (!fn) {
         ParserErrorSet(prs, ERR_OUT_OF_MEMORY, prs->cur);
         return MS_RESULT_ERROR;
@@ -2114,17 +1831,13 @@ static ms_Result ParserParseFunctionExpression(ms_Parser *prs, bool require_name
         return MS_RESULT_ERROR;
     }
 
-    /* steal the identifier for the declaration */
+    /* copy the identifier for the declaration */
     if (has_name) {
-        fn->ident = malloc(sizeof(ms_Ident));
+        fn->ident = ms_IdentNew(prs->cur->text, prs->cur->len);
         if (!fn->ident) {
             ParserErrorSet(prs, ERR_OUT_OF_MEMORY, prs->cur);
             return MS_RESULT_ERROR;
         }
-
-        fn->ident->name = prs->cur->value;
-        fn->ident->type = ms_IdentGetType(dsbuf_char_ptr(prs->cur->value));
-        prs->cur->value = NULL;
         ParserConsumeToken(prs);
     }
 
@@ -2149,15 +1862,11 @@ static ms_Result ParserParseFunctionExpression(ms_Parser *prs, bool require_name
             return MS_RESULT_ERROR;
         }
 
-        ms_Ident *ident = malloc(sizeof(ms_Ident));
+        ms_Ident *ident = ms_IdentNew(prs->cur->text, prs->cur->len);
         if (!ident) {
             ParserErrorSet(prs, ERR_OUT_OF_MEMORY, prs->cur);
             return MS_RESULT_ERROR;
         }
-
-        ident->name = prs->cur->value;
-        ident->type = ms_IdentGetType(dsbuf_char_ptr(prs->cur->value));
-        prs->cur->value = NULL;
         dsarray_append(fn->args, ident);
         ParserConsumeToken(prs);
 
@@ -2287,7 +1996,7 @@ static ms_Result ParserParseObjectExpression(ms_Parser *prs, ms_Expr **expr) {
             return MS_RESULT_ERROR;
         }
 
-        ms_ValObjectTuple *tuple = malloc(sizeof(ms_ValObjectTuple));
+        ms_ValObjectTuple *tuple = dsalloc(sizeof(ms_ValObjectTuple));
         if (!tuple) {
             ms_ExprDestroy(k);
             ms_ExprDestroy(v);
@@ -2437,34 +2146,483 @@ static ms_Result ParserExprCombineUnary(ms_Parser *prs, ms_Expr *inner, ms_ExprU
     return MS_RESULT_SUCCESS;
 }
 
+/*
+ * SINGLE PASS COMPILER
+ *
+ * Simple statements are compiled straight from the token stream, without
+ * building an AST, emitting exactly the bytecode the code generator would
+ * emit for the same input. Names are verified as they are compiled: a name
+ * may only be referenced (or assigned) once it has been declared, and may
+ * not be declared twice. A declared name is in scope within its own
+ * initializer, as in the verifier, but its identifier follows those of the
+ * initializer, as in the code generator.
+ *
+ * The compiler never reports errors. Anything it does not handle, whether
+ * valid or not, simply stops compilation so the caller can parse the input
+ * again with the full parser, which reports errors as usual.
+ */
+
+static bool ParserCompileStatement(ParserCompiler *c) {
+    assert(c);
+
+    ms_Parser *prs = c->prs;
+    switch (prs->cur->type) {
+        case KW_VAR:
+            return ParserCompileDeclaration(c);
+        case IDENTIFIER:
+            if ((prs->nxt) &&
+                ((prs->nxt->type == OP_EQ) || (COMPOUND_OPS[prs->nxt->type].prec != PREC_NONE))) {
+                return ParserCompileAssignment(c);
+            }
+            break;
+        default:
+            break;
+    }
+
+    return ParserCompileExpr(c, PREC_OR) && ParserCompileTerminator(c);
+}
+
+static bool ParserCompileDeclaration(ParserCompiler *c) {
+    assert(c);
+
+    ms_Parser *prs = c->prs;
+    do {
+        ParserConsumeToken(prs);
+        if (!ParserExpectToken(prs, IDENTIFIER)) {
+            return false;
+        }
+
+        DSBuffer *name;
+        ParserCompileName *entry = ParserCompileLookup(c, prs->cur, &name);
+        if ((!entry) || (entry->declared)) {
+            return false;
+        }
+        entry->declared = true;
+        ParserConsumeToken(prs);
+
+        bool init = ParserExpectToken(prs, OP_EQ);
+        if (init) {
+            ParserConsumeToken(prs);
+            if (!ParserCompileExpr(c, PREC_OR)) {
+                return false;
+            }
+        }
+
+        size_t index;
+        if ((!ParserCompileIdent(c, name, entry, &index)) ||
+            (!ParserCompileEmit(c, OPC_NEW_NAME, index))) {
+            return false;
+        }
+        if ((init) && (!ParserCompileEmit(c, OPC_SET_NAME, index))) {
+            return false;
+        }
+    } while (ParserExpectToken(prs, COMMA));
+
+    return ParserCompileTerminator(c);
+}
+
+static bool ParserCompileAssignment(ParserCompiler *c) {
+    assert(c);
+
+    ms_Parser *prs = c->prs;
+    DSBuffer *name;
+    ParserCompileName *entry = ParserCompileLookup(c, prs->cur, &name);
+    if ((!entry) || (!entry->declared)) {
+        return false;
+    }
+    ParserConsumeToken(prs);
+
+    /* compound assignments apply their operator to the current value */
+    size_t index;
+    const ParserBinaryOp *compound = &COMPOUND_OPS[prs->cur->type];
+    if (compound->prec != PREC_NONE) {
+        if ((!ParserCompileIdent(c, name, entry, &index)) ||
+            (!ParserCompileEmit(c, OPC_GET_NAME, index))) {
+            return false;
+        }
+        ParserConsumeToken(prs);
+        if ((!ParserCompileExpr(c, PREC_OR)) ||
+            (!ParserCompileEmit(c, compound->opc, 0))) {
+            return false;
+        }
+    } else {
+        ParserConsumeToken(prs);
+        if ((!ParserCompileExpr(c, PREC_OR)) ||
+            (!ParserCompileIdent(c, name, entry, &index))) {
+            return false;
+        }
+    }
+
+    return ParserCompileEmit(c, OPC_SET_NAME, index) && ParserCompileTerminator(c);
+}
+
+static bool ParserCompileTerminator(ParserCompiler *c) {
+    assert(c);
+
+    if (!ParserExpectToken(c->prs, SEMICOLON)) {
+        return false;
+    }
+
+    ParserConsumeToken(c->prs);
+    return true;
+}
+
+/* Compile a binary expression by precedence climbing, exactly as it is
+ * parsed by `ParserParseBinaryExpr`. */
+static bool ParserCompileExpr(ParserCompiler *c, ParserPrecedence minprec) {
+    assert(c);
+    assert(minprec > PREC_NONE);
+
+    if (!ParserCompileUnaryExpr(c)) {
+        return false;
+    }
+
+    ms_Parser *prs = c->prs;
+    while (prs->cur) {
+        const ParserBinaryOp *binop = &BINARY_OPS[prs->cur->type];
+        if (binop->prec < minprec) {
+            break;
+        }
+
+        ParserPrecedence rprec = (binop->prec == PREC_POWER) ? PREC_TERM : binop->prec + 1;
+
+        ParserConsumeToken(prs);
+        if ((!ParserCompileExpr(c, rprec)) ||
+            (!ParserCompileEmit(c, binop->opc, 0))) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool ParserCompileUnaryExpr(ParserCompiler *c) {
+    assert(c);
+
+    ms_Parser *prs = c->prs;
+    if (!prs->cur) {
+        return false;
+    }
+
+    ms_VMOpCodeType opc;
+    switch (prs->cur->type) {
+        case OP_BITWISE_NOT:        opc = OPC_BITWISE_NOT;      break;
+        case OP_NOT:                opc = OPC_NOT;              break;
+        case OP_MINUS:              /* fallthrough */
+        case OP_UMINUS:             opc = OPC_NEGATE;           break;
+        default:
+            return ParserCompileAtom(c);
+    }
+
+    ParserConsumeToken(prs);
+    return ParserCompileUnaryExpr(c) && ParserCompileEmit(c, opc, 0);
+}
+
+static bool ParserCompileAtom(ParserCompiler *c) {
+    assert(c);
+
+    ms_Parser *prs = c->prs;
+    const ms_TokenView *cur = prs->cur;
+    if (!cur) {
+        return false;
+    }
+
+    ms_VMValue val;
+    switch (cur->type) {
+        case FLOAT_NUMBER:
+            errno = 0;
+            val.type = VMVAL_FLOAT;
+            val.val.f = strtod(cur->text, NULL);
+            if (errno != 0) {
+                return false;
+            }
+            break;
+        case INT_NUMBER:
+            errno = 0;
+            val.type = VMVAL_INT;
+            val.val.i = strtoll(cur->text, NULL, 10);
+            if (errno != 0) {
+                return false;
+            }
+            break;
+        case STRING: {
+            DSBuffer *text = ParserTokenText(cur);
+            val.type = VMVAL_STR;
+            val.val.s = (text) ? ms_InternStr(text) : NULL;
+            dsbuf_destroy(text);
+            if (!val.val.s) {
+                return false;
+            }
+            break;
+        }
+        case KW_TRUE:
+        case KW_FALSE:
+            val.type = VMVAL_BOOL;
+            val.val.b = (cur->type == KW_TRUE);
+            break;
+        case KW_NULL:
+            val.type = VMVAL_NULL;
+            val.val.n = MS_VM_NULL_POINTER;
+            break;
+        case IDENTIFIER: {
+            DSBuffer *name;
+            size_t index;
+            ParserCompileName *entry = ParserCompileLookup(c, cur, &name);
+            if ((!entry) || (!entry->declared) ||
+                (!ParserCompileIdent(c, name, entry, &index))) {
+                return false;
+            }
+            ParserConsumeToken(prs);
+            return ParserCompileEmit(c, OPC_GET_NAME, index);
+        }
+        case LPAREN:
+            ParserConsumeToken(prs);
+            if ((!ParserCompileExpr(c, PREC_OR)) || (!ParserExpectToken(prs, RPAREN))) {
+                return false;
+            }
+            ParserConsumeToken(prs);
+            return true;
+        default:
+            return false;
+    }
+
+    ParserConsumeToken(prs);
+    return ParserCompileValue(c, val);
+}
+
+/* Return the entry for the name in an identifier token, adding an entry
+ * for names which have not been seen before. The interned name (whose
+ * reference is held by the name table) is returned in `name`. */
+static ParserCompileName *ParserCompileLookup(ParserCompiler *c, const ms_TokenView *tok, DSBuffer **name) {
+    assert(c);
+    assert(tok);
+    assert(name);
+
+    DSBuffer *text = ParserTokenText(tok);
+    DSBuffer *interned = (text) ? ms_InternStr(text) : NULL;
+    dsbuf_destroy(text);
+    if (!interned) {
+        return NULL;
+    }
+
+    ParserCompileName *entry = dsdict_get(c->names, interned);
+    if (entry) {
+        ms_InternRelease(interned);
+        *name = interned;
+        return entry;
+    }
+
+    entry = dsalloc(sizeof(ParserCompileName));
+    if (!entry) {
+        ms_InternRelease(interned);
+        return NULL;
+    }
+    entry->declared = false;
+    entry->index = -1;
+
+    dsdict_put(c->names, interned, entry);
+    if (dsdict_get(c->names, interned) != entry) {
+        dsfree(entry);
+        ms_InternRelease(interned);
+        return NULL;
+    }
+
+    *name = interned;
+    return entry;
+}
+
+/* Find the index of a name in the identifier table, adding it on first use. */
+static bool ParserCompileIdent(ParserCompiler *c, DSBuffer *name, ParserCompileName *entry, size_t *index) {
+    assert(c);
+    assert(name);
+    assert(entry);
+    assert(index);
+
+    if (entry->index < 0) {
+        if ((c->nidents > PARSER_COMPILE_ARG_MAX) ||
+            (!ParserCompilerGrow((void **)&c->idents, &c->identcap, c->nidents, sizeof(DSBuffer *)))) {
+            return false;
+        }
+        c->idents[c->nidents] = ms_InternRetain(name);
+        entry->index = (int)c->nidents;
+        c->nidents++;
+    }
+
+    *index = (size_t)entry->index;
+    return true;
+}
+
+/* Add a value to the value table and push it, taking ownership of any
+ * string in the value. */
+static bool ParserCompileValue(ParserCompiler *c, ms_VMValue val) {
+    assert(c);
+
+    if ((c->nvals > PARSER_COMPILE_ARG_MAX) ||
+        (!ParserCompilerGrow((void **)&c->values, &c->valcap, c->nvals, sizeof(ms_VMValue)))) {
+        if (val.type == VMVAL_STR) {
+            ms_InternRelease(val.val.s);
+        }
+        return false;
+    }
+
+    c->values[c->nvals] = val;
+    c->nvals++;
+    return ParserCompileEmit(c, OPC_PUSH, c->nvals - 1);
+}
+
+static bool ParserCompileEmit(ParserCompiler *c, ms_VMOpCodeType type, size_t arg) {
+    assert(c);
+    assert(arg <= PARSER_COMPILE_ARG_MAX);
+
+    if (!ParserCompilerGrow((void **)&c->code, &c->opcap, c->nops, sizeof(ms_VMOpCode))) {
+        return false;
+    }
+
+    c->code[c->nops] = ms_VMOpCodeWithArg(type, (int)arg);
+    c->nops++;
+    return true;
+}
+
+/* Make room for at least one more element in a compiler array. */
+static bool ParserCompilerGrow(void **data, size_t *cap, size_t len, size_t size) {
+    if (len < *cap) {
+        return true;
+    }
+
+    size_t newcap = (*cap > 0) ? *cap * 2 : PARSER_COMPILE_DEFAULT_CAP;
+    void *newdata = dsrealloc(*data, newcap * size);
+    if (!newdata) {
+        return false;
+    }
+
+    *data = newdata;
+    *cap = newcap;
+    return true;
+}
+
+static void ParserCompilerClean(ParserCompiler *c) {
+    assert(c);
+
+    dsfree(c->code);
+    c->code = NULL;
+    for (size_t i = 0; i < c->nvals; i++) {
+        if (c->values[i].type == VMVAL_STR) {
+            ms_InternRelease(c->values[i].val.s);
+        }
+    }
+    dsfree(c->values);
+    c->values = NULL;
+    for (size_t i = 0; i < c->nidents; i++) {
+        ms_InternRelease(c->idents[i]);
+    }
+    dsfree(c->idents);
+    c->idents = NULL;
+    dsdict_destroy(c->names);
+    c->names = NULL;
+}
+
 static bool ParserIdentIsInvalidAssignmentTarget(ms_ExprIdentType type) {
     return (type != EXPRIDENT_NAME) &&
            (type != EXPRIDENT_QUALIFIED) &&
            (type != EXPRIDENT_GLOBAL);
 }
 
-/* Move the pointer to the next token in the lexer stream without
- * discarding the previous token.
- *
- * BE CAREFUL WITH THIS FUNCTION. Abusing this function will cause memory
- * leaks since token objects are not freed by this function. */
-static inline ms_Token *ParserAdvanceToken(ms_Parser *prs) {
+/* Read the first two tokens from a freshly initialized lexer and discard
+ * the state left by any previous input. */
+static bool ParserReset(ms_Parser *prs) {
+    assert(prs);
+    assert(prs->lex);
+
+    prs->head = 0;
+    prs->nxt = NULL;
+    prs->cur = ParserLexToken(prs, &prs->ring[0]);
+    if (!prs->cur) {
+        return false;
+    }
+    prs->line = prs->cur->line;
+    prs->col = prs->cur->col;
+    prs->nxt = ParserLexToken(prs, &prs->ring[1]);
+
+    prs->err = NULL;
+    return ParserArenaReset(prs);
+}
+
+/* Discard the current AST. Its nodes are returned to the arena for the next
+ * module, unless lazily compiled functions still refer to the tree, in which
+ * case the parser leaves the arena to them and starts a new one. */
+static bool ParserArenaReset(ms_Parser *prs) {
+    assert(prs);
+    assert(prs->arena);
+
+    if (prs->arena->refs == 1) {
+        ms_ASTArenaClear(prs->arena);
+        return true;
+    }
+
+    ms_ASTArena *arena = ms_ASTArenaNew();
+    if (!arena) {
+        return false;
+    }
+
+    ms_ASTArenaRelease(prs->arena);
+    prs->arena = arena;
+    return true;
+}
+
+/* Lex the next token into a slot of the token ring, copying its text into
+ * the slot's storage (which is only grown, never freed, between tokens). */
+static const ms_TokenView *ParserLexToken(ms_Parser *prs, ParserTokenSlot *slot) {
+    assert(prs);
+    assert(slot);
+
+    const ms_TokenView *tok = ms_LexerNextTokenView(prs->lex);
+    if (!tok) {
+        return NULL;
+    }
+
+    if (tok->len >= slot->cap) {
+        size_t cap = (slot->cap > 0) ? slot->cap : PARSER_TOKEN_TEXT_DEFAULT_CAP;
+        while (tok->len >= cap) {
+            cap *= 2;
+        }
+
+        char *text = dsrealloc(slot->text, cap);
+        if (!text) {
+            return NULL;
+        }
+        slot->text = text;
+        slot->cap = cap;
+    }
+
+    memcpy(slot->text, tok->text, tok->len);
+    slot->text[tok->len] = '\0';
+    slot->tok = *tok;
+    slot->tok.text = slot->text;
+    return &slot->tok;
+}
+
+/* Copy the text of a token into a new buffer owned by the caller. */
+static DSBuffer *ParserTokenText(const ms_TokenView *tok) {
+    assert(tok);
+    /* guarantee that empty strings have a length since len must be >= 1 */
+    return dsbuf_new_l(tok->text, (tok->len == 0) ? 1 : tok->len);
+}
+
+/* Consume the current token, moving the lookahead token into its place
+ * and lexing a new lookahead token into the slot which is freed. */
+static inline void ParserConsumeToken(ms_Parser *prs) {
     assert(prs);
     assert(prs->lex);
-    ms_Token *old = prs->cur;
+
     prs->cur = prs->nxt;
+    prs->head = (prs->head + 1) % PARSER_TOKEN_RING_SIZE;
     if (prs->cur) {
         prs->line = prs->cur->line;
         prs->col = prs->cur->col;
     }
-    prs->nxt = (prs->nxt) ? (ms_LexerNextToken(prs->lex)) : (NULL);
-    return old;
-}
 
-/* Consume the next token in the stream. */
-static inline void ParserConsumeToken(ms_Parser *prs) {
-    assert(prs);
-    ms_TokenDestroy(ParserAdvanceToken(prs));
+    size_t next = (prs->head + 1) % PARSER_TOKEN_RING_SIZE;
+    prs->nxt = (prs->nxt) ? ParserLexToken(prs, &prs->ring[next]) : NULL;
 }
 
 /* Check if the next token to see if it matches our expected next token. */
@@ -2496,12 +2654,12 @@ static inline bool ParserExpectTokenAny(ms_Parser *prs, ms_TokenType type[], siz
 }
 
 /* Generate a new ParseError object attached to the Parser. */
-static void ParserErrorSet(ms_Parser *prs, const char *msg, const ms_Token *tok, ...) {
+static void ParserErrorSet(ms_Parser *prs, const char *msg, const ms_TokenView *tok, ...) {
     assert(prs);
 
     ms_Error **err = prs->err;
     assert(!(*err));
-    *err = malloc(sizeof(ms_Error));
+    *err = dsalloc(sizeof(ms_Error));
     if (!(*err)) {
         return;
     }
@@ -2518,14 +2676,14 @@ static void ParserErrorSet(ms_Parser *prs, const char *msg, const ms_Token *tok,
     }
 
     (*err)->len = (size_t)len;
-    (*err)->msg = malloc((size_t)len + 1);
+    (*err)->msg = dsalloc((size_t)len + 1);
     if ((*err)->msg) {
         vsnprintf((*err)->msg, len + 1, msg, argscpy);
     }
 
     (*err)->detail.parse.tok = (tok) ?
-                               ms_TokenNew(tok->type, dsbuf_char_ptr(tok->value),
-                                           dsbuf_len(tok->value), tok->line, tok->col) :
+                               ms_TokenNew(tok->type, tok->text, tok->len,
+                                           tok->line, tok->col) :
                                NULL;
 
 parser_close_error_va_args:
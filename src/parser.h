@@ -34,6 +34,12 @@ ms_Parser *ms_ParserNew(void);
 */
 bool ms_ParserInitFile(ms_Parser *prs, const char *fname);
 
+/**
+* @brief Initialize a @c ms_Parser from an open file, such as @c stdin ,
+* which is read in fixed size chunks and need not be seekable.
+*/
+bool ms_ParserInitFileHandle(ms_Parser *prs, FILE *file);
+
 /**
 * @brief Initialize a @c ms_Parser from a string.
 */
@@ -59,6 +65,40 @@ bool ms_ParserInitStringL(ms_Parser *prs, const char *str, size_t len);
 */
 ms_Result ms_ParserParse(ms_Parser *prs, const ms_AST **ast, ms_Error **err);
 
+/**
+* @brief Compile the mscript string or file associated with this
+* @c ms_Parser directly to bytecode, without building or verifying an AST.
+*
+* Only simple statements are compiled this way: declarations, assignments
+* and compound assignments to declared names, and expressions built from
+* literals, declared names, and unary and binary operators. Names are
+* checked as they are compiled, just as the verifier checks them.
+*
+* @param prs a @c ms_Parser object
+* @param code if compilation succeeds, set to the new bytecode, which is
+*        owned by the caller
+* @returns true if the input was compiled; false if it contains anything
+*          outside of the simple subset, or any error, in which case the
+*          parser must be reinitialized and the input parsed with
+*          @c ms_ParserParse (which will report any error)
+*/
+bool ms_ParserCompile(ms_Parser *prs, ms_VMByteCode **code);
+
+/**
+* @brief Return the arena holding the AST from the last call to
+* @c ms_ParserParse .
+*
+* Code generated lazily from the AST may retain the arena; the parser then
+* parses any later input into a new arena.
+*/
+ms_ASTArena *ms_ParserArena(ms_Parser *prs);
+
+/**
+* @brief Close the input of a @c ms_Parser , releasing any file it opened,
+* where the parser itself cannot be destroyed.
+*/
+void ms_ParserCloseInput(ms_Parser *prs);
+
 /**
 * @brief Destroy a @c ms_Parser object.
 */
@@ -17,15 +17,14 @@
 #include <assert.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
+#include "libds/alloc.h"
 #include "libds/array.h"
 #include "libds/dict.h"
-#include "libds/list.h"
 #include "verifier.h"
 #include "lang.h"
 
-static int VERIFIER_SYMBOL_VAL = 1;
-
 /*
  * FORWARD DECLARATIONS
  */
@@ -37,24 +36,40 @@ typedef enum {
     ASTCTX_FORSTMT,
 } ASTElementContextType;
 
-typedef struct ASTContext ASTContext;
-struct ASTContext {
-    ASTContext *parent;
-    ASTElementContextType type;
-    DSDict *symbols;
-};
+typedef struct {
+    ASTElementContextType type;     /** type of the block which opened the scope */
+    size_t mark;                    /** number of symbols on the stack when the scope was opened */
+} VerifierScope;
 
-typedef DSList ContextEvalQueue;
+typedef struct {
+    DSBuffer *name;                 /** symbol name (owned by the AST) */
+    size_t depth;                   /** index of the scope which declared the symbol */
+    size_t shadowed;                /** index + 1 of the binding this one shadows, or 0 */
+} VerifierSymbol;
 
 typedef struct {
-    ASTContext *ctx;
-    const ms_Stmt *stmt;
-} ContextQueueTuple;
+    const ms_StmtBlock *block;      /** statements in the block */
+    ASTElementContextType type;     /** type of scope the block opens */
+    const ms_ArgList *args;         /** function arguments declared in the block, or NULL */
+    DSBuffer *loopvar;              /** loop variable declared in the block, or NULL */
+} VerifierBlock;
 
 typedef struct {
-    ContextEvalQueue *queue;
-    DSArray *ctxlist;
-} QueueContext;
+    VerifierScope *scopes;          /** stack of open scopes */
+    size_t nscopes;                 /** number of open scopes */
+    size_t scopecap;                /** capacity of the scope stack */
+    VerifierSymbol *symbols;        /** stack of symbols declared in the open scopes */
+    size_t nsymbols;                /** number of declared symbols */
+    size_t symcap;                  /** capacity of the symbol stack */
+    DSDict *index;                  /** innermost binding (as index + 1) of each visible name */
+    VerifierBlock *blocks;          /** nested blocks waiting to be verified */
+    size_t nblocks;                 /** number of waiting blocks */
+    size_t blockcap;                /** capacity of the waiting block array */
+    const DSDict *names;            /** first part (as index + 1) declaring each module name, or NULL */
+    size_t part;                    /** index + 1 of the part being verified, if `names` is set */
+} Verifier;
+
+static const size_t VERIFIER_DEFAULT_CAP = 16;
 
 static const char *const ERR_BREAK_OUTSIDE_FOR = "`break` statements may only appear within a `for` statement block";
 static const char *const ERR_CONTINUE_OUTSIDE_FOR = "`continue` statements may only appear within a `for` statement block";
@@ -67,46 +82,39 @@ static const char *const ERR_REFERENCE_TO_UNDEFINED = "reference to undefined va
 static const char *const ERR_INVALID_STATEMENT_TYPE = "Invalid statement type encountered.";
 static const char *const ERR_EMPTY_EXPR_ATOM = "encountered an empty expression atom";
 
-static ASTContext *ASTContextNew(ASTContext *parent, ASTElementContextType type);
-static void ASTContextDestroy(ASTContext *ctx);
-static ms_Result QueueContextInit(QueueContext *qctx);
-static void QueueContextClean(QueueContext *qctx);
-static void QueueContextTupleDestroy(ContextQueueTuple *tuple);
-
-static ms_Result ParserEnqueueModule(const ms_Module *module, QueueContext *qctx);
-static ms_Result ParserEnqueueStatement(const ms_Stmt *stmt, ASTContext *ctx, QueueContext *qctx);
-static ms_Result ParserEnqueueIfStmt(const ms_StmtIf *ifstmt, ASTContext *parent, QueueContext *qctx);
-static ms_Result ParserEnqueueElseIfStmt(const ms_StmtIfElse *elif, ASTContext *parent, QueueContext *qctx);
-static ms_Result ParserEnqueueExpression(const ms_Expr *expr, ASTContext *parent, QueueContext *qctx);
-static ms_Result ParserEnqueueExprAtom(const ms_ExprAtom *atom, ms_ExprAtomType atomtype, ASTContext *parent, QueueContext *qctx);
-static ms_Result ParserEnqueueExprValue(const ms_Value *val, ASTContext *parent, QueueContext *qctx);
-static ms_Result ParserEnqueueBlock(const ms_StmtBlock *block, ASTContext *parent, ASTElementContextType type, QueueContext *qctx);
-static ms_Result ParserEnqueueBlockWithChild(const ms_StmtBlock *block, ASTContext *parent, ASTElementContextType type, QueueContext *qctx, ASTContext **blockctx);
-
-static ms_Result ParserDepleteQueue(QueueContext *qctx, ms_Error **err);
-
-static ms_Result ParserVerifyStatement(const ms_Stmt *stmt, ASTContext *ctx, QueueContext *qctx, ms_Error **err);
-static ms_Result ParserVerifyBreakStmt(const ms_StmtBreak *brk, ASTContext *ctx, QueueContext *qctx, ms_Error **err);
-static ms_Result ParserVerifyContinueStmt(const ms_StmtContinue *cont, ASTContext *ctx, QueueContext *qctx, ms_Error **err);
-static ms_Result ParserVerifyDeleteStmt(const ms_StmtDelete *del, ASTContext *ctx, QueueContext *qctx, ms_Error **err);
-static ms_Result ParserVerifyForStmt(const ms_StmtFor *forstmt, ASTContext *ctx, QueueContext *qctx, ms_Error **err);
-static ms_Result ParserVerifyForIncrement(const ms_StmtForIncrement *inc, ASTContext *ctx, QueueContext *qctx, ASTContext *childctx, ms_Error **err);
-static ms_Result ParserVerifyForIterator(const ms_StmtForIterator *iter, ASTContext *ctx, QueueContext *qctx, ASTContext *childctx, ms_Error **err);
-static ms_Result ParserVerifyIfStmt(const ms_StmtIf *ifstmt, ASTContext *ctx, QueueContext *qctx, ms_Error **err);
-static ms_Result ParserVerifyElseIfStmt(const ms_StmtIfElse *elif, ASTContext *ctx, QueueContext *qctx, ms_Error **err);
-static ms_Result ParserVerifyImportStmt(const ms_StmtImport *import, ASTContext *ctx, QueueContext *qctx, ms_Error **err);
-static ms_Result ParserVerifyReturnStmt(const ms_StmtReturn *ret, ASTContext *ctx, QueueContext *qctx, ms_Error **err);
-static ms_Result ParserVerifyDeclaration(const ms_StmtDeclaration *decl, ASTContext *ctx, QueueContext *qctx, ms_Error **err);
-static ms_Result ParserVerifyAssignment(const ms_StmtAssignment *assign, ASTContext *ctx, QueueContext *qctx, ms_Error **err);
-static ms_Result ParserVerifyExpression(const ms_Expr *expr, ASTContext *ctx, QueueContext *qctx, ms_Error **err);
-static ms_Result ParserVerifyExprAtom(const ms_ExprAtom *atom, ms_ExprAtomType type, ASTContext *ctx, QueueContext *qctx, ms_Error **err);
-static ms_Result ParserVerifyExprAtomValue(const ms_Value *val, ASTContext *ctx, QueueContext *qctx, ms_Error **err);
-static ms_Result ParserVerifyIdent(const ms_Ident *ident, ASTContext *ctx, QueueContext *qctx, ms_Error **err);
-
-static inline bool VerifierInContext(ASTContext *ctx, ASTElementContextType type);
-static inline bool VerifierInConstrainedContext(ASTContext *ctx, ASTElementContextType ancestor, ASTElementContextType type);
-static inline bool VerifierSymbolExistsInCurrentScope(ASTContext *ctx, DSBuffer *buf);
-static inline bool VerifierSymbolExistsInLexicalScope(ASTContext *ctx, DSBuffer *buf);
+static ms_Result VerifierVerifyModule(const ms_AST *ast, const ms_ArgList *params, const DSDict *names, size_t part, ms_Error **err);
+static ms_Result VerifierInit(Verifier *v);
+static void VerifierClean(Verifier *v);
+static bool VerifierGrow(void **data, size_t *cap, size_t len, size_t size);
+static bool VerifierScopeOpen(Verifier *v, ASTElementContextType type);
+static void VerifierScopeClose(Verifier *v);
+static bool VerifierSymbolPut(Verifier *v, DSBuffer *name);
+static ms_Result VerifierEnqueueBlock(Verifier *v, const ms_StmtBlock *block, ASTElementContextType type, const ms_ArgList *args, DSBuffer *loopvar);
+
+static ms_Result ParserVerifyBlock(const VerifierBlock *block, Verifier *v, ms_Error **err);
+static ms_Result ParserVerifyStatement(const ms_Stmt *stmt, Verifier *v, ms_Error **err);
+static ms_Result ParserVerifyBreakStmt(const ms_StmtBreak *brk, Verifier *v, ms_Error **err);
+static ms_Result ParserVerifyContinueStmt(const ms_StmtContinue *cont, Verifier *v, ms_Error **err);
+static ms_Result ParserVerifyDeleteStmt(const ms_StmtDelete *del, Verifier *v, ms_Error **err);
+static ms_Result ParserVerifyForStmt(const ms_StmtFor *forstmt, Verifier *v, ms_Error **err);
+static ms_Result ParserVerifyForIncrement(const ms_StmtForIncrement *inc, Verifier *v, DSBuffer **loopvar, ms_Error **err);
+static ms_Result ParserVerifyForIterator(const ms_StmtForIterator *iter, Verifier *v, DSBuffer **loopvar, ms_Error **err);
+static ms_Result ParserVerifyIfStmt(const ms_StmtIf *ifstmt, Verifier *v, ms_Error **err);
+static ms_Result ParserVerifyElseIfStmt(const ms_StmtIfElse *elif, Verifier *v, ms_Error **err);
+static ms_Result ParserVerifyImportStmt(const ms_StmtImport *import, Verifier *v, ms_Error **err);
+static ms_Result ParserVerifyReturnStmt(const ms_StmtReturn *ret, Verifier *v, ms_Error **err);
+static ms_Result ParserVerifyDeclaration(const ms_StmtDeclaration *decl, Verifier *v, ms_Error **err);
+static ms_Result ParserVerifyAssignment(const ms_StmtAssignment *assign, Verifier *v, ms_Error **err);
+static ms_Result ParserVerifyExpression(const ms_Expr *expr, Verifier *v, ms_Error **err);
+static ms_Result ParserVerifyExprAtom(const ms_ExprAtom *atom, ms_ExprAtomType type, Verifier *v, ms_Error **err);
+static ms_Result ParserVerifyExprAtomValue(const ms_Value *val, Verifier *v, ms_Error **err);
+static ms_Result ParserVerifyIdent(const ms_Ident *ident, Verifier *v, ms_Error **err);
+
+static inline bool VerifierInContext(const Verifier *v, ASTElementContextType type);
+static inline bool VerifierInConstrainedContext(const Verifier *v, ASTElementContextType ancestor, ASTElementContextType type);
+static inline bool VerifierSymbolExistsInCurrentScope(const Verifier *v, DSBuffer *buf);
+static inline bool VerifierSymbolExistsInLexicalScope(const Verifier *v, DSBuffer *buf);
+static inline bool VerifierSymbolDeclaredByPart(const Verifier *v, DSBuffer *buf);
 static void VerifierErrorSet(ms_Error **err, const char *msg, ...);
 
 /*
@@ -114,100 +122,165 @@ static void VerifierErrorSet(ms_Error **err, const char *msg, ...);
  */
 
 ms_Result ms_ParserVerifyAST(const ms_AST *ast, ms_Error **err) {
+    return ms_ParserVerifyASTParams(ast, NULL, err);
+}
+
+ms_Result ms_ParserVerifyASTParams(const ms_AST *ast, const ms_ArgList *params, ms_Error **err) {
+    return VerifierVerifyModule(ast, params, NULL, 0, err);
+}
+
+ms_Result ms_ParserVerifyASTPart(const ms_AST *ast, const ms_ArgList *params, const DSDict *names, size_t part, ms_Error **err) {
+    assert(names);
+    return VerifierVerifyModule(ast, params, names, part + 1, err);
+}
+
+/*
+ * A module which has been split at top-level statements is verified one
+ * part at a time, as if each part were preceded by the parts before it
+ * and followed by those after it. Statements in the module scope of a
+ * part can see names declared at the top level of earlier parts, while
+ * nested blocks (which are verified once the module scope is complete)
+ * can see names declared at the top level of any part.
+ */
+
+static ms_Result VerifierVerifyModule(const ms_AST *ast, const ms_ArgList *params, const DSDict *names, size_t part, ms_Error **err) {
     assert(ast);
     assert(err);
 
     ms_Result res;
-    QueueContext qctx = { .queue = NULL, .ctxlist = NULL };
+    Verifier v;
     *err = NULL;
 
-    if ((res = QueueContextInit(&qctx)) == MS_RESULT_ERROR) {
+    if ((res = VerifierInit(&v)) == MS_RESULT_ERROR) {
         goto cleanup_verify_ast;
     }
+    v.names = names;
+    v.part = part;
 
-    if ((res = ParserEnqueueModule(ast, &qctx)) == MS_RESULT_ERROR) {
-        goto cleanup_verify_ast;
-    }
-
-    if ((res = ParserDepleteQueue(&qctx, err)) == MS_RESULT_ERROR) {
-        goto cleanup_verify_ast;
-    }
+    VerifierBlock module = {
+        .block = ast, .type = ASTCTX_MODULE, .args = params, .loopvar = NULL
+    };
+    res = ParserVerifyBlock(&module, &v, err);
 
 cleanup_verify_ast:
-    QueueContextClean(&qctx);
+    VerifierClean(&v);
     return res;
 }
 
 /*
- * CONTEXT FUNCTIONS
+ * VERIFIER STATE FUNCTIONS
+ *
+ * The verifier keeps every symbol visible from the statement being
+ * verified on a single stack, with the symbols of each enclosing scope
+ * stacked beneath those of the scopes it contains. A single dictionary
+ * maps each visible name to its innermost binding, and each binding
+ * records the binding it shadows, so closing a scope simply pops its
+ * symbols and restores whatever they shadowed.
  */
 
-static ASTContext *ASTContextNew(ASTContext *parent, ASTElementContextType type) {
-    ASTContext *ctx = malloc(sizeof(ASTContext));
-    if (!ctx) {
-        return NULL;
-    }
+static ms_Result VerifierInit(Verifier *v) {
+    assert(v);
 
-    ctx->symbols = dsdict_new((dsdict_hash_fn)dsbuf_hash,
-                              (dsdict_compare_fn)dsbuf_compare, NULL, NULL);
-    if (!ctx->symbols) {
-        free(ctx);
-        return NULL;
+    *v = (Verifier){ 0 };
+    v->index = dsdict_new((dsdict_hash_fn)dsbuf_hash,
+                          (dsdict_compare_fn)dsbuf_compare, NULL, NULL);
+    if (!v->index) {
+        return MS_RESULT_ERROR;
     }
 
-    ctx->parent = parent;
-    ctx->type = type;
-    return ctx;
+    return MS_RESULT_SUCCESS;
 }
 
-static void ASTContextDestroy(ASTContext *ctx) {
-    if (!ctx) { return; }
-    ctx->parent = NULL;
-    dsdict_destroy(ctx->symbols);
-    ctx->symbols = NULL;
-    free(ctx);
+static void VerifierClean(Verifier *v) {
+    if (!v) { return; }
+    dsdict_destroy(v->index);
+    dsfree(v->scopes);
+    dsfree(v->symbols);
+    dsfree(v->blocks);
+    *v = (Verifier){ 0 };
 }
 
-static ms_Result QueueContextInit(QueueContext *qctx) {
-    assert(qctx);
+/* Make room for at least one more element in a verifier stack. */
+static bool VerifierGrow(void **data, size_t *cap, size_t len, size_t size) {
+    if (len < *cap) {
+        return true;
+    }
 
-    /* array of ASTContexts to make sure they're all freed */
-    qctx->ctxlist = dsarray_new(NULL, (dsarray_free_fn)ASTContextDestroy);
-    if (!qctx->ctxlist) {
-        return MS_RESULT_ERROR;
+    size_t newcap = (*cap > 0) ? *cap * 2 : VERIFIER_DEFAULT_CAP;
+    void *newdata = dsrealloc(*data, newcap * size);
+    if (!newdata) {
+        return false;
     }
 
-    /* queue of statements to be evaluated breadth-first to make sure
-     * we always have access to identifiers declared later in an enclosing
-     * lexical context */
-    qctx->queue = dslist_new(NULL, (dslist_free_fn)QueueContextTupleDestroy);
-    if (!qctx->queue) {
-        return MS_RESULT_ERROR;
+    *data = newdata;
+    *cap = newcap;
+    return true;
+}
+
+static bool VerifierScopeOpen(Verifier *v, ASTElementContextType type) {
+    assert(v);
+
+    if (!VerifierGrow((void **)&v->scopes, &v->scopecap, v->nscopes, sizeof(VerifierScope))) {
+        return false;
     }
 
-    return MS_RESULT_SUCCESS;
+    v->scopes[v->nscopes].type = type;
+    v->scopes[v->nscopes].mark = v->nsymbols;
+    v->nscopes++;
+    return true;
 }
 
-static void QueueContextClean(QueueContext *qctx) {
-    if (!qctx) { return; }
-    dsarray_destroy(qctx->ctxlist);
-    dslist_destroy(qctx->queue);
+static void VerifierScopeClose(Verifier *v) {
+    assert(v);
+    assert(v->nscopes > 0);
+
+    v->nscopes--;
+    size_t mark = v->scopes[v->nscopes].mark;
+    while (v->nsymbols > mark) {
+        v->nsymbols--;
+        VerifierSymbol *sym = &v->symbols[v->nsymbols];
+        if (sym->shadowed) {
+            dsdict_put(v->index, sym->name, (void *)(uintptr_t)sym->shadowed);
+        } else {
+            (void)dsdict_del(v->index, sym->name);
+        }
+    }
 }
 
-static void QueueContextTupleDestroy(ContextQueueTuple *tuple) {
-    if (!tuple) { return; }
-    tuple->ctx = NULL;
-    tuple->stmt = NULL;
-    free(tuple);
+/* Declare `name` in the innermost scope, unless it is already declared there. */
+static bool VerifierSymbolPut(Verifier *v, DSBuffer *name) {
+    assert(v);
+    assert(v->nscopes > 0);
+    assert(name);
+
+    size_t shadowed = (size_t)(uintptr_t)dsdict_get(v->index, name);
+    if ((shadowed) && (v->symbols[shadowed - 1].depth == v->nscopes - 1)) {
+        return true;
+    }
+
+    if (!VerifierGrow((void **)&v->symbols, &v->symcap, v->nsymbols, sizeof(VerifierSymbol))) {
+        return false;
+    }
+
+    VerifierSymbol *sym = &v->symbols[v->nsymbols];
+    sym->name = name;
+    sym->depth = v->nscopes - 1;
+    sym->shadowed = shadowed;
+    v->nsymbols++;
+
+    dsdict_put(v->index, name, (void *)(uintptr_t)v->nsymbols);
+    return true;
 }
 
 /*
- * ENQUEUE FUNCTIONS
+ * BLOCK PROCESSOR
  *
- * The verifier reads the entire abstract syntax tree statement-by-statement
- * into a queue in a breadth-first pattern. This allows the verifier to
- * analyze each nested lexical block within the full context of the
- * containing block.
+ * The verifier verifies every statement in a block before verifying any
+ * of the blocks nested within it. Nested blocks are collected into a
+ * single array as their enclosing statements are verified, and are then
+ * verified in order once the enclosing block is complete. This allows
+ * the verifier to analyze each nested lexical block within the full
+ * context of the containing block.
  *
  * In a module, this means that code like this:
  *
@@ -219,250 +292,71 @@ static void QueueContextTupleDestroy(ContextQueueTuple *tuple) {
  * evaluated _after_ the containing module.
  */
 
-static ms_Result ParserEnqueueModule(const ms_Module *module, QueueContext *qctx) {
-    assert(module);
-    assert(qctx);
-
-    ASTContext *ctx = ASTContextNew(NULL, ASTCTX_MODULE);
-    if (!ctx) {
-        return MS_RESULT_ERROR;
-    }
-    dsarray_append(qctx->ctxlist, ctx);
-
-    size_t len = dsarray_len(module);
-    for(size_t i = 0; i < len; i++) {
-        ms_Stmt *stmt = dsarray_get(module, i);
-        if (ParserEnqueueStatement(stmt, ctx, qctx) == MS_RESULT_ERROR) {
-            return MS_RESULT_ERROR;
-        }
-    }
-
-    return MS_RESULT_SUCCESS;
-}
-
-static ms_Result ParserEnqueueStatement(const ms_Stmt *stmt, ASTContext *ctx, QueueContext *qctx) {
-    assert(stmt);
-    assert(ctx);
-    assert(qctx);
+static ms_Result VerifierEnqueueBlock(Verifier *v, const ms_StmtBlock *block, ASTElementContextType type, const ms_ArgList *args, DSBuffer *loopvar) {
+    assert(v);
+    assert(block);
 
-    ContextQueueTuple *tuple = malloc(sizeof(ContextQueueTuple));
-    if (!tuple) {
+    if (!VerifierGrow((void **)&v->blocks, &v->blockcap, v->nblocks, sizeof(VerifierBlock))) {
         return MS_RESULT_ERROR;
     }
 
-    tuple->stmt = stmt;
-    tuple->ctx = ctx;
-    dslist_enqueue(qctx->queue, tuple);
+    VerifierBlock *next = &v->blocks[v->nblocks];
+    next->block = block;
+    next->type = type;
+    next->args = args;
+    next->loopvar = loopvar;
+    v->nblocks++;
     return MS_RESULT_SUCCESS;
 }
 
-static ms_Result ParserEnqueueIfStmt(const ms_StmtIf *ifstmt, ASTContext *parent, QueueContext *qctx) {
-    assert(ifstmt);
-    assert(parent);
-    assert(qctx);
-
-    if (ParserEnqueueBlock(ifstmt->block, parent, ASTCTX_IFSTMT, qctx) == MS_RESULT_ERROR) {
-        return MS_RESULT_ERROR;
-    }
-
-    if (!ifstmt->elif) {
-        return MS_RESULT_SUCCESS;
-    }
+static ms_Result ParserVerifyBlock(const VerifierBlock *block, Verifier *v, ms_Error **err) {
+    assert(block);
+    assert(v);
+    assert(err);
 
-    if (ParserEnqueueElseIfStmt(ifstmt->elif, parent, qctx) == MS_RESULT_ERROR) {
+    if (!VerifierScopeOpen(v, block->type)) {
         return MS_RESULT_ERROR;
     }
 
-    return MS_RESULT_SUCCESS;
-}
-
-static ms_Result ParserEnqueueElseIfStmt(const ms_StmtIfElse *elif, ASTContext *parent, QueueContext *qctx) {
-    assert(elif);
-    assert(parent);
-    assert(qctx);
-
-    switch (elif->type) {
-        case IFELSE_IF: {
-            if (ParserEnqueueBlock(elif->clause.ifstmt->block, parent, ASTCTX_IFSTMT, qctx) == MS_RESULT_ERROR) {
-                return MS_RESULT_ERROR;
-            }
-            return ParserEnqueueElseIfStmt(elif->clause.ifstmt->elif, parent, qctx);
-        }
-        case IFELSE_ELSE:
-            return ParserEnqueueBlock(elif->clause.elstmt->block, parent, ASTCTX_IFSTMT, qctx);
-    }
-
-    assert(false);
-    return MS_RESULT_ERROR;
-}
-
-static ms_Result ParserEnqueueExpression(const ms_Expr *expr, ASTContext *parent, QueueContext *qctx) {
-    assert(expr);
-    assert(parent);
-    assert(qctx);
-
-    switch (expr->type) {
-        case EXPRTYPE_UNARY: {
-            return ParserEnqueueExprAtom(&expr->cmpnt.u->atom, expr->cmpnt.u->type, parent, qctx);
-        }
-        case EXPRTYPE_BINARY: {
-            if (ParserEnqueueExprAtom(&expr->cmpnt.b->latom, expr->cmpnt.b->ltype, parent, qctx) == MS_RESULT_ERROR) {
-                return MS_RESULT_ERROR;
-            }
-
-            if (ParserEnqueueExprAtom(&expr->cmpnt.b->ratom, expr->cmpnt.b->rtype, parent, qctx) == MS_RESULT_ERROR) {
-                return MS_RESULT_ERROR;
-            }
-
-            return MS_RESULT_SUCCESS;
-        }
-        case EXPRTYPE_CONDITIONAL: {
-            if (ParserEnqueueExprAtom(&expr->cmpnt.c->cond, expr->cmpnt.c->condtype, parent, qctx) == MS_RESULT_ERROR) {
-                return MS_RESULT_ERROR;
-            }
-
-            if (ParserEnqueueExprAtom(&expr->cmpnt.c->iftrue, expr->cmpnt.c->truetype, parent, qctx) == MS_RESULT_ERROR) {
-                return MS_RESULT_ERROR;
-            }
-
-            if (ParserEnqueueExprAtom(&expr->cmpnt.c->iffalse, expr->cmpnt.c->falsetype, parent, qctx) == MS_RESULT_ERROR) {
-                return MS_RESULT_ERROR;
-            }
-
-            return MS_RESULT_SUCCESS;
-        }
-    }
-
-    assert(false);
-    return MS_RESULT_ERROR;
-}
-
-static ms_Result ParserEnqueueExprAtom(const ms_ExprAtom *atom, ms_ExprAtomType atomtype, ASTContext *parent, QueueContext *qctx) {
-    assert(atom);
-    assert(parent);
-    assert(qctx);
+    ms_Result res = MS_RESULT_SUCCESS;
+    size_t first = v->nblocks;
 
-    switch (atomtype) {
-        case EXPRATOM_IDENT:        /* fall through */
-        case EXPRATOM_EMPTY:
-            return MS_RESULT_SUCCESS;
-        case EXPRATOM_EXPRLIST: {
-            size_t len = dsarray_len(atom->list);
-            for (size_t i = 0; i < len; i++) {
-                ms_Expr *expr = dsarray_get(atom->list, i);
-                if (ParserEnqueueExpression(expr, parent, qctx) == MS_RESULT_ERROR) {
-                    return MS_RESULT_ERROR;
-                }
-            }
-            return MS_RESULT_SUCCESS;
+    size_t nargs = (block->args) ? dsarray_len(block->args) : 0;
+    for (size_t i = 0; i < nargs; i++) {
+        ms_Ident *arg = dsarray_get(block->args, i);
+        if (!VerifierSymbolPut(v, arg->name)) {
+            res = MS_RESULT_ERROR;
+            goto cleanup_verify_block;
         }
-        case EXPRATOM_VALUE:
-            return ParserEnqueueExprValue(&atom->val, parent, qctx);
-        case EXPRATOM_EXPRESSION:
-            return ParserEnqueueExpression(atom->expr, parent, qctx);
     }
 
-    assert(false);
-    return MS_RESULT_ERROR;
-}
-
-static ms_Result ParserEnqueueExprValue(const ms_Value *val, ASTContext *parent, QueueContext *qctx) {
-    assert(val);
-    assert(parent);
-    assert(qctx);
-
-    switch (val->type) {
-        case MSVAL_FLOAT:       /* fall through */
-        case MSVAL_INT:         /* fall through */
-        case MSVAL_NULL:        /* fall through */
-        case MSVAL_BOOL:        /* fall through */
-        case MSVAL_STR:
-            return MS_RESULT_SUCCESS;
-        case MSVAL_ARRAY: {
-            size_t len = dsarray_len(val->val.a);
-            for (size_t i = 0; i < len; i++) {
-                ms_Expr *expr = dsarray_get(val->val.a, i);
-                if (ParserEnqueueExpression(expr, parent, qctx) == MS_RESULT_ERROR) {
-                    return MS_RESULT_ERROR;
-                }
-            }
-            return MS_RESULT_SUCCESS;
-        }
-        case MSVAL_OBJECT: {
-            size_t len = dsarray_len(val->val.o);
-            for (size_t i = 0; i < len; i++) {
-                ms_ValObjectTuple *tuple = dsarray_get(val->val.o, i);
-                if (ParserEnqueueExpression(tuple->key, parent, qctx) == MS_RESULT_ERROR) {
-                    return MS_RESULT_ERROR;
-                }
-                if (ParserEnqueueExpression(tuple->val, parent, qctx) == MS_RESULT_ERROR) {
-                    return MS_RESULT_ERROR;
-                }
-            }
-            return MS_RESULT_SUCCESS;
-        }
-        case MSVAL_FUNC:
-            return ParserEnqueueBlock(val->val.fn->block, parent, ASTCTX_FUNCTION, qctx);
+    if ((block->loopvar) && (!VerifierSymbolPut(v, block->loopvar))) {
+        res = MS_RESULT_ERROR;
+        goto cleanup_verify_block;
     }
 
-    assert(false);
-    return MS_RESULT_ERROR;
-}
-
-static ms_Result ParserEnqueueBlock(const ms_StmtBlock *block, ASTContext *parent, ASTElementContextType type, QueueContext *qctx) {
-    assert(block);
-    assert(parent);
-    assert(qctx);
-
-    ASTContext *blockctx;
-    return ParserEnqueueBlockWithChild(block, parent, type, qctx, &blockctx);
-}
-
-static ms_Result ParserEnqueueBlockWithChild(const ms_StmtBlock *block, ASTContext *parent, ASTElementContextType type, QueueContext *qctx, ASTContext **blockctx) {
-    assert(block);
-    assert(parent);
-    assert(qctx);
-
-    *blockctx = ASTContextNew(parent, type);
-    if (!(*blockctx)) {
-        return MS_RESULT_ERROR;
-    }
-    dsarray_append(qctx->ctxlist, (*blockctx));
-
-    size_t len = dsarray_len(block);
-    for(size_t i = 0; i < len; i++) {
-        ms_Stmt *stmt = dsarray_get(block, i);
-        if (ParserEnqueueStatement(stmt, *blockctx, qctx) == MS_RESULT_ERROR) {
-            ASTContextDestroy(*blockctx);
-            return MS_RESULT_ERROR;
+    size_t len = dsarray_len(block->block);
+    for (size_t i = 0; i < len; i++) {
+        ms_Stmt *stmt = dsarray_get(block->block, i);
+        if (ParserVerifyStatement(stmt, v, err) == MS_RESULT_ERROR) {
+            res = MS_RESULT_ERROR;
+            goto cleanup_verify_block;
         }
     }
 
-    return MS_RESULT_SUCCESS;
-}
-
-/*
- * QUEUE PROCESSOR
- *
- * Process the queue statement by statement. Each statement with a containing
- * statement block will enqueue the statements contained in the block as
- * the statement is evaluated.
- */
-
-static ms_Result ParserDepleteQueue(QueueContext *qctx, ms_Error **err) {
-    assert(qctx);
-    assert(err);
-
-    ContextQueueTuple *tuple;
-    while ((tuple = dslist_dequeue(qctx->queue)) != NULL) {
-        if (ParserVerifyStatement(tuple->stmt, tuple->ctx, qctx, err) == MS_RESULT_ERROR) {
-            QueueContextTupleDestroy(tuple);
-            return MS_RESULT_ERROR;
+    /* nested blocks are copied out, since verifying them may move the array */
+    for (size_t i = first; i < v->nblocks; i++) {
+        VerifierBlock nested = v->blocks[i];
+        if (ParserVerifyBlock(&nested, v, err) == MS_RESULT_ERROR) {
+            res = MS_RESULT_ERROR;
+            goto cleanup_verify_block;
         }
-        QueueContextTupleDestroy(tuple);
     }
 
-    return MS_RESULT_SUCCESS;
+cleanup_verify_block:
+    v->nblocks = first;
+    VerifierScopeClose(v);
+    return res;
 }
 
 /*
@@ -480,35 +374,32 @@ static ms_Result ParserDepleteQueue(QueueContext *qctx, ms_Error **err) {
  *  - `return` statements only appear within a function definition
  */
 
-static ms_Result ParserVerifyStatement(const ms_Stmt *stmt, ASTContext *ctx, QueueContext *qctx, ms_Error **err) {
+static ms_Result ParserVerifyStatement(const ms_Stmt *stmt, Verifier *v, ms_Error **err) {
     assert(stmt);
-    assert(ctx);
+    assert(v);
     assert(err);
 
     switch (stmt->type) {
         case STMTTYPE_BREAK:
-            return ParserVerifyBreakStmt(stmt->cmpnt.brk, ctx, qctx, err);
+            return ParserVerifyBreakStmt(stmt->cmpnt.brk, v, err);
         case STMTTYPE_CONTINUE:
-            return ParserVerifyContinueStmt(stmt->cmpnt.cont, ctx, qctx, err);
+            return ParserVerifyContinueStmt(stmt->cmpnt.cont, v, err);
         case STMTTYPE_DELETE:
-            return ParserVerifyDeleteStmt(stmt->cmpnt.del, ctx, qctx, err);
+            return ParserVerifyDeleteStmt(stmt->cmpnt.del, v, err);
         case STMTTYPE_FOR:
-            return ParserVerifyForStmt(stmt->cmpnt.forstmt, ctx, qctx, err);
+            return ParserVerifyForStmt(stmt->cmpnt.forstmt, v, err);
         case STMTTYPE_IF:
-            return ParserVerifyIfStmt(stmt->cmpnt.ifstmt, ctx, qctx, err);
+            return ParserVerifyIfStmt(stmt->cmpnt.ifstmt, v, err);
         case STMTTYPE_IMPORT:
-            return ParserVerifyImportStmt(stmt->cmpnt.import, ctx, qctx, err);
+            return ParserVerifyImportStmt(stmt->cmpnt.import, v, err);
         case STMTTYPE_RETURN:
-            return ParserVerifyReturnStmt(stmt->cmpnt.ret, ctx, qctx, err);
+            return ParserVerifyReturnStmt(stmt->cmpnt.ret, v, err);
         case STMTTYPE_DECLARATION:
-            return ParserVerifyDeclaration(stmt->cmpnt.decl, ctx, qctx, err);
+            return ParserVerifyDeclaration(stmt->cmpnt.decl, v, err);
         case STMTTYPE_ASSIGNMENT:
-            return ParserVerifyAssignment(stmt->cmpnt.assign, ctx, qctx, err);
+            return ParserVerifyAssignment(stmt->cmpnt.assign, v, err);
         case STMTTYPE_EXPRESSION:
-            if (ParserEnqueueExpression(stmt->cmpnt.expr, ctx, qctx) == MS_RESULT_ERROR) {
-                return MS_RESULT_ERROR;
-            }
-            return ParserVerifyExpression(stmt->cmpnt.expr, ctx, qctx, err);
+            return ParserVerifyExpression(stmt->cmpnt.expr, v, err);
         case STMTTYPE_EMPTY:
             assert(false);
             VerifierErrorSet(err, ERR_INVALID_STATEMENT_TYPE);
@@ -518,13 +409,12 @@ static ms_Result ParserVerifyStatement(const ms_Stmt *stmt, ASTContext *ctx, Que
     return MS_RESULT_ERROR;
 }
 
-static ms_Result ParserVerifyBreakStmt(const ms_StmtBreak *brk, ASTContext *ctx, QueueContext *qctx, ms_Error **err) {
+static ms_Result ParserVerifyBreakStmt(const ms_StmtBreak *brk, Verifier *v, ms_Error **err) {
     assert(!brk);
-    assert(ctx);
-    assert(qctx);
+    assert(v);
     assert(err);
 
-    if (!VerifierInConstrainedContext(ctx, ASTCTX_FUNCTION, ASTCTX_FORSTMT)) {
+    if (!VerifierInConstrainedContext(v, ASTCTX_FUNCTION, ASTCTX_FORSTMT)) {
         VerifierErrorSet(err, ERR_BREAK_OUTSIDE_FOR);
         return MS_RESULT_ERROR;
     }
@@ -532,13 +422,12 @@ static ms_Result ParserVerifyBreakStmt(const ms_StmtBreak *brk, ASTContext *ctx,
     return MS_RESULT_SUCCESS;
 }
 
-static ms_Result ParserVerifyContinueStmt(const ms_StmtContinue *cont, ASTContext *ctx, QueueContext *qctx, ms_Error **err) {
+static ms_Result ParserVerifyContinueStmt(const ms_StmtContinue *cont, Verifier *v, ms_Error **err) {
     assert(!cont);
-    assert(ctx);
-    assert(qctx);
+    assert(v);
     assert(err);
 
-    if (!VerifierInConstrainedContext(ctx, ASTCTX_FUNCTION, ASTCTX_FORSTMT)) {
+    if (!VerifierInConstrainedContext(v, ASTCTX_FUNCTION, ASTCTX_FORSTMT)) {
         VerifierErrorSet(err, ERR_CONTINUE_OUTSIDE_FOR);
         return MS_RESULT_ERROR;
     }
@@ -546,51 +435,44 @@ static ms_Result ParserVerifyContinueStmt(const ms_StmtContinue *cont, ASTContex
     return MS_RESULT_SUCCESS;
 }
 
-static ms_Result ParserVerifyDeleteStmt(const ms_StmtDelete *del, ASTContext *ctx, QueueContext *qctx, ms_Error **err) {
+static ms_Result ParserVerifyDeleteStmt(const ms_StmtDelete *del, Verifier *v, ms_Error **err) {
     assert(del);
-    assert(ctx);
-    assert(qctx);
+    assert(v);
     assert(err);
 
-    return ParserVerifyExpression(del->expr, ctx, qctx, err);
+    return ParserVerifyExpression(del->expr, v, err);
 }
 
-static ms_Result ParserVerifyForStmt(const ms_StmtFor *forstmt, ASTContext *ctx, QueueContext *qctx, ms_Error **err) {
+static ms_Result ParserVerifyForStmt(const ms_StmtFor *forstmt, Verifier *v, ms_Error **err) {
     assert(forstmt);
-    assert(ctx);
-    assert(qctx);
+    assert(v);
     assert(err);
 
-    ASTContext *blockctx;
-    if (ParserEnqueueBlockWithChild(forstmt->block, ctx, ASTCTX_FORSTMT, qctx, &blockctx) == MS_RESULT_ERROR) {
-        return MS_RESULT_ERROR;
-    }
-
+    DSBuffer *loopvar = NULL;
     switch (forstmt->type) {
         case FORSTMT_INCREMENT:
-            if (ParserVerifyForIncrement(forstmt->clause.inc, ctx, qctx, blockctx, err) == MS_RESULT_ERROR) {
+            if (ParserVerifyForIncrement(forstmt->clause.inc, v, &loopvar, err) == MS_RESULT_ERROR) {
                 return MS_RESULT_ERROR;
             }
             break;
         case FORSTMT_ITERATOR:
-            if (ParserVerifyForIterator(forstmt->clause.iter, ctx, qctx, blockctx, err) == MS_RESULT_ERROR) {
+            if (ParserVerifyForIterator(forstmt->clause.iter, v, &loopvar, err) == MS_RESULT_ERROR) {
                 return MS_RESULT_ERROR;
             }
             break;
         case FORSTMT_EXPR:
-            if (ParserVerifyExpression(forstmt->clause.expr->expr, ctx, qctx, err) == MS_RESULT_ERROR) {
+            if (ParserVerifyExpression(forstmt->clause.expr->expr, v, err) == MS_RESULT_ERROR) {
                 return MS_RESULT_ERROR;
             }
             break;
     }
 
-    return MS_RESULT_SUCCESS;
+    return VerifierEnqueueBlock(v, forstmt->block, ASTCTX_FORSTMT, NULL, loopvar);
 }
 
-static ms_Result ParserVerifyForIncrement(const ms_StmtForIncrement *inc, ASTContext *ctx, QueueContext *qctx, ASTContext *childctx, ms_Error **err) {
+static ms_Result ParserVerifyForIncrement(const ms_StmtForIncrement *inc, Verifier *v, DSBuffer **loopvar, ms_Error **err) {
     assert(inc);
-    assert(ctx);
-    assert(qctx);
+    assert(v);
     assert(err);
 
     if (inc->declare) {
@@ -603,18 +485,18 @@ static ms_Result ParserVerifyForIncrement(const ms_StmtForIncrement *inc, ASTCon
         assert(inc->ident->cmpnt.u);
         assert(inc->ident->cmpnt.u->type == EXPRATOM_IDENT);
         assert(inc->ident->cmpnt.u->atom.ident);
-        dsdict_put(childctx->symbols, inc->ident->cmpnt.u->atom.ident->name, &VERIFIER_SYMBOL_VAL);
+        *loopvar = inc->ident->cmpnt.u->atom.ident->name;
     } else {
-        if (ParserVerifyExpression(inc->ident, ctx, qctx, err) == MS_RESULT_ERROR) {
+        if (ParserVerifyExpression(inc->ident, v, err) == MS_RESULT_ERROR) {
             return MS_RESULT_ERROR;
         }
     }
 
-    if (ParserVerifyExpression(inc->init, ctx, qctx, err) == MS_RESULT_ERROR) {
+    if (ParserVerifyExpression(inc->init, v, err) == MS_RESULT_ERROR) {
         return MS_RESULT_ERROR;
     }
 
-    if (ParserVerifyExpression(inc->end, ctx, qctx, err) == MS_RESULT_ERROR) {
+    if (ParserVerifyExpression(inc->end, v, err) == MS_RESULT_ERROR) {
         return MS_RESULT_ERROR;
     }
 
@@ -622,17 +504,16 @@ static ms_Result ParserVerifyForIncrement(const ms_StmtForIncrement *inc, ASTCon
         return MS_RESULT_SUCCESS;
     }
 
-    if (ParserVerifyExpression(inc->end, ctx, qctx, err) == MS_RESULT_ERROR) {
+    if (ParserVerifyExpression(inc->end, v, err) == MS_RESULT_ERROR) {
         return MS_RESULT_ERROR;
     }
 
     return MS_RESULT_SUCCESS;
 }
 
-static ms_Result ParserVerifyForIterator(const ms_StmtForIterator *iter, ASTContext *ctx, QueueContext *qctx, ASTContext *childctx, ms_Error **err) {
+static ms_Result ParserVerifyForIterator(const ms_StmtForIterator *iter, Verifier *v, DSBuffer **loopvar, ms_Error **err) {
     assert(iter);
-    assert(ctx);
-    assert(qctx);
+    assert(v);
     assert(err);
 
     if (iter->declare) {
@@ -645,64 +526,60 @@ static ms_Result ParserVerifyForIterator(const ms_StmtForIterator *iter, ASTCont
         assert(iter->ident->cmpnt.u);
         assert(iter->ident->cmpnt.u->type == EXPRATOM_IDENT);
         assert(iter->ident->cmpnt.u->atom.ident);
-        dsdict_put(childctx->symbols, iter->ident->cmpnt.u->atom.ident->name, &VERIFIER_SYMBOL_VAL);
+        *loopvar = iter->ident->cmpnt.u->atom.ident->name;
     } else {
-        if (ParserVerifyExpression(iter->ident, ctx, qctx, err) == MS_RESULT_ERROR) {
+        if (ParserVerifyExpression(iter->ident, v, err) == MS_RESULT_ERROR) {
             return MS_RESULT_ERROR;
         }
     }
 
-    if (ParserVerifyExpression(iter->iter, ctx, qctx, err) == MS_RESULT_ERROR) {
+    if (ParserVerifyExpression(iter->iter, v, err) == MS_RESULT_ERROR) {
         return MS_RESULT_ERROR;
     }
 
     return MS_RESULT_SUCCESS;
 }
 
-static ms_Result ParserVerifyIfStmt(const ms_StmtIf *ifstmt, ASTContext *ctx, QueueContext *qctx, ms_Error **err) {
+static ms_Result ParserVerifyIfStmt(const ms_StmtIf *ifstmt, Verifier *v, ms_Error **err) {
     assert(ifstmt);
-    assert(ctx);
-    assert(qctx);
+    assert(v);
     assert(err);
 
-    if (ParserVerifyExpression(ifstmt->expr, ctx, qctx, err) == MS_RESULT_ERROR) {
+    if (ParserVerifyExpression(ifstmt->expr, v, err) == MS_RESULT_ERROR) {
         return MS_RESULT_ERROR;
     }
 
-    if (ParserEnqueueIfStmt(ifstmt, ctx, qctx) == MS_RESULT_ERROR) {
+    if (VerifierEnqueueBlock(v, ifstmt->block, ASTCTX_IFSTMT, NULL, NULL) == MS_RESULT_ERROR) {
         return MS_RESULT_ERROR;
     }
 
     return (ifstmt->elif) ?
-           ParserVerifyElseIfStmt(ifstmt->elif, ctx, qctx, err) :
+           ParserVerifyElseIfStmt(ifstmt->elif, v, err) :
            MS_RESULT_SUCCESS;
 }
 
-static ms_Result ParserVerifyElseIfStmt(const ms_StmtIfElse *elif, ASTContext *ctx, QueueContext *qctx, ms_Error **err) {
+static ms_Result ParserVerifyElseIfStmt(const ms_StmtIfElse *elif, Verifier *v, ms_Error **err) {
     assert(elif);
-    assert(ctx);
-    assert(qctx);
+    assert(v);
     assert(err);
 
     switch (elif->type) {
         case IFELSE_IF:
-            return ParserVerifyIfStmt(elif->clause.ifstmt, ctx, qctx, err);
+            return ParserVerifyIfStmt(elif->clause.ifstmt, v, err);
         case IFELSE_ELSE:
-            /* enqueued by ParserEnqueueIfStmt */
-            break;
+            return VerifierEnqueueBlock(v, elif->clause.elstmt->block, ASTCTX_IFSTMT, NULL, NULL);
     }
 
     return MS_RESULT_SUCCESS;
 }
 
-static ms_Result ParserVerifyImportStmt(const ms_StmtImport *import, ASTContext *ctx, QueueContext *qctx, ms_Error **err) {
+static ms_Result ParserVerifyImportStmt(const ms_StmtImport *import, Verifier *v, ms_Error **err) {
     assert(import);
-    assert(ctx);
-    assert(qctx);
+    assert(v);
     assert(err);
 
     if (import->alias) {
-        if (VerifierSymbolExistsInCurrentScope(ctx, import->alias->name)) {
+        if (VerifierSymbolExistsInCurrentScope(v, import->alias->name)) {
             VerifierErrorSet(err, ERR_REDECLARATION_IN_IMPORT, dsbuf_char_ptr(import->alias->name));
             return MS_RESULT_ERROR;
         }
@@ -711,24 +588,22 @@ static ms_Result ParserVerifyImportStmt(const ms_StmtImport *import, ASTContext
     return MS_RESULT_SUCCESS;
 }
 
-static ms_Result ParserVerifyReturnStmt(const ms_StmtReturn *ret, ASTContext *ctx, QueueContext *qctx, ms_Error **err) {
+static ms_Result ParserVerifyReturnStmt(const ms_StmtReturn *ret, Verifier *v, ms_Error **err) {
     assert(ret);
-    assert(ctx);
-    assert(qctx);
+    assert(v);
     assert(err);
 
-    if (!VerifierInContext(ctx, ASTCTX_FUNCTION)) {
+    if (!VerifierInContext(v, ASTCTX_FUNCTION)) {
         VerifierErrorSet(err, ERR_RETURN_OUTSIDE_FUNC);
         return MS_RESULT_ERROR;
     }
 
-    return ParserVerifyExpression(ret->expr, ctx, qctx, err);
+    return ParserVerifyExpression(ret->expr, v, err);
 }
 
-static ms_Result ParserVerifyDeclaration(const ms_StmtDeclaration *decl, ASTContext *ctx, QueueContext *qctx, ms_Error **err) {
+static ms_Result ParserVerifyDeclaration(const ms_StmtDeclaration *decl, Verifier *v, ms_Error **err) {
     assert(decl);
-    assert(ctx);
-    assert(qctx);
+    assert(v);
     assert(err);
 
     if (decl->ident->type != IDENT_NAME) {
@@ -736,39 +611,40 @@ static ms_Result ParserVerifyDeclaration(const ms_StmtDeclaration *decl, ASTCont
         return MS_RESULT_ERROR;
     }
 
-    if (VerifierSymbolExistsInCurrentScope(ctx, decl->ident->name)) {
+    if (VerifierSymbolExistsInCurrentScope(v, decl->ident->name)) {
         VerifierErrorSet(err, ERR_VAR_REDECLARATION, dsbuf_char_ptr(decl->ident->name));
         return MS_RESULT_ERROR;
     }
 
     /* issue a warning if declaration merely shadows a name from an enclosing scope */
-    if (VerifierSymbolExistsInLexicalScope(ctx, decl->ident->name)) {
+    if (VerifierSymbolExistsInLexicalScope(v, decl->ident->name)) {
         /* TODO: add warning to err object */
         return MS_RESULT_WARNINGS;
     }
 
-    dsdict_put(ctx->symbols, decl->ident->name, &VERIFIER_SYMBOL_VAL);
+    if (!VerifierSymbolPut(v, decl->ident->name)) {
+        return MS_RESULT_ERROR;
+    }
 
     if ((decl->expr) &&
-        (ParserVerifyExpression(decl->expr, ctx, qctx, err) == MS_RESULT_ERROR)) {
+        (ParserVerifyExpression(decl->expr, v, err) == MS_RESULT_ERROR)) {
         return MS_RESULT_ERROR;
     }
 
     return (decl->next) ?
-           ParserVerifyDeclaration(decl->next, ctx, qctx, err) :
+           ParserVerifyDeclaration(decl->next, v, err) :
            MS_RESULT_SUCCESS;
 }
 
-static ms_Result ParserVerifyAssignment(const ms_StmtAssignment *assign, ASTContext *ctx, QueueContext *qctx, ms_Error **err) {
+static ms_Result ParserVerifyAssignment(const ms_StmtAssignment *assign, Verifier *v, ms_Error **err) {
     assert(assign);
-    assert(ctx);
-    assert(qctx);
+    assert(v);
     assert(err);
 
     size_t ntargets = 0;
     ms_StmtAssignTarget *target = assign->ident;
     while (target) {
-        if (ParserVerifyExpression(target->target, ctx, qctx, err) == MS_RESULT_ERROR) {
+        if (ParserVerifyExpression(target->target, v, err) == MS_RESULT_ERROR) {
             return MS_RESULT_ERROR;
         }
         ntargets += 1;
@@ -778,7 +654,7 @@ static ms_Result ParserVerifyAssignment(const ms_StmtAssignment *assign, ASTCont
     size_t nexprs = 0;
     ms_StmtAssignExpr *expr = assign->expr;
     while (expr) {
-        if (ParserVerifyExpression(expr->expr, ctx, qctx, err) == MS_RESULT_ERROR) {
+        if (ParserVerifyExpression(expr->expr, v, err) == MS_RESULT_ERROR) {
             return MS_RESULT_ERROR;
         }
         nexprs += 1;
@@ -793,34 +669,33 @@ static ms_Result ParserVerifyAssignment(const ms_StmtAssignment *assign, ASTCont
     return MS_RESULT_SUCCESS;
 }
 
-static ms_Result ParserVerifyExpression(const ms_Expr *expr, ASTContext *ctx, QueueContext *qctx, ms_Error **err) {
+static ms_Result ParserVerifyExpression(const ms_Expr *expr, Verifier *v, ms_Error **err) {
     assert(expr);
-    assert(ctx);
-    assert(qctx);
+    assert(v);
     assert(err);
 
     switch (expr->type) {
         case EXPRTYPE_UNARY:
-            if (ParserVerifyExprAtom(&expr->cmpnt.u->atom, expr->cmpnt.u->type, ctx, qctx, err) == MS_RESULT_ERROR) {
+            if (ParserVerifyExprAtom(&expr->cmpnt.u->atom, expr->cmpnt.u->type, v, err) == MS_RESULT_ERROR) {
                 return MS_RESULT_ERROR;
             }
             break;
         case EXPRTYPE_BINARY:
-            if (ParserVerifyExprAtom(&expr->cmpnt.b->latom, expr->cmpnt.b->ltype, ctx, qctx, err) == MS_RESULT_ERROR) {
+            if (ParserVerifyExprAtom(&expr->cmpnt.b->latom, expr->cmpnt.b->ltype, v, err) == MS_RESULT_ERROR) {
                 return MS_RESULT_ERROR;
             }
-            if (ParserVerifyExprAtom(&expr->cmpnt.b->ratom, expr->cmpnt.b->rtype, ctx, qctx, err) == MS_RESULT_ERROR) {
+            if (ParserVerifyExprAtom(&expr->cmpnt.b->ratom, expr->cmpnt.b->rtype, v, err) == MS_RESULT_ERROR) {
                 return MS_RESULT_ERROR;
             }
             break;
         case EXPRTYPE_CONDITIONAL:
-            if (ParserVerifyExprAtom(&expr->cmpnt.c->cond, expr->cmpnt.c->condtype, ctx, qctx, err) == MS_RESULT_ERROR) {
+            if (ParserVerifyExprAtom(&expr->cmpnt.c->cond, expr->cmpnt.c->condtype, v, err) == MS_RESULT_ERROR) {
                 return MS_RESULT_ERROR;
             }
-            if (ParserVerifyExprAtom(&expr->cmpnt.c->iftrue, expr->cmpnt.c->truetype, ctx, qctx, err) == MS_RESULT_ERROR) {
+            if (ParserVerifyExprAtom(&expr->cmpnt.c->iftrue, expr->cmpnt.c->truetype, v, err) == MS_RESULT_ERROR) {
                 return MS_RESULT_ERROR;
             }
-            if (ParserVerifyExprAtom(&expr->cmpnt.c->iffalse, expr->cmpnt.c->falsetype, ctx, qctx, err) == MS_RESULT_ERROR) {
+            if (ParserVerifyExprAtom(&expr->cmpnt.c->iffalse, expr->cmpnt.c->falsetype, v, err) == MS_RESULT_ERROR) {
                 return MS_RESULT_ERROR;
             }
             break;
@@ -829,25 +704,24 @@ static ms_Result ParserVerifyExpression(const ms_Expr *expr, ASTContext *ctx, Qu
     return MS_RESULT_SUCCESS;
 }
 
-static ms_Result ParserVerifyExprAtom(const ms_ExprAtom *atom, ms_ExprAtomType type, ASTContext *ctx, QueueContext *qctx, ms_Error **err) {
+static ms_Result ParserVerifyExprAtom(const ms_ExprAtom *atom, ms_ExprAtomType type, Verifier *v, ms_Error **err) {
     assert(atom);
-    assert(ctx);
-    assert(qctx);
+    assert(v);
     assert(err);
 
     switch (type) {
         case EXPRATOM_VALUE:
-            if (ParserVerifyExprAtomValue(&atom->val, ctx, qctx, err) == MS_RESULT_ERROR) {
+            if (ParserVerifyExprAtomValue(&atom->val, v, err) == MS_RESULT_ERROR) {
                 return MS_RESULT_ERROR;
             }
             break;
         case EXPRATOM_EXPRESSION:
-            if (ParserVerifyExpression(atom->expr, ctx, qctx, err) == MS_RESULT_ERROR) {
+            if (ParserVerifyExpression(atom->expr, v, err) == MS_RESULT_ERROR) {
                 return MS_RESULT_ERROR;
             }
             break;
         case EXPRATOM_IDENT:
-            if (ParserVerifyIdent(atom->ident, ctx, qctx, err) == MS_RESULT_ERROR) {
+            if (ParserVerifyIdent(atom->ident, v, err) == MS_RESULT_ERROR) {
                 return MS_RESULT_ERROR;
             }
             break;
@@ -855,7 +729,7 @@ static ms_Result ParserVerifyExprAtom(const ms_ExprAtom *atom, ms_ExprAtomType t
             size_t len = dsarray_len(atom->list);
             for (size_t i = 0; i < len; i++) {
                 ms_Expr *elem = dsarray_get(atom->list, i);
-                if (ParserVerifyExpression(elem, ctx, qctx, err) == MS_RESULT_ERROR) {
+                if (ParserVerifyExpression(elem, v, err) == MS_RESULT_ERROR) {
                     return MS_RESULT_ERROR;
                 }
             }
@@ -870,10 +744,9 @@ static ms_Result ParserVerifyExprAtom(const ms_ExprAtom *atom, ms_ExprAtomType t
     return MS_RESULT_SUCCESS;
 }
 
-static ms_Result ParserVerifyExprAtomValue(const ms_Value *val, ASTContext *ctx, QueueContext *qctx, ms_Error **err) {
+static ms_Result ParserVerifyExprAtomValue(const ms_Value *val, Verifier *v, ms_Error **err) {
     assert(val);
-    assert(ctx);
-    assert(qctx);
+    assert(v);
     assert(err);
 
     switch (val->type) {
@@ -887,7 +760,7 @@ static ms_Result ParserVerifyExprAtomValue(const ms_Value *val, ASTContext *ctx,
             size_t len = dsarray_len(val->val.a);
             for (size_t i = 0; i < len; i++) {
                 ms_Expr *elem = dsarray_get(val->val.a, i);
-                if (ParserVerifyExpression(elem, ctx, qctx, err) == MS_RESULT_ERROR) {
+                if (ParserVerifyExpression(elem, v, err) == MS_RESULT_ERROR) {
                     return MS_RESULT_ERROR;
                 }
             }
@@ -897,74 +770,58 @@ static ms_Result ParserVerifyExprAtomValue(const ms_Value *val, ASTContext *ctx,
             size_t len = dsarray_len(val->val.o);
             for (size_t i = 0; i < len; i++) {
                 ms_ValObjectTuple *tuple = dsarray_get(val->val.o, i);
-                if (ParserVerifyExpression(tuple->key, ctx, qctx, err) == MS_RESULT_ERROR) {
+                if (ParserVerifyExpression(tuple->key, v, err) == MS_RESULT_ERROR) {
                     return MS_RESULT_ERROR;
                 }
-                if (ParserVerifyExpression(tuple->val, ctx, qctx, err) == MS_RESULT_ERROR) {
+                if (ParserVerifyExpression(tuple->val, v, err) == MS_RESULT_ERROR) {
                     return MS_RESULT_ERROR;
                 }
             }
             break;
         }
         case MSVAL_FUNC: {
-            ASTContext *blockctx;
-            if (ParserEnqueueBlockWithChild(val->val.fn->block, ctx, ASTCTX_FUNCTION, qctx, &blockctx) == MS_RESULT_ERROR) {
-                return MS_RESULT_ERROR;
-            }
-
-            size_t nargs = dsarray_len(val->val.fn->args);
-            for (size_t i = 0; i < nargs; i++) {
-                ms_Ident *arg = dsarray_get(val->val.fn->args, i);
-                dsdict_put(blockctx->symbols, arg->name, &VERIFIER_SYMBOL_VAL);
-            }
-
-            return MS_RESULT_SUCCESS;
+            return VerifierEnqueueBlock(v, val->val.fn->block, ASTCTX_FUNCTION, val->val.fn->args, NULL);
         }
     }
 
     return MS_RESULT_SUCCESS;
 }
 
-static ms_Result ParserVerifyIdent(const ms_Ident *ident, ASTContext *ctx, QueueContext *qctx, ms_Error **err) {
+static ms_Result ParserVerifyIdent(const ms_Ident *ident, Verifier *v, ms_Error **err) {
     assert(ident);
-    assert(ctx);
-    assert(qctx);
+    assert(v);
     assert(err);
 
     if ((ident->type == IDENT_GLOBAL) || (ident->type == IDENT_BUILTIN)) {
         return MS_RESULT_SUCCESS;
     }
 
-    if (!VerifierSymbolExistsInLexicalScope(ctx, ident->name)) {
+    if (!VerifierSymbolExistsInLexicalScope(v, ident->name)) {
         VerifierErrorSet(err, ERR_REFERENCE_TO_UNDEFINED, dsbuf_char_ptr(ident->name));
         return MS_RESULT_ERROR;
     }
 
-    dsdict_put(ctx->symbols, ident->name, &VERIFIER_SYMBOL_VAL);
-
-    return MS_RESULT_SUCCESS;
+    return (VerifierSymbolPut(v, ident->name)) ? MS_RESULT_SUCCESS : MS_RESULT_ERROR;
 }
 
 /*
  * UTILITY FUNCTIONS
  */
 
-static inline bool VerifierInContext(ASTContext *ctx, ASTElementContextType type) {
-    assert(ctx);
+static inline bool VerifierInContext(const Verifier *v, ASTElementContextType type) {
+    assert(v);
 
-    ASTContext *cur = ctx;
-    while (cur) {
-        if (cur->type == type) {
+    for (size_t i = v->nscopes; i > 0; i--) {
+        if (v->scopes[i - 1].type == type) {
             return true;
         }
-        cur = cur->parent;
     }
 
     return false;
 }
 
-static inline bool VerifierInConstrainedContext(ASTContext *ctx, ASTElementContextType ancestor, ASTElementContextType type) {
-    assert(ctx);
+static inline bool VerifierInConstrainedContext(const Verifier *v, ASTElementContextType ancestor, ASTElementContextType type) {
+    assert(v);
 
     /*
      * We want to assert that an AST element appears in a context which
@@ -998,48 +855,60 @@ static inline bool VerifierInConstrainedContext(ASTContext *ctx, ASTElementConte
      */
 
     bool found_ancestor_context = false;
-    ASTContext *cur = ctx;
-    while (cur) {
-        if (cur->type == ancestor) {
+    for (size_t i = v->nscopes; i > 0; i--) {
+        ASTElementContextType cur = v->scopes[i - 1].type;
+        if (cur == ancestor) {
             found_ancestor_context = true;
         }
-        if (cur->type == type) {
+        if (cur == type) {
             if (found_ancestor_context) {
                 return false;
             }
             return true;
         }
-        cur = cur->parent;
     }
 
     return false;
 }
 
-static inline bool VerifierSymbolExistsInCurrentScope(ASTContext *ctx, DSBuffer *buf) {
-    assert(ctx);
+static inline bool VerifierSymbolExistsInCurrentScope(const Verifier *v, DSBuffer *buf) {
+    assert(v);
     assert(buf);
-    return dsdict_get(ctx->symbols, buf) != NULL;
+
+    size_t top = (size_t)(uintptr_t)dsdict_get(v->index, buf);
+    if (top) {
+        return (v->symbols[top - 1].depth == v->nscopes - 1);
+    }
+    return (v->nscopes == 1) && (VerifierSymbolDeclaredByPart(v, buf));
 }
 
-static inline bool VerifierSymbolExistsInLexicalScope(ASTContext *ctx, DSBuffer *buf) {
-    assert(ctx);
+static inline bool VerifierSymbolExistsInLexicalScope(const Verifier *v, DSBuffer *buf) {
+    assert(v);
     assert(buf);
+    return (dsdict_get(v->index, buf) != NULL) || (VerifierSymbolDeclaredByPart(v, buf));
+}
 
-    ASTContext *cur = ctx;
-    while (cur) {
-        if (VerifierSymbolExistsInCurrentScope(cur, buf)) {
-            return true;
-        }
-        cur = cur->parent;
+/* Return true if another part of a split module declares `buf` at its top
+ * level, and that declaration is visible from the current scope. */
+static inline bool VerifierSymbolDeclaredByPart(const Verifier *v, DSBuffer *buf) {
+    assert(v);
+    assert(buf);
+
+    if (!v->names) {
+        return false;
     }
 
-    return false;
+    size_t part = (size_t)(uintptr_t)dsdict_get(v->names, buf);
+    if ((!part) || (part == v->part)) {
+        return false;
+    }
+    return (part < v->part) || (v->nscopes > 1);
 }
 
 static void VerifierErrorSet(ms_Error **err, const char *msg, ...) {
     assert(err);
 
-    *err = malloc(sizeof(ms_Error));
+    *err = dsalloc(sizeof(ms_Error));
     if (!(*err)) {
         return;
     }
@@ -1056,7 +925,7 @@ static void VerifierErrorSet(ms_Error **err, const char *msg, ...) {
     }
 
     (*err)->len = (size_t)len;
-    (*err)->msg = malloc((size_t)len + 1);
+    (*err)->msg = dsalloc((size_t)len + 1);
     if ((*err)->msg) {
         vsnprintf((*err)->msg, len + 1, msg, argscpy);
     }
@@ -17,9 +17,27 @@
 #ifndef MSCRIPT_VERIFIER_H
 #define MSCRIPT_VERIFIER_H
 
+#include "libds/dict.h"
 #include "error.h"
 #include "lang.h"
 
 ms_Result ms_ParserVerifyAST(const ms_AST *ast, ms_Error **err);
 
+/**
+* @brief Verify an AST whose module scope begins with each of the names in
+* @c params already declared, as for the arguments of a function.
+*/
+ms_Result ms_ParserVerifyASTParams(const ms_AST *ast, const ms_ArgList *params, ms_Error **err);
+
+/**
+* @brief Verify one part of a module which was split at top-level
+* statements, as it would be verified as part of the whole module.
+*
+* @param params names declared at the start of the whole module, or NULL
+* @param names maps each name declared at the top level of the module to
+*        the index + 1 of the first part declaring it
+* @param part the index of the part being verified
+*/
+ms_Result ms_ParserVerifyASTPart(const ms_AST *ast, const ms_ArgList *params, const DSDict *names, size_t part, ms_Error **err);
+
 #endif //MSCRIPT_VERIFIER_H
@@ -20,10 +20,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "libds/alloc.h"
 #include "libds/array.h"
 #include "libds/buffer.h"
 #include "libds/dict.h"
 #include "libds/hash.h"
+#include "libds/pool.h"
+#include "intern.h"
 #include "obj.h"
 #include "vm.h"
 #include "lang.h"
@@ -33,6 +36,8 @@
 static const size_t FRAME_DATA_STACK_LIMIT = FRAME_DATA_STACK_LIMIT_L;
 static const size_t VM_FRAME_STACK_LIMIT = VM_FRAME_STACK_LIMIT_L;
 static const size_t VM_FRAME_BLOCK_STACK_CAP = 10;
+static const size_t VM_ROPE_FLATTEN_STACK_CAP = 16;
+static const size_t VM_COLLECT_STACK_CAP = 16;
 static const ms_VMValue EMPTY_STACK_VAL;
 
 static const int MS_VM_NULL = 0;
@@ -42,24 +47,48 @@ static const char *const ERR_IF_EXPR_NOT_BOOL = "if statement expressions must b
 static const char *const ERR_NAME_NOT_DEFINED = "name '%s' not defined in the current scope";
 static const char *const ERR_NOT_IMPLEMENTED = "not implemented";
 static const char *const ERR_OUT_OF_MEMORY = "out of memory";
+static const char *const ERR_STACK_OVERFLOW = "stack overflow";
 
 typedef struct {
     DSDict *env;                                    /* block level symbol table */
+    DSPool *pool;                                   /* pool the block was allocated from */
 } ms_VMBlock;
 
+struct ms_VMRope {
+    ms_VMValue left;                                /* left operand (string or rope) */
+    ms_VMValue right;                               /* right operand (string or rope) */
+    size_t len;                                     /* total length of the rope in bytes */
+    DSBuffer *flat;                                 /* flattened string (NULL until first read) */
+    bool kept;                                      /* true once the rope has outlived the call which made it */
+    ms_VMRope *next;                                /* next rope allocated by the same VM */
+};
+
+struct ms_VMSlice {
+    const DSBuffer *parent;                         /* string the slice points into (pinned) */
+    size_t start;                                   /* offset of the slice in the parent */
+    size_t len;                                     /* length of the slice in bytes */
+    DSBuffer *flat;                                 /* copy of the slice (NULL unless requested) */
+    bool kept;                                      /* true once the slice has outlived the call which made it */
+    ms_VMSlice *next;                               /* next slice allocated by the same VM */
+};
+
 typedef struct {
     size_t ip;                                      /* instruction pointer */
     size_t dp;                                      /* data stack pointer (points to index of NEXT push), current top is always (dp-1) */
     ms_VMByteCode *code;                            /* byte code for current frame */
+    bool borrowed;                                  /* true if `code` is owned by the caller */
     ms_VMValue data[FRAME_DATA_STACK_LIMIT_L];      /* frame data stack */
     DSArray *blocks;                                /* stack of frame blocks */
 } ms_VMFrame;
 
 struct ms_VM {
+    DSPool *pool;                                   /* per-VM cache of small runtime objects */
     DSArray *fstack;                                /* call stack frame */
     ms_Error **err;                                 /* pointer to current VM error (not owned by VM) */
 
     DSDict *env;                                    /* global namespace */
+    ms_VMRope *ropes;                               /* every rope allocated by the VM */
+    ms_VMSlice *slices;                             /* every slice allocated by the VM */
 
     DSDict *float_;                                 /* float primitive prototype */
     DSDict *int_;                                   /* int primitive prototype */
@@ -70,15 +99,29 @@ struct ms_VM {
 };
 
 static bool VMGeneratePrototypes(ms_VM *vm);
-static ms_VMFrame *VMFrameNew(ms_VMByteCode *bc);
+static ms_VMFrame *VMFrameNew(ms_VM *vm, ms_VMByteCode *bc);
 static void VMFrameDestroy(ms_VMFrame *f);
-static ms_VMBlock *VMBlockNew(void);
+static ms_VMBlock *VMBlockNew(DSPool *pool);
 static void VMBlockDestroy(ms_VMBlock *blk);
 static ms_Result VMFrameExecute(ms_VM *vm, ms_VMFrame *f);
 static ms_VMValue *VMPeek(const ms_VM *vm, int index);
 static bool VMStackIsEmpty(const ms_VM *vm);
+static bool VMStackIsFull(ms_VM *vm);
 static inline ms_VMFrame *VMCurrentFrame(const ms_VM *vm);
 static inline DSDict *VMFindIdentEnv(const ms_VM *vm, const ms_VMFrame *f, DSBuffer *ident);
+static inline DSDict *VMEnvNew(DSPool *pool);
+static bool VMEnvPut(DSDict *env, DSPool *pool, DSBuffer *ident, ms_VMValue v);
+static void VMEnvDestroy(DSDict *env, DSPool *pool);
+static inline bool VMIsStr(const ms_VMValue *v);
+static DSBuffer *VMRopeFlatten(const ms_VMRope *rope);
+static inline const char *VMRopePart(const ms_VMValue *v, size_t *len);
+static inline size_t VMRopeCopyPart(char *str, size_t pos, const char *part, size_t len);
+static void VMRopesDestroy(ms_VM *vm, const ms_VMRope *mark);
+static void VMSlicesDestroy(ms_VM *vm, const ms_VMSlice *mark);
+static void VMStrsCollect(ms_VM *vm, size_t depth, const ms_VMRope *ropes, const ms_VMSlice *slices);
+static bool VMStrsMarkEnv(DSArray *stack, DSDict *env);
+static bool VMStrsMark(ms_VM *vm, DSArray *stack, const ms_VMRope *ropes);
+static void VMStrsSweep(ms_VM *vm, const ms_VMRope *ropes, const ms_VMSlice *slices);
 
 static inline size_t VMPrint(ms_VM *vm);
 static inline size_t VMPush(ms_VM *vm, int val);
@@ -101,31 +144,40 @@ static inline size_t VMDelName(ms_VM *vm, int arg);
  */
 
 ms_VM *ms_VMNew(void) {
-    ms_VM *vm = malloc(sizeof(ms_VM));
+    ms_VM *vm = dsalloc(sizeof(ms_VM));
     if (!vm) {
         return NULL;
     }
 
+    vm->ropes = NULL;
+    vm->slices = NULL;
+    vm->pool = dspool_new();
+    if (!vm->pool) {
+        dsfree(vm);
+        return NULL;
+    }
+
     vm->fstack = dsarray_new_cap(VM_FRAME_STACK_LIMIT, NULL,
                                  (dsarray_free_fn)VMFrameDestroy);
     if (!vm->fstack) {
-        free(vm);
+        dspool_destroy(vm->pool);
+        dsfree(vm);
         return NULL;
     }
 
-    vm->env = dsdict_new((dsdict_hash_fn)dsbuf_hash,
-                         (dsdict_compare_fn)dsbuf_compare,
-                         (dsdict_free_fn)dsbuf_destroy, NULL);
+    vm->env = VMEnvNew(vm->pool);
     if (!vm->env) {
         dsarray_destroy(vm->fstack);
-        free(vm);
+        dspool_destroy(vm->pool);
+        dsfree(vm);
         return NULL;
     }
 
     if (!VMGeneratePrototypes(vm)) {
         dsarray_destroy(vm->fstack);
-        dsdict_destroy(vm->env);
-        free(vm);
+        VMEnvDestroy(vm->env, vm->pool);
+        dspool_destroy(vm->pool);
+        dsfree(vm);
         return NULL;
     }
 
@@ -141,13 +193,61 @@ ms_Result ms_VMExecute(ms_VM *vm, ms_VMByteCode *bc, ms_Error **err) {
     *err = NULL;
     vm->err = err;
 
-    ms_VMFrame *newf = VMFrameNew(bc);
+    ms_VMFrame *newf = VMFrameNew(vm, bc);
     if (!newf) {
         return MS_RESULT_ERROR;
     }
+
+    size_t depth = dsarray_len(vm->fstack);
+    ms_VMRope *ropes = vm->ropes;
+    ms_VMSlice *slices = vm->slices;
     dsarray_append(vm->fstack, newf);
 
     ms_Result res = VMFrameExecute(vm, newf);
+    VMStrsCollect(vm, depth, ropes, slices);
+    return res;
+}
+
+ms_Result ms_VMExecuteBound(ms_VM *vm, const ms_VMByteCode *bc, DSBuffer *const *names,
+                            const ms_VMValue *vals, size_t nvals, ms_Error **err) {
+    if ((!vm) || (!bc)) {
+        return MS_RESULT_ERROR;
+    }
+
+    *err = NULL;
+    vm->err = err;
+
+    /* the bytecode is only ever read while it executes */
+    ms_VMFrame *newf = VMFrameNew(vm, (ms_VMByteCode *)bc);
+    if (!newf) {
+        return MS_RESULT_ERROR;
+    }
+    newf->borrowed = true;
+
+    ms_VMBlock *blk = dsarray_top(newf->blocks);
+    for (size_t i = 0; i < nvals; i++) {
+        if (!VMEnvPut(blk->env, vm->pool, names[i], vals[i])) {
+            VMFrameDestroy(newf);
+            ms_VMErrorSet(vm, ERR_OUT_OF_MEMORY);
+            return MS_RESULT_ERROR;
+        }
+    }
+
+    size_t depth = dsarray_len(vm->fstack);
+    ms_VMRope *ropes = vm->ropes;
+    ms_VMSlice *slices = vm->slices;
+    dsarray_append(vm->fstack, newf);
+    ms_Result res = VMFrameExecute(vm, newf);
+
+    /* drop the frame (and any left above it by a failed call), so the VM
+     * holds no reference to the bytecode once execution is complete; no
+     * value can outlive the frame (the VM does not implement globals), so
+     * neither can any rope or slice made while it executed */
+    while (dsarray_len(vm->fstack) > depth) {
+        VMFrameDestroy(dsarray_pop(vm->fstack));
+    }
+    VMRopesDestroy(vm, ropes);
+    VMSlicesDestroy(vm, slices);
     return res;
 }
 
@@ -159,10 +259,14 @@ ms_Result ms_VMExecuteAndPrint(ms_VM *vm, ms_VMByteCode *bc, ms_Error **err) {
     *err = NULL;
     vm->err = err;
 
-    ms_VMFrame *newf = VMFrameNew(bc);
+    ms_VMFrame *newf = VMFrameNew(vm, bc);
     if (!newf) {
         return MS_RESULT_ERROR;
     }
+
+    size_t depth = dsarray_len(vm->fstack);
+    ms_VMRope *ropes = vm->ropes;
+    ms_VMSlice *slices = vm->slices;
     dsarray_append(vm->fstack, newf);
 
     ms_Result res = VMFrameExecute(vm, newf);
@@ -171,6 +275,7 @@ ms_Result ms_VMExecuteAndPrint(ms_VM *vm, ms_VMByteCode *bc, ms_Error **err) {
             (void) VMPrint(vm);
         }
     }
+    VMStrsCollect(vm, depth, ropes, slices);
     return res;
 }
 
@@ -190,7 +295,7 @@ ms_VMValue ms_VMPop(ms_VM *vm) {
     assert(f);
     assert((f->dp - 1) != SIZE_MAX);
     ms_VMValue val = f->data[f->dp - 1];
-    f->data[f->dp] = EMPTY_STACK_VAL;
+    f->data[f->dp - 1] = EMPTY_STACK_VAL;
     f->dp--;
     return val;
 }
@@ -200,7 +305,7 @@ void ms_VMErrorSet(ms_VM *vm, const char *msg, ...) {
 
     ms_Error **err = vm->err;
     assert(!(*err));
-    *err = malloc(sizeof(ms_Error));
+    *err = dsalloc(sizeof(ms_Error));
     if (!(*err)) {
         return;
     }
@@ -217,7 +322,7 @@ void ms_VMErrorSet(ms_VM *vm, const char *msg, ...) {
     }
 
     (*err)->len = (size_t)len;
-    (*err)->msg = malloc((size_t)len + 1);
+    (*err)->msg = dsalloc((size_t)len + 1);
     if ((*err)->msg) {
         vsnprintf((*err)->msg, len + 1, msg, argscpy);
     }
@@ -271,6 +376,155 @@ void ms_VMPushStrL(ms_VM *vm, const char *s, size_t len) {
     ms_VMPush(vm, v);
 }
 
+bool ms_VMPushStrConcat(ms_VM *vm, ms_VMValue left, ms_VMValue right) {
+    assert(vm);
+    assert(VMIsStr(&left));
+    assert(VMIsStr(&right));
+
+    /* appending an empty string is common enough in loops that it is
+     * worth avoiding a new node */
+    size_t llen = ms_VMStrLen(&left);
+    size_t rlen = ms_VMStrLen(&right);
+    if (rlen == 0) {
+        ms_VMPush(vm, left);
+        return true;
+    }
+    if (llen == 0) {
+        ms_VMPush(vm, right);
+        return true;
+    }
+
+    ms_VMRope *rope = dspool_alloc(vm->pool, sizeof(ms_VMRope));
+    if (!rope) {
+        return false;
+    }
+
+    rope->left = left;
+    rope->right = right;
+    rope->len = llen + rlen;
+    rope->flat = NULL;
+    rope->kept = false;
+    rope->next = vm->ropes;
+    vm->ropes = rope;
+
+    ms_VMValue v;
+    v.type = VMVAL_ROPE;
+    v.val.r = rope;
+    ms_VMPush(vm, v);
+    return true;
+}
+
+const ms_VMStr *ms_VMStrFlatten(ms_VM *vm, const ms_VMValue *v) {
+    assert(vm);
+    assert(v);
+
+    switch (v->type) {
+        case VMVAL_STR:
+            return v->val.s;
+        case VMVAL_ROPE: {
+            ms_VMRope *rope = v->val.r;
+            assert(rope);
+            if (!rope->flat) {
+                rope->flat = VMRopeFlatten(rope);
+            }
+            return rope->flat;
+        }
+        case VMVAL_SLICE: {
+            /* callers needing a buffer of their own force the slice to be
+             * copied (once); ms_VMStrChars can read a slice without one */
+            ms_VMSlice *slice = v->val.sl;
+            assert(slice);
+            if (!slice->flat) {
+                slice->flat = (slice->len > 0) ?
+                              dsbuf_substr(slice->parent, slice->start, slice->len) :
+                              dsbuf_new_buffer(0);
+            }
+            return slice->flat;
+        }
+        default:
+            break;
+    }
+
+    assert(false && "Value is not a string.");
+    return NULL;
+}
+
+bool ms_VMPushStrSlice(ms_VM *vm, const ms_VMValue *str, size_t start, size_t len) {
+    assert(vm);
+    assert(str);
+    assert(VMIsStr(str));
+    assert(start <= ms_VMStrLen(str));
+    assert(len <= (ms_VMStrLen(str) - start));
+
+    /* slices always refer to a contiguous parent buffer, so ropes are
+     * flattened and slices of slices refer to the original parent */
+    const DSBuffer *parent;
+    switch (str->type) {
+        case VMVAL_SLICE:
+            parent = str->val.sl->parent;
+            start += str->val.sl->start;
+            break;
+        default:
+            parent = ms_VMStrFlatten(vm, str);
+            if (!parent) {
+                return false;
+            }
+            break;
+    }
+
+    ms_VMSlice *slice = dspool_alloc(vm->pool, sizeof(ms_VMSlice));
+    if (!slice) {
+        return false;
+    }
+
+    slice->parent = parent;
+    slice->start = start;
+    slice->len = len;
+    slice->flat = NULL;
+    slice->kept = false;
+    slice->next = vm->slices;
+    vm->slices = slice;
+
+    ms_VMValue v;
+    v.type = VMVAL_SLICE;
+    v.val.sl = slice;
+    ms_VMPush(vm, v);
+    return true;
+}
+
+const char *ms_VMStrChars(ms_VM *vm, const ms_VMValue *v, size_t *len) {
+    assert(vm);
+    assert(v);
+    assert(len);
+
+    if (v->type == VMVAL_SLICE) {
+        const ms_VMSlice *slice = v->val.sl;
+        *len = slice->len;
+        return dsbuf_char_ptr(slice->parent) + slice->start;
+    }
+
+    const ms_VMStr *s = ms_VMStrFlatten(vm, v);
+    *len = (s) ? dsbuf_len(s) : 0;
+    return (s) ? dsbuf_char_ptr(s) : NULL;
+}
+
+size_t ms_VMStrLen(const ms_VMValue *v) {
+    assert(v);
+    switch (v->type) {
+        case VMVAL_STR:
+            return (v->val.s) ? dsbuf_len(v->val.s) : 0;
+        case VMVAL_ROPE:
+            return v->val.r->len;
+        case VMVAL_SLICE:
+            return v->val.sl->len;
+        default:
+            break;
+    }
+
+    assert(false && "Value is not a string.");
+    return 0;
+}
+
 void ms_VMPushBool(ms_VM *vm, ms_ValBool b) {
     assert(vm);
     ms_VMValue v;
@@ -307,7 +561,9 @@ ms_Function ms_VMPrototypeFuncGet(ms_VM *vm, ms_VMDataType type, const char *met
         case VMVAL_INT:
             def = dsdict_get(vm->int_, (void *)method);
             return (def) ? def->func : NULL;
-        case VMVAL_STR:
+        case VMVAL_STR:         /* fall through */
+        case VMVAL_ROPE:        /* fall through */
+        case VMVAL_SLICE:
             def = dsdict_get(vm->str, (void *)method);
             return (def) ? def->func : NULL;
         case VMVAL_BOOL:
@@ -344,8 +600,20 @@ void ms_VMDestroy(ms_VM *vm) {
     vm->null = NULL;
     dsarray_destroy(vm->fstack);
     vm->fstack = NULL;
+    VMEnvDestroy(vm->env, vm->pool);
+    vm->env = NULL;
+    VMRopesDestroy(vm, NULL);
+    VMSlicesDestroy(vm, NULL);
+    dspool_destroy(vm->pool);
+    vm->pool = NULL;
     vm->err = NULL;
-    free(vm);
+    dsfree(vm);
+}
+
+void ms_VMPoolStats(const ms_VM *vm, DSPoolStats *stats) {
+    assert(vm);
+    assert(stats);
+    dspool_stats(vm->pool, stats);
 }
 
 bool ms_VMFloatIsInt(ms_VMFloat f, ms_VMInt *l) {
@@ -371,16 +639,16 @@ static bool VMGeneratePrototypes(ms_VM *vm) {
     vm->bool_ = NULL;
     vm->null = NULL;
 
-    vm->float_ = dsdict_new((dsdict_hash_fn)hash_fnv1,
-                            (dsdict_compare_fn)strcmp, NULL, NULL);
-    vm->int_ = dsdict_new((dsdict_hash_fn)hash_fnv1,
-                          (dsdict_compare_fn)strcmp, NULL, NULL);
-    vm->str = dsdict_new((dsdict_hash_fn)hash_fnv1,
-                         (dsdict_compare_fn)strcmp, NULL, NULL);
-    vm->bool_ = dsdict_new((dsdict_hash_fn)hash_fnv1,
-                           (dsdict_compare_fn)strcmp, NULL, NULL);
-    vm->null = dsdict_new((dsdict_hash_fn)hash_fnv1,
-                          (dsdict_compare_fn)strcmp, NULL, NULL);
+    vm->float_ = dsdict_new_pool((dsdict_hash_fn)hash_cstr,
+                                 (dsdict_compare_fn)strcmp, NULL, NULL, vm->pool);
+    vm->int_ = dsdict_new_pool((dsdict_hash_fn)hash_cstr,
+                               (dsdict_compare_fn)strcmp, NULL, NULL, vm->pool);
+    vm->str = dsdict_new_pool((dsdict_hash_fn)hash_cstr,
+                              (dsdict_compare_fn)strcmp, NULL, NULL, vm->pool);
+    vm->bool_ = dsdict_new_pool((dsdict_hash_fn)hash_cstr,
+                                (dsdict_compare_fn)strcmp, NULL, NULL, vm->pool);
+    vm->null = dsdict_new_pool((dsdict_hash_fn)hash_cstr,
+                               (dsdict_compare_fn)strcmp, NULL, NULL, vm->pool);
 
     if ((!vm->float_) || (!vm->int_) || (!vm->str) || (!vm->bool_) || (!vm->null)) {
         dsdict_destroy(vm->float_);
@@ -424,8 +692,10 @@ static bool VMGeneratePrototypes(ms_VM *vm) {
     return true;
 }
 
-static ms_VMFrame *VMFrameNew(ms_VMByteCode *bc) {
-    ms_VMFrame *f = calloc(1, sizeof(ms_VMFrame));
+static ms_VMFrame *VMFrameNew(ms_VM *vm, ms_VMByteCode *bc) {
+    assert(vm);
+
+    ms_VMFrame *f = dscalloc(1, sizeof(ms_VMFrame));
     if (!f) {
         return NULL;
     }
@@ -438,7 +708,7 @@ static ms_VMFrame *VMFrameNew(ms_VMByteCode *bc) {
         return NULL;
     }
 
-    ms_VMBlock *blk = VMBlockNew();
+    ms_VMBlock *blk = VMBlockNew(vm->pool);
     if (!blk) {
         VMFrameDestroy(f);
         return NULL;
@@ -450,25 +720,25 @@ static ms_VMFrame *VMFrameNew(ms_VMByteCode *bc) {
 
 static void VMFrameDestroy(ms_VMFrame *f) {
     if (!f) { return; }
-    ms_VMByteCodeDestroy(f->code);  /* TODO: probably eventually cache bytecode */
+    if (!f->borrowed) {
+        ms_VMByteCodeDestroy(f->code);
+    }
     f->code = NULL;
     dsarray_destroy(f->blocks);
     f->blocks = NULL;
-    free(f);
+    dsfree(f);
 }
 
-static ms_VMBlock *VMBlockNew(void) {
-    ms_VMBlock *blk = malloc(sizeof(ms_VMBlock));
+static ms_VMBlock *VMBlockNew(DSPool *pool) {
+    ms_VMBlock *blk = dspool_alloc(pool, sizeof(ms_VMBlock));
     if (!blk) {
         return NULL;
     }
 
-    blk->env = dsdict_new((dsdict_hash_fn)dsbuf_hash,
-                          (dsdict_compare_fn)dsbuf_compare,
-                          NULL,      /* keys are stored in ms_VMByteCode structure and are freed by a separate function */
-                          NULL);     // TODO: this should have a free function that decrements the (future) reference counter
+    blk->pool = pool;
+    blk->env = VMEnvNew(pool);
     if (!blk->env) {
-        free(blk);
+        dspool_free(pool, blk, sizeof(ms_VMBlock));
         return NULL;
     }
 
@@ -477,9 +747,9 @@ static ms_VMBlock *VMBlockNew(void) {
 
 static void VMBlockDestroy(ms_VMBlock *blk) {
     if (!blk) { return; }
-    dsdict_destroy(blk->env);
+    VMEnvDestroy(blk->env, blk->pool);
     blk->env = NULL;
-    free(blk);
+    dspool_free(blk->pool, blk, sizeof(ms_VMBlock));
 }
 
 static ms_Result VMFrameExecute(ms_VM *vm, ms_VMFrame *f) {
@@ -689,6 +959,21 @@ static bool VMStackIsEmpty(const ms_VM *vm) {
     return (f->dp == 0);
 }
 
+// Return true (and set an error) if nothing more may be pushed onto the
+// data stack. Loops may push without popping, so this is checked as each
+// opcode which grows the stack is executed.
+static bool VMStackIsFull(ms_VM *vm) {
+    assert(vm);
+    assert(vm->fstack);
+    ms_VMFrame *f = dsarray_top(vm->fstack);
+    assert(f);
+    if (f->dp < FRAME_DATA_STACK_LIMIT) {
+        return false;
+    }
+    ms_VMErrorSet(vm, ERR_STACK_OVERFLOW);
+    return true;
+}
+
 static inline ms_VMFrame *VMCurrentFrame(const ms_VM *vm) {
     assert(vm);
     assert(vm->fstack);
@@ -711,6 +996,298 @@ static inline DSDict *VMFindIdentEnv(const ms_VM *vm, const ms_VMFrame *f, DSBuf
     return vm->env;
 }
 
+// Create a new symbol table keyed on interned identifiers, which may be
+// hashed and compared by identity rather than by content. Values are
+// allocated from the pool, so they are freed by VMEnvDestroy.
+static inline DSDict *VMEnvNew(DSPool *pool) {
+    return dsdict_new_pool((dsdict_hash_fn)ms_InternHash,
+                           (dsdict_compare_fn)ms_InternCompare,
+                           (dsdict_free_fn)ms_InternRelease,
+                           NULL, pool);
+}
+
+// Put a value into a symbol table. Existing values are overwritten in
+// place; new names take a reference to the identifier so it outlives
+// the bytecode it came from.
+static bool VMEnvPut(DSDict *env, DSPool *pool, DSBuffer *ident, ms_VMValue v) {
+    assert(env);
+    assert(ident);
+
+    ms_VMValue *cur = dsdict_get(env, ident);
+    if (cur) {
+        *cur = v;
+        return true;
+    }
+
+    cur = dspool_alloc(pool, sizeof(ms_VMValue));
+    if (!cur) {
+        return false;
+    }
+
+    *cur = v;
+    ms_InternRetain(ident);
+    dsdict_put(env, ident, cur);
+    return true;
+}
+
+// Destroy a symbol table and return its values to the pool.
+static void VMEnvDestroy(DSDict *env, DSPool *pool) {
+    if (!env) { return; }
+
+    DSDICT_FOREACH(env, iter) {
+        dspool_free(pool, dsiter_value(&iter), sizeof(ms_VMValue));
+    }
+
+    dsdict_destroy(env);
+}
+
+// Return true if the value is any of the string representations.
+static inline bool VMIsStr(const ms_VMValue *v) {
+    assert(v);
+    return ((v->type == VMVAL_STR) ||
+            (v->type == VMVAL_ROPE) ||
+            (v->type == VMVAL_SLICE));
+}
+
+// Copy every leaf of the rope into a single new buffer. Ropes built up by
+// repeated appends are as deep as they are long, so the tree is walked
+// iteratively and filled in from the end: left operands are followed
+// directly and only right operands which are themselves unflattened ropes
+// are deferred onto an explicit stack.
+static DSBuffer *VMRopeFlatten(const ms_VMRope *rope) {
+    assert(rope);
+    assert(rope->len > 0);
+
+    DSBuffer *flat = NULL;
+    char *str = dsalloc(rope->len);
+    DSArray *stack = dsarray_new_cap(VM_ROPE_FLATTEN_STACK_CAP, NULL, NULL);
+    if ((!str) || (!stack)) {
+        goto cleanup_rope_flatten;
+    }
+
+    size_t pos = rope->len;
+    ms_VMValue root;
+    root.type = VMVAL_ROPE;
+    root.val.r = (ms_VMRope *)rope;
+
+    const ms_VMValue *v = &root;
+    while (v) {
+        size_t len;
+        const char *part = VMRopePart(v, &len);
+        if (part) {
+            pos = VMRopeCopyPart(str, pos, part, len);
+            v = (dsarray_len(stack) > 0) ? dsarray_pop(stack) : NULL;
+            continue;
+        }
+
+        const ms_VMRope *node = v->val.r;
+        part = VMRopePart(&node->right, &len);
+        if (part) {
+            pos = VMRopeCopyPart(str, pos, part, len);
+            v = &node->left;
+        } else {
+            if (!dsarray_append(stack, (void *)&node->left)) {
+                goto cleanup_rope_flatten;
+            }
+            v = &node->right;
+        }
+    }
+
+    assert(pos == 0);
+    flat = dsbuf_new_l(str, rope->len);
+
+cleanup_rope_flatten:
+    dsarray_destroy(stack);
+    dsfree(str);
+    return flat;
+}
+
+// Return the contiguous bytes of a string, slice, or already flattened
+// rope, or NULL if the value is a rope which has not yet been flattened.
+static inline const char *VMRopePart(const ms_VMValue *v, size_t *len) {
+    assert(v);
+    assert(len);
+    const DSBuffer *buf;
+    switch (v->type) {
+        case VMVAL_SLICE:
+            *len = v->val.sl->len;
+            return dsbuf_char_ptr(v->val.sl->parent) + v->val.sl->start;
+        case VMVAL_ROPE:
+            buf = v->val.r->flat;
+            break;
+        default:
+            assert(v->type == VMVAL_STR);
+            buf = v->val.s;
+            break;
+    }
+
+    /* empty strings have no bytes to copy, but are not unflattened ropes */
+    *len = (buf) ? dsbuf_len(buf) : 0;
+    return (buf) ? dsbuf_char_ptr(buf) : ((v->type == VMVAL_STR) ? "" : NULL);
+}
+
+// Copy a string into the rope buffer ending at pos; return the new end.
+static inline size_t VMRopeCopyPart(char *str, size_t pos, const char *part, size_t len) {
+    assert(len <= pos);
+    pos -= len;
+    memcpy(&str[pos], part, len);
+    return pos;
+}
+
+// Free every rope allocated by the VM since `mark` was the most recent,
+// or every rope if `mark` is NULL.
+static void VMRopesDestroy(ms_VM *vm, const ms_VMRope *mark) {
+    assert(vm);
+    ms_VMRope *rope = vm->ropes;
+    while (rope != mark) {
+        ms_VMRope *next = rope->next;
+        dsbuf_destroy(rope->flat);
+        dspool_free(vm->pool, rope, sizeof(ms_VMRope));
+        rope = next;
+    }
+    vm->ropes = (ms_VMRope *)mark;
+}
+
+// Free every slice allocated by the VM since `mark` was the most recent,
+// or every slice if `mark` is NULL.
+static void VMSlicesDestroy(ms_VM *vm, const ms_VMSlice *mark) {
+    assert(vm);
+    ms_VMSlice *slice = vm->slices;
+    while (slice != mark) {
+        ms_VMSlice *next = slice->next;
+        dsbuf_destroy(slice->flat);
+        dspool_free(vm->pool, slice, sizeof(ms_VMSlice));
+        slice = next;
+    }
+    vm->slices = (ms_VMSlice *)mark;
+}
+
+// Free every rope and slice made since `ropes` and `slices` were the most
+// recent which is no longer referred to once a call completes. Names are
+// only resolved in the current frame and the global environment, so only
+// values left in the frames from `depth` up (those the call made) and in
+// the global environment can refer to anything made during the call.
+// Survivors are kept, so later collections stop at them. If the roots
+// cannot be walked for lack of memory, nothing is freed.
+static void VMStrsCollect(ms_VM *vm, size_t depth, const ms_VMRope *ropes, const ms_VMSlice *slices) {
+    assert(vm);
+    if ((vm->ropes == ropes) && (vm->slices == slices)) {
+        return;
+    }
+
+    DSArray *stack = dsarray_new_cap(VM_COLLECT_STACK_CAP, NULL, NULL);
+    if (!stack) {
+        return;
+    }
+
+    bool marked = VMStrsMarkEnv(stack, vm->env);
+    size_t nframes = dsarray_len(vm->fstack);
+    for (size_t i = depth; (marked) && (i < nframes); i++) {
+        ms_VMFrame *f = dsarray_get(vm->fstack, i);
+        for (size_t j = 0; (marked) && (j < f->dp); j++) {
+            marked = dsarray_append(stack, &f->data[j]);
+        }
+
+        size_t nblocks = dsarray_len(f->blocks);
+        for (size_t j = 0; (marked) && (j < nblocks); j++) {
+            ms_VMBlock *blk = dsarray_get(f->blocks, j);
+            marked = VMStrsMarkEnv(stack, blk->env);
+        }
+    }
+
+    if ((marked) && (VMStrsMark(vm, stack, ropes))) {
+        VMStrsSweep(vm, ropes, slices);
+    }
+    dsarray_destroy(stack);
+}
+
+// Push every value in a symbol table onto the mark stack.
+static bool VMStrsMarkEnv(DSArray *stack, DSDict *env) {
+    assert(stack);
+    assert(env);
+
+    DSDICT_FOREACH(env, iter) {
+        if (!dsarray_append(stack, dsiter_value(&iter))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Keep every rope and slice reachable from the values on the stack. A
+// flattened rope no longer reads its operands, so they are not followed
+// (and are dropped, since they may be freed); a slice keeps the rope (made
+// since `ropes` was the most recent) whose flattened string it points into.
+static bool VMStrsMark(ms_VM *vm, DSArray *stack, const ms_VMRope *ropes) {
+    assert(vm);
+    assert(stack);
+
+    while (dsarray_len(stack) > 0) {
+        ms_VMValue *v = dsarray_pop(stack);
+        if (v->type == VMVAL_ROPE) {
+            ms_VMRope *rope = v->val.r;
+            if (rope->kept) {
+                continue;
+            }
+
+            rope->kept = true;
+            if (rope->flat) {
+                rope->left.type = VMVAL_NULL;
+                rope->right.type = VMVAL_NULL;
+            } else if ((!dsarray_append(stack, &rope->left)) ||
+                       (!dsarray_append(stack, &rope->right))) {
+                return false;
+            }
+        } else if (v->type == VMVAL_SLICE) {
+            ms_VMSlice *slice = v->val.sl;
+            if (slice->kept) {
+                continue;
+            }
+
+            slice->kept = true;
+            for (ms_VMRope *rope = vm->ropes; rope != ropes; rope = rope->next) {
+                if (rope->flat == slice->parent) {
+                    rope->kept = true;
+                    rope->left.type = VMVAL_NULL;
+                    rope->right.type = VMVAL_NULL;
+                    break;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// Free every rope and slice made since `ropes` and `slices` were the most
+// recent which was not kept by VMStrsMark.
+static void VMStrsSweep(ms_VM *vm, const ms_VMRope *ropes, const ms_VMSlice *slices) {
+    assert(vm);
+
+    ms_VMRope **rnext = &vm->ropes;
+    while (*rnext != ropes) {
+        ms_VMRope *rope = *rnext;
+        if (rope->kept) {
+            rnext = &rope->next;
+            continue;
+        }
+        *rnext = rope->next;
+        dsbuf_destroy(rope->flat);
+        dspool_free(vm->pool, rope, sizeof(ms_VMRope));
+    }
+
+    ms_VMSlice **snext = &vm->slices;
+    while (*snext != slices) {
+        ms_VMSlice *slice = *snext;
+        if (slice->kept) {
+            snext = &slice->next;
+            continue;
+        }
+        *snext = slice->next;
+        dsbuf_destroy(slice->flat);
+        dspool_free(vm->pool, slice, sizeof(ms_VMSlice));
+    }
+}
+
 /*
  * OPCODE FUNCTIONS
  */
@@ -738,12 +1315,27 @@ static inline size_t VMPrint(ms_VM *vm) {
         case VMVAL_FUNC:
             printf("<func %p>\n", (void *)v->val.fn);
             break;
+        case VMVAL_ROPE:        /* fall through */
+        case VMVAL_SLICE: {
+            size_t len;
+            const char *s = ms_VMStrChars(vm, v, &len);
+            if (!s) {
+                ms_VMErrorSet(vm, ERR_OUT_OF_MEMORY);
+                return 0;
+            }
+            printf("%.*s\n", (int)len, s);
+            break;
+        }
     }
     return 1;
 }
 
 static inline size_t VMPush(ms_VM *vm, int arg) {
     assert(vm);
+    if (VMStackIsFull(vm)) {
+        return 0;
+    }
+
     ms_VMFrame *f = VMCurrentFrame(vm);
     assert(f);
     f->data[f->dp] = f->code->values[arg];
@@ -772,8 +1364,10 @@ static inline size_t VMSwap(ms_VM *vm) {
 
 static inline size_t VMDup(ms_VM *vm) {
     assert(vm);
-    ms_VMFrame *f = VMCurrentFrame(vm);
-    assert(f);
+    if (VMStackIsFull(vm)) {
+        return 0;
+    }
+
     ms_VMValue v = *ms_VMTop(vm);
     ms_VMPush(vm, v);
     return 1;
@@ -808,7 +1402,7 @@ static inline size_t VMPushBlock(ms_VM *vm) {
     ms_VMFrame *f = VMCurrentFrame(vm);
     assert(f);
     assert(f->blocks);
-    ms_VMBlock *blk = VMBlockNew();
+    ms_VMBlock *blk = VMBlockNew(vm->pool);
     assert(blk);
     dsarray_append(f->blocks, blk);
     return 1;
@@ -827,6 +1421,12 @@ static inline size_t VMPopBlock(ms_VM *vm) {
 static inline size_t VMCallFunction(ms_VM *vm) {
     assert(vm);
     ms_VMValue *l = VMPeek(vm, -1);
+
+    /* function bodies may be left to be compiled on their first call */
+    if ((l->type == VMVAL_FUNC) && (ms_VMFuncCompile(l->val.fn, vm->err) == MS_RESULT_ERROR)) {
+        return 0;
+    }
+
     ms_Function op = ms_VMPrototypeFuncGet(vm, l->type, "__call__");
     if (!op) {
         ms_VMErrorSet(vm, "Object is not callable.");
@@ -864,12 +1464,16 @@ static inline size_t VMLoadName(ms_VM *vm, int arg) {
     assert(id);
 
     DSDict *env = VMFindIdentEnv(vm, f, id);
-    if (!env) {
+    ms_VMValue *v = (env) ? dsdict_get(env, id) : NULL;
+    if (!v) {
         ms_VMErrorSet(vm, ERR_NAME_NOT_DEFINED, dsbuf_char_ptr(id));
         return 0;
     }
 
-    ms_VMValue *v = dsdict_get(env, id);
+    if (VMStackIsFull(vm)) {
+        return 0;
+    }
+
     ms_VMPush(vm, *v);
     return 1;
 }
@@ -883,16 +1487,15 @@ static inline size_t VMNewName(ms_VM *vm, int arg) {
     DSBuffer *id = f->code->idents[arg];
     assert(id);
 
-    ms_VMValue *v = malloc(sizeof(ms_VMValue));
-    if (!v) {
+    ms_VMValue v;
+    v.type = VMVAL_NULL;
+    v.val.n = MS_VM_NULL_POINTER;
+
+    ms_VMBlock *blk = dsarray_top(f->blocks);
+    if (!VMEnvPut(blk->env, vm->pool, id, v)) {
         ms_VMErrorSet(vm, ERR_OUT_OF_MEMORY);
         return 0;
     }
-    v->type = VMVAL_NULL;
-    v->val.n = MS_VM_NULL_POINTER;
-
-    ms_VMBlock *blk = dsarray_top(f->blocks);
-    dsdict_put(blk->env, id, v);
     return 1;
 }
 
@@ -908,15 +1511,11 @@ static inline size_t VMSetName(ms_VM *vm, int arg) {
     DSDict *env = VMFindIdentEnv(vm, f, id);
     assert(env);
 
-    ms_VMValue *v = malloc(sizeof(ms_VMValue));
-    if (!v) {
+    // TODO: decrement reference count on the previous value
+    if (!VMEnvPut(env, vm->pool, id, ms_VMPop(vm))) {
         ms_VMErrorSet(vm, ERR_OUT_OF_MEMORY);
         return 0;
     }
-
-    *v = ms_VMPop(vm);
-    // TODO: decrement reference count on the previous value
-    dsdict_put(env, id, v);
     return 1;
 }
 
@@ -935,6 +1534,10 @@ static inline size_t VMDelName(ms_VM *vm, int arg) {
         return 0;
     }
 
-    dsdict_del(env, id);
+    ms_VMValue *v = dsdict_del(env, id);
+    if (v) {
+        dspool_free(vm->pool, v, sizeof(ms_VMValue));
+        ms_InternRelease(id);
+    }
     return 1;
 }
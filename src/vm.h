@@ -20,6 +20,7 @@
 #include <stdbool.h>
 #include "libds/array.h"
 #include "libds/buffer.h"
+#include "libds/pool.h"
 #include "bytecode.h"
 #include "error.h"
 #include "lang.h"
@@ -50,6 +51,19 @@ ms_VM *ms_VMNew(void);
 */
 ms_Result ms_VMExecute(ms_VM *vm, ms_VMByteCode *bc, ms_Error **err);
 
+/**
+* @brief Execute a bytecode script owned by the caller on the mscript VM, with
+* each of @c names bound to the corresponding value in @c vals in the
+* outermost scope of the script.
+*
+* Names must be interned. The frame for the script is removed once it
+* completes, so the VM holds no reference to @c bc after this returns and
+* the same bytecode may be executed again, on this VM or any other. Ropes
+* and slices made by the script are freed along with its frame.
+*/
+ms_Result ms_VMExecuteBound(ms_VM *vm, const ms_VMByteCode *bc, DSBuffer *const *names,
+                            const ms_VMValue *vals, size_t nvals, ms_Error **err);
+
 /**
 * @brief Execute a bytecode script on the mscript VM and print any expression
 * left on the data stack.
@@ -96,6 +110,59 @@ void ms_VMPushStr(ms_VM *vm, ms_ValStr *s);
 */
 void ms_VMPushStrL(ms_VM *vm, const char *s, size_t len);
 
+/*
+* @brief Push the concatenation of two string values onto the stack.
+*
+* The result is a lazy rope which only refers to its operands; it is not
+* flattened into a contiguous buffer until it is first read by
+* @c ms_VMStrFlatten . Ropes are owned by the VM; those which are no longer
+* reachable from the stack or any environment are freed when the call to
+* @c ms_VMExecute which made them completes.
+*
+* @returns true if the value could be pushed; false if memory could not
+*          be allocated
+*/
+bool ms_VMPushStrConcat(ms_VM *vm, ms_VMValue left, ms_VMValue right);
+
+/*
+* @brief Return the contiguous buffer for a string or rope value, flattening
+* (and caching) the rope if it has not been read before.
+*
+* @returns a @c DSBuffer owned by the value or the VM or @c NULL if memory
+*          could not be allocated
+*/
+const ms_VMStr *ms_VMStrFlatten(ms_VM *vm, const ms_VMValue *v);
+
+/*
+* @brief Push a slice of @c len bytes of a string value starting at @c start
+* onto the stack.
+*
+* The slice refers to the bytes of its parent string rather than copying
+* them; slices of slices refer directly to the original parent. Parents are
+* pinned for as long as the slice is; slices which are no longer reachable
+* are freed when the call to @c ms_VMExecute which made them completes.
+*
+* @returns true if the value could be pushed; false if memory could not
+*          be allocated
+*/
+bool ms_VMPushStrSlice(ms_VM *vm, const ms_VMValue *str, size_t start, size_t len);
+
+/*
+* @brief Return a pointer to the bytes of any string value without copying.
+*
+* The returned string is not necessarily NUL terminated; its length is
+* written to @c len .
+*
+* @returns a pointer to the string bytes or @c NULL if memory could not
+*          be allocated to flatten a rope
+*/
+const char *ms_VMStrChars(ms_VM *vm, const ms_VMValue *v, size_t *len);
+
+/*
+* @brief Return the length in bytes of any string value.
+*/
+size_t ms_VMStrLen(const ms_VMValue *v);
+
 /*
 * @brief Push a boolean value onto the stack.
 */
@@ -130,6 +197,14 @@ void ms_VMClear(ms_VM *vm);
 */
 void ms_VMDestroy(ms_VM *vm);
 
+/**
+* @brief Fill @c stats with the occupancy of the VM's runtime object pool.
+*
+* @param vm a @c ms_VM object
+* @param stats the statistics structure to fill
+*/
+void ms_VMPoolStats(const ms_VM *vm, DSPoolStats *stats);
+
 /*
 * @brief Check if the floating point value is actually an integer.
 *
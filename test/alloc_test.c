@@ -0,0 +1,322 @@
+/*------------------------------------------------------------------------------
+ *    Copyright 2016 Chris Rink
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *----------------------------------------------------------------------------*/
+
+#include <string.h>
+#include "alloc_test.h"
+#include "libds/alloc.h"
+
+/*
+ * TEST DEFINITIONS
+ */
+
+static MunitResult alloc_TestAccounting(const MunitParameter params[], void *user_data);
+static MunitResult alloc_TestOwnership(const MunitParameter params[], void *user_data);
+static MunitResult alloc_TestLimit(const MunitParameter params[], void *user_data);
+static MunitResult alloc_TestRelease(const MunitParameter params[], void *user_data);
+static MunitResult alloc_TestMerge(const MunitParameter params[], void *user_data);
+static MunitResult alloc_TestDefault(const MunitParameter params[], void *user_data);
+
+MunitTest alloc_tests[] = {
+    {
+        "/Accounting",
+        alloc_TestAccounting,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/Ownership",
+        alloc_TestOwnership,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/Limit",
+        alloc_TestLimit,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/Release",
+        alloc_TestRelease,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/Merge",
+        alloc_TestMerge,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/Default",
+        alloc_TestDefault,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
+
+/*
+ * FORWARD DECLARATIONS
+ */
+
+typedef struct {
+    size_t nlive;                   /** blocks currently allocated */
+    size_t ncalls;                  /** calls to the allocation function */
+} CountingContext;
+
+static size_t LIMIT_HITS = 0;
+
+static void *CountingAlloc(void *ctx, void *ptr, size_t size);
+static void CountLimitHit(DSAllocator *alloc);
+
+/*
+ * UNIT TEST FUNCTIONS
+ */
+
+static MunitResult alloc_TestAccounting(const MunitParameter params[], void *user_data) {
+    CountingContext ctx = { 0, 0 };
+    DSAllocator alloc;
+    dsallocator_init(&alloc, CountingAlloc, &ctx, 0);
+    DSAllocator *prev = dsallocator_swap(&alloc);
+
+    char *a = dsalloc(100);
+    munit_assert_not_null(a);
+    size_t one = alloc.used;
+    munit_assert_size(one, >=, 100);
+    munit_assert_size(ctx.nlive, ==, 1);
+
+    char *b = dscalloc(10, 20);
+    munit_assert_not_null(b);
+    for (size_t i = 0; i < 200; i++) {
+        munit_assert_char(b[i], ==, 0);
+    }
+    munit_assert_size(alloc.used, ==, 2 * one + 100);
+
+    memset(a, 'x', 100);
+    a = dsrealloc(a, 1000);
+    munit_assert_not_null(a);
+    munit_assert_char(a[99], ==, 'x');
+    munit_assert_size(alloc.used, ==, 2 * one + 1000);
+    munit_assert_size(alloc.peak, ==, alloc.used);
+
+    dsfree(a);
+    dsfree(b);
+    munit_assert_size(alloc.used, ==, 0);
+    munit_assert_size(alloc.peak, ==, 2 * one + 1000);
+    munit_assert_size(ctx.nlive, ==, 0);
+
+    munit_assert_ptr_equal(dsallocator_swap(prev), &alloc);
+    return MUNIT_OK;
+}
+
+static MunitResult alloc_TestOwnership(const MunitParameter params[], void *user_data) {
+    CountingContext ctx1 = { 0, 0 };
+    CountingContext ctx2 = { 0, 0 };
+    DSAllocator alloc1;
+    DSAllocator alloc2;
+    dsallocator_init(&alloc1, CountingAlloc, &ctx1, 0);
+    dsallocator_init(&alloc2, CountingAlloc, &ctx2, 0);
+
+    DSAllocator *prev = dsallocator_swap(&alloc1);
+    void *p = dsalloc(64);
+    munit_assert_not_null(p);
+
+    /* blocks stay with the allocator they came from */
+    dsallocator_swap(&alloc2);
+    p = dsrealloc(p, 128);
+    munit_assert_not_null(p);
+    munit_assert_size(alloc2.used, ==, 0);
+    munit_assert_size(ctx2.ncalls, ==, 0);
+
+    dsfree(p);
+    munit_assert_size(alloc1.used, ==, 0);
+    munit_assert_size(ctx1.nlive, ==, 0);
+
+    dsallocator_swap(prev);
+    return MUNIT_OK;
+}
+
+static MunitResult alloc_TestLimit(const MunitParameter params[], void *user_data) {
+    CountingContext ctx = { 0, 0 };
+    DSAllocator alloc;
+    dsallocator_init(&alloc, CountingAlloc, &ctx, 1024);
+    alloc.on_limit = CountLimitHit;
+    LIMIT_HITS = 0;
+    DSAllocator *prev = dsallocator_swap(&alloc);
+
+    void *a = dsalloc(512);
+    munit_assert_not_null(a);
+    munit_assert_false(alloc.exceeded);
+
+    munit_assert_null(dsalloc(1024));
+    munit_assert_true(alloc.exceeded);
+    munit_assert_size(LIMIT_HITS, ==, 1);
+
+    /* a refused resize leaves the block intact */
+    munit_assert_null(dsrealloc(a, 2048));
+    munit_assert_size(LIMIT_HITS, ==, 2);
+    size_t used = alloc.used;
+
+    dsfree(a);
+    munit_assert_size(used, >, 0);
+    munit_assert_size(alloc.used, ==, 0);
+    munit_assert_size(ctx.nlive, ==, 0);
+
+    /* freed memory may be allocated again */
+    a = dsalloc(900);
+    munit_assert_not_null(a);
+    dsfree(a);
+
+    dsallocator_swap(prev);
+    return MUNIT_OK;
+}
+
+static MunitResult alloc_TestRelease(const MunitParameter params[], void *user_data) {
+    CountingContext ctx = { 0, 0 };
+    DSAllocator alloc;
+    dsallocator_init(&alloc, CountingAlloc, &ctx, 0);
+    DSAllocator *prev = dsallocator_swap(&alloc);
+
+    void *keep = NULL;
+    for (size_t i = 0; i < 100; i++) {
+        void *p = dsalloc(16 + i);
+        munit_assert_not_null(p);
+        if (i == 50) {
+            keep = dsrealloc(p, 4096);
+            munit_assert_not_null(keep);
+        } else if (i % 3 == 0) {
+            dsfree(p);
+        }
+    }
+    munit_assert_not_null(keep);
+    munit_assert_size(ctx.nlive, >, 0);
+
+    dsallocator_release(&alloc);
+    munit_assert_size(ctx.nlive, ==, 0);
+    munit_assert_size(alloc.used, ==, 0);
+
+    dsallocator_swap(prev);
+    return MUNIT_OK;
+}
+
+static MunitResult alloc_TestMerge(const MunitParameter params[], void *user_data) {
+    CountingContext ctx = { 0, 0 };
+    DSAllocator into;
+    DSAllocator from;
+    dsallocator_init(&into, CountingAlloc, &ctx, 256);
+    dsallocator_init(&from, CountingAlloc, &ctx, 0);
+    DSAllocator *prev = dsallocator_swap(&into);
+
+    void *a = dsalloc(100);
+    munit_assert_not_null(a);
+    size_t used = into.used;
+
+    dsallocator_swap(&from);
+    void *b = dsalloc(200);
+    munit_assert_not_null(b);
+    size_t bsize = from.used;
+    void *c = dsalloc(300);
+    munit_assert_not_null(c);
+
+    /* merged blocks are charged to the new owner, even past its limit */
+    size_t moved = from.used;
+    dsallocator_merge(&into, &from);
+    munit_assert_size(from.used, ==, 0);
+    munit_assert_size(into.used, ==, used + moved);
+    munit_assert_size(into.peak, ==, into.used);
+    munit_assert_false(into.exceeded);
+
+    /* and outlive the allocator they came from */
+    dsallocator_release(&from);
+    munit_assert_size(ctx.nlive, ==, 3);
+    dsfree(b);
+    munit_assert_size(into.used, ==, used + moved - bsize);
+
+    dsallocator_release(&into);
+    munit_assert_size(ctx.nlive, ==, 0);
+    munit_assert_size(into.used, ==, 0);
+
+    dsallocator_swap(prev);
+    return MUNIT_OK;
+}
+
+static MunitResult alloc_TestDefault(const MunitParameter params[], void *user_data) {
+    CountingContext ctx = { 0, 0 };
+    DSAllocator alloc;
+    dsallocator_init(&alloc, CountingAlloc, &ctx, 0);
+
+    DSAllocator *prev = dsallocator_swap(NULL);
+    char *p = dsalloc(16);
+    munit_assert_not_null(p);
+    memcpy(p, "default", 8);
+    void *q = dsalloc(32);
+    munit_assert_not_null(q);
+
+    /* blocks from the default allocator are neither counted nor listed,
+     * but may still be resized and freed while another is current */
+    dsallocator_swap(&alloc);
+    p = dsrealloc(p, 4096);
+    munit_assert_not_null(p);
+    munit_assert_string_equal(p, "default");
+    dsfree(q);
+    dsfree(p);
+    munit_assert_size(alloc.used, ==, 0);
+    munit_assert_null(alloc.blocks);
+    munit_assert_size(ctx.ncalls, ==, 0);
+
+    dsallocator_swap(prev);
+    return MUNIT_OK;
+}
+
+/*
+ * UTILITY FUNCTIONS
+ */
+
+static void *CountingAlloc(void *ctx, void *ptr, size_t size) {
+    CountingContext *cnt = ctx;
+    cnt->ncalls++;
+
+    if (size == 0) {
+        munit_assert_size(cnt->nlive, >, 0);
+        cnt->nlive--;
+        free(ptr);
+        return NULL;
+    }
+
+    void *res = realloc(ptr, size);
+    if ((res) && (!ptr)) {
+        cnt->nlive++;
+    }
+    return res;
+}
+
+static void CountLimitHit(DSAllocator *alloc) {
+    munit_assert_true(alloc->exceeded);
+    LIMIT_HITS++;
+}
@@ -0,0 +1,202 @@
+/*------------------------------------------------------------------------------
+ *    Copyright 2016 Chris Rink
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *----------------------------------------------------------------------------*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "array_test.h"
+#include "libds/alloc.h"
+#include "libds/array.h"
+
+/*
+ * TEST DEFINITIONS
+ */
+
+static MunitResult array_TestInlineStorage(const MunitParameter params[], void *user_data);
+static MunitResult array_TestSpill(const MunitParameter params[], void *user_data);
+static MunitResult array_TestFullCapacity(const MunitParameter params[], void *user_data);
+static MunitResult array_TestNewLit(const MunitParameter params[], void *user_data);
+
+MunitTest array_tests[] = {
+    {
+        "/InlineStorage",
+        array_TestInlineStorage,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/Spill",
+        array_TestSpill,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/FullCapacity",
+        array_TestFullCapacity,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/NewLit",
+        array_TestNewLit,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
+
+/*
+ * FORWARD DECLARATIONS
+ */
+
+static size_t ARRAY_ELEMS_FREED = 0;
+
+static size_t array_CountAllocs(DSArray *(*create)(void));
+static void *array_CountingAlloc(void *ctx, void *ptr, size_t size);
+static DSArray *array_NewSmall(void);
+static DSArray *array_NewLarge(void);
+static void array_CountFree(void *elem);
+static void *array_Elem(size_t i);
+
+/*
+ * UNIT TEST FUNCTIONS
+ */
+
+static MunitResult array_TestInlineStorage(const MunitParameter params[], void *user_data) {
+    /* small arrays need only one allocation; larger ones need two */
+    munit_assert_size(array_CountAllocs(array_NewSmall), ==, 1);
+    munit_assert_size(array_CountAllocs(array_NewLarge), ==, 2);
+    return MUNIT_OK;
+}
+
+static MunitResult array_TestSpill(const MunitParameter params[], void *user_data) {
+    static const size_t nelems = 100;
+
+    DSArray *array = dsarray_new_cap(2, NULL, array_CountFree);
+    munit_assert_not_null(array);
+    ARRAY_ELEMS_FREED = 0;
+
+    for (size_t i = 0; i < nelems; i++) {
+        munit_assert_true(dsarray_append(array, array_Elem(i)));
+    }
+    munit_assert_size(dsarray_len(array), ==, nelems);
+    munit_assert_size(dsarray_cap(array), >=, nelems);
+
+    /* elements inserted at the front shift through both storage areas */
+    munit_assert_true(dsarray_insert(array, array_Elem(nelems), 0));
+    munit_assert_ptr_equal(dsarray_get(array, 0), array_Elem(nelems));
+    for (size_t i = 0; i < nelems; i++) {
+        munit_assert_ptr_equal(dsarray_get(array, i + 1), array_Elem(i));
+    }
+
+    dsarray_destroy(array);
+    munit_assert_size(ARRAY_ELEMS_FREED, ==, nelems + 1);
+    return MUNIT_OK;
+}
+
+static MunitResult array_TestFullCapacity(const MunitParameter params[], void *user_data) {
+    DSArray *array = dsarray_new_cap(4, NULL, NULL);
+    munit_assert_not_null(array);
+    for (size_t i = 0; i < 4; i++) {
+        munit_assert_true(dsarray_append(array, array_Elem(i)));
+    }
+    munit_assert_size(dsarray_cap(array), ==, 4);
+
+    /* no access may reach past the last slot of a full array */
+    munit_assert_null(dsarray_get(array, 4));
+    munit_assert_ptr_equal(dsarray_remove_index(array, 1), array_Elem(1));
+    munit_assert_size(dsarray_len(array), ==, 3);
+    munit_assert_ptr_equal(dsarray_get(array, 1), array_Elem(2));
+    munit_assert_ptr_equal(dsarray_get(array, 2), array_Elem(3));
+    munit_assert_null(dsarray_get(array, 3));
+
+    munit_assert_ptr_equal(dsarray_pop(array), array_Elem(3));
+    munit_assert_ptr_equal(dsarray_top(array), array_Elem(2));
+
+    dsarray_destroy(array);
+    return MUNIT_OK;
+}
+
+static MunitResult array_TestNewLit(const MunitParameter params[], void *user_data) {
+    void *elems[] = { array_Elem(0), array_Elem(1), array_Elem(2) };
+
+    DSArray *array = dsarray_new_lit(elems, 3, 8, NULL, NULL);
+    munit_assert_not_null(array);
+    munit_assert_size(dsarray_len(array), ==, 3);
+    munit_assert_size(dsarray_cap(array), ==, 8);
+    for (size_t i = 0; i < 3; i++) {
+        munit_assert_ptr_equal(dsarray_get(array, i), elems[i]);
+    }
+    munit_assert_null(dsarray_get(array, 3));
+
+    dsarray_destroy(array);
+    return MUNIT_OK;
+}
+
+/*
+ * UTILITY FUNCTIONS
+ */
+
+/* Return the number of allocations made to create an array with `create`. */
+static size_t array_CountAllocs(DSArray *(*create)(void)) {
+    size_t nallocs = 0;
+    DSAllocator alloc;
+    dsallocator_init(&alloc, array_CountingAlloc, &nallocs, 0);
+    DSAllocator *prev = dsallocator_swap(&alloc);
+
+    DSArray *array = create();
+    munit_assert_not_null(array);
+    size_t count = nallocs;
+
+    dsarray_destroy(array);
+    dsallocator_swap(prev);
+    return count;
+}
+
+static void *array_CountingAlloc(void *ctx, void *ptr, size_t size) {
+    if (size == 0) {
+        free(ptr);
+        return NULL;
+    }
+    if (!ptr) {
+        (*(size_t *)ctx)++;
+    }
+    return realloc(ptr, size);
+}
+
+static DSArray *array_NewSmall(void) {
+    return dsarray_new_cap(DSARRAY_INLINE_MAX_CAPACITY, NULL, NULL);
+}
+
+static DSArray *array_NewLarge(void) {
+    return dsarray_new_cap(DSARRAY_INLINE_MAX_CAPACITY + 1, NULL, NULL);
+}
+
+static void array_CountFree(void *elem) {
+    ARRAY_ELEMS_FREED++;
+}
+
+/* Elements must be non-NULL, so offset every integer by one. */
+static void *array_Elem(size_t i) {
+    return (void *)(uintptr_t)(i + 1);
+}
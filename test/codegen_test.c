@@ -14,9 +14,13 @@
  *  limitations under the License.
  *----------------------------------------------------------------------------*/
 
+#include <stdio.h>
 #include "codegen_test.h"
+#include "libds/alloc.h"
 #include "../src/bytecode.h"
+#include "../src/parallel.h"
 #include "../src/parser.h"
+#include "../src/verifier.h"
 #include "../src/vm.h"
 
 typedef struct {
@@ -51,6 +55,9 @@ static MunitResult prs_TestCodeGenDeclaration(const MunitParameter params[], voi
 static MunitResult prs_TestCodeGenAssignment(const MunitParameter params[], void *user_data);
 static MunitResult prs_TestCodeGenMultipleAssignment(const MunitParameter params[], void *user_data);
 static MunitResult prs_TestCodeGenCompoundAssignment(const MunitParameter params[], void *user_data);
+static MunitResult prs_TestCodeGenLazyFunctions(const MunitParameter params[], void *user_data);
+static MunitResult prs_TestCodeGenSinglePass(const MunitParameter params[], void *user_data);
+static MunitResult prs_TestCodeGenParallel(const MunitParameter params[], void *user_data);
 
 MunitTest codegen_tests[] = {
     {
@@ -237,6 +244,30 @@ MunitTest codegen_tests[] = {
         MUNIT_TEST_OPTION_NONE,
         NULL
     },
+    {
+        "/LazyFunctions",
+        prs_TestCodeGenLazyFunctions,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/SinglePass",
+        prs_TestCodeGenSinglePass,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/Parallel",
+        prs_TestCodeGenParallel,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
     { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
 };
 
@@ -245,9 +276,12 @@ MunitTest codegen_tests[] = {
  */
 
 static MunitResult CompareByteCode(const ms_VMByteCode *bc1, const ms_VMByteCode *bc2);
+static DSBuffer *ParallelSource(const char *prefix, const char *suffix);
+static void ParallelLimitHit(DSAllocator *alloc);
 static MunitResult CompareFunctionValues(const ms_VMFunc *fn1, const ms_VMFunc *fn2);
 static MunitResult CompareValues(const ms_VMValue *val1, const ms_VMValue *val2);
 static MunitResult TestCodeGenResultTuple(CodeGenResultTuple *tuples, size_t len);
+static void CompileFunctions(ms_VMByteCode *bc);
 static void CleanByteCode(ms_VMByteCode *bc);
 static void CleanValue(ms_VMValue *v);
 
@@ -3644,6 +3678,239 @@ static MunitResult prs_TestCodeGenCompoundAssignment(const MunitParameter params
     return MUNIT_OK;
 }
 
+static MunitResult prs_TestCodeGenLazyFunctions(const MunitParameter params[], void *user_data) {
+    ms_Parser *prs = ms_ParserNew();
+    munit_assert_not_null(prs);
+
+    const ms_AST *ast;
+    ms_Error *err;
+    ms_ParserInitString(prs, "func Adder(a) { return func(b) { return a + b; }; }");
+    munit_assert_int(ms_ParserParse(prs, &ast, &err), !=, MS_RESULT_ERROR);
+
+    ms_VMByteCode *code;
+    munit_assert_int(ms_VMByteCodeGenerateLazy(ms_ParserArena(prs), &code, &err), !=, MS_RESULT_ERROR);
+    munit_assert_null(err);
+    munit_assert_size(code->nvals, ==, 1);
+    munit_assert_int(code->values[0].type, ==, VMVAL_FUNC);
+
+    ms_VMFunc *fn = code->values[0].val.fn;
+    munit_assert_null(fn->code);
+    munit_assert_not_null(fn->fn);
+    munit_assert_size(dsarray_len(fn->args), ==, 1);
+
+    /* the parser moves to a new arena while functions still hold its tree */
+    ms_ASTArena *arena = ms_ParserArena(prs);
+    ms_ParserInitString(prs, "var x := 1;");
+    munit_assert_int(ms_ParserParse(prs, &ast, &err), !=, MS_RESULT_ERROR);
+    munit_assert_ptr_not_equal(ms_ParserArena(prs), arena);
+    ms_ParserDestroy(prs);
+
+    munit_assert_int(ms_VMFuncCompile(fn, &err), !=, MS_RESULT_ERROR);
+    munit_assert_null(err);
+    munit_assert_not_null(fn->code);
+    munit_assert_null(fn->fn);
+    munit_assert_null(fn->arena);
+
+    /* nested functions are compiled independently of the enclosing function */
+    munit_assert_size(fn->code->nvals, ==, 1);
+    ms_VMFunc *inner = fn->code->values[0].val.fn;
+    munit_assert_null(inner->code);
+    munit_assert_ptr_equal(inner->arena, arena);
+    munit_assert_int(ms_VMFuncCompile(inner, &err), !=, MS_RESULT_ERROR);
+    munit_assert_not_null(inner->code);
+    munit_assert_size(inner->code->nops, ==, 4);
+
+    /* compiling again is a no-op */
+    ms_VMByteCode *compiled = inner->code;
+    munit_assert_int(ms_VMFuncCompile(inner, &err), !=, MS_RESULT_ERROR);
+    munit_assert_ptr_equal(inner->code, compiled);
+
+    ms_VMByteCodeDestroy(code);
+    return MUNIT_OK;
+}
+
+static MunitResult prs_TestCodeGenSinglePass(const MunitParameter params[], void *user_data) {
+    /* simple statements compile to exactly the bytecode the full pipeline generates */
+    const char *compiled[] = {
+        "1;",
+        "3.14; \"a string\"; true; false; null;",
+        "var x;",
+        "var x := 1;",
+        "var x := x;",
+        "var x := 1, y, z := x + 2;",
+        "var x := 1; x := x * 2;",
+        "var x, y := 2; x := y; y := x;",
+        "var a := 1, b := 2; a += b; b -= a; a *= 3; b /= 4; a \\= 5; b %= 6;",
+        "var a := 1; a &= 2; a |= 3; a ^= 4; a <<= 5; a >>= 6;",
+        "var a := 1; a += 1 + 2 * 3;",
+        "var a := 2, b := 3; a ** b ** 2; -a ** b; a ** b * a;",
+        "var a, b, c; a + b * c - a / b \\ c % a;",
+        "var a, b, c; (a + b) * (c - (a / b));",
+        "var a, b; a == b; a != b; a < b; a <= b; a > b; a >= b;",
+        "var a, b; a && b || !a && ~b;",
+        "var a, b; a | b ^ a & b << 2 >> 1;",
+        "var a := 1; -a; - -a; !!a; -(a + 1);",
+        "\"x\" + \"y\"; \"\";",
+    };
+
+    /* anything else (including errors) is left to the full pipeline */
+    const char *deferred[] = {
+        "x;",
+        "x := 1;",
+        "x += 1;",
+        "var x; var x;",
+        "var x := 1",
+        "var x := 1, 2;",
+        "var x, y; x, y := 1, 2;",
+        "var x := y;",
+        "var x; x := (1;",
+        "var x; x.y;",
+        "var x; x[0];",
+        "var x; x(1);",
+        "var x; x ?: 1;",
+        "var x; x ? 1 : 2;",
+        "select(true : 1, 2);",
+        "0x1F;",
+        "99999999999999999999;",
+        "@global;",
+        "$len(\"abc\");",
+        "[1, 2];",
+        "{ \"a\": 1 };",
+        "func f() { return 1; }",
+        "var f := func() { return 1; };",
+        "if true { 1; }",
+        "import os;",
+        "var x := 1; var y := 2; x := y; delete x;",
+    };
+
+    ms_Parser *prs = ms_ParserNew();
+    munit_assert_not_null(prs);
+
+    for (size_t i = 0; i < sizeof(compiled) / sizeof(compiled[0]); i++) {
+        munit_logf(MUNIT_LOG_INFO, "  code='%s'", compiled[i]);
+        munit_assert_true(ms_ParserInitString(prs, compiled[i]));
+
+        ms_VMByteCode *single;
+        munit_assert_true(ms_ParserCompile(prs, &single));
+        munit_assert_not_null(single);
+
+        const ms_AST *ast;
+        ms_Error *err;
+        munit_assert_true(ms_ParserInitString(prs, compiled[i]));
+        munit_assert_int(ms_ParserParse(prs, &ast, &err), !=, MS_RESULT_ERROR);
+        munit_assert_int(ms_ParserVerifyAST(ast, &err), !=, MS_RESULT_ERROR);
+
+        ms_VMByteCode *code;
+        munit_assert_int(ms_VMByteCodeGenerateFromAST(ast, &code, &err), !=, MS_RESULT_ERROR);
+        munit_assert_null(err);
+
+        CompareByteCode(single, code);
+        for (size_t j = 0; j < code->nvals; j++) {
+            if (code->values[j].type == VMVAL_STR) {
+                munit_assert_ptr_equal(single->values[j].val.s, code->values[j].val.s);
+            }
+        }
+        for (size_t j = 0; j < code->nidents; j++) {
+            munit_assert_ptr_equal(single->idents[j], code->idents[j]);
+        }
+
+        ms_VMByteCodeDestroy(single);
+        ms_VMByteCodeDestroy(code);
+    }
+
+    for (size_t i = 0; i < sizeof(deferred) / sizeof(deferred[0]); i++) {
+        munit_logf(MUNIT_LOG_INFO, "  code='%s'", deferred[i]);
+        munit_assert_true(ms_ParserInitString(prs, deferred[i]));
+
+        ms_VMByteCode *single;
+        munit_assert_false(ms_ParserCompile(prs, &single));
+        munit_assert_null(single);
+    }
+
+    ms_ParserDestroy(prs);
+    return MUNIT_OK;
+}
+
+static MunitResult prs_TestCodeGenParallel(const MunitParameter params[], void *user_data) {
+#ifndef MS_USE_PTHREADS
+    return MUNIT_SKIP;
+#endif
+
+    DSBuffer *src = ParallelSource("", "");
+    size_t len = dsbuf_len(src);
+
+    /* small modules are not worth splitting */
+    ms_VMByteCode *code;
+    munit_assert_false(ms_ParserCompileParallel("var x := 1;", 11, NULL, 4, NULL, &code));
+    munit_assert_false(ms_ParserCompileParallel(dsbuf_char_ptr(src), len, NULL, 1, NULL, &code));
+
+    ms_Parser *prs = ms_ParserNew();
+    munit_assert_not_null(prs);
+    munit_assert_true(ms_ParserInitStringL(prs, dsbuf_char_ptr(src), len));
+
+    const ms_AST *ast;
+    ms_Error *err;
+    munit_assert_int(ms_ParserParse(prs, &ast, &err), !=, MS_RESULT_ERROR);
+    munit_assert_int(ms_ParserVerifyAST(ast, &err), !=, MS_RESULT_ERROR);
+
+    ms_VMByteCode *single;
+    munit_assert_int(ms_VMByteCodeGenerateFromAST(ast, &single, &err), !=, MS_RESULT_ERROR);
+    munit_assert_null(err);
+
+    /* the linked module is identical to the module compiled on one thread */
+    munit_assert_true(ms_ParserCompileParallel(dsbuf_char_ptr(src), len, NULL, 4, NULL, &code));
+    CompareByteCode(single, code);
+    for (size_t i = 0; i < code->nvals; i++) {
+        if (code->values[i].type == VMVAL_STR) {
+            munit_assert_ptr_equal(single->values[i].val.s, code->values[i].val.s);
+        }
+    }
+    for (size_t i = 0; i < code->nidents; i++) {
+        munit_assert_ptr_equal(single->idents[i], code->idents[i]);
+    }
+    ms_VMByteCodeDestroy(code);
+
+    /* the module may be charged to an allocator; one which does not fit is
+     * refused without calling the allocator's limit handler */
+    DSAllocator alloc;
+    dsallocator_init(&alloc, NULL, NULL, 0);
+    alloc.on_limit = ParallelLimitHit;
+    munit_assert_true(ms_ParserCompileParallel(dsbuf_char_ptr(src), len, NULL, 4, &alloc, &code));
+    CompareByteCode(single, code);
+    size_t charged = alloc.used;
+    munit_assert_size(charged, >, 0);
+    ms_VMByteCodeDestroy(code);
+    munit_assert_size(alloc.used, ==, 0);
+
+    alloc.limit = charged / 2;
+    munit_assert_false(ms_ParserCompileParallel(dsbuf_char_ptr(src), len, NULL, 4, &alloc, &code));
+    munit_assert_null(code);
+    munit_assert_true(alloc.exceeded);
+    munit_assert_size(alloc.used, ==, 0);
+    munit_assert_true(alloc.on_limit == ParallelLimitHit);
+
+    ms_VMByteCodeDestroy(single);
+    ms_ParserDestroy(prs);
+    dsbuf_destroy(src);
+
+    /* modules with any error are left to be compiled on one thread */
+    const char *broken[][2] = {
+        { "var early := v399;\n", "" },
+        { "", "var v0;\n" },
+        { "", "var late := (1;\n" },
+        { "}\n", "" },
+    };
+
+    for (size_t i = 0; i < sizeof(broken) / sizeof(broken[0]); i++) {
+        munit_logf(MUNIT_LOG_INFO, "  prefix='%s' suffix='%s'", broken[i][0], broken[i][1]);
+        src = ParallelSource(broken[i][0], broken[i][1]);
+        munit_assert_false(ms_ParserCompileParallel(dsbuf_char_ptr(src), dsbuf_len(src), NULL, 4, NULL, &code));
+        dsbuf_destroy(src);
+    }
+
+    return MUNIT_OK;
+}
+
 /*
  * COMPARISON FUNCTIONS
  */
@@ -3733,6 +4000,10 @@ static MunitResult CompareValues(const ms_VMValue *val1, const ms_VMValue *val2)
         case VMVAL_FUNC:
             CompareFunctionValues(val1->val.fn, val2->val.fn);
             break;
+        case VMVAL_ROPE:        /* fall through */
+        case VMVAL_SLICE:
+            munit_error("ropes and slices should never appear in generated bytecode");
+            break;
     }
 
     return MUNIT_OK;
@@ -3770,6 +4041,16 @@ static MunitResult TestCodeGenResultTuple(CodeGenResultTuple *tuples, size_t len
         munit_assert_not_null(code);
         munit_assert_null(err);
 
+        CompareByteCode(code, tuple->bc);
+        ms_VMByteCodeDestroy(code);
+
+        /* lazily compiled functions must match their eager counterparts */
+        gres = ms_VMByteCodeGenerateLazy(ms_ParserArena(prs), &code, &err);
+        munit_assert_int(gres, !=, MS_RESULT_ERROR);
+        munit_assert_not_null(code);
+        munit_assert_null(err);
+
+        CompileFunctions(code);
         CompareByteCode(code, tuple->bc);
         ms_VMByteCodeDestroy(code);
         CleanByteCode(tuple->bc);
@@ -3779,10 +4060,60 @@ static MunitResult TestCodeGenResultTuple(CodeGenResultTuple *tuples, size_t len
     return MUNIT_OK;
 }
 
+// Generate a module large enough to be split into several parts, whose
+// functions refer to functions declared after them and whose strings and
+// comments contain characters which end statements.
+static DSBuffer *ParallelSource(const char *prefix, const char *suffix) {
+    static const size_t nfuncs = 400;
+    char chunk[512];
+
+    DSBuffer *src = dsbuf_new_buffer(nfuncs * sizeof(chunk));
+    munit_assert_not_null(src);
+    munit_assert_true(dsbuf_append_str(src, prefix));
+
+    for (size_t i = 0; i < nfuncs; i++) {
+        snprintf(chunk, sizeof(chunk),
+                 "func f%zu(a, b) {\n"
+                 "    var s := \"str %zu // not a comment; }\";\n"
+                 "    if a > b { return f%zu(a, s); } else { for var x in b { a += x; } }\n"
+                 "    return 'q\\'%zu;' + s;\n"
+                 "}\n"
+                 "var v%zu := f%zu(%zu, \"x;y\");\n"
+                 "// comment %zu; } func\n"
+                 "if v%zu { v%zu := 1; } else { v%zu := 2.5; }\n",
+                 i, i, (i + 1) % nfuncs, i, i, i, i, i, i, i, i);
+        munit_assert_true(dsbuf_append_str(src, chunk));
+    }
+
+    munit_assert_true(dsbuf_append_str(src, suffix));
+    return src;
+}
+
+// Fail any test which calls the limit handler of an allocator.
+static void ParallelLimitHit(DSAllocator *alloc) {
+    munit_errorf("limit handler called (limit=%zu)", alloc->limit);
+}
+
 /*
  * CLEAN UP FUNCTIONS
  */
 
+static void CompileFunctions(ms_VMByteCode *bc) {
+    for (size_t i = 0; i < bc->nvals; i++) {
+        if (bc->values[i].type != VMVAL_FUNC) {
+            continue;
+        }
+
+        ms_VMFunc *fn = bc->values[i].val.fn;
+        munit_assert_null(fn->code);
+
+        ms_Error *err;
+        munit_assert_int(ms_VMFuncCompile(fn, &err), !=, MS_RESULT_ERROR);
+        munit_assert_null(err);
+        CompileFunctions(fn->code);
+    }
+}
+
 static void CleanByteCode(ms_VMByteCode *bc) {
     for (size_t i = 0; i < bc->nvals; i++) {
         CleanValue(&bc->values[i]);
@@ -3813,7 +4144,9 @@ static void CleanValue(ms_VMValue *v) {
         case VMVAL_INT:         /* fall through */
         case VMVAL_FLOAT:       /* fall through */
         case VMVAL_BOOL:        /* fall through */
-        case VMVAL_NULL:
+        case VMVAL_NULL:        /* fall through */
+        case VMVAL_ROPE:        /* fall through */
+        case VMVAL_SLICE:
             break;
     }
 }
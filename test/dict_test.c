@@ -0,0 +1,374 @@
+/*------------------------------------------------------------------------------
+ *    Copyright 2016 Chris Rink
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *----------------------------------------------------------------------------*/
+
+#include <stdint.h>
+#include "dict_test.h"
+#include "libds/dict.h"
+#include "libds/iter.h"
+
+/*
+ * TEST DEFINITIONS
+ */
+
+static MunitResult dict_TestPutGet(const MunitParameter params[], void *user_data);
+static MunitResult dict_TestEmpty(const MunitParameter params[], void *user_data);
+static MunitResult dict_TestGrow(const MunitParameter params[], void *user_data);
+static MunitResult dict_TestCollisions(const MunitParameter params[], void *user_data);
+static MunitResult dict_TestIncremental(const MunitParameter params[], void *user_data);
+static MunitResult dict_TestChurn(const MunitParameter params[], void *user_data);
+static MunitResult dict_TestIterate(const MunitParameter params[], void *user_data);
+
+MunitTest dict_tests[] = {
+    {
+        "/PutGet",
+        dict_TestPutGet,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/Empty",
+        dict_TestEmpty,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/Grow",
+        dict_TestGrow,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/Collisions",
+        dict_TestCollisions,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/Incremental",
+        dict_TestIncremental,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/Churn",
+        dict_TestChurn,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/Iterate",
+        dict_TestIterate,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
+
+/*
+ * FORWARD DECLARATIONS
+ */
+
+static size_t DICT_VALUES_FREED = 0;
+static size_t DICT_ENTRIES_SEEN = 0;
+
+static uint32_t dict_HashInt(void *key);
+static uint32_t dict_HashConstant(void *key);
+static int dict_CompareInt(const void *left, const void *right);
+static void dict_CountFree(void *val);
+static void dict_CountEntry(const void *key, void *val);
+static void *dict_Key(size_t i);
+
+/*
+ * UNIT TEST FUNCTIONS
+ */
+
+static MunitResult dict_TestPutGet(const MunitParameter params[], void *user_data) {
+    DSDict *dict = dsdict_new(dict_HashInt, dict_CompareInt, NULL, dict_CountFree);
+    munit_assert_not_null(dict);
+    DICT_VALUES_FREED = 0;
+
+    for (size_t i = 0; i < 5; i++) {
+        dsdict_put(dict, dict_Key(i), dict_Key(i * 10));
+    }
+    munit_assert_size(dsdict_count(dict), ==, 5);
+
+    for (size_t i = 0; i < 5; i++) {
+        munit_assert_ptr_equal(dsdict_get(dict, dict_Key(i)), dict_Key(i * 10));
+    }
+    munit_assert_null(dsdict_get(dict, dict_Key(5)));
+
+    /* overwriting a key frees the old value and does not change the count */
+    dsdict_put(dict, dict_Key(3), dict_Key(99));
+    munit_assert_size(DICT_VALUES_FREED, ==, 1);
+    munit_assert_size(dsdict_count(dict), ==, 5);
+    munit_assert_ptr_equal(dsdict_get(dict, dict_Key(3)), dict_Key(99));
+
+    /* deleting returns the value without freeing it */
+    munit_assert_ptr_equal(dsdict_del(dict, dict_Key(3)), dict_Key(99));
+    munit_assert_null(dsdict_del(dict, dict_Key(3)));
+    munit_assert_null(dsdict_get(dict, dict_Key(3)));
+    munit_assert_size(dsdict_count(dict), ==, 4);
+    munit_assert_size(DICT_VALUES_FREED, ==, 1);
+
+    dsdict_destroy(dict);
+    munit_assert_size(DICT_VALUES_FREED, ==, 5);
+    return MUNIT_OK;
+}
+
+static MunitResult dict_TestEmpty(const MunitParameter params[], void *user_data) {
+    DSDict *dict = dsdict_new(dict_HashInt, dict_CompareInt, NULL, NULL);
+    munit_assert_not_null(dict);
+
+    /* no table is allocated until the first put */
+    munit_assert_size(dsdict_cap(dict), ==, 0);
+    munit_assert_null(dsdict_get(dict, dict_Key(1)));
+    munit_assert_null(dsdict_del(dict, dict_Key(1)));
+
+    DSIter *iter = dsdict_iter(dict);
+    munit_assert_not_null(iter);
+    munit_assert_false(dsiter_next(iter));
+    dsiter_destroy(iter);
+
+    dsdict_put(dict, dict_Key(1), dict_Key(1));
+    munit_assert_size(dsdict_cap(dict), >, 0);
+    munit_assert_size(dsdict_cap(dict), <=, 16);
+
+    dsdict_destroy(dict);
+    return MUNIT_OK;
+}
+
+static MunitResult dict_TestGrow(const MunitParameter params[], void *user_data) {
+    static const size_t nkeys = 100000;
+
+    DSDict *dict = dsdict_new(dict_HashInt, dict_CompareInt, NULL, NULL);
+    munit_assert_not_null(dict);
+
+    for (size_t i = 0; i < nkeys; i++) {
+        dsdict_put(dict, dict_Key(i), dict_Key(i + 1));
+
+        size_t cap = dsdict_cap(dict);
+        munit_assert_size(cap & (cap - 1), ==, 0);
+        munit_assert_size(dsdict_count(dict), <, cap);
+    }
+    munit_assert_size(dsdict_count(dict), ==, nkeys);
+
+    for (size_t i = 0; i < nkeys; i++) {
+        munit_assert_ptr_equal(dsdict_get(dict, dict_Key(i)), dict_Key(i + 1));
+    }
+    munit_assert_null(dsdict_get(dict, dict_Key(nkeys)));
+
+    dsdict_destroy(dict);
+    return MUNIT_OK;
+}
+
+static MunitResult dict_TestCollisions(const MunitParameter params[], void *user_data) {
+    static const size_t nkeys = 200;
+
+    /* every key probes the same sequence of groups */
+    DSDict *dict = dsdict_new(dict_HashConstant, dict_CompareInt, NULL, NULL);
+    munit_assert_not_null(dict);
+
+    for (size_t i = 0; i < nkeys; i++) {
+        dsdict_put(dict, dict_Key(i), dict_Key(i + 1));
+    }
+    munit_assert_size(dsdict_count(dict), ==, nkeys);
+
+    for (size_t i = 0; i < nkeys; i += 2) {
+        munit_assert_ptr_equal(dsdict_del(dict, dict_Key(i)), dict_Key(i + 1));
+    }
+    for (size_t i = 0; i < nkeys; i++) {
+        void *expected = (i % 2 == 0) ? NULL : dict_Key(i + 1);
+        munit_assert_ptr_equal(dsdict_get(dict, dict_Key(i)), expected);
+    }
+
+    dsdict_destroy(dict);
+    return MUNIT_OK;
+}
+
+static MunitResult dict_TestIncremental(const MunitParameter params[], void *user_data) {
+    DSDict *dict = dsdict_new(dict_HashInt, dict_CompareInt, NULL, dict_CountFree);
+    munit_assert_not_null(dict);
+    DICT_VALUES_FREED = 0;
+
+    /* stop immediately after a large table resizes, while most of its
+     * entries remain in the old table */
+    size_t nkeys = 0;
+    size_t cap = 0;
+    do {
+        cap = dsdict_cap(dict);
+        dsdict_put(dict, dict_Key(nkeys), dict_Key(nkeys));
+        nkeys++;
+    } while ((cap < 4096) || (dsdict_cap(dict) == cap));
+
+    for (size_t i = 0; i < nkeys; i++) {
+        munit_assert_ptr_equal(dsdict_get(dict, dict_Key(i)), dict_Key(i));
+    }
+
+    size_t seen = 0;
+    DSIter *iter = dsdict_iter(dict);
+    munit_assert_not_null(iter);
+    while (dsiter_next(iter)) {
+        munit_assert_ptr_equal(dsiter_key(iter), dsiter_value(iter));
+        seen++;
+    }
+    dsiter_destroy(iter);
+    munit_assert_size(seen, ==, nkeys);
+
+    /* overwrite even keys, delete odd keys, and insert new keys, touching
+     * both tables as entries migrate */
+    size_t npairs = nkeys / 2;
+    for (size_t i = 0; i < npairs; i++) {
+        dsdict_put(dict, dict_Key(2 * i), dict_Key(2 * i + 1));
+        munit_assert_ptr_equal(dsdict_del(dict, dict_Key(2 * i + 1)), dict_Key(2 * i + 1));
+        dsdict_put(dict, dict_Key(nkeys + i), dict_Key(nkeys + i));
+    }
+    munit_assert_size(DICT_VALUES_FREED, ==, npairs);
+    munit_assert_size(dsdict_count(dict), ==, nkeys);
+
+    for (size_t i = 0; i < 2 * npairs; i++) {
+        void *expected = (i % 2 == 0) ? dict_Key(i + 1) : NULL;
+        munit_assert_ptr_equal(dsdict_get(dict, dict_Key(i)), expected);
+    }
+    for (size_t i = nkeys; i < nkeys + npairs; i++) {
+        munit_assert_ptr_equal(dsdict_get(dict, dict_Key(i)), dict_Key(i));
+    }
+
+    DICT_VALUES_FREED = 0;
+    dsdict_destroy(dict);
+    munit_assert_size(DICT_VALUES_FREED, ==, nkeys);
+    return MUNIT_OK;
+}
+
+static MunitResult dict_TestChurn(const MunitParameter params[], void *user_data) {
+    static const size_t nkeys = 512;
+    static const size_t nops = 200000;
+
+    DSDict *dict = dsdict_new(dict_HashInt, dict_CompareInt, NULL, NULL);
+    munit_assert_not_null(dict);
+
+    /* mirror every operation in a plain array of present keys */
+    bool shadow[512] = { false };
+    size_t present = 0;
+    size_t maxcap = 0;
+
+    for (size_t op = 0; op < nops; op++) {
+        size_t key = (size_t)munit_rand_int_range(0, (int)nkeys - 1);
+        if (munit_rand_int_range(0, 1) == 0) {
+            dsdict_put(dict, dict_Key(key), dict_Key(key + 1));
+            if (!shadow[key]) { present++; }
+            shadow[key] = true;
+        } else {
+            void *val = dsdict_del(dict, dict_Key(key));
+            munit_assert_ptr_equal(val, (shadow[key]) ? dict_Key(key + 1) : NULL);
+            if (shadow[key]) { present--; }
+            shadow[key] = false;
+        }
+
+        munit_assert_size(dsdict_count(dict), ==, present);
+        if (dsdict_cap(dict) > maxcap) { maxcap = dsdict_cap(dict); }
+    }
+
+    for (size_t i = 0; i < nkeys; i++) {
+        void *expected = (shadow[i]) ? dict_Key(i + 1) : NULL;
+        munit_assert_ptr_equal(dsdict_get(dict, dict_Key(i)), expected);
+    }
+
+    /* deleted slots are reclaimed rather than growing the table forever */
+    munit_assert_size(maxcap, <=, 4 * nkeys);
+
+    dsdict_destroy(dict);
+    return MUNIT_OK;
+}
+
+static MunitResult dict_TestIterate(const MunitParameter params[], void *user_data) {
+    static const size_t nkeys = 1000;
+
+    DSDict *dict = dsdict_new(dict_HashInt, dict_CompareInt, NULL, NULL);
+    munit_assert_not_null(dict);
+
+    size_t expected = 0;
+    for (size_t i = 0; i < nkeys; i++) {
+        dsdict_put(dict, dict_Key(i), dict_Key(i));
+        if (i % 3 != 0) { expected += i; }
+    }
+    for (size_t i = 0; i < nkeys; i += 3) {
+        dsdict_del(dict, dict_Key(i));
+    }
+
+    size_t seen = 0;
+    size_t sum = 0;
+    DSIter *iter = dsdict_iter(dict);
+    munit_assert_not_null(iter);
+    while (dsiter_next(iter)) {
+        munit_assert_ptr_equal(dsiter_key(iter), dsiter_value(iter));
+        sum += (size_t)(uintptr_t)dsiter_key(iter) - 1;
+        seen++;
+    }
+    dsiter_destroy(iter);
+    munit_assert_size(seen, ==, dsdict_count(dict));
+    munit_assert_size(sum, ==, expected);
+
+    DICT_ENTRIES_SEEN = 0;
+    dsdict_foreach(dict, dict_CountEntry);
+    munit_assert_size(DICT_ENTRIES_SEEN, ==, dsdict_count(dict));
+
+    dsdict_destroy(dict);
+    return MUNIT_OK;
+}
+
+/*
+ * UTILITY FUNCTIONS
+ */
+
+static uint32_t dict_HashInt(void *key) {
+    uint32_t k = (uint32_t)(uintptr_t)key;
+    return k * 2654435761u;
+}
+
+static uint32_t dict_HashConstant(void *key) {
+    return 0x5bd1e995;
+}
+
+static int dict_CompareInt(const void *left, const void *right) {
+    return (left == right) ? 0 : 1;
+}
+
+static void dict_CountFree(void *val) {
+    DICT_VALUES_FREED++;
+}
+
+static void dict_CountEntry(const void *key, void *val) {
+    DICT_ENTRIES_SEEN++;
+}
+
+/* Keys must be non-NULL, so offset every integer key by one. */
+static void *dict_Key(size_t i) {
+    return (void *)(uintptr_t)(i + 1);
+}
@@ -0,0 +1,146 @@
+/*------------------------------------------------------------------------------
+ *    Copyright 2016 Chris Rink
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *----------------------------------------------------------------------------*/
+
+#include <stdint.h>
+#include <string.h>
+#include "hash_test.h"
+#include "libds/buffer.h"
+#include "libds/hash.h"
+
+/*
+ * TEST DEFINITIONS
+ */
+
+static MunitResult hash_TestDeterministic(const MunitParameter params[], void *user_data);
+static MunitResult hash_TestLengths(const MunitParameter params[], void *user_data);
+static MunitResult hash_TestEmbeddedNul(const MunitParameter params[], void *user_data);
+static MunitResult hash_TestSeed(const MunitParameter params[], void *user_data);
+
+MunitTest hash_tests[] = {
+    {
+        "/Deterministic",
+        hash_TestDeterministic,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/Lengths",
+        hash_TestLengths,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/EmbeddedNul",
+        hash_TestEmbeddedNul,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/Seed",
+        hash_TestSeed,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
+
+/*
+ * UNIT TEST FUNCTIONS
+ */
+
+static MunitResult hash_TestDeterministic(const MunitParameter params[], void *user_data) {
+    const char *str = "identifier";
+    munit_assert_uint32(hash_bytes(str, strlen(str)), ==, hash_bytes(str, strlen(str)));
+    munit_assert_uint32(hash_cstr(str), ==, hash_bytes(str, strlen(str)));
+
+    /* the hash depends on the contents of the buffer, not its address */
+    char copy[16];
+    memcpy(copy, str, strlen(str) + 1);
+    munit_assert_uint32(hash_cstr(copy), ==, hash_cstr(str));
+
+    DSBuffer *buf = dsbuf_new(str);
+    munit_assert_not_null(buf);
+    munit_assert_uint32(dsbuf_hash(buf), ==, hash_cstr(str));
+    dsbuf_destroy(buf);
+    return MUNIT_OK;
+}
+
+static MunitResult hash_TestLengths(const MunitParameter params[], void *user_data) {
+    static const size_t maxlen = 200;
+    uint8_t data[200];
+    uint32_t hashes[201];
+
+    for (size_t i = 0; i < maxlen; i++) {
+        data[i] = (uint8_t)(i * 7 + 1);
+    }
+
+    /* every prefix length takes a different path through the hash, so
+     * check that none of them collide */
+    for (size_t len = 0; len <= maxlen; len++) {
+        hashes[len] = hash_bytes(data, len);
+        for (size_t j = 0; j < len; j++) {
+            munit_assert_uint32(hashes[j], !=, hashes[len]);
+        }
+    }
+
+    /* and that every byte of each length contributes to the hash */
+    for (size_t len = 1; len <= maxlen; len += 13) {
+        for (size_t i = 0; i < len; i++) {
+            data[i] ^= 0x20;
+            munit_assert_uint32(hash_bytes(data, len), !=, hashes[len]);
+            data[i] ^= 0x20;
+        }
+    }
+    return MUNIT_OK;
+}
+
+static MunitResult hash_TestEmbeddedNul(const MunitParameter params[], void *user_data) {
+    static const char left[] = { 'a', '\0', 'b' };
+    static const char right[] = { 'a', '\0', 'c' };
+
+    munit_assert_uint32(hash_bytes(left, sizeof(left)), !=, hash_bytes(right, sizeof(right)));
+    munit_assert_uint32(hash_bytes(left, sizeof(left)), !=, hash_bytes(left, 1));
+    munit_assert_uint32(hash_bytes(left, 1), ==, hash_cstr(left));
+    return MUNIT_OK;
+}
+
+static MunitResult hash_TestSeed(const MunitParameter params[], void *user_data) {
+    const char *str = "identifier";
+    uint32_t unseeded = hash_cstr(str);
+
+    hash_seed(12345);
+    uint32_t seeded = hash_cstr(str);
+    munit_assert_uint32(seeded, !=, unseeded);
+
+    hash_seed(54321);
+    munit_assert_uint32(hash_cstr(str), !=, seeded);
+
+    hash_seed(12345);
+    munit_assert_uint32(hash_cstr(str), ==, seeded);
+
+    /* restore the default seed for every other test */
+    hash_seed(0);
+    munit_assert_uint32(hash_cstr(str), ==, unseeded);
+    return MUNIT_OK;
+}
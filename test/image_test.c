@@ -0,0 +1,736 @@
+/*------------------------------------------------------------------------------
+ *    Copyright 2016 Chris Rink
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *----------------------------------------------------------------------------*/
+
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#ifdef MS_USE_PTHREADS
+#include <pthread.h>
+#endif
+#include "image_test.h"
+#include "libds/alloc.h"
+#include "../src/bytecode.h"
+#include "../src/image.h"
+#include "../src/intern.h"
+#include "../src/mscript.h"
+#include "../src/parser.h"
+
+/*
+ * TEST DEFINITIONS
+ */
+
+static MunitResult img_TestRoundTrip(const MunitParameter params[], void *file);
+static MunitResult img_TestScript(const MunitParameter params[], void *file);
+static MunitResult img_TestLoadThreads(const MunitParameter params[], void *file);
+static MunitResult img_TestRejected(const MunitParameter params[], void *file);
+static MunitResult img_TestCache(const MunitParameter params[], void *file);
+static MunitResult img_TestCacheMemoryLimit(const MunitParameter params[], void *file);
+static MunitResult img_TestStackDepth(const MunitParameter params[], void *file);
+static void *img_CreateTempName(const MunitParameter params[], void *user_data);
+static void img_CleanUpTempName(void *file);
+
+MunitTest image_tests[] = {
+    {
+        "/RoundTrip",
+        img_TestRoundTrip,
+        img_CreateTempName,
+        img_CleanUpTempName,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/Script",
+        img_TestScript,
+        img_CreateTempName,
+        img_CleanUpTempName,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/LoadThreads",
+        img_TestLoadThreads,
+        img_CreateTempName,
+        img_CleanUpTempName,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/Rejected",
+        img_TestRejected,
+        img_CreateTempName,
+        img_CleanUpTempName,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/Cache",
+        img_TestCache,
+        img_CreateTempName,
+        img_CleanUpTempName,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/CacheMemoryLimit",
+        img_TestCacheMemoryLimit,
+        img_CreateTempName,
+        img_CleanUpTempName,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/StackDepth",
+        img_TestStackDepth,
+        img_CreateTempName,
+        img_CleanUpTempName,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
+
+/*
+ * FORWARD DECLARATIONS
+ */
+
+static const char *const RoundTripScript =
+        "var name := \"first\" + \" \" + \"last\";\n"
+        "var n := 3 * 4.5 - -2;\n"
+        "var ok := !(true && false) || null;\n"
+        "var MakeName := func(first, last) { return first + last; };\n"
+        "var Outer := func(a) { var b := \"first\"; return func(c) { return a + b + c; }; };\n"
+        "name := MakeName(name, \"!\");\n";
+
+static const size_t CACHE_SCRIPT_NAMES = 2000;
+static const size_t CACHE_MEMORY_LIMIT = 256 * 1024;
+#define LOAD_THREADS (8)
+
+#ifdef MS_USE_PTHREADS
+typedef struct {
+    ms_VMByteCode *code;            /** bytecode whose functions are loaded */
+    pthread_barrier_t start;        /** released once every thread is ready */
+} LoadThreadsContext;
+#endif
+
+#ifdef MS_USE_PTHREADS
+static void *LoadFunctionsThread(void *ctx);
+static size_t LoadFunctions(ms_VMByteCode *code);
+#endif
+static void CompareByteCode(ms_VMByteCode *code, ms_VMByteCode *expected);
+static void CompareValues(ms_VMValue *val, ms_VMValue *expected);
+static ms_VMByteCode *GenerateByteCode(const char *src);
+static ms_VMByteCode *AssembleByteCode(const ms_VMOpCode *ops, size_t nops);
+static char *CacheEntry(const char *dir);
+static char *FindFunctionBody(char *image, size_t len, const char *src);
+static void WriteFile(const char *fname, const char *contents, size_t len);
+static char *ReadFile(const char *fname, size_t *len);
+
+/*
+ * SETUP AND TEARDOWN FUNCTIONS
+ */
+
+static void *img_CreateTempName(const MunitParameter params[], void *user_data) {
+    char *tmpname = munit_malloc(12);
+    memcpy(tmpname, "imageXXXXXX", 11);
+    munit_assert_int(mkstemp(tmpname), !=, -1);
+    return tmpname;
+}
+
+static void img_CleanUpTempName(void *file) {
+    remove((char *)file);
+    free(file);
+}
+
+/*
+ * UNIT TEST FUNCTIONS
+ */
+
+static MunitResult img_TestRoundTrip(const MunitParameter params[], void *file) {
+    ms_VMByteCode *code = GenerateByteCode(RoundTripScript);
+
+    ms_Error *err;
+    DSBuffer *names[] = { dsbuf_new("n"), dsbuf_new("s") };
+    munit_assert_int(ms_VMImageWrite(code, names, 2, (char *)file, &err), ==, MS_RESULT_SUCCESS);
+    munit_assert_null(err);
+    munit_assert_true(ms_VMImageIsFile((char *)file));
+
+    ms_VMImage *img = ms_VMImageOpen((char *)file, &err);
+    munit_assert_not_null(img);
+    munit_assert_null(err);
+    munit_assert_size(ms_VMImageParamCount(img), ==, 2);
+    for (size_t i = 0; i < 2; i++) {
+        DSBuffer *param = ms_VMImageParam(img, i);
+        munit_assert_true(dsbuf_equals(param, names[i]));
+        ms_InternRelease(param);
+        dsbuf_destroy(names[i]);
+    }
+
+    ms_VMByteCode *loaded;
+    munit_assert_int(ms_VMImageLoadChunk(img, 0, &loaded, &err), ==, MS_RESULT_SUCCESS);
+    munit_assert_null(err);
+    munit_assert_ptr_equal(loaded->image, img);
+
+    /* chunks must be loaded by index from the same image */
+    ms_VMByteCode *missing;
+    munit_assert_int(ms_VMImageLoadChunk(img, SIZE_MAX, &missing, &err), ==, MS_RESULT_ERROR);
+    munit_assert_not_null(err);
+    ms_ErrorDestroy(err);
+
+    /* loaded bytecode holds its own reference to the image */
+    ms_VMImageRelease(img);
+    CompareByteCode(loaded, code);
+
+    ms_VMByteCodeDestroy(loaded);
+    ms_VMByteCodeDestroy(code);
+    return MUNIT_OK;
+}
+
+static MunitResult img_TestScript(const MunitParameter params[], void *file) {
+    const char *const names[] = { "n", "s" };
+    const char *src = "var total := n * 2;\n"
+                      "var neg := -s;\n"
+                      "var label := s * total;\n";
+
+    ms_Error *cerr;
+    ms_Script *script = ms_ScriptCompileString(src, names, 2, &cerr);
+    munit_assert_not_null(script);
+    munit_assert_null(cerr);
+    munit_assert_false(ms_ScriptFileIsCompiled((char *)file));
+    munit_assert_int(ms_ScriptSave(script, (char *)file, &cerr), ==, MS_RESULT_SUCCESS);
+    munit_assert_null(cerr);
+    munit_assert_true(ms_ScriptFileIsCompiled((char *)file));
+    ms_ScriptDestroy(script);
+
+    script = ms_ScriptLoad((char *)file, &cerr);
+    munit_assert_not_null(script);
+    munit_assert_null(cerr);
+
+    ms_State *state = ms_StateNew();
+    munit_assert_not_null(state);
+
+    /* parameters are bound by their saved names; negating a string only
+     * fails at runtime, so a loaded script must actually execute */
+    const ms_Error *err;
+    ms_Param args[] = {
+        { .type = MS_PARAM_INT, .val.i = 2 },
+        { .type = MS_PARAM_STR, .val.s = "label", .len = 5 },
+    };
+    munit_assert_int(ms_StateExecuteScript(state, script, args, 2, &err), ==, MS_RESULT_ERROR);
+    munit_assert_not_null(err);
+    munit_assert_int(err->type, ==, MS_ERROR_VM);
+
+    args[1] = (ms_Param){ .type = MS_PARAM_INT, .val.i = 7 };
+    munit_assert_int(ms_StateExecuteScript(state, script, args, 2, &err), ==, MS_RESULT_SUCCESS);
+    munit_assert_null(err);
+    munit_assert_int(ms_StateExecuteScript(state, script, args, 1, &err), ==, MS_RESULT_ERROR);
+    munit_assert_not_null(err);
+
+    ms_StateDestroy(state);
+    ms_ScriptDestroy(script);
+    return MUNIT_OK;
+}
+
+static MunitResult img_TestLoadThreads(const MunitParameter params[], void *file) {
+#ifndef MS_USE_PTHREADS
+    return MUNIT_SKIP;
+#else
+    ms_VMByteCode *code = GenerateByteCode(RoundTripScript);
+
+    ms_Error *err;
+    munit_assert_int(ms_VMImageWrite(code, NULL, 0, (char *)file, &err), ==, MS_RESULT_SUCCESS);
+    ms_VMImage *img = ms_VMImageOpen((char *)file, &err);
+    munit_assert_not_null(img);
+
+    ms_VMByteCode *loaded;
+    munit_assert_int(ms_VMImageLoadChunk(img, 0, &loaded, &err), ==, MS_RESULT_SUCCESS);
+    ms_VMImageRelease(img);
+
+    /* bodies shared between threads are each loaded once, by any of them */
+    LoadThreadsContext ctx = { .code = loaded };
+    munit_assert_int(pthread_barrier_init(&ctx.start, NULL, LOAD_THREADS), ==, 0);
+    pthread_t threads[LOAD_THREADS];
+    for (size_t i = 0; i < LOAD_THREADS; i++) {
+        munit_assert_int(pthread_create(&threads[i], NULL, LoadFunctionsThread, &ctx), ==, 0);
+    }
+
+    size_t failed = 0;
+    for (size_t i = 0; i < LOAD_THREADS; i++) {
+        void *res;
+        munit_assert_int(pthread_join(threads[i], &res), ==, 0);
+        failed += (size_t)(uintptr_t)res;
+    }
+    pthread_barrier_destroy(&ctx.start);
+    munit_assert_size(failed, ==, 0);
+    for (size_t i = 0; i < loaded->nvals; i++) {
+        if (loaded->values[i].type != VMVAL_FUNC) {
+            continue;
+        }
+
+        ms_VMFunc *fn = loaded->values[i].val.fn;
+        munit_assert_null(fn->image);
+        munit_assert_not_null(fn->code);
+        munit_assert_size(fn->code->nops, ==, code->values[i].val.fn->code->nops);
+    }
+
+    ms_VMByteCodeDestroy(loaded);
+    ms_VMByteCodeDestroy(code);
+    return MUNIT_OK;
+#endif
+}
+
+static MunitResult img_TestRejected(const MunitParameter params[], void *file) {
+    ms_Error *err;
+    ms_Script *script = ms_ScriptCompileString(RoundTripScript, NULL, 0, &err);
+    munit_assert_not_null(script);
+    munit_assert_int(ms_ScriptSave(script, (char *)file, &err), ==, MS_RESULT_SUCCESS);
+    ms_ScriptDestroy(script);
+
+    size_t len;
+    char *image = ReadFile((char *)file, &len);
+    munit_assert_size(len, >, 8);
+
+    /* missing files and source files */
+    munit_assert_null(ms_ScriptLoad("image-file-which-does-not-exist", &err));
+    munit_assert_not_null(err);
+    ms_ErrorDestroy(err);
+
+    WriteFile((char *)file, RoundTripScript, strlen(RoundTripScript));
+    munit_assert_false(ms_ScriptFileIsCompiled((char *)file));
+    munit_assert_null(ms_ScriptLoad((char *)file, &err));
+    munit_assert_not_null(err);
+    ms_ErrorDestroy(err);
+
+    /* images from a newer version of the format */
+    char *copy = munit_malloc(len);
+    memcpy(copy, image, len);
+    copy[4] = (char)0x7f;
+    WriteFile((char *)file, copy, len);
+    munit_assert_true(ms_ScriptFileIsCompiled((char *)file));
+    munit_assert_null(ms_ScriptLoad((char *)file, &err));
+    munit_assert_not_null(err);
+    ms_ErrorDestroy(err);
+
+    /* truncated images at every length */
+    for (size_t i = 0; i < len; i++) {
+        WriteFile((char *)file, image, i);
+        munit_assert_null(ms_ScriptLoad((char *)file, &err));
+        munit_assert_not_null(err);
+        ms_ErrorDestroy(err);
+    }
+
+    /* damaged strings are caught by the checksum */
+    memcpy(copy, image, len);
+    copy[len - 1] = (char)~copy[len - 1];
+    WriteFile((char *)file, copy, len);
+    munit_assert_null(ms_ScriptLoad((char *)file, &err));
+    munit_assert_not_null(err);
+    ms_ErrorDestroy(err);
+
+    /* damaged bytes may fail to load, but must never be read out of bounds */
+    for (size_t i = 4; i < len; i++) {
+        memcpy(copy, image, len);
+        copy[i] = (char)~copy[i];
+        WriteFile((char *)file, copy, len);
+        script = ms_ScriptLoad((char *)file, &err);
+        if (script) {
+            munit_assert_null(err);
+            ms_ScriptDestroy(script);
+        } else {
+            munit_assert_not_null(err);
+            ms_ErrorDestroy(err);
+        }
+    }
+
+    free(copy);
+    free(image);
+    return MUNIT_OK;
+}
+
+static MunitResult img_TestCache(const MunitParameter params[], void *file) {
+    char dir[] = "imagecacheXXXXXX";
+    munit_assert_not_null(mkdtemp(dir));
+
+    const char *src = "var n := 3;\nvar s := \"a\" + \"b\";\n";
+    WriteFile((char *)file, src, strlen(src));
+
+    ms_StateOptions opts = { .cache_dir = dir };
+    ms_State *state = ms_StateNewOptions(&opts);
+    munit_assert_not_null(state);
+
+    /* the first execution compiles the file and caches its bytecode */
+    const ms_Error *err;
+    munit_assert_null(CacheEntry(dir));
+    munit_assert_int(ms_StateExecuteFile(state, (char *)file, &err), ==, MS_RESULT_SUCCESS);
+    munit_assert_null(err);
+    char *entry = CacheEntry(dir);
+    munit_assert_not_null(entry);
+    munit_assert_true(ms_ScriptFileIsCompiled(entry));
+
+    /* later executions run the cached bytecode rather than the source, so
+     * an entry holding different bytecode is observable */
+    ms_Error *cerr;
+    ms_Script *other = ms_ScriptCompileString("var s := -\"a\";", NULL, 0, &cerr);
+    munit_assert_not_null(other);
+    munit_assert_int(ms_ScriptSave(other, entry, &cerr), ==, MS_RESULT_SUCCESS);
+    ms_ScriptDestroy(other);
+    munit_assert_int(ms_StateExecuteFile(state, (char *)file, &err), ==, MS_RESULT_ERROR);
+    munit_assert_not_null(err);
+    munit_assert_int(err->type, ==, MS_ERROR_VM);
+
+    /* corrupt entries are compiled again and replaced */
+    WriteFile(entry, MS_VM_IMAGE_MAGIC, strlen(MS_VM_IMAGE_MAGIC));
+    munit_assert_int(ms_StateExecuteFile(state, (char *)file, &err), ==, MS_RESULT_SUCCESS);
+    munit_assert_null(err);
+    munit_assert_int(ms_StateExecuteFile(state, (char *)file, &err), ==, MS_RESULT_SUCCESS);
+    munit_assert_null(err);
+
+    /* entries are checked in full before they are executed, so a damaged
+     * function body is compiled again rather than failing once called */
+    munit_assert_int(remove(entry), ==, 0);
+    free(entry);
+    const char *fnsrc = "var f := func(a) { return a + 1; };\n";
+    WriteFile((char *)file, fnsrc, strlen(fnsrc));
+    munit_assert_int(ms_StateExecuteFile(state, (char *)file, &err), ==, MS_RESULT_SUCCESS);
+    entry = CacheEntry(dir);
+    munit_assert_not_null(entry);
+
+    size_t len;
+    char *image = ReadFile(entry, &len);
+    char *body = FindFunctionBody(image, len, fnsrc);
+    *body = (char)~(*body);
+    WriteFile(entry, image, len);
+    other = ms_ScriptLoad(entry, &cerr);
+    munit_assert_not_null(other);
+    ms_ScriptDestroy(other);
+
+    munit_assert_int(ms_StateExecuteFile(state, (char *)file, &err), ==, MS_RESULT_SUCCESS);
+    munit_assert_null(err);
+    ms_VMImage *img = ms_VMImageOpen(entry, &cerr);
+    munit_assert_not_null(img);
+    munit_assert_int(ms_VMImageVerify(img, &cerr), ==, MS_RESULT_SUCCESS);
+    munit_assert_null(cerr);
+    ms_VMImageRelease(img);
+    free(image);
+
+    /* changed source never matches the entry of its previous contents */
+    munit_assert_int(remove(entry), ==, 0);
+    const char *bad = "var n := ;";
+    WriteFile((char *)file, bad, strlen(bad));
+    munit_assert_int(ms_StateExecuteFile(state, (char *)file, &err), ==, MS_RESULT_ERROR);
+    munit_assert_not_null(err);
+    munit_assert_int(err->type, ==, MS_ERROR_PARSER);
+    munit_assert_null(CacheEntry(dir));
+
+    ms_StateDestroy(state);
+
+    /* missing cache directories only cost the cache */
+    opts.cache_dir = "image-cache-directory-which-does-not-exist";
+    state = ms_StateNewOptions(&opts);
+    munit_assert_not_null(state);
+    WriteFile((char *)file, src, strlen(src));
+    munit_assert_int(ms_StateExecuteFile(state, (char *)file, &err), ==, MS_RESULT_SUCCESS);
+    munit_assert_null(err);
+    ms_StateDestroy(state);
+
+    free(entry);
+    munit_assert_int(remove(dir), ==, 0);
+    return MUNIT_OK;
+}
+
+static MunitResult img_TestCacheMemoryLimit(const MunitParameter params[], void *file) {
+    char dir[] = "imagecacheXXXXXX";
+    munit_assert_not_null(mkdtemp(dir));
+
+    FILE *f = fopen((char *)file, "wb");
+    munit_assert_not_null(f);
+    for (size_t i = 0; i < CACHE_SCRIPT_NAMES; i++) {
+        fprintf(f, "var name%zu := \"value\" + \"%zu\";\n", i, i);
+    }
+    munit_assert_int(fclose(f), ==, 0);
+
+    /* compiling an entry is charged to the state, so a script which cannot
+     * be compiled within the limit is never cached */
+    ms_StateOptions opts = { .cache_dir = dir, .mem_limit = CACHE_MEMORY_LIMIT };
+    ms_State *state = ms_StateNewOptions(&opts);
+    munit_assert_not_null(state);
+    const ms_Error *err;
+    munit_assert_int(ms_StateExecuteFile(state, (char *)file, &err), ==, MS_RESULT_ERROR);
+    munit_assert_not_null(err);
+    munit_assert_int(err->type, ==, MS_ERROR_VM);
+    munit_assert_size(ms_StateMemoryPeak(state), <=, CACHE_MEMORY_LIMIT);
+    munit_assert_null(CacheEntry(dir));
+    ms_StateDestroy(state);
+
+    opts.mem_limit = 0;
+    state = ms_StateNewOptions(&opts);
+    munit_assert_not_null(state);
+    munit_assert_int(ms_StateExecuteFile(state, (char *)file, &err), ==, MS_RESULT_SUCCESS);
+    munit_assert_size(ms_StateMemoryPeak(state), >, CACHE_MEMORY_LIMIT);
+    ms_StateDestroy(state);
+
+    char *entry = CacheEntry(dir);
+    munit_assert_not_null(entry);
+    munit_assert_int(remove(entry), ==, 0);
+    free(entry);
+    munit_assert_int(remove(dir), ==, 0);
+    return MUNIT_OK;
+}
+
+static MunitResult img_TestStackDepth(const MunitParameter params[], void *file) {
+    const struct {
+        ms_VMOpCode ops[4];
+        size_t nops;
+    } underflows[] = {
+        { { OPC_POP }, 1 },
+        { { ms_VMOpCodeWithArg(OPC_PUSH, 0), OPC_ADD }, 2 },
+        { { ms_VMOpCodeWithArg(OPC_PUSH, 0), ms_VMOpCodeWithArg(OPC_JUMP_IF_FALSE, 3), OPC_POP, OPC_POP }, 4 },
+        { { ms_VMOpCodeWithArg(OPC_PUSH, 0), OPC_POP, ms_VMOpCodeWithArg(OPC_GOTO, 1) }, 3 },
+        { { OPC_PUSH_BLOCK, OPC_POP_BLOCK, OPC_POP_BLOCK }, 3 },
+    };
+
+    /* images whose opcodes could pop from an empty stack are never loaded,
+     * even though their checksums are intact */
+    ms_Error *err;
+    for (size_t i = 0; i < sizeof(underflows) / sizeof(underflows[0]); i++) {
+        ms_VMByteCode *code = AssembleByteCode(underflows[i].ops, underflows[i].nops);
+        munit_assert_int(ms_VMImageWrite(code, NULL, 0, (char *)file, &err), ==, MS_RESULT_SUCCESS);
+        ms_VMByteCodeDestroy(code);
+        munit_assert_null(ms_ScriptLoad((char *)file, &err));
+        munit_assert_not_null(err);
+        ms_ErrorDestroy(err);
+    }
+
+    /* loops may grow the stack, which fails when it is executed */
+    const ms_VMOpCode grows[] = { ms_VMOpCodeWithArg(OPC_PUSH, 0), ms_VMOpCodeWithArg(OPC_GOTO, 0) };
+    ms_VMByteCode *code = AssembleByteCode(grows, 2);
+    munit_assert_int(ms_VMImageWrite(code, NULL, 0, (char *)file, &err), ==, MS_RESULT_SUCCESS);
+    ms_VMByteCodeDestroy(code);
+    ms_Script *script = ms_ScriptLoad((char *)file, &err);
+    munit_assert_not_null(script);
+    munit_assert_null(err);
+
+    ms_State *state = ms_StateNew();
+    munit_assert_not_null(state);
+    const ms_Error *xerr;
+    munit_assert_int(ms_StateExecuteScript(state, script, NULL, 0, &xerr), ==, MS_RESULT_ERROR);
+    munit_assert_not_null(xerr);
+    munit_assert_int(xerr->type, ==, MS_ERROR_VM);
+    ms_StateDestroy(state);
+    ms_ScriptDestroy(script);
+    return MUNIT_OK;
+}
+
+/*
+ * UTILITY FUNCTIONS
+ */
+
+// Return bytecode holding a copy of `ops` and a single integer constant.
+static ms_VMByteCode *AssembleByteCode(const ms_VMOpCode *ops, size_t nops) {
+    ms_VMOpCode *code = dsalloc(nops * sizeof(ms_VMOpCode));
+    ms_VMValue *values = dsalloc(sizeof(ms_VMValue));
+    munit_assert_not_null(code);
+    munit_assert_not_null(values);
+    memcpy(code, ops, nops * sizeof(ms_VMOpCode));
+    values[0].type = VMVAL_INT;
+    values[0].val.i = 1;
+
+    ms_VMByteCode *bc = ms_VMByteCodeNew(code, nops, values, 1, NULL, 0);
+    munit_assert_not_null(bc);
+    return bc;
+}
+
+// Return the path of the only entry in a bytecode cache directory, or
+// NULL if it is empty.
+static char *CacheEntry(const char *dir) {
+    DIR *d = opendir(dir);
+    munit_assert_not_null(d);
+
+    char *path = NULL;
+    struct dirent *ent;
+    while ((ent = readdir(d)) != NULL) {
+        if (ent->d_name[0] == '.') {
+            continue;
+        }
+        munit_assert_null(path);
+        size_t len = strlen(dir) + strlen(ent->d_name) + 2;
+        path = munit_malloc(len);
+        snprintf(path, len, "%s/%s", dir, ent->d_name);
+    }
+
+    closedir(d);
+    return path;
+}
+
+// Return the first opcode of the body of the first function defined by
+// `src` within an image of its bytecode.
+static char *FindFunctionBody(char *image, size_t len, const char *src) {
+    ms_VMByteCode *code = GenerateByteCode(src);
+    ms_VMFunc *fn = NULL;
+    for (size_t i = 0; (!fn) && (i < code->nvals); i++) {
+        if (code->values[i].type == VMVAL_FUNC) {
+            fn = code->values[i].val.fn;
+        }
+    }
+    munit_assert_not_null(fn);
+
+    ms_Error *err;
+    munit_assert_int(ms_VMFuncCompile(fn, &err), ==, MS_RESULT_SUCCESS);
+    size_t size = fn->code->nops * sizeof(ms_VMOpCode);
+    munit_assert_size(size, >, 0);
+
+    char *body = NULL;
+    for (size_t i = 0; (!body) && (i + size <= len); i++) {
+        if (memcmp(image + i, fn->code->code, size) == 0) {
+            body = image + i;
+        }
+    }
+    munit_assert_not_null(body);
+    ms_VMByteCodeDestroy(code);
+    return body;
+}
+
+#ifdef MS_USE_PTHREADS
+// Load every function body once all threads are ready (munit assertions
+// are not safe off the main thread), returning the number which could not
+// be loaded.
+static void *LoadFunctionsThread(void *ctx) {
+    LoadThreadsContext *lctx = ctx;
+    pthread_barrier_wait(&lctx->start);
+    return (void *)(uintptr_t)LoadFunctions(lctx->code);
+}
+
+static size_t LoadFunctions(ms_VMByteCode *code) {
+    size_t failed = 0;
+    for (size_t i = 0; i < code->nvals; i++) {
+        if (code->values[i].type != VMVAL_FUNC) {
+            continue;
+        }
+
+        ms_VMFunc *fn = code->values[i].val.fn;
+        ms_Error *err;
+        if (ms_VMFuncCompile(fn, &err) == MS_RESULT_ERROR) {
+            ms_ErrorDestroy(err);
+            failed++;
+            continue;
+        }
+        failed += LoadFunctions(fn->code);
+    }
+    return failed;
+}
+#endif
+
+static void CompareByteCode(ms_VMByteCode *code, ms_VMByteCode *expected) {
+    munit_assert_size(code->nops, ==, expected->nops);
+    munit_assert_size(code->nvals, ==, expected->nvals);
+    munit_assert_size(code->nidents, ==, expected->nidents);
+    munit_assert_memory_equal(code->nops * sizeof(ms_VMOpCode), code->code, expected->code);
+
+    for (size_t i = 0; i < code->nvals; i++) {
+        CompareValues(&code->values[i], &expected->values[i]);
+    }
+
+    /* identifiers are interned, so the VM may compare them by address */
+    for (size_t i = 0; i < code->nidents; i++) {
+        munit_assert_ptr_equal(code->idents[i], expected->idents[i]);
+    }
+}
+
+static void CompareValues(ms_VMValue *val, ms_VMValue *expected) {
+    munit_assert_int(val->type, ==, expected->type);
+
+    switch (val->type) {
+        case VMVAL_FLOAT:
+            munit_assert_double(val->val.f, ==, expected->val.f);
+            break;
+        case VMVAL_INT:
+            munit_assert_llong(val->val.i, ==, expected->val.i);
+            break;
+        case VMVAL_STR:
+            munit_assert_ptr_equal(val->val.s, expected->val.s);
+            break;
+        case VMVAL_BOOL:
+            munit_assert_int(val->val.b, ==, expected->val.b);
+            break;
+        case VMVAL_NULL:
+            break;
+        case VMVAL_FUNC: {
+            /* function bodies are only loaded on their first call */
+            ms_VMFunc *fn = val->val.fn;
+            ms_VMFunc *efn = expected->val.fn;
+            munit_assert_null(fn->code);
+            munit_assert_not_null(fn->image);
+
+            munit_assert_size(dsarray_len(fn->args), ==, dsarray_len(efn->args));
+            for (size_t i = 0; i < dsarray_len(fn->args); i++) {
+                munit_assert_ptr_equal(dsarray_get(fn->args, i), dsarray_get(efn->args, i));
+            }
+
+            ms_Error *err;
+            munit_assert_int(ms_VMFuncCompile(fn, &err), ==, MS_RESULT_SUCCESS);
+            munit_assert_null(err);
+            munit_assert_null(fn->image);
+            CompareByteCode(fn->code, efn->code);
+            break;
+        }
+        default:
+            munit_error("unexpected constant type");
+    }
+}
+
+static ms_VMByteCode *GenerateByteCode(const char *src) {
+    ms_Parser *prs = ms_ParserNew();
+    munit_assert_not_null(prs);
+    ms_ParserInitString(prs, src);
+
+    const ms_AST *ast;
+    ms_Error *err;
+    munit_assert_int(ms_ParserParse(prs, &ast, &err), !=, MS_RESULT_ERROR);
+    munit_assert_null(err);
+
+    ms_VMByteCode *code;
+    munit_assert_int(ms_VMByteCodeGenerateFromAST(ast, &code, &err), !=, MS_RESULT_ERROR);
+    munit_assert_null(err);
+
+    ms_ParserDestroy(prs);
+    return code;
+}
+
+static void WriteFile(const char *fname, const char *contents, size_t len) {
+    FILE *f = fopen(fname, "wb");
+    munit_assert_not_null(f);
+    munit_assert_size(fwrite(contents, 1, len, f), ==, len);
+    munit_assert_int(fclose(f), ==, 0);
+}
+
+static char *ReadFile(const char *fname, size_t *len) {
+    FILE *f = fopen(fname, "rb");
+    munit_assert_not_null(f);
+    munit_assert_int(fseek(f, 0, SEEK_END), ==, 0);
+    long size = ftell(f);
+    munit_assert_long(size, >, 0);
+    munit_assert_int(fseek(f, 0, SEEK_SET), ==, 0);
+
+    char *contents = munit_malloc((size_t)size);
+    munit_assert_size(fread(contents, 1, (size_t)size, f), ==, (size_t)size);
+    munit_assert_int(fclose(f), ==, 0);
+    *len = (size_t)size;
+    return contents;
+}
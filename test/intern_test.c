@@ -0,0 +1,230 @@
+/*------------------------------------------------------------------------------
+ *    Copyright 2016 Chris Rink
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *----------------------------------------------------------------------------*/
+
+#include "intern_test.h"
+#include "../src/bytecode.h"
+#include "../src/intern.h"
+#include "../src/parser.h"
+#include "libds/alloc.h"
+
+/*
+ * TEST DEFINITIONS
+ */
+
+static MunitResult int_TestCanonicalPointers(const MunitParameter params[], void *user_data);
+static MunitResult int_TestReferenceCounts(const MunitParameter params[], void *user_data);
+static MunitResult int_TestSharedAcrossByteCode(const MunitParameter params[], void *user_data);
+static MunitResult int_TestTrackedAllocator(const MunitParameter params[], void *user_data);
+
+MunitTest intern_tests[] = {
+    {
+        "/CanonicalPointers",
+        int_TestCanonicalPointers,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/ReferenceCounts",
+        int_TestReferenceCounts,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/SharedAcrossByteCode",
+        int_TestSharedAcrossByteCode,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/TrackedAllocator",
+        int_TestTrackedAllocator,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
+
+/*
+ * FORWARD DECLARATIONS
+ */
+
+static ms_VMByteCode *CompileString(ms_Parser *prs, const char *code);
+
+/*
+ * TEST CASE FUNCTIONS
+ */
+
+static MunitResult int_TestCanonicalPointers(const MunitParameter params[], void *user_data) {
+    DSBuffer *a1 = dsbuf_new("identifier");
+    DSBuffer *a2 = dsbuf_new("identifier");
+    DSBuffer *b = dsbuf_new("other");
+
+    DSBuffer *ia1 = ms_InternStr(a1);
+    DSBuffer *ia2 = ms_InternStr(a2);
+    DSBuffer *ib = ms_InternStr(b);
+    munit_assert_not_null(ia1);
+    munit_assert_not_null(ib);
+
+    munit_assert_ptr_equal(ia1, ia2);
+    munit_assert_ptr_not_equal(ia1, ib);
+    munit_assert_ptr_not_equal(ia1, a1);
+    munit_assert_true(dsbuf_equals(ia1, a1));
+    munit_assert_int(ms_InternCompare(ia1, ia2), ==, 0);
+    munit_assert_int(ms_InternCompare(ia1, ib), !=, 0);
+    munit_assert_uint32(ms_InternHash(ia1), ==, ms_InternHash(ia2));
+
+    ms_InternRelease(ia1);
+    ms_InternRelease(ia2);
+    ms_InternRelease(ib);
+    dsbuf_destroy(a1);
+    dsbuf_destroy(a2);
+    dsbuf_destroy(b);
+    return MUNIT_OK;
+}
+
+static MunitResult int_TestReferenceCounts(const MunitParameter params[], void *user_data) {
+    ms_InternStats before;
+    ms_InternGetStats(&before);
+
+    DSBuffer *s = dsbuf_new("refcounted");
+    DSBuffer *is = ms_InternStr(s);
+    munit_assert_not_null(is);
+    munit_assert_ptr_equal(ms_InternRetain(is), is);
+
+    ms_InternStats during;
+    ms_InternGetStats(&during);
+    munit_assert_size(during.nstrs, ==, before.nstrs + 1);
+    munit_assert_size(during.nbytes, ==, before.nbytes + dsbuf_len(s));
+    munit_assert_size(during.nrefs, ==, before.nrefs + 2);
+
+    ms_InternRelease(is);
+    ms_InternGetStats(&during);
+    munit_assert_size(during.nstrs, ==, before.nstrs + 1);
+
+    ms_InternRelease(is);
+    ms_InternGetStats(&during);
+    munit_assert_size(during.nstrs, ==, before.nstrs);
+    munit_assert_size(during.nbytes, ==, before.nbytes);
+    munit_assert_size(during.nrefs, ==, before.nrefs);
+
+    dsbuf_destroy(s);
+    return MUNIT_OK;
+}
+
+static MunitResult int_TestSharedAcrossByteCode(const MunitParameter params[], void *user_data) {
+    ms_Parser *prs = ms_ParserNew();
+    munit_assert_not_null(prs);
+
+    ms_VMByteCode *bc1 = CompileString(prs, "var name := \"constant\";");
+    ms_VMByteCode *bc2 = CompileString(prs, "name := \"constant\";");
+
+    munit_assert_size(bc1->nidents, ==, 1);
+    munit_assert_size(bc2->nidents, ==, 1);
+    munit_assert_ptr_equal(bc1->idents[0], bc2->idents[0]);
+
+    munit_assert_size(bc1->nvals, ==, 1);
+    munit_assert_size(bc2->nvals, ==, 1);
+    munit_assert_int(bc1->values[0].type, ==, VMVAL_STR);
+    munit_assert_ptr_equal(bc1->values[0].val.s, bc2->values[0].val.s);
+
+    /* the canonical strings must survive the first bytecode */
+    ms_VMByteCodeDestroy(bc1);
+    munit_assert_string_equal(dsbuf_char_ptr(bc2->idents[0]), "name");
+    munit_assert_string_equal(dsbuf_char_ptr(bc2->values[0].val.s), "constant");
+
+    ms_VMByteCodeDestroy(bc2);
+    ms_ParserDestroy(prs);
+    return MUNIT_OK;
+}
+
+static MunitResult int_TestTrackedAllocator(const MunitParameter params[], void *user_data) {
+    ms_InternStats before;
+    ms_InternGetStats(&before);
+
+    DSAllocator alloc;
+    dsallocator_init(&alloc, NULL, NULL, 0);
+    munit_assert_true(ms_InternTrack(&alloc));
+
+    /* each string is charged once, however many references are held */
+    DSBuffer *s = dsbuf_new("a string charged to whoever refers to it");
+    DSAllocator *prev = dsallocator_swap(&alloc);
+    DSBuffer *is = ms_InternStr(s);
+    munit_assert_not_null(is);
+    size_t charged = alloc.used;
+    munit_assert_size(charged, >=, dsbuf_len(s));
+    munit_assert_ptr_equal(ms_InternRetain(is), is);
+    munit_assert_size(alloc.used, ==, charged);
+
+    ms_InternRelease(is);
+    munit_assert_size(alloc.used, ==, charged);
+    ms_InternRelease(is);
+    munit_assert_size(alloc.used, ==, 0);
+
+    /* references still held when the allocator is untracked are dropped */
+    is = ms_InternStr(s);
+    munit_assert_not_null(ms_InternRetain(is));
+    dsallocator_swap(prev);
+    ms_InternUntrack(&alloc);
+
+    ms_InternStats after;
+    ms_InternGetStats(&after);
+    munit_assert_size(after.nstrs, ==, before.nstrs);
+    munit_assert_size(after.nrefs, ==, before.nrefs);
+
+    /* strings which do not fit are refused like any other request */
+    dsallocator_init(&alloc, NULL, NULL, dsbuf_len(s) / 2);
+    munit_assert_true(ms_InternTrack(&alloc));
+    prev = dsallocator_swap(&alloc);
+    munit_assert_null(ms_InternStr(s));
+    dsallocator_swap(prev);
+    munit_assert_true(alloc.exceeded);
+    munit_assert_size(alloc.used, ==, 0);
+    ms_InternUntrack(&alloc);
+
+    ms_InternGetStats(&after);
+    munit_assert_size(after.nstrs, ==, before.nstrs);
+    munit_assert_size(after.nrefs, ==, before.nrefs);
+
+    dsbuf_destroy(s);
+    return MUNIT_OK;
+}
+
+/*
+ * UTILITY FUNCTIONS
+ */
+
+static ms_VMByteCode *CompileString(ms_Parser *prs, const char *code) {
+    munit_assert_true(ms_ParserInitString(prs, code));
+
+    const ms_AST *ast;
+    ms_Error *err;
+    munit_assert_int(ms_ParserParse(prs, &ast, &err), !=, MS_RESULT_ERROR);
+    munit_assert_null(err);
+
+    ms_VMByteCode *bc;
+    munit_assert_int(ms_VMByteCodeGenerateFromAST(ast, &bc, &err), !=, MS_RESULT_ERROR);
+    munit_assert_null(err);
+    munit_assert_not_null(bc);
+    return bc;
+}
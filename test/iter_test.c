@@ -0,0 +1,264 @@
+/*------------------------------------------------------------------------------
+ *    Copyright 2016 Chris Rink
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *----------------------------------------------------------------------------*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "iter_test.h"
+#include "libds/alloc.h"
+#include "libds/array.h"
+#include "libds/dict.h"
+#include "libds/list.h"
+
+/*
+ * TEST DEFINITIONS
+ */
+
+static MunitResult iter_TestArray(const MunitParameter params[], void *user_data);
+static MunitResult iter_TestDict(const MunitParameter params[], void *user_data);
+static MunitResult iter_TestList(const MunitParameter params[], void *user_data);
+static MunitResult iter_TestHasNextAndReset(const MunitParameter params[], void *user_data);
+static MunitResult iter_TestNoAllocation(const MunitParameter params[], void *user_data);
+
+MunitTest iter_tests[] = {
+    {
+        "/Array",
+        iter_TestArray,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/Dict",
+        iter_TestDict,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/List",
+        iter_TestList,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/HasNextAndReset",
+        iter_TestHasNextAndReset,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/NoAllocation",
+        iter_TestNoAllocation,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
+
+/*
+ * FORWARD DECLARATIONS
+ */
+
+static const size_t NUM_ELEMS = 100;
+
+static DSArray *iter_NewArray(void);
+static DSDict *iter_NewDict(void);
+static DSList *iter_NewList(void);
+static uint32_t iter_HashInt(void *key);
+static int iter_CompareInt(const void *left, const void *right);
+static void *iter_CountingAlloc(void *ctx, void *ptr, size_t size);
+static void *iter_Elem(size_t i);
+
+/*
+ * UNIT TEST FUNCTIONS
+ */
+
+static MunitResult iter_TestArray(const MunitParameter params[], void *user_data) {
+    DSArray *array = iter_NewArray();
+
+    size_t seen = 0;
+    DSARRAY_FOREACH(array, iter) {
+        munit_assert_size(dsiter_index(&iter), ==, seen);
+        munit_assert_ptr_equal(dsiter_value(&iter), iter_Elem(seen));
+        munit_assert_null(dsiter_key(&iter));
+        seen++;
+    }
+    munit_assert_size(seen, ==, NUM_ELEMS);
+
+    dsarray_destroy(array);
+    return MUNIT_OK;
+}
+
+static MunitResult iter_TestDict(const MunitParameter params[], void *user_data) {
+    DSDict *dict = iter_NewDict();
+
+    /* every entry is visited exactly once, whatever the table layout */
+    bool visited[100] = { false };
+    size_t seen = 0;
+    DSDICT_FOREACH(dict, iter) {
+        size_t i = (size_t)(uintptr_t)dsiter_key(&iter) - 1;
+        munit_assert_size(i, <, NUM_ELEMS);
+        munit_assert_false(visited[i]);
+        munit_assert_ptr_equal(dsiter_value(&iter), iter_Elem(i));
+        visited[i] = true;
+        seen++;
+    }
+    munit_assert_size(seen, ==, NUM_ELEMS);
+
+    dsdict_destroy(dict);
+    return MUNIT_OK;
+}
+
+static MunitResult iter_TestList(const MunitParameter params[], void *user_data) {
+    DSList *list = iter_NewList();
+
+    size_t seen = 0;
+    DSLIST_FOREACH(list, iter) {
+        munit_assert_ptr_equal(dsiter_value(&iter), iter_Elem(seen));
+        seen++;
+    }
+    munit_assert_size(seen, ==, NUM_ELEMS);
+
+    dslist_destroy(list);
+    return MUNIT_OK;
+}
+
+static MunitResult iter_TestHasNextAndReset(const MunitParameter params[], void *user_data) {
+    DSArray *empty = dsarray_new(NULL, NULL);
+    munit_assert_not_null(empty);
+    DSIter none = DSARRAY_ITER_INIT(empty);
+    munit_assert_false(dsiter_has_next(&none));
+    munit_assert_false(dsiter_next(&none));
+    dsarray_destroy(empty);
+
+    DSDict *dict = iter_NewDict();
+    DSIter iter = DSDICT_ITER_INIT(dict);
+    munit_assert_true(dsiter_has_next(&iter));
+
+    size_t first = 0;
+    while (dsiter_next(&iter)) {
+        first++;
+    }
+    munit_assert_false(dsiter_has_next(&iter));
+
+    dsiter_reset(&iter);
+    size_t second = 0;
+    while (dsiter_next(&iter)) {
+        second++;
+    }
+    munit_assert_size(first, ==, NUM_ELEMS);
+    munit_assert_size(second, ==, NUM_ELEMS);
+
+    /* stack iterators hold no memory, so destroying one does nothing */
+    dsiter_destroy(&iter);
+    munit_assert_false(dsiter_next(&iter));
+
+    dsdict_destroy(dict);
+    return MUNIT_OK;
+}
+
+static MunitResult iter_TestNoAllocation(const MunitParameter params[], void *user_data) {
+    DSArray *array = iter_NewArray();
+    DSDict *dict = iter_NewDict();
+    DSList *list = iter_NewList();
+
+    size_t ncalls = 0;
+    DSAllocator alloc;
+    dsallocator_init(&alloc, iter_CountingAlloc, &ncalls, 0);
+    DSAllocator *prev = dsallocator_swap(&alloc);
+
+    size_t seen = 0;
+    DSARRAY_FOREACH(array, iter) {
+        seen++;
+    }
+    DSDICT_FOREACH(dict, iter) {
+        seen++;
+    }
+    DSLIST_FOREACH(list, iter) {
+        seen++;
+    }
+
+    dsallocator_swap(prev);
+    munit_assert_size(seen, ==, 3 * NUM_ELEMS);
+    munit_assert_size(ncalls, ==, 0);
+
+    dsarray_destroy(array);
+    dsdict_destroy(dict);
+    dslist_destroy(list);
+    return MUNIT_OK;
+}
+
+/*
+ * UTILITY FUNCTIONS
+ */
+
+static DSArray *iter_NewArray(void) {
+    DSArray *array = dsarray_new(NULL, NULL);
+    munit_assert_not_null(array);
+    for (size_t i = 0; i < NUM_ELEMS; i++) {
+        munit_assert_true(dsarray_append(array, iter_Elem(i)));
+    }
+    return array;
+}
+
+static DSDict *iter_NewDict(void) {
+    DSDict *dict = dsdict_new(iter_HashInt, iter_CompareInt, NULL, NULL);
+    munit_assert_not_null(dict);
+    for (size_t i = 0; i < NUM_ELEMS; i++) {
+        dsdict_put(dict, iter_Elem(i), iter_Elem(i));
+    }
+    return dict;
+}
+
+static DSList *iter_NewList(void) {
+    DSList *list = dslist_new(NULL, NULL);
+    munit_assert_not_null(list);
+    for (size_t i = 0; i < NUM_ELEMS; i++) {
+        munit_assert_true(dslist_append(list, iter_Elem(i)));
+    }
+    return list;
+}
+
+static uint32_t iter_HashInt(void *key) {
+    return (uint32_t)(uintptr_t)key * 2654435761u;
+}
+
+static int iter_CompareInt(const void *left, const void *right) {
+    return (left == right) ? 0 : 1;
+}
+
+static void *iter_CountingAlloc(void *ctx, void *ptr, size_t size) {
+    size_t *ncalls = ctx;
+    (*ncalls)++;
+    if (size == 0) {
+        free(ptr);
+        return NULL;
+    }
+    return realloc(ptr, size);
+}
+
+/* Elements must be non-NULL, so offset every integer by one. */
+static void *iter_Elem(size_t i) {
+    return (void *)(uintptr_t)(i + 1);
+}
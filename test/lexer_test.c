@@ -71,7 +71,8 @@ static MunitParameterEnum bad_num_params[] = {
 
 static char *non_keyword_vals[] = {
     "IF", "ret", "True", "False", "nil", "function", "delete",
-    "i", "k", "next", "CONSTANT",
+    "i", "k", "next", "CONSTANT", "iff", "fo", "forr", "els", "nul", "ia",
+    "continues", "ifelse", "obj2", "switch_", "Do", "d",
     NULL
 };
 
@@ -131,6 +132,8 @@ static char* string_vals[] = {
     "\"string containing keywords: if, else, func\"",
     "\"string containing builtin: $begin, $commit\"",
     "\"string containing global: @glo, @people\"",
+    "'a string long enough to be searched in pieces, with \\'escapes\\' too'",
+    "\"0123456789abcde\\\"0123456789abcdef\\\"\"",
     NULL
 };
 
@@ -141,6 +144,8 @@ static MunitParameterEnum string_params[] = {
 
 static char* invalid_string_vals[] = {
     "\"'", "'\"", "\"\n\"", "\"\r\n\"", "'\n'", "'\r\n'",
+    "\"a string which spans more than\none line\"",
+    "'a string which is never closed at all",
     NULL
 };
 
@@ -167,6 +172,9 @@ static MunitResult lex_TestLexOperators(const MunitParameter *params, void *user
 static MunitResult lex_TestLexPunctuation(const MunitParameter *params, void *user_data);
 static MunitResult lex_TestLexStrings(const MunitParameter params[], void *user_data);
 static MunitResult lex_TestLexInvalidStrings(const MunitParameter params[], void *user_data);
+static MunitResult lex_TestLexComments(const MunitParameter params[], void *user_data);
+static MunitResult lex_TestLexLongTokens(const MunitParameter params[], void *user_data);
+static MunitResult lex_TestLexTokenViews(const MunitParameter params[], void *user_data);
 
 MunitTest lexer_tests[] = {
     {
@@ -281,6 +289,30 @@ MunitTest lexer_tests[] = {
         MUNIT_TEST_OPTION_NONE,
         invalid_string_params
     },
+    {
+        "/Comments",
+        lex_TestLexComments,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/LongTokens",
+        lex_TestLexLongTokens,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/TokenViews",
+        lex_TestLexTokenViews,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
     { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
 };
 
@@ -438,6 +470,84 @@ static MunitResult lex_TestLexInvalidStrings(const MunitParameter params[], void
     return LexExpect(str, ERROR);
 }
 
+static MunitResult lex_TestLexComments(const MunitParameter params[], void *user_data) {
+    ms_Lexer *lex = ms_LexerNew();
+    munit_assert_not_null(lex);
+    munit_assert(ms_LexerInitString(lex, "first // a comment\r\n"
+                                         "// a whole line of comment\n"
+                                         "second / third // no newline"));
+
+    const char *expected[] = { "first", "second", "/", "third" };
+    for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); i++) {
+        ms_Token *tok = ms_LexerNextToken(lex);
+        munit_assert_not_null(tok);
+        munit_assert_string_equal(dsbuf_char_ptr(tok->value), expected[i]);
+        ms_TokenDestroy(tok);
+    }
+
+    /* a comment may end the input without a newline */
+    munit_assert_null(ms_LexerNextToken(lex));
+    ms_LexerDestroy(lex);
+    return MUNIT_OK;
+}
+
+static MunitResult lex_TestLexLongTokens(const MunitParameter params[], void *user_data) {
+    char src[1024];
+    char ident[400];
+    memset(ident, 'k', sizeof(ident) - 1);
+    ident[sizeof(ident) - 1] = '\0';
+    snprintf(src, sizeof(src), "%s%*s0x%s", ident, 300, "", "1234567890abcdefABCDEF");
+
+    ms_Lexer *lex = ms_LexerNew();
+    munit_assert_not_null(lex);
+    munit_assert(ms_LexerInitString(lex, src));
+
+    ms_Token *tok = ms_LexerNextToken(lex);
+    munit_assert_not_null(tok);
+    munit_assert_int(tok->type, ==, IDENTIFIER);
+    munit_assert_string_equal(dsbuf_char_ptr(tok->value), ident);
+    ms_TokenDestroy(tok);
+
+    tok = ms_LexerNextToken(lex);
+    munit_assert_not_null(tok);
+    munit_assert_int(tok->type, ==, HEX_NUMBER);
+    munit_assert_string_equal(dsbuf_char_ptr(tok->value), "0x1234567890abcdefABCDEF");
+    ms_TokenDestroy(tok);
+
+    munit_assert_null(ms_LexerNextToken(lex));
+    ms_LexerDestroy(lex);
+    return MUNIT_OK;
+}
+
+static MunitResult lex_TestLexTokenViews(const MunitParameter params[], void *user_data) {
+    static LexResultTuple tokens[] = {
+        { "var", KW_VAR },
+        { "total", IDENTIFIER },
+        { ":=", OP_EQ },
+        { "0x1f", HEX_NUMBER },
+        { "+", OP_PLUS },
+        { "", STRING },
+        { "$len", BUILTIN_FUNC },
+        { ";", SEMICOLON },
+    };
+
+    ms_Lexer *lex = ms_LexerNew();
+    munit_assert_not_null(lex);
+    munit_assert(ms_LexerInitString(lex, "var total := 0x1f + '' $len;"));
+
+    for (size_t i = 0; i < sizeof(tokens) / sizeof(tokens[0]); i++) {
+        const ms_TokenView *tok = ms_LexerNextTokenView(lex);
+        munit_assert_not_null(tok);
+        munit_assert_int(tok->type, ==, tokens[i].type);
+        munit_assert_size(tok->len, ==, strlen(tokens[i].val));
+        munit_assert_string_equal(tok->text, tokens[i].val);
+    }
+
+    munit_assert_null(ms_LexerNextTokenView(lex));
+    ms_LexerDestroy(lex);
+    return MUNIT_OK;
+}
+
 /*
  * PRIVATE FUNCTIONS
  */
@@ -478,7 +588,7 @@ static MunitResult TestLexResultTuple(LexResultTuple *tokens, size_t len) {
     munit_assert_not_null(lex);
 
     for (size_t i = 0; i < len; i++) {
-        LexResultTuple *tuple = &tokens[0];
+        LexResultTuple *tuple = &tokens[i];
         munit_logf(MUNIT_LOG_INFO, "  val='%s'", tuple->val);
         (void)LexExpect(tuple->val, tuple->type);
     }
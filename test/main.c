@@ -15,11 +15,21 @@
  *----------------------------------------------------------------------------*/
 
 #include "munit/munit.h"
+#include "alloc_test.h"
+#include "array_test.h"
 #include "codegen_test.h"
+#include "dict_test.h"
+#include "hash_test.h"
+#include "image_test.h"
+#include "intern_test.h"
+#include "iter_test.h"
 #include "lexer_test.h"
 #include "parser_test.h"
+#include "pool_test.h"
+#include "state_test.h"
 #include "streamreader_test.h"
 #include "verifier_test.h"
+#include "vm_test.h"
 
 static MunitSuite suites[] = {
     {
@@ -29,6 +39,48 @@ static MunitSuite suites[] = {
         1,
         MUNIT_SUITE_OPTION_NONE
     },
+    {
+        "/lib/alloc",
+        alloc_tests,
+        NULL,
+        1,
+        MUNIT_SUITE_OPTION_NONE
+    },
+    {
+        "/lib/array",
+        array_tests,
+        NULL,
+        1,
+        MUNIT_SUITE_OPTION_NONE
+    },
+    {
+        "/lib/dict",
+        dict_tests,
+        NULL,
+        1,
+        MUNIT_SUITE_OPTION_NONE
+    },
+    {
+        "/lib/hash",
+        hash_tests,
+        NULL,
+        1,
+        MUNIT_SUITE_OPTION_NONE
+    },
+    {
+        "/lib/iter",
+        iter_tests,
+        NULL,
+        1,
+        MUNIT_SUITE_OPTION_NONE
+    },
+    {
+        "/lib/pool",
+        pool_tests,
+        NULL,
+        1,
+        MUNIT_SUITE_OPTION_NONE
+    },
     {
         "/lexer",
         lexer_tests,
@@ -57,6 +109,34 @@ static MunitSuite suites[] = {
         1,
         MUNIT_SUITE_OPTION_NONE
     },
+    {
+        "/image",
+        image_tests,
+        NULL,
+        1,
+        MUNIT_SUITE_OPTION_NONE
+    },
+    {
+        "/intern",
+        intern_tests,
+        NULL,
+        1,
+        MUNIT_SUITE_OPTION_NONE
+    },
+    {
+        "/vm",
+        vm_tests,
+        NULL,
+        1,
+        MUNIT_SUITE_OPTION_NONE
+    },
+    {
+        "/state",
+        state_tests,
+        NULL,
+        1,
+        MUNIT_SUITE_OPTION_NONE
+    },
     { NULL, NULL, NULL, 0, MUNIT_SUITE_OPTION_NONE },
 };
 
@@ -19,6 +19,7 @@
 #include "../src/parser.h"
 #include "../src/vm.h"
 #include "../src/bytecode.h"
+#include "libds/pool.h"
 
 typedef union {
     ms_AST *module;
@@ -64,6 +65,7 @@ static MunitResult prs_TestParseDeclaration(const MunitParameter params[], void
 static MunitResult prs_TestParseAssignment(const MunitParameter params[], void *user_data);
 static MunitResult prs_TestParseMultipleAssignment(const MunitParameter params[], void *user_data);
 static MunitResult prs_TestParseCompoundAssignment(const MunitParameter params[], void *user_data);
+static MunitResult prs_TestASTPool(const MunitParameter params[], void *user_data);
 
 static char* bad_code[] = {
     "(;",
@@ -345,6 +347,14 @@ MunitTest parser_tests[] = {
         MUNIT_TEST_OPTION_NONE,
         NULL
     },
+    {
+        "/ASTPool",
+        prs_TestASTPool,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
     { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
 };
 
@@ -564,6 +574,16 @@ static MunitResult prs_TestParseLiterals(const MunitParameter params[], void *us
             .type = ASTCMPNT_EXPR,
             .cmpnt.expr = AST_UEXPR_V(UNARY_NONE, VM_NULL()),
         },
+        {
+            .val = "\"\";",
+            .type = ASTCMPNT_EXPR,
+            .cmpnt.expr = AST_UEXPR_V(UNARY_NONE, VM_STR("\0")),
+        },
+        {
+            .val = "'a string longer than the parser keeps for most tokens';",
+            .type = ASTCMPNT_EXPR,
+            .cmpnt.expr = AST_UEXPR_V(UNARY_NONE, VM_STR("a string longer than the parser keeps for most tokens")),
+        },
     };
 
     size_t len = sizeof(exprs) / sizeof(exprs[0]);
@@ -1006,6 +1026,26 @@ static MunitResult prs_TestParseExprPrecedence(const MunitParameter params[], vo
             .type = ASTCMPNT_EXPR,
             .cmpnt.expr = AST_BEXPR_VE(VM_INT(7), BINARY_EXPONENTIATE, AST_BEXPR_VV(VM_INT(4), BINARY_PLUS, VM_INT(2))),
         },
+        {
+            .val = "2 * 7 ** 4 * 2;",
+            .type = ASTCMPNT_EXPR,
+            .cmpnt.expr = AST_BEXPR_VE(VM_INT(2), BINARY_TIMES, AST_BEXPR_VE(VM_INT(7), BINARY_EXPONENTIATE, AST_BEXPR_VV(VM_INT(4), BINARY_TIMES, VM_INT(2)))),
+        },
+        {
+            .val = "true && 1 == 2;",
+            .type = ASTCMPNT_EXPR,
+            .cmpnt.expr = AST_BEXPR_VE(VM_BOOL(true), BINARY_AND, AST_BEXPR_VV(VM_INT(1), BINARY_EQ, VM_INT(2))),
+        },
+        {
+            .val = "1 < 2 == 3 >= 4;",
+            .type = ASTCMPNT_EXPR,
+            .cmpnt.expr = AST_BEXPR_EE(AST_BEXPR_VV(VM_INT(1), BINARY_LT, VM_INT(2)), BINARY_EQ, AST_BEXPR_VV(VM_INT(3), BINARY_GE, VM_INT(4))),
+        },
+        {
+            .val = "1 | 2 <= 3 & 4 >> 5;",
+            .type = ASTCMPNT_EXPR,
+            .cmpnt.expr = AST_BEXPR_EE(AST_BEXPR_VV(VM_INT(1), BINARY_BITWISE_OR, VM_INT(2)), BINARY_LE, AST_BEXPR_VE(VM_INT(3), BINARY_BITWISE_AND, AST_BEXPR_VV(VM_INT(4), BINARY_SHIFT_RIGHT, VM_INT(5)))),
+        },
     };
     size_t len = sizeof(exprs) / sizeof(exprs[0]);
     TestParseResultTuple(exprs, len);
@@ -1530,7 +1570,7 @@ static MunitResult prs_TestParseMultipleAssignment(const MunitParameter params[]
             .type = ASTCMPNT_STMT,
             .cmpnt.stmt = AST_ASSIGN(
                 AST_ASSIGN_T(AST_BEXPR_IV(AST_IDENT(IDENT_NAME, "x"), BINARY_GETATTR, VM_STR("attr")), AST_ASSIGN_T_SNG(AST_BEXPR_IV(AST_IDENT(IDENT_NAME, "y"), BINARY_GETATTR, VM_STR("attr")))),
-                AST_ASSIGN_E(AST_BEXPR_IV(AST_IDENT(IDENT_NAME, "x"), BINARY_GETATTR, VM_STR("attr")), AST_ASSIGN_E_SNG(AST_UEXPR_V(UNARY_NONE, VM_INT(1))))
+                AST_ASSIGN_E(AST_BEXPR_IV(AST_IDENT(IDENT_NAME, "y"), BINARY_GETATTR, VM_STR("attr")), AST_ASSIGN_E_SNG(AST_UEXPR_V(UNARY_NONE, VM_INT(1))))
             ),
         },
     };
@@ -1550,57 +1590,57 @@ static MunitResult prs_TestParseCompoundAssignment(const MunitParameter params[]
         {
             .val = "name += 10;",
             .type = ASTCMPNT_STMT,
-            .cmpnt.stmt = AST_ASSIGN_SNG(AST_UEXPR_I(UNARY_NONE, AST_IDENT(IDENT_NAME, "name")), AST_BEXPR_IV(AST_IDENT(IDENT_NAME, "name"), BINARY_PLUS, VM_INT(10))),
+            .cmpnt.stmt = AST_ASSIGN_SNG(AST_UEXPR_I(UNARY_NONE, AST_IDENT(IDENT_NAME, "name")), AST_BEXPR_EV(AST_UEXPR_I(UNARY_NONE, AST_IDENT(IDENT_NAME, "name")), BINARY_PLUS, VM_INT(10))),
         },
         {
             .val = "name -= 10;",
             .type = ASTCMPNT_STMT,
-            .cmpnt.stmt = AST_ASSIGN_SNG(AST_UEXPR_I(UNARY_NONE, AST_IDENT(IDENT_NAME, "name")), AST_BEXPR_IV(AST_IDENT(IDENT_NAME, "name"), BINARY_MINUS, VM_INT(10))),
+            .cmpnt.stmt = AST_ASSIGN_SNG(AST_UEXPR_I(UNARY_NONE, AST_IDENT(IDENT_NAME, "name")), AST_BEXPR_EV(AST_UEXPR_I(UNARY_NONE, AST_IDENT(IDENT_NAME, "name")), BINARY_MINUS, VM_INT(10))),
         },
         {
             .val = "name *= 10;",
             .type = ASTCMPNT_STMT,
-            .cmpnt.stmt = AST_ASSIGN_SNG(AST_UEXPR_I(UNARY_NONE, AST_IDENT(IDENT_NAME, "name")), AST_BEXPR_IV(AST_IDENT(IDENT_NAME, "name"), BINARY_TIMES, VM_INT(10))),
+            .cmpnt.stmt = AST_ASSIGN_SNG(AST_UEXPR_I(UNARY_NONE, AST_IDENT(IDENT_NAME, "name")), AST_BEXPR_EV(AST_UEXPR_I(UNARY_NONE, AST_IDENT(IDENT_NAME, "name")), BINARY_TIMES, VM_INT(10))),
         },
         {
             .val = "name /= 10;",
             .type = ASTCMPNT_STMT,
-            .cmpnt.stmt = AST_ASSIGN_SNG(AST_UEXPR_I(UNARY_NONE, AST_IDENT(IDENT_NAME, "name")), AST_BEXPR_IV(AST_IDENT(IDENT_NAME, "name"), BINARY_DIVIDE, VM_INT(10))),
+            .cmpnt.stmt = AST_ASSIGN_SNG(AST_UEXPR_I(UNARY_NONE, AST_IDENT(IDENT_NAME, "name")), AST_BEXPR_EV(AST_UEXPR_I(UNARY_NONE, AST_IDENT(IDENT_NAME, "name")), BINARY_DIVIDE, VM_INT(10))),
         },
         {
             .val = "name \\= 10;",
             .type = ASTCMPNT_STMT,
-            .cmpnt.stmt = AST_ASSIGN_SNG(AST_UEXPR_I(UNARY_NONE, AST_IDENT(IDENT_NAME, "name")), AST_BEXPR_IV(AST_IDENT(IDENT_NAME, "name"), BINARY_IDIVIDE, VM_INT(10))),
+            .cmpnt.stmt = AST_ASSIGN_SNG(AST_UEXPR_I(UNARY_NONE, AST_IDENT(IDENT_NAME, "name")), AST_BEXPR_EV(AST_UEXPR_I(UNARY_NONE, AST_IDENT(IDENT_NAME, "name")), BINARY_IDIVIDE, VM_INT(10))),
         },
         {
             .val = "name %= 10;",
             .type = ASTCMPNT_STMT,
-            .cmpnt.stmt = AST_ASSIGN_SNG(AST_UEXPR_I(UNARY_NONE, AST_IDENT(IDENT_NAME, "name")), AST_BEXPR_IV(AST_IDENT(IDENT_NAME, "name"), BINARY_MODULO, VM_INT(10))),
+            .cmpnt.stmt = AST_ASSIGN_SNG(AST_UEXPR_I(UNARY_NONE, AST_IDENT(IDENT_NAME, "name")), AST_BEXPR_EV(AST_UEXPR_I(UNARY_NONE, AST_IDENT(IDENT_NAME, "name")), BINARY_MODULO, VM_INT(10))),
         },
         {
             .val = "name &= 10;",
             .type = ASTCMPNT_STMT,
-            .cmpnt.stmt = AST_ASSIGN_SNG(AST_UEXPR_I(UNARY_NONE, AST_IDENT(IDENT_NAME, "name")), AST_BEXPR_IV(AST_IDENT(IDENT_NAME, "name"), BINARY_BITWISE_AND, VM_INT(10))),
+            .cmpnt.stmt = AST_ASSIGN_SNG(AST_UEXPR_I(UNARY_NONE, AST_IDENT(IDENT_NAME, "name")), AST_BEXPR_EV(AST_UEXPR_I(UNARY_NONE, AST_IDENT(IDENT_NAME, "name")), BINARY_BITWISE_AND, VM_INT(10))),
         },
         {
             .val = "name |= 10;",
             .type = ASTCMPNT_STMT,
-            .cmpnt.stmt = AST_ASSIGN_SNG(AST_UEXPR_I(UNARY_NONE, AST_IDENT(IDENT_NAME, "name")), AST_BEXPR_IV(AST_IDENT(IDENT_NAME, "name"), BINARY_BITWISE_OR, VM_INT(10))),
+            .cmpnt.stmt = AST_ASSIGN_SNG(AST_UEXPR_I(UNARY_NONE, AST_IDENT(IDENT_NAME, "name")), AST_BEXPR_EV(AST_UEXPR_I(UNARY_NONE, AST_IDENT(IDENT_NAME, "name")), BINARY_BITWISE_OR, VM_INT(10))),
         },
         {
             .val = "name ^= 10;",
             .type = ASTCMPNT_STMT,
-            .cmpnt.stmt = AST_ASSIGN_SNG(AST_UEXPR_I(UNARY_NONE, AST_IDENT(IDENT_NAME, "name")), AST_BEXPR_IV(AST_IDENT(IDENT_NAME, "name"), BINARY_BITWISE_XOR, VM_INT(10))),
+            .cmpnt.stmt = AST_ASSIGN_SNG(AST_UEXPR_I(UNARY_NONE, AST_IDENT(IDENT_NAME, "name")), AST_BEXPR_EV(AST_UEXPR_I(UNARY_NONE, AST_IDENT(IDENT_NAME, "name")), BINARY_BITWISE_XOR, VM_INT(10))),
         },
         {
             .val = "name <<= 10;",
             .type = ASTCMPNT_STMT,
-            .cmpnt.stmt = AST_ASSIGN_SNG(AST_UEXPR_I(UNARY_NONE, AST_IDENT(IDENT_NAME, "name")), AST_BEXPR_IV(AST_IDENT(IDENT_NAME, "name"), BINARY_SHIFT_LEFT, VM_INT(10))),
+            .cmpnt.stmt = AST_ASSIGN_SNG(AST_UEXPR_I(UNARY_NONE, AST_IDENT(IDENT_NAME, "name")), AST_BEXPR_EV(AST_UEXPR_I(UNARY_NONE, AST_IDENT(IDENT_NAME, "name")), BINARY_SHIFT_LEFT, VM_INT(10))),
         },
         {
             .val = "name >>= 10;",
             .type = ASTCMPNT_STMT,
-            .cmpnt.stmt = AST_ASSIGN_SNG(AST_UEXPR_I(UNARY_NONE, AST_IDENT(IDENT_NAME, "name")), AST_BEXPR_IV(AST_IDENT(IDENT_NAME, "name"), BINARY_SHIFT_RIGHT, VM_INT(10))),
+            .cmpnt.stmt = AST_ASSIGN_SNG(AST_UEXPR_I(UNARY_NONE, AST_IDENT(IDENT_NAME, "name")), AST_BEXPR_EV(AST_UEXPR_I(UNARY_NONE, AST_IDENT(IDENT_NAME, "name")), BINARY_SHIFT_RIGHT, VM_INT(10))),
         },
     };
 
@@ -1609,6 +1649,57 @@ static MunitResult prs_TestParseCompoundAssignment(const MunitParameter params[]
     return MUNIT_OK;
 }
 
+static MunitResult prs_TestASTPool(const MunitParameter params[], void *user_data) {
+    DSPool *pool = dspool_new();
+    munit_assert_not_null(pool);
+    DSPool *prev = ms_ASTPoolSwap(pool);
+
+    /* the expression, the expression wrapping its operand and the
+     * operand's identifier are all drawn from the installed pool */
+    ms_Expr *expr = ms_ExprNew(EXPRTYPE_BINARY);
+    munit_assert_not_null(expr);
+    ms_Expr *name = ms_ExprNewWithIdent("name", 4);
+    munit_assert_not_null(name);
+    expr->cmpnt.b->latom.expr = name;
+    expr->cmpnt.b->ltype = EXPRATOM_EXPRESSION;
+    expr->cmpnt.b->op = BINARY_PLUS;
+    expr->cmpnt.b->ratom.val.type = MSVAL_INT;
+    expr->cmpnt.b->ratom.val.val.i = 1;
+    expr->cmpnt.b->rtype = EXPRATOM_VALUE;
+
+    DSPoolStats stats;
+    dspool_stats(pool, &stats);
+    munit_assert_size(stats.nallocs, ==, 3);
+    munit_assert_size(stats.nfrees, ==, 0);
+    size_t reserved = stats.reserved;
+
+    /* destroying the tree recycles every node into the pool, so building
+     * the same tree again needs no more memory */
+    ms_ExprDestroy(expr);
+    dspool_stats(pool, &stats);
+    munit_assert_size(stats.nfrees, ==, 3);
+    munit_assert_size(stats.requested, ==, 0);
+
+    expr = ms_ExprNewWithIdent("name", 4);
+    munit_assert_not_null(expr);
+    dspool_stats(pool, &stats);
+    munit_assert_size(stats.nallocs - stats.nfrees, ==, 2);
+    munit_assert_size(stats.reserved, <=, reserved);
+    ms_ExprDestroy(expr);
+
+    /* nothing is drawn from the pool once it is swapped out again */
+    munit_assert_ptr_equal(ms_ASTPoolSwap(prev), pool);
+    expr = ms_ExprNewWithIdent("name", 4);
+    munit_assert_not_null(expr);
+    ms_ExprDestroy(expr);
+    dspool_stats(pool, &stats);
+    munit_assert_size(stats.nallocs, ==, 5);
+    munit_assert_size(stats.nfrees, ==, 5);
+
+    dspool_destroy(pool);
+    return MUNIT_OK;
+}
+
 /*
  * COMPARISON FUNCTIONS
  *
@@ -1819,7 +1910,7 @@ static MunitResult CompareAssignment(const ms_StmtAssignment *assign1, const ms_
     munit_assert_null(ident2);
 
     ms_StmtAssignExpr *expr1 = assign1->expr;
-    ms_StmtAssignExpr *expr2 = assign1->expr;
+    ms_StmtAssignExpr *expr2 = assign2->expr;
     while ((expr1) && (expr2)) {
         CompareExpressions(expr1->expr, expr2->expr);
         expr1 = expr1->next;
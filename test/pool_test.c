@@ -0,0 +1,234 @@
+/*------------------------------------------------------------------------------
+ *    Copyright 2016 Chris Rink
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *----------------------------------------------------------------------------*/
+
+#include <string.h>
+#include "pool_test.h"
+#include "libds/dict.h"
+#include "libds/hash.h"
+#include "libds/pool.h"
+
+/*
+ * TEST DEFINITIONS
+ */
+
+static MunitResult pool_TestAllocFree(const MunitParameter params[], void *pool);
+static MunitResult pool_TestSizeClasses(const MunitParameter params[], void *pool);
+static MunitResult pool_TestLargeObjects(const MunitParameter params[], void *pool);
+static MunitResult pool_TestDict(const MunitParameter params[], void *pool);
+static void *pool_CreatePool(const MunitParameter params[], void *user_data);
+static void pool_DestroyPool(void *pool);
+
+MunitTest pool_tests[] = {
+    {
+        "/AllocFree",
+        pool_TestAllocFree,
+        pool_CreatePool,
+        pool_DestroyPool,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/SizeClasses",
+        pool_TestSizeClasses,
+        pool_CreatePool,
+        pool_DestroyPool,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/LargeObjects",
+        pool_TestLargeObjects,
+        pool_CreatePool,
+        pool_DestroyPool,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/Dict",
+        pool_TestDict,
+        pool_CreatePool,
+        pool_DestroyPool,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
+
+/*
+ * SETUP AND TEARDOWN FUNCTIONS
+ */
+
+static void *pool_CreatePool(const MunitParameter params[], void *user_data) {
+    DSPool *pool = dspool_new();
+    munit_assert_not_null(pool);
+    return pool;
+}
+
+static void pool_DestroyPool(void *pool) {
+    DSPoolStats stats;
+    dspool_stats(pool, &stats);
+    munit_assert_size(stats.nallocs, ==, stats.nfrees);
+    munit_assert_size(stats.requested, ==, 0);
+    dspool_destroy(pool);
+}
+
+/*
+ * UNIT TEST FUNCTIONS
+ */
+
+static MunitResult pool_TestAllocFree(const MunitParameter params[], void *pool) {
+    static const size_t count = 5000;
+    unsigned char **objs = munit_newa(unsigned char *, count);
+
+    for (size_t i = 0; i < count; i++) {
+        objs[i] = dspool_alloc(pool, 24);
+        munit_assert_not_null(objs[i]);
+        memset(objs[i], (int)(i & 0xFF), 24);
+    }
+
+    /* no two live objects may overlap */
+    for (size_t i = 0; i < count; i++) {
+        for (size_t j = 0; j < 24; j++) {
+            munit_assert_uint8(objs[i][j], ==, (uint8_t)(i & 0xFF));
+        }
+    }
+
+    DSPoolStats stats;
+    dspool_stats(pool, &stats);
+    munit_assert_size(stats.nallocs, ==, count);
+    munit_assert_size(stats.requested, ==, count * 24);
+
+    for (size_t i = 0; i < count; i += 2) {
+        dspool_free(pool, objs[i], 24);
+        objs[i] = NULL;
+    }
+
+#ifndef DSPOOL_USE_MALLOC
+    /* freed slots are reused before any new slab is carved */
+    DSPoolStats before;
+    dspool_stats(pool, &before);
+    for (size_t i = 0; i < count; i += 2) {
+        objs[i] = dspool_alloc(pool, 32);
+        munit_assert_not_null(objs[i]);
+    }
+    dspool_stats(pool, &stats);
+    munit_assert_size(stats.reserved, ==, before.reserved);
+    munit_assert_size(stats.classes[1].nlive, ==, count);
+    munit_assert_size(stats.classes[1].nslabs, ==, before.classes[1].nslabs);
+
+    for (size_t i = 0; i < count; i += 2) {
+        dspool_free(pool, objs[i], 32);
+    }
+#endif
+
+    for (size_t i = 1; i < count; i += 2) {
+        dspool_free(pool, objs[i], 24);
+    }
+
+    free(objs);
+    return MUNIT_OK;
+}
+
+static MunitResult pool_TestSizeClasses(const MunitParameter params[], void *pool) {
+    void *objs[DSPOOL_MAX_OBJECT_SIZE];
+
+    for (size_t size = 1; size <= DSPOOL_MAX_OBJECT_SIZE; size++) {
+        objs[size - 1] = dspool_alloc(pool, size);
+        munit_assert_not_null(objs[size - 1]);
+        uintptr_t misalign = (uintptr_t)objs[size - 1] % sizeof(void *);
+        munit_assert_size(misalign, ==, 0);
+        memset(objs[size - 1], 0xAB, size);
+    }
+
+    DSPoolStats stats;
+    dspool_stats(pool, &stats);
+    munit_assert_size(stats.nlarge, ==, 0);
+    munit_assert_size(stats.requested, ==, DSPOOL_MAX_OBJECT_SIZE * (DSPOOL_MAX_OBJECT_SIZE + 1) / 2);
+
+    size_t live = 0;
+    size_t prev = 0;
+    for (int i = 0; i < DSPOOL_NUM_CLASSES; i++) {
+        DSPoolClassStats *cls = &stats.classes[i];
+        munit_assert_size(cls->size, >, prev);
+        munit_assert_size(cls->nlive, ==, cls->size - prev);
+        munit_assert_size(cls->requested, <=, cls->nlive * cls->size);
+        live += cls->nlive;
+        prev = cls->size;
+    }
+    munit_assert_size(prev, ==, DSPOOL_MAX_OBJECT_SIZE);
+    munit_assert_size(live, ==, DSPOOL_MAX_OBJECT_SIZE);
+
+    for (size_t size = 1; size <= DSPOOL_MAX_OBJECT_SIZE; size++) {
+        dspool_free(pool, objs[size - 1], size);
+    }
+
+    return MUNIT_OK;
+}
+
+static MunitResult pool_TestLargeObjects(const MunitParameter params[], void *pool) {
+    void *big = dspool_alloc(pool, DSPOOL_MAX_OBJECT_SIZE + 1);
+    munit_assert_not_null(big);
+    memset(big, 0, DSPOOL_MAX_OBJECT_SIZE + 1);
+
+    DSPoolStats stats;
+    dspool_stats(pool, &stats);
+    munit_assert_size(stats.nlarge, ==, 1);
+    munit_assert_size(stats.requested, ==, DSPOOL_MAX_OBJECT_SIZE + 1);
+    for (int i = 0; i < DSPOOL_NUM_CLASSES; i++) {
+        munit_assert_size(stats.classes[i].nlive, ==, 0);
+    }
+
+    dspool_free(pool, big, DSPOOL_MAX_OBJECT_SIZE + 1);
+    dspool_stats(pool, &stats);
+    munit_assert_size(stats.nlarge, ==, 0);
+    return MUNIT_OK;
+}
+
+static MunitResult pool_TestDict(const MunitParameter params[], void *pool) {
+    static const char *keys[] = { "alpha", "beta", "gamma", "delta", "epsilon" };
+    static const size_t nkeys = sizeof(keys) / sizeof(keys[0]);
+
+    DSDict *dict = dsdict_new_pool((dsdict_hash_fn)hash_fnv1,
+                                   (dsdict_compare_fn)strcmp,
+                                   NULL, NULL, pool);
+    munit_assert_not_null(dict);
+
+    for (size_t i = 0; i < nkeys; i++) {
+        dsdict_put(dict, (void *)keys[i], (void *)keys[i]);
+    }
+    munit_assert_size(dsdict_count(dict), ==, nkeys);
+
+    DSPoolStats stats;
+    dspool_stats(pool, &stats);
+    /* entries are stored inline, so only the dict and its table are live */
+    munit_assert_size(stats.nallocs - stats.nfrees, ==, 2);
+
+    DSIter *iter = dsdict_iter(dict);
+    munit_assert_not_null(iter);
+    size_t seen = 0;
+    while (dsiter_next(iter)) {
+        seen++;
+    }
+    dsiter_destroy(iter);
+    munit_assert_size(seen, ==, nkeys);
+
+    munit_assert_ptr_equal(dsdict_del(dict, (void *)keys[2]), keys[2]);
+    munit_assert_null(dsdict_get(dict, (void *)keys[2]));
+    munit_assert_size(dsdict_count(dict), ==, nkeys - 1);
+
+    dsdict_destroy(dict);
+    return MUNIT_OK;
+}
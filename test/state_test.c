@@ -0,0 +1,440 @@
+/*------------------------------------------------------------------------------
+ *    Copyright 2016 Chris Rink
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *----------------------------------------------------------------------------*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "state_test.h"
+#include "libds/buffer.h"
+#include "../src/intern.h"
+#include "../src/mscript.h"
+
+/*
+ * TEST DEFINITIONS
+ */
+
+static MunitResult state_TestCustomAllocator(const MunitParameter params[], void *user_data);
+static MunitResult state_TestMemoryLimit(const MunitParameter params[], void *user_data);
+static MunitResult state_TestMemoryLimitAtCreation(const MunitParameter params[], void *user_data);
+static MunitResult state_TestMemoryLimitInterns(const MunitParameter params[], void *user_data);
+static MunitResult state_TestFileStream(const MunitParameter params[], void *user_data);
+static void *state_CreateTempName(const MunitParameter params[], void *user_data);
+static void state_CleanUpTempName(void *file);
+static MunitResult state_TestScript(const MunitParameter params[], void *user_data);
+static MunitResult state_TestScriptErrors(const MunitParameter params[], void *user_data);
+
+MunitTest state_tests[] = {
+    {
+        "/CustomAllocator",
+        state_TestCustomAllocator,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/MemoryLimit",
+        state_TestMemoryLimit,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/MemoryLimitAtCreation",
+        state_TestMemoryLimitAtCreation,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/MemoryLimitInterns",
+        state_TestMemoryLimitInterns,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/FileStream",
+        state_TestFileStream,
+        state_CreateTempName,
+        state_CleanUpTempName,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/Script",
+        state_TestScript,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/ScriptErrors",
+        state_TestScriptErrors,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
+
+/*
+ * FORWARD DECLARATIONS
+ */
+
+static const size_t MEMORY_LIMIT = 256 * 1024;
+static const size_t LARGE_SCRIPT_NAMES = 5000;
+static const size_t SCRIPT_RUNS = 100;
+
+typedef struct {
+    size_t nlive;                   /** blocks currently allocated */
+} TenantContext;
+
+static void *TenantAlloc(void *ctx, void *ptr, size_t size);
+static DSBuffer *LargeScript(void);
+
+/*
+ * UNIT TEST FUNCTIONS
+ */
+
+static MunitResult state_TestCustomAllocator(const MunitParameter params[], void *user_data) {
+    TenantContext ctx = { 0 };
+    ms_StateOptions opts = {
+        .alloc = TenantAlloc,
+        .alloc_ctx = &ctx,
+    };
+
+    ms_State *state = ms_StateNewOptions(&opts);
+    munit_assert_not_null(state);
+    munit_assert_size(ctx.nlive, >, 0);
+    size_t created = ms_StateMemoryUsed(state);
+    munit_assert_size(created, >, 0);
+
+    const ms_Error *err;
+    munit_assert_int(ms_StateExecuteString(state, "var s := \"a\" + \"b\"; var n := 3;", &err), !=, MS_RESULT_ERROR);
+    munit_assert_null(err);
+    munit_assert_size(ms_StateMemoryUsed(state), >, created);
+    munit_assert_size(ms_StateMemoryPeak(state), >=, ms_StateMemoryUsed(state));
+
+    ms_StateDestroy(state);
+    munit_assert_size(ctx.nlive, ==, 0);
+    return MUNIT_OK;
+}
+
+static MunitResult state_TestMemoryLimit(const MunitParameter params[], void *user_data) {
+    TenantContext ctx = { 0 };
+    ms_StateOptions opts = {
+        .alloc = TenantAlloc,
+        .alloc_ctx = &ctx,
+        .mem_limit = MEMORY_LIMIT,
+    };
+
+    ms_State *state = ms_StateNewOptions(&opts);
+    munit_assert_not_null(state);
+
+    /* small scripts run as usual */
+    const ms_Error *err;
+    munit_assert_int(ms_StateExecuteString(state, "var n := 1;", &err), !=, MS_RESULT_ERROR);
+    munit_assert_null(err);
+
+    DSBuffer *script = LargeScript();
+    munit_assert_int(ms_StateExecuteString(state, dsbuf_char_ptr(script), &err), ==, MS_RESULT_ERROR);
+    munit_assert_not_null(err);
+    munit_assert_int(err->type, ==, MS_ERROR_VM);
+    munit_assert_not_null(strstr(err->msg, "memory limit"));
+    munit_assert_size(ms_StateMemoryPeak(state), <=, MEMORY_LIMIT);
+
+    /* the state reports the same error from then on */
+    munit_assert_int(ms_StateExecuteString(state, "var m := 2;", &err), ==, MS_RESULT_ERROR);
+    munit_assert_not_null(err);
+    munit_assert_int(err->type, ==, MS_ERROR_VM);
+
+    ms_StateDestroy(state);
+    munit_assert_size(ctx.nlive, ==, 0);
+
+    /* the same script runs without a limit */
+    opts.mem_limit = 0;
+    state = ms_StateNewOptions(&opts);
+    munit_assert_not_null(state);
+    munit_assert_int(ms_StateExecuteString(state, dsbuf_char_ptr(script), &err), !=, MS_RESULT_ERROR);
+    munit_assert_size(ms_StateMemoryPeak(state), >, MEMORY_LIMIT);
+    ms_StateDestroy(state);
+    munit_assert_size(ctx.nlive, ==, 0);
+
+    dsbuf_destroy(script);
+    return MUNIT_OK;
+}
+
+static MunitResult state_TestMemoryLimitAtCreation(const MunitParameter params[], void *user_data) {
+    TenantContext ctx = { 0 };
+    ms_StateOptions opts = {
+        .alloc = TenantAlloc,
+        .alloc_ctx = &ctx,
+        .mem_limit = 1024,
+    };
+
+    munit_assert_null(ms_StateNewOptions(&opts));
+    munit_assert_size(ctx.nlive, ==, 0);
+    return MUNIT_OK;
+}
+
+static MunitResult state_TestMemoryLimitInterns(const MunitParameter params[], void *user_data) {
+    TenantContext ctx = { 0 };
+    ms_StateOptions opts = {
+        .alloc = TenantAlloc,
+        .alloc_ctx = &ctx,
+        .mem_limit = MEMORY_LIMIT,
+    };
+
+    ms_InternStats before;
+    ms_InternGetStats(&before);
+
+    /* states abandoned on their limit give back every string they interned */
+    DSBuffer *script = LargeScript();
+    for (int i = 0; i < 3; i++) {
+        ms_State *state = ms_StateNewOptions(&opts);
+        munit_assert_not_null(state);
+
+        const ms_Error *err;
+        munit_assert_int(ms_StateExecuteString(state, dsbuf_char_ptr(script), &err), ==, MS_RESULT_ERROR);
+        munit_assert_size(ms_StateMemoryPeak(state), <=, MEMORY_LIMIT);
+        ms_StateDestroy(state);
+        munit_assert_size(ctx.nlive, ==, 0);
+
+        ms_InternStats after;
+        ms_InternGetStats(&after);
+        munit_assert_size(after.nstrs, ==, before.nstrs);
+        munit_assert_size(after.nrefs, ==, before.nrefs);
+        munit_assert_size(after.nbytes, ==, before.nbytes);
+    }
+
+    dsbuf_destroy(script);
+    return MUNIT_OK;
+}
+
+static MunitResult state_TestFileStream(const MunitParameter params[], void *user_data) {
+    TenantContext ctx = { 0 };
+    ms_StateOptions opts = {
+        .alloc = TenantAlloc,
+        .alloc_ctx = &ctx,
+        .mem_limit = MEMORY_LIMIT,
+    };
+
+    /* a file larger than the limit still runs, since it is parsed straight
+     * from the file rather than read into the state's memory first */
+    FILE *f = fopen((char *)user_data, "wb");
+    munit_assert_not_null(f);
+    for (size_t i = 0; i < 2 * MEMORY_LIMIT / 64; i++) {
+        fprintf(f, "// %-58zu\n", i);
+    }
+    fputs("var n := 1 + 2;\n", f);
+    munit_assert_int(fclose(f), ==, 0);
+
+    ms_State *state = ms_StateNewOptions(&opts);
+    munit_assert_not_null(state);
+    const ms_Error *err;
+    munit_assert_int(ms_StateExecuteFile(state, (char *)user_data, &err), ==, MS_RESULT_SUCCESS);
+    munit_assert_null(err);
+    munit_assert_size(ms_StateMemoryPeak(state), <, MEMORY_LIMIT);
+
+    /* exceeding the limit while the file is parsed closes it along with
+     * everything else the state held */
+    DSBuffer *script = LargeScript();
+    f = fopen((char *)user_data, "wb");
+    munit_assert_not_null(f);
+    munit_assert_size(fwrite(dsbuf_char_ptr(script), 1, dsbuf_len(script), f), ==, dsbuf_len(script));
+    munit_assert_int(fclose(f), ==, 0);
+    dsbuf_destroy(script);
+
+    munit_assert_int(ms_StateExecuteFile(state, (char *)user_data, &err), ==, MS_RESULT_ERROR);
+    munit_assert_not_null(err);
+    munit_assert_not_null(strstr(err->msg, "memory limit"));
+    ms_StateDestroy(state);
+    munit_assert_size(ctx.nlive, ==, 0);
+
+    /* nothing the abandoned parse held is used once the state is destroyed */
+    const char *const names[] = { "n" };
+    ms_Error *cerr;
+    ms_Script *compiled = ms_ScriptCompileString("var m := n;", names, 1, &cerr);
+    munit_assert_not_null(compiled);
+    ms_ScriptDestroy(compiled);
+
+    /* missing files are reported as such */
+    state = ms_StateNewOptions(&opts);
+    munit_assert_not_null(state);
+    munit_assert_int(ms_StateExecuteFile(state, "/nonexistent/file.ms", &err), ==, MS_RESULT_ERROR);
+    munit_assert_not_null(err);
+    munit_assert_not_null(strstr(err->msg, "could not read file"));
+    ms_StateDestroy(state);
+    munit_assert_size(ctx.nlive, ==, 0);
+    return MUNIT_OK;
+}
+
+static MunitResult state_TestScript(const MunitParameter params[], void *user_data) {
+    const char *const names[] = { "n", "s" };
+    const char *src = "var total := 0;\n"
+                      "var neg := -n;\n"
+                      "var label := s + \"!\";\n"
+                      "total := n * 2 + neg;\n";
+
+    ms_Error *cerr;
+    ms_Script *script = ms_ScriptCompileString(src, names, 2, &cerr);
+    munit_assert_not_null(script);
+    munit_assert_null(cerr);
+
+    ms_State *states[2] = { ms_StateNew(), ms_StateNew() };
+    munit_assert_not_null(states[0]);
+    munit_assert_not_null(states[1]);
+
+    /* names declared by one run do not collide with the next, and nothing
+     * is left behind in the state once the script completes */
+    const ms_Error *err;
+    size_t used[2] = { 0, 0 };
+    for (size_t i = 0; i < SCRIPT_RUNS; i++) {
+        ms_State *state = states[i % 2];
+        ms_Param args[] = {
+            { .type = MS_PARAM_INT, .val.i = (long long)i },
+            { .type = MS_PARAM_STR, .val.s = "label", .len = 5 },
+        };
+        munit_assert_int(ms_StateExecuteScript(state, script, args, 2, &err), ==, MS_RESULT_SUCCESS);
+        munit_assert_null(err);
+
+        if (i < 2) {
+            used[i] = ms_StateMemoryUsed(state);
+        } else {
+            size_t want = used[i % 2];
+            munit_assert_size(ms_StateMemoryUsed(state), ==, want);
+        }
+    }
+
+    /* parameters take the type of the value bound to them */
+    ms_Param str[] = {
+        { .type = MS_PARAM_STR, .val.s = "n", .len = 1 },
+        { .type = MS_PARAM_STR, .val.s = "s", .len = 1 },
+    };
+    munit_assert_int(ms_StateExecuteScript(states[0], script, str, 2, &err), ==, MS_RESULT_ERROR);
+    munit_assert_not_null(err);
+    munit_assert_int(err->type, ==, MS_ERROR_VM);
+
+    ms_Param null[] = {
+        { .type = MS_PARAM_FLOAT, .val.f = 1.5 },
+        { .type = MS_PARAM_NULL },
+    };
+    munit_assert_int(ms_StateExecuteScript(states[0], script, null, 2, &err), ==, MS_RESULT_ERROR);
+    munit_assert_not_null(err);
+
+    /* a state may outlive the scripts it has executed */
+    ms_ScriptDestroy(script);
+    munit_assert_int(ms_StateExecuteString(states[1], "var x := 1;", &err), ==, MS_RESULT_SUCCESS);
+
+    ms_StateDestroy(states[0]);
+    ms_StateDestroy(states[1]);
+    return MUNIT_OK;
+}
+
+static MunitResult state_TestScriptErrors(const MunitParameter params[], void *user_data) {
+    const char *const names[] = { "n" };
+    ms_Error *cerr;
+
+    munit_assert_null(ms_ScriptCompileString("var y := n + 1;", NULL, 0, &cerr));
+    munit_assert_not_null(cerr);
+    munit_assert_int(cerr->type, ==, MS_ERROR_VERIFIER);
+    ms_ErrorDestroy(cerr);
+
+    munit_assert_null(ms_ScriptCompileString("var n := 1;", names, 1, &cerr));
+    munit_assert_not_null(cerr);
+    munit_assert_int(cerr->type, ==, MS_ERROR_VERIFIER);
+    ms_ErrorDestroy(cerr);
+
+    munit_assert_null(ms_ScriptCompileString("var y := ;", names, 1, &cerr));
+    munit_assert_not_null(cerr);
+    munit_assert_int(cerr->type, ==, MS_ERROR_PARSER);
+    ms_ErrorDestroy(cerr);
+
+    munit_assert_null(ms_ScriptCompileFile("script-file-which-does-not-exist", names, 1, &cerr));
+    munit_assert_not_null(cerr);
+    ms_ErrorDestroy(cerr);
+
+    ms_Script *script = ms_ScriptCompileString("var y := n + 1;", names, 1, &cerr);
+    munit_assert_not_null(script);
+
+    ms_State *state = ms_StateNew();
+    munit_assert_not_null(state);
+
+    const ms_Error *err;
+    munit_assert_int(ms_StateExecuteScript(state, script, NULL, 0, &err), ==, MS_RESULT_ERROR);
+    munit_assert_not_null(err);
+
+    ms_Param args[] = { { .type = MS_PARAM_INT, .val.i = 1 } };
+    munit_assert_int(ms_StateExecuteScript(state, script, args, 1, &err), ==, MS_RESULT_SUCCESS);
+    munit_assert_null(err);
+
+    ms_StateDestroy(state);
+    ms_ScriptDestroy(script);
+    return MUNIT_OK;
+}
+
+/*
+ * UTILITY FUNCTIONS
+ */
+
+static void *TenantAlloc(void *ctx, void *ptr, size_t size) {
+    TenantContext *tenant = ctx;
+
+    if (size == 0) {
+        munit_assert_size(tenant->nlive, >, 0);
+        tenant->nlive--;
+        free(ptr);
+        return NULL;
+    }
+
+    void *res = realloc(ptr, size);
+    if ((res) && (!ptr)) {
+        tenant->nlive++;
+    }
+    return res;
+}
+
+static void *state_CreateTempName(const MunitParameter params[], void *user_data) {
+    char *tmpname = munit_malloc(12);
+    memcpy(tmpname, "stateXXXXXX", 11);
+    munit_assert_int(mkstemp(tmpname), !=, -1);
+    return tmpname;
+}
+
+static void state_CleanUpTempName(void *file) {
+    remove((char *)file);
+    free(file);
+}
+
+static DSBuffer *LargeScript(void) {
+    char line[64];
+    DSBuffer *script = dsbuf_new_buffer(LARGE_SCRIPT_NAMES * 32);
+    munit_assert_not_null(script);
+
+    for (size_t i = 0; i < LARGE_SCRIPT_NAMES; i++) {
+        snprintf(line, sizeof(line), "var name%zu := \"value\" + \"%zu\";\n", i, i);
+        munit_assert_true(dsbuf_append_str(script, line));
+    }
+    return script;
+}
@@ -23,10 +23,17 @@
 
 static MunitResult sr_TestFileNextChar(const MunitParameter params[], void *file);
 static MunitResult sr_TestFileUnread(const MunitParameter params[], void *file);
+static MunitResult sr_TestFileEmpty(const MunitParameter params[], void *na);
+static MunitResult sr_TestFileLarge(const MunitParameter params[], void *na);
+static MunitResult sr_TestFileMissing(const MunitParameter params[], void *na);
+static MunitResult sr_TestFileHandle(const MunitParameter params[], void *na);
 static MunitResult sr_TestStringNextChar(const MunitParameter params[], void *na);
 static MunitResult sr_TestStringUnread(const MunitParameter params[], void *na);
+static MunitResult sr_TestStringAvailable(const MunitParameter params[], void *na);
 static void *sr_CreateTempFile(const MunitParameter params[], void *user_data);
 static void sr_CleanUpTempFile(void *file);
+static char *sr_WriteTempFile(const char *contents, size_t len);
+static char *sr_LargeContents(size_t len);
 
 MunitTest streamreader_tests[] = {
     {
@@ -45,6 +52,38 @@ MunitTest streamreader_tests[] = {
         MUNIT_TEST_OPTION_NONE,
         NULL
     },
+    {
+        "/FILE-Empty",
+        sr_TestFileEmpty,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/FILE-Large",
+        sr_TestFileLarge,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/FILE-Missing",
+        sr_TestFileMissing,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/FILE-Handle",
+        sr_TestFileHandle,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
     {
         "/char*-NextChar",
         sr_TestStringNextChar,
@@ -61,6 +100,14 @@ MunitTest streamreader_tests[] = {
         MUNIT_TEST_OPTION_NONE,
         NULL
     },
+    {
+        "/char*-Available",
+        sr_TestStringAvailable,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
     { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
 };
 
@@ -73,22 +120,26 @@ static const char * const TestString = "This value is going to be the test\n"
  */
 
 static void *sr_CreateTempFile(const MunitParameter params[], void *user_data) {
+    return sr_WriteTempFile(TestString, strlen(TestString));
+}
+
+static void sr_CleanUpTempFile(void *file) {
+    munit_assert_int(remove((char *)file), ==, 0);
+    free(file);
+}
+
+static char *sr_WriteTempFile(const char *contents, size_t len) {
     char *tmpname = munit_malloc(19);
     memcpy(tmpname, "streamreaderXXXXXX", 18);
     mkstemp(tmpname);
 
     FILE *f = fopen(tmpname, "r+");
     munit_assert_not_null(f);
-    munit_assert_int(fprintf(f, TestString), >, 0);
+    munit_assert_size(fwrite(contents, 1, len, f), ==, len);
     munit_assert_int(fclose(f), ==, 0);
     return tmpname;
 }
 
-static void sr_CleanUpTempFile(void *file) {
-    munit_assert_int(remove((char *)file), ==, 0);
-    free(file);
-}
-
 /*
  * UNIT TEST FUNCTIONS
  */
@@ -127,6 +178,85 @@ static MunitResult sr_TestFileUnread(const MunitParameter params[], void *file)
     return MUNIT_OK;
 }
 
+static MunitResult sr_TestFileEmpty(const MunitParameter params[], void *na) {
+    char *file = sr_WriteTempFile("", 0);
+    ms_StreamReader *stream = ms_StreamNewFile(file);
+    munit_assert_not_null(stream);
+
+    munit_assert_int(ms_StreamNextChar(stream), ==, EOF);
+    munit_assert_int(ms_StreamUnread(stream), ==, EOF);
+    munit_assert_int(ms_StreamNextChar(stream), ==, EOF);
+
+    ms_StreamDestroy(stream);
+    sr_CleanUpTempFile(file);
+    return MUNIT_OK;
+}
+
+static MunitResult sr_TestFileLarge(const MunitParameter params[], void *na) {
+    size_t len = 1024 * 1024 + 17;
+    char *contents = sr_LargeContents(len);
+    char *file = sr_WriteTempFile(contents, len);
+    ms_StreamReader *stream = ms_StreamNewFile(file);
+    munit_assert_not_null(stream);
+
+    /* bytes outside of ASCII must not be confused with EOF */
+    for (size_t i = 0; i < len; i++) {
+        munit_assert_int(ms_StreamNextChar(stream), ==, (unsigned char)contents[i]);
+    }
+    munit_assert_int(ms_StreamNextChar(stream), ==, EOF);
+
+    for (size_t i = 1; i <= MS_STREAM_MAX_PUSHBACK; i++) {
+        munit_assert_int(ms_StreamUnread(stream), ==, (unsigned char)contents[len - i]);
+    }
+    munit_assert_int(ms_StreamNextChar(stream), ==,
+                     (unsigned char)contents[len - MS_STREAM_MAX_PUSHBACK]);
+
+    ms_StreamDestroy(stream);
+    sr_CleanUpTempFile(file);
+    free(contents);
+    return MUNIT_OK;
+}
+
+static MunitResult sr_TestFileMissing(const MunitParameter params[], void *na) {
+    munit_assert_null(ms_StreamNewFile("streamreader-file-which-does-not-exist"));
+    return MUNIT_OK;
+}
+
+static MunitResult sr_TestFileHandle(const MunitParameter params[], void *na) {
+    size_t len = 3 * 64 * 1024 + 5;
+    char *contents = sr_LargeContents(len);
+    char *file = sr_WriteTempFile(contents, len);
+    FILE *f = fopen(file, "rb");
+    munit_assert_not_null(f);
+
+    ms_StreamReader *stream = ms_StreamNewFileHandle(f);
+    munit_assert_not_null(stream);
+
+    /* step back over each chunk boundary as it is crossed */
+    for (size_t i = 0; i < len; i++) {
+        munit_assert_int(ms_StreamNextChar(stream), ==, (unsigned char)contents[i]);
+        if ((i > 0) && (i % 4096 == 0)) {
+            for (size_t j = 0; j < MS_STREAM_MAX_PUSHBACK; j++) {
+                munit_assert_int(ms_StreamUnread(stream), ==, (unsigned char)contents[i - j]);
+            }
+            for (size_t j = MS_STREAM_MAX_PUSHBACK; j > 0; j--) {
+                munit_assert_int(ms_StreamNextChar(stream), ==, (unsigned char)contents[i - j + 1]);
+            }
+        }
+    }
+    munit_assert_int(ms_StreamNextChar(stream), ==, EOF);
+    munit_assert_int(ms_StreamUnread(stream), ==, (unsigned char)contents[len - 1]);
+    munit_assert_int(ms_StreamNextChar(stream), ==, (unsigned char)contents[len - 1]);
+    munit_assert_int(ms_StreamNextChar(stream), ==, EOF);
+
+    /* the caller retains ownership of the file */
+    ms_StreamDestroy(stream);
+    munit_assert_int(fclose(f), ==, 0);
+    sr_CleanUpTempFile(file);
+    free(contents);
+    return MUNIT_OK;
+}
+
 static MunitResult sr_TestStringNextChar(const MunitParameter params[], void *na) {
     ms_StreamReader *stream = ms_StreamNewString(TestString);
     munit_assert_not_null(stream);
@@ -160,3 +290,42 @@ static MunitResult sr_TestStringUnread(const MunitParameter params[], void *na)
     ms_StreamDestroy(stream);
     return MUNIT_OK;
 }
+
+static MunitResult sr_TestStringAvailable(const MunitParameter params[], void *na) {
+    ms_StreamReader *stream = ms_StreamNewString(TestString);
+    munit_assert_not_null(stream);
+
+    size_t len;
+    munit_assert_int(ms_StreamNextChar(stream), ==, TestString[0]);
+    const char *run = ms_StreamAvailable(stream, &len);
+    munit_assert_ptr_equal(run, &TestString[1]);
+    munit_assert_size(len, ==, strlen(TestString) - 1);
+
+    /* skipped characters may still be unread */
+    ms_StreamSkip(stream, 4);
+    munit_assert_int(ms_StreamNextChar(stream), ==, TestString[5]);
+    munit_assert_int(ms_StreamUnread(stream), ==, TestString[5]);
+    munit_assert_int(ms_StreamUnread(stream), ==, TestString[4]);
+
+    run = ms_StreamAvailable(stream, &len);
+    ms_StreamSkip(stream, len);
+    munit_assert_null(ms_StreamAvailable(stream, &len));
+    munit_assert_size(len, ==, 0);
+    munit_assert_int(ms_StreamNextChar(stream), ==, EOF);
+
+    ms_StreamDestroy(stream);
+    return MUNIT_OK;
+}
+
+/*
+ * UTILITY FUNCTIONS
+ */
+
+static char *sr_LargeContents(size_t len) {
+    char *contents = munit_malloc(len);
+    for (size_t i = 0; i < len; i++) {
+        contents[i] = (char)(' ' + (i % 95));
+    }
+    contents[len - 1] = (char)0xff;
+    return contents;
+}
@@ -33,6 +33,7 @@ static MunitResult ver_TestProhibitUndefinedReference(const MunitParameter param
 static MunitResult ver_TestRequireBreakAndContinueInLoop(const MunitParameter params[], void *user_data);
 static MunitResult ver_TestProhibitBreakAndContinueInAnonFn(const MunitParameter params[], void *user_data);
 static MunitResult ver_TestRequireFunctionForReturnStmt(const MunitParameter params[], void *user_data);
+static MunitResult ver_TestScopesAreIndependent(const MunitParameter params[], void *user_data);
 
 MunitTest verifier_tests[] = {
     {
@@ -75,6 +76,14 @@ MunitTest verifier_tests[] = {
         MUNIT_TEST_OPTION_NONE,
         NULL
     },
+    {
+        "/ScopesAreIndependent",
+        ver_TestScopesAreIndependent,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
     { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
 };
 
@@ -514,6 +523,78 @@ static MunitResult ver_TestRequireFunctionForReturnStmt(const MunitParameter par
     return MUNIT_OK;
 }
 
+static MunitResult ver_TestScopesAreIndependent(const MunitParameter params[], void *user_data) {
+    VerifierResultTuple tuples[] = {
+        {
+            .val = "func first() {\n"
+                "    var x := 1;\n"
+                "    return x;\n"
+                "}\n"
+                "func second() {\n"
+                "    return x;\n"
+                "}",
+            .expected = MS_RESULT_ERROR
+        },
+        {
+            .val = "func first(x) {\n"
+                "    return x;\n"
+                "}\n"
+                "func second() {\n"
+                "    return x;\n"
+                "}",
+            .expected = MS_RESULT_ERROR
+        },
+        {
+            .val = "func main(x) {\n"
+                "    if x {\n"
+                "        var y := 1;\n"
+                "    }\n"
+                "    return y;\n"
+                "}",
+            .expected = MS_RESULT_ERROR
+        },
+        {
+            .val = "func main(x) {\n"
+                "    if x {\n"
+                "        var y := 1;\n"
+                "    } else {\n"
+                "        return y;\n"
+                "    }\n"
+                "}",
+            .expected = MS_RESULT_ERROR
+        },
+        {
+            .val = "var x := 1;\n"
+                "func first() {\n"
+                "    var y := x;\n"
+                "    return y;\n"
+                "}\n"
+                "func second() {\n"
+                "    var y := x + 1;\n"
+                "    return y;\n"
+                "}",
+            .expected = MS_RESULT_SUCCESS
+        },
+        {
+            .val = "func outer(x) {\n"
+                "    func inner() {\n"
+                "        return x + y;\n"
+                "    }\n"
+                "    var y := 2;\n"
+                "    return inner();\n"
+                "}\n"
+                "func other(x) {\n"
+                "    return x;\n"
+                "}",
+            .expected = MS_RESULT_SUCCESS
+        },
+    };
+
+    size_t len = sizeof(tuples) / sizeof(tuples[0]);
+    TestVerifierResultTuple(tuples, len);
+    return MUNIT_OK;
+}
+
 /*
  * COMPARISON FUNCTIONS
  */
@@ -0,0 +1,417 @@
+/*------------------------------------------------------------------------------
+ *    Copyright 2016 Chris Rink
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *----------------------------------------------------------------------------*/
+
+#include "vm_test.h"
+#include "../src/bytecode.h"
+#include "../src/parser.h"
+#include "../src/vm.h"
+
+/*
+ * TEST DEFINITIONS
+ */
+
+static MunitResult vm_TestStrConcat(const MunitParameter params[], void *user_data);
+static MunitResult vm_TestStrConcatEmpty(const MunitParameter params[], void *user_data);
+static MunitResult vm_TestStrConcatNested(const MunitParameter params[], void *user_data);
+static MunitResult vm_TestStrConcatDeep(const MunitParameter params[], void *user_data);
+static MunitResult vm_TestStrIndex(const MunitParameter params[], void *user_data);
+static MunitResult vm_TestStrSlice(const MunitParameter params[], void *user_data);
+static MunitResult vm_TestStrSliceOfRope(const MunitParameter params[], void *user_data);
+static MunitResult vm_TestPoolStats(const MunitParameter params[], void *user_data);
+static MunitResult vm_TestStrCollect(const MunitParameter params[], void *user_data);
+static MunitResult vm_TestStrSliceCollect(const MunitParameter params[], void *user_data);
+
+MunitTest vm_tests[] = {
+    {
+        "/StrConcat",
+        vm_TestStrConcat,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/StrConcatEmpty",
+        vm_TestStrConcatEmpty,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/StrConcatNested",
+        vm_TestStrConcatNested,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/StrConcatDeep",
+        vm_TestStrConcatDeep,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/StrIndex",
+        vm_TestStrIndex,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/StrSlice",
+        vm_TestStrSlice,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/StrSliceOfRope",
+        vm_TestStrSliceOfRope,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/PoolStats",
+        vm_TestPoolStats,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/StrCollect",
+        vm_TestStrCollect,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    {
+        "/StrSliceCollect",
+        vm_TestStrSliceCollect,
+        NULL,
+        NULL,
+        MUNIT_TEST_OPTION_NONE,
+        NULL
+    },
+    { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
+
+/*
+ * FORWARD DECLARATIONS
+ */
+
+static const size_t DEEP_CONCAT_PIECES = 99999;
+
+static ms_VM *ExecuteString(const char *code);
+static ms_VMValue StrValue(DSBuffer *s);
+
+/*
+ * TEST CASE FUNCTIONS
+ */
+
+static MunitResult vm_TestStrConcat(const MunitParameter params[], void *user_data) {
+    ms_VM *vm = ExecuteString("\"ab\" + \"cd\" + \"ef\";");
+
+    ms_VMValue *top = ms_VMTop(vm);
+    munit_assert_int(top->type, ==, VMVAL_ROPE);
+
+    const ms_VMStr *flat = ms_VMStrFlatten(vm, top);
+    munit_assert_not_null(flat);
+    munit_assert_size(dsbuf_len(flat), ==, 6);
+    munit_assert_string_equal(dsbuf_char_ptr(flat), "abcdef");
+
+    /* the flattened string is cached on the rope after the first read */
+    munit_assert_ptr_equal(ms_VMStrFlatten(vm, top), flat);
+
+    ms_VMDestroy(vm);
+    return MUNIT_OK;
+}
+
+static MunitResult vm_TestStrConcatEmpty(const MunitParameter params[], void *user_data) {
+    ms_VM *vm = ExecuteString("var s := \"x\";");
+    DSBuffer *s = dsbuf_new("string");
+    DSBuffer *empty = dsbuf_new_buffer(0);
+    munit_assert_not_null(s);
+    munit_assert_not_null(empty);
+
+    munit_assert_true(ms_VMPushStrConcat(vm, StrValue(s), StrValue(empty)));
+    ms_VMValue v = ms_VMPop(vm);
+    munit_assert_int(v.type, ==, VMVAL_STR);
+    munit_assert_ptr_equal(v.val.s, s);
+
+    munit_assert_true(ms_VMPushStrConcat(vm, StrValue(empty), StrValue(s)));
+    v = ms_VMPop(vm);
+    munit_assert_int(v.type, ==, VMVAL_STR);
+    munit_assert_ptr_equal(v.val.s, s);
+
+    ms_VMDestroy(vm);
+    dsbuf_destroy(s);
+    dsbuf_destroy(empty);
+    return MUNIT_OK;
+}
+
+static MunitResult vm_TestStrConcatNested(const MunitParameter params[], void *user_data) {
+    ms_VM *vm = ExecuteString("var s := \"x\";");
+    DSBuffer *a = dsbuf_new("a");
+    DSBuffer *b = dsbuf_new("bb");
+    DSBuffer *c = dsbuf_new("ccc");
+    DSBuffer *d = dsbuf_new("dddd");
+
+    munit_assert_true(ms_VMPushStrConcat(vm, StrValue(a), StrValue(b)));
+    ms_VMValue ab = ms_VMPop(vm);
+    munit_assert_true(ms_VMPushStrConcat(vm, StrValue(c), StrValue(d)));
+    ms_VMValue cd = ms_VMPop(vm);
+
+    /* flatten one operand first to check cached subtrees are reused */
+    const ms_VMStr *cdflat = ms_VMStrFlatten(vm, &cd);
+    munit_assert_string_equal(dsbuf_char_ptr(cdflat), "cccdddd");
+
+    munit_assert_true(ms_VMPushStrConcat(vm, ab, cd));
+    ms_VMValue v = ms_VMPop(vm);
+    munit_assert_int(v.type, ==, VMVAL_ROPE);
+
+    const ms_VMStr *flat = ms_VMStrFlatten(vm, &v);
+    munit_assert_not_null(flat);
+    munit_assert_string_equal(dsbuf_char_ptr(flat), "abbcccdddd");
+
+    ms_VMDestroy(vm);
+    dsbuf_destroy(a);
+    dsbuf_destroy(b);
+    dsbuf_destroy(c);
+    dsbuf_destroy(d);
+    return MUNIT_OK;
+}
+
+static MunitResult vm_TestStrConcatDeep(const MunitParameter params[], void *user_data) {
+    ms_VM *vm = ExecuteString("var s := \"x\";");
+    DSBuffer *pieces[] = { dsbuf_new("0123"), dsbuf_new("4567"), dsbuf_new("89") };
+    const size_t npieces = sizeof(pieces) / sizeof(pieces[0]);
+
+    ms_VMValue s = StrValue(pieces[0]);
+    size_t len = dsbuf_len(pieces[0]);
+    for (size_t i = 1; i < DEEP_CONCAT_PIECES; i++) {
+        DSBuffer *piece = pieces[i % npieces];
+        munit_assert_true(ms_VMPushStrConcat(vm, s, StrValue(piece)));
+        s = ms_VMPop(vm);
+        len += dsbuf_len(piece);
+    }
+
+    const ms_VMStr *flat = ms_VMStrFlatten(vm, &s);
+    munit_assert_not_null(flat);
+    munit_assert_size(dsbuf_len(flat), ==, len);
+
+    const char *str = dsbuf_char_ptr(flat);
+    munit_assert_memory_equal(10, str, "0123456789");
+    munit_assert_memory_equal(10, &str[len - 10], "0123456789");
+
+    ms_VMDestroy(vm);
+    for (size_t i = 0; i < npieces; i++) {
+        dsbuf_destroy(pieces[i]);
+    }
+    return MUNIT_OK;
+}
+
+static MunitResult vm_TestStrIndex(const MunitParameter params[], void *user_data) {
+    ms_VM *vm = ExecuteString("\"hello\"[1];");
+
+    ms_VMValue *top = ms_VMTop(vm);
+    munit_assert_int(top->type, ==, VMVAL_SLICE);
+
+    size_t len;
+    const char *s = ms_VMStrChars(vm, top, &len);
+    munit_assert_size(len, ==, 1);
+    munit_assert_char(s[0], ==, 'e');
+
+    const ms_VMStr *flat = ms_VMStrFlatten(vm, top);
+    munit_assert_not_null(flat);
+    munit_assert_string_equal(dsbuf_char_ptr(flat), "e");
+
+    ms_VMDestroy(vm);
+    return MUNIT_OK;
+}
+
+static MunitResult vm_TestStrSlice(const MunitParameter params[], void *user_data) {
+    ms_VM *vm = ExecuteString("var s := \"x\";");
+    DSBuffer *s = dsbuf_new("name,address,phone");
+    munit_assert_not_null(s);
+    ms_VMValue str = StrValue(s);
+
+    munit_assert_true(ms_VMPushStrSlice(vm, &str, 5, 7));
+    ms_VMValue field = ms_VMPop(vm);
+    munit_assert_int(field.type, ==, VMVAL_SLICE);
+    munit_assert_size(ms_VMStrLen(&field), ==, 7);
+
+    /* slices point into their parent rather than copying it */
+    size_t len;
+    const char *chars = ms_VMStrChars(vm, &field, &len);
+    munit_assert_ptr_equal(chars, dsbuf_char_ptr(s) + 5);
+    munit_assert_size(len, ==, 7);
+
+    /* slices of slices point into the original parent */
+    munit_assert_true(ms_VMPushStrSlice(vm, &field, 2, 3));
+    ms_VMValue sub = ms_VMPop(vm);
+    chars = ms_VMStrChars(vm, &sub, &len);
+    munit_assert_ptr_equal(chars, dsbuf_char_ptr(s) + 7);
+    munit_assert_size(len, ==, 3);
+    munit_assert_memory_equal(3, chars, "dre");
+
+    /* slices may be concatenated like any other string */
+    munit_assert_true(ms_VMPushStrConcat(vm, sub, field));
+    ms_VMValue cat = ms_VMPop(vm);
+    const ms_VMStr *flat = ms_VMStrFlatten(vm, &cat);
+    munit_assert_string_equal(dsbuf_char_ptr(flat), "dreaddress");
+
+    ms_VMDestroy(vm);
+    dsbuf_destroy(s);
+    return MUNIT_OK;
+}
+
+static MunitResult vm_TestStrSliceOfRope(const MunitParameter params[], void *user_data) {
+    ms_VM *vm = ExecuteString("\"left\" + \"right\";");
+    ms_VMValue rope = ms_VMPop(vm);
+    munit_assert_int(rope.type, ==, VMVAL_ROPE);
+
+    munit_assert_true(ms_VMPushStrSlice(vm, &rope, 2, 5));
+    ms_VMValue slice = ms_VMPop(vm);
+
+    size_t len;
+    const char *chars = ms_VMStrChars(vm, &slice, &len);
+    munit_assert_size(len, ==, 5);
+    munit_assert_memory_equal(5, chars, "ftrig");
+
+    /* the rope was flattened to give the slice a contiguous parent */
+    const ms_VMStr *flat = ms_VMStrFlatten(vm, &rope);
+    munit_assert_ptr_equal(chars, dsbuf_char_ptr(flat) + 2);
+
+    munit_assert_true(ms_VMPushStrSlice(vm, &rope, 9, 0));
+    ms_VMValue empty = ms_VMPop(vm);
+    munit_assert_size(ms_VMStrLen(&empty), ==, 0);
+    flat = ms_VMStrFlatten(vm, &empty);
+    munit_assert_not_null(flat);
+    munit_assert_size(dsbuf_len(flat), ==, 0);
+
+    ms_VMDestroy(vm);
+    return MUNIT_OK;
+}
+
+static MunitResult vm_TestPoolStats(const MunitParameter params[], void *user_data) {
+    ms_VM *vm = ExecuteString("var a := 1; var b := 2; var c := \"x\" + \"y\";");
+
+    DSPoolStats stats;
+    ms_VMPoolStats(vm, &stats);
+    munit_assert_size(stats.nallocs, >, stats.nfrees);
+    munit_assert_size(stats.requested, >=, 3 * sizeof(ms_VMValue));
+    munit_assert_size(stats.reserved, >=, stats.requested);
+
+    /* each rope is drawn from the pool and released with the VM */
+    size_t live = stats.nallocs - stats.nfrees;
+    DSBuffer *s = dsbuf_new("x");
+    munit_assert_true(ms_VMPushStrConcat(vm, StrValue(s), StrValue(s)));
+    (void)ms_VMPop(vm);
+    ms_VMPoolStats(vm, &stats);
+    munit_assert_size(stats.nallocs - stats.nfrees, ==, live + 1);
+
+    ms_VMDestroy(vm);
+    dsbuf_destroy(s);
+    return MUNIT_OK;
+}
+
+static MunitResult vm_TestStrCollect(const MunitParameter params[], void *user_data) {
+    ms_VM *flat = ExecuteString("var s := (\"ab\" + \"c\")[1]; (\"d\" + \"e\")[0];");
+    ms_VM *vm = ExecuteString("var s := (\"a\" + \"b\" + \"c\")[1]; (\"d\" + \"e\")[0];");
+
+    /* the inner rope is only an operand of a rope which was flattened to be
+     * sliced, so it is reclaimed once execution completes; the outer ropes
+     * and both slices are still reachable and are kept */
+    DSPoolStats want, stats;
+    ms_VMPoolStats(flat, &want);
+    ms_VMPoolStats(vm, &stats);
+    munit_assert_size(stats.nallocs - stats.nfrees, ==, want.nallocs - want.nfrees);
+    munit_assert_size(stats.nfrees, ==, want.nfrees + 1);
+
+    ms_VMValue *top = ms_VMTop(vm);
+    munit_assert_int(top->type, ==, VMVAL_SLICE);
+    const ms_VMStr *str = ms_VMStrFlatten(vm, top);
+    munit_assert_not_null(str);
+    munit_assert_string_equal(dsbuf_char_ptr(str), "d");
+
+    ms_VMDestroy(flat);
+    ms_VMDestroy(vm);
+    return MUNIT_OK;
+}
+
+static MunitResult vm_TestStrSliceCollect(const MunitParameter params[], void *user_data) {
+    ms_VM *flat = ExecuteString("var s := (\"ab\" + \"c\")[1];");
+    ms_VM *vm = ExecuteString("var s := ((\"a\" + \"b\")[0] + \"c\")[1];");
+
+    /* the inner slice is only an operand of a rope which was flattened, so
+     * it is reclaimed once execution completes along with the rope it was
+     * sliced from; the outer rope and slice are still reachable */
+    DSPoolStats want, stats;
+    ms_VMPoolStats(flat, &want);
+    ms_VMPoolStats(vm, &stats);
+    munit_assert_size(stats.nallocs - stats.nfrees, ==, want.nallocs - want.nfrees);
+    munit_assert_size(stats.nfrees, ==, want.nfrees + 2);
+
+    ms_VMDestroy(flat);
+    ms_VMDestroy(vm);
+    return MUNIT_OK;
+}
+
+/*
+ * UTILITY FUNCTIONS
+ */
+
+// Create a new VM and execute the given code on it, leaving the VM with a
+// current frame to push values onto.
+static ms_VM *ExecuteString(const char *code) {
+    ms_Parser *prs = ms_ParserNew();
+    munit_assert_not_null(prs);
+    munit_assert_true(ms_ParserInitString(prs, code));
+
+    const ms_AST *ast;
+    ms_Error *err;
+    munit_assert_int(ms_ParserParse(prs, &ast, &err), !=, MS_RESULT_ERROR);
+    munit_assert_null(err);
+
+    ms_VMByteCode *bc;      /* freed by the VM */
+    munit_assert_int(ms_VMByteCodeGenerateFromAST(ast, &bc, &err), !=, MS_RESULT_ERROR);
+    munit_assert_null(err);
+
+    ms_VM *vm = ms_VMNew();
+    munit_assert_not_null(vm);
+    munit_assert_int(ms_VMExecute(vm, bc, &err), !=, MS_RESULT_ERROR);
+    munit_assert_null(err);
+
+    ms_ParserDestroy(prs);
+    return vm;
+}
+
+static ms_VMValue StrValue(DSBuffer *s) {
+    ms_VMValue v;
+    v.type = VMVAL_STR;
+    v.val.s = s;
+    return v;
+}